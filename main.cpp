@@ -1,26 +1,443 @@
 #include "src/windsofchange.cpp"
 #include "src/window.cpp"
+#include "src/windfield.cpp"
+#include "src/broadphase.cpp"
+#include "src/particles.cpp"
+#include "src/levelfile.cpp"
+#include "src/editor.cpp"
+#include "src/soak.cpp"
+#include "src/collisioncheck.cpp"
+#include "src/counters.cpp"
+#include "src/memory.cpp"
+#include "src/startup.cpp"
+#include "src/replay.cpp"
+#include "src/capture.cpp"
+#include "src/framelimiter.cpp"
+#include "src/levelstream.cpp"
+#include "src/netplay.cpp"
+#include "src/simulation.cpp"
+#include "src/rewind.cpp"
+#include "src/levelgen.cpp"
+#include "src/solver.cpp"
 
-int main()
+// Tool modes run headless and exit before any window is created.
+static bool run_command_line_tool(int argc, char** argv, int& exit_code)
 {
-    auto menu_state = woc::menu_init(woc::MenuPageType::MainMenu, false, woc::ResolutionPreset::Resolution_1600x900);
-    auto window = woc::window_init();
-    auto renderer = woc::renderer_init();
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string_view(argv[i]) == "--generate-levels" && i + 1 < argc)
+        {
+            auto count = static_cast<woc::u32>(std::max(1, std::atoi(argv[i + 1])));
+            std::vector<woc::GeneratedLevel> levels;
+            levels.reserve(count);
+
+            auto start = std::chrono::steady_clock::now();
+            woc::levelgen_generate_verified_batch(woc::random_hash(count, 0), count, levels);
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for (auto& level : levels)
+            {
+                std::cout << "seed " << level.seed << ": " << level.enemies.size() << " walls, "
+                    << level.balls_available << " balls, " << level.wind_available << " wind\n";
+            }
+            std::cout << levels.size() << " solvable levels in " << seconds << " s ("
+                << static_cast<double>(levels.size()) / seconds << " levels/s)\n";
+            exit_code = 0;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--large-level" && i + 2 < argc)
+        {
+            // Writes a level file with WALLS walls in a world sized to fit, for trying out scrolling and culling.
+            auto level = static_cast<woc::u32>(std::max(0, std::atoi(argv[i + 1])));
+            auto walls = static_cast<woc::u32>(std::max(1, std::atoi(argv[i + 2])));
+            auto generated = woc::levelgen_generate_large(woc::random_hash(level, walls), walls);
+            if (!woc::physics_fits(generated.world_min, generated.world_max))
+            {
+                std::cerr << walls << " walls need a world of " << generated.world_max.x - generated.world_min.x << "x"
+                    << generated.world_max.y - generated.world_min.y << ", past the +-" << woc::FIXED_POINT_MAX_COORDINATE
+                    << " fixed point physics can hold\n";
+                exit_code = 1;
+                return true;
+            }
+            auto definition = woc::LevelDefinition {
+                .enemies = generated.enemies,
+                .wind_zones = generated.wind_zones,
+                .balls_available = generated.balls_available,
+                .wind_available = generated.wind_available,
+                .world_min = generated.world_min,
+                .world_max = generated.world_max
+            };
+            auto error = std::string{};
+            if (!woc::levelfile_save(level, definition, error))
+            {
+                std::cerr << error << "\n";
+                exit_code = 1;
+                return true;
+            }
+            std::cout << woc::levelfile_path(level) << ": " << walls << " walls, world "
+                << generated.world_max.x - generated.world_min.x << "x" << generated.world_max.y - generated.world_min.y << "\n";
+            exit_code = 0;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--chunk-level" && i + 2 < argc)
+        {
+            // Moves a level's walls out into chunk files of CHUNK_SIZE squares that are streamed in while playing.
+            auto level = static_cast<woc::u32>(std::max(0, std::atoi(argv[i + 1])));
+            auto chunk_size = static_cast<woc::f32>(std::atof(argv[i + 2]));
+            auto definition = woc::LevelDefinition{};
+            auto error = std::string{};
+            if (!woc::levelfile_load(level, definition, error) || !woc::level_stream_write(level, definition, chunk_size, error))
+            {
+                std::cerr << error << "\n";
+                exit_code = 1;
+                return true;
+            }
+            std::cout << woc::levelfile_path(level) << ": " << definition.enemies.size() << " walls streamed in chunks of " << chunk_size << "\n";
+            exit_code = 0;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--physics-check" && i + 2 < argc)
+        {
+            // Plays a fixed pseudo-random input script. The hash should match on every build with the same
+            // WOC_FIXED_POINT_PHYSICS setting, the timing compares the two settings.
+            auto level = static_cast<woc::u32>(std::max(0, std::atoi(argv[i + 1])));
+            auto ticks = static_cast<woc::u32>(std::max(1, std::atoi(argv[i + 2])));
+            auto game_state = woc::game_init(level);
+            game_state.player.balls_available = std::max(game_state.player.balls_available, 1000u);
+            game_state.player.wind_available = std::max(game_state.player.wind_available, 1000u);
+            auto audio_state = woc::AudioState{};
+            audio_state.defer_playback = true;
+            auto random = woc::Random { .state = level };
+
+            auto input = woc::InputState{};
+            auto start = std::chrono::steady_clock::now();
+            woc::u32 tick = 0;
+            for (; tick < ticks && game_state.level_status == woc::LevelStatus::InProgress; tick++)
+            {
+                if (tick % 60 == 0)
+                {
+                    input = woc::InputState{};
+                    input.move_dir = static_cast<woc::i32>(woc::random_u32(random, 0, 2)) - 1;
+                    input.send_ball = woc::random_u32(random, 0, 3) == 0;
+                    input.wind_dir_x = static_cast<woc::i32>(woc::random_u32(random, 0, 8) / 4) - 1;
+                }
+                woc::game_update(game_state, input, audio_state, woc::SIMULATION_TICK_SECONDS);
+                audio_state.deferred_sounds.clear();
+            }
+            auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << (WOC_FIXED_POINT_PHYSICS ? "fixed" : "float") << " physics, hash " << std::hex << woc::game_hash(game_state) << std::dec
+                << " after " << tick << " ticks, " << seconds * 1e9 / tick << " ns/tick\n";
+            if (game_state.chunks.stream)
+            {
+                std::cout << game_state.enemies.size() << " walls awake in " << game_state.chunks.awake.size() << " chunks, ";
+                woc::level_stream_report(*game_state.chunks.stream, std::cout);
+            }
+            exit_code = 0;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--netplay-loopback" && i + 2 < argc)
+        {
+            // --netplay-loopback LEVEL SECONDS [DELAY_MS [LOSS_PERCENT [JITTER_MS]]] plays a two player game between
+            // two peers on this machine over UDP, with each peer's packets delayed and dropped as given.
+            auto level = static_cast<woc::u32>(std::max(0, std::atoi(argv[i + 1])));
+            auto conditions = woc::NetplayConditions {
+                .delay_seconds = i + 3 < argc ? std::atof(argv[i + 3]) / 1000.0 : 0.0,
+                .jitter_seconds = i + 5 < argc ? std::atof(argv[i + 5]) / 1000.0 : 0.0,
+                .loss = i + 4 < argc ? static_cast<woc::f32>(std::atof(argv[i + 4]) / 100.0) : 0.f
+            };
+            exit_code = woc::netplay_loopback_test(level, std::atof(argv[i + 2]), conditions, std::cout) ? 0 : 1;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--soak" && i + 1 < argc)
+        {
+            // Ticks the game flat out, doing everything the simulation thread and the renderer do per tick that
+            // doesn't need a window. Frame times here are tick times, including level loads.
+            using Clock = std::chrono::steady_clock;
+            auto duration_seconds = std::atof(argv[i + 1]);
+            auto report_seconds = i + 2 < argc ? std::atof(argv[i + 2]) : woc::SOAK_DEFAULT_REPORT_SECONDS;
+            auto start = Clock::now();
+            auto bot = woc::soak_bot_init(woc::START_LEVEL, woc::ENDLESS_START_LEVEL + 3, 1);
+            auto game_state = woc::game_init(woc::START_LEVEL);
+            auto audio_state = woc::AudioState{};
+            audio_state.defer_playback = true;
+            auto rewind_buffer = woc::rewind_init();
+            woc::rewind_reset(rewind_buffer, game_state);
+            auto renderer = woc::Renderer{};
+            renderer.particles = woc::particles_init(1);
+            auto log = woc::soak_log_init(0.0, report_seconds);
+
+            constexpr woc::u32 TICKS_PER_FRAME = 4;
+            woc::u64 sounds = 0;
+            woc::u64 tick = 0;
+            for (auto now = 0.0; now < duration_seconds; now = std::chrono::duration<double>(Clock::now() - start).count())
+            {
+                auto tick_start = Clock::now();
+                auto input = woc::soak_bot_input(bot, game_state);
+                woc::game_update(game_state, input, audio_state, woc::SIMULATION_TICK_SECONDS);
+                woc::rewind_record(rewind_buffer, game_state, input);
+                sounds += audio_state.deferred_sounds.size();
+                audio_state.deferred_sounds.clear();
+                if (++tick % TICKS_PER_FRAME == 0)
+                {
+                    woc::renderer_update_effects(renderer, game_state, woc::SIMULATION_TICK_SECONDS * TICKS_PER_FRAME);
+                }
+                woc::u32 next_level = 0;
+                if (woc::soak_bot_next_level(bot, game_state, woc::SIMULATION_TICK_SECONDS, next_level))
+                {
+                    game_state = woc::game_init(next_level);
+                    woc::rewind_reset(rewind_buffer, game_state);
+                }
+                woc::soak_log_frame(log, std::chrono::duration<woc::f32>(Clock::now() - tick_start).count());
+                woc::soak_log_update(log, now, bot, woc::soak_counts(game_state, renderer.particles.count, sounds), std::cout);
+            }
+            std::cout << tick << " ticks, " << bot.levels_won << "/" << bot.levels_played << " levels won\n";
+            exit_code = 0;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--collision-check")
+        {
+            // Differential check of the collision kernel and the projectile loop against the reference kernel.
+            auto cases = i + 1 < argc ? std::strtoull(argv[i + 1], nullptr, 10) : woc::COLLISION_CHECK_DEFAULT_CASES;
+            auto seed = i + 2 < argc ? std::strtoull(argv[i + 2], nullptr, 10) : 1;
+            auto result = woc::collision_check_run(cases, seed, std::max(1u, std::thread::hardware_concurrency()), std::cout);
+            exit_code = result.mismatches == 0 && result.level_mismatches == 0 ? 0 : 1;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--counters" && i + 1 < argc)
+        {
+            // Reads the registry a running game publishes, from another terminal.
+            auto pid = std::strtoull(argv[i + 1], nullptr, 10);
+            auto interval = i + 2 < argc ? std::atof(argv[i + 2]) : woc::COUNTERS_DEFAULT_WATCH_SECONDS;
+            exit_code = woc::counters_watch(pid, std::max(interval, 0.01), std::cout) ? 0 : 1;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--render-replays" && i + 4 < argc)
+        {
+            // --render-replays OUT_DIR png|y4m JOBS REPLAY... re-simulates each replay and writes its video frames.
+            auto format = woc::ReplayVideoFormat::Png;
+            if (!woc::replay_video_format_parse(argv[i + 2], format))
+            {
+                std::cerr << "Unknown video format " << argv[i + 2] << ", expected png or y4m\n";
+                exit_code = 1;
+                return true;
+            }
+            auto jobs = static_cast<woc::u32>(std::max(1, std::atoi(argv[i + 3])));
+            auto paths = std::vector<std::string>(argv + i + 4, argv + argc);
+            auto failures = woc::replay_render_batch(paths, argv[i + 1], format, jobs, std::cout);
+            std::cout << paths.size() - failures << "/" << paths.size() << " replays rendered\n";
+            exit_code = failures == 0 ? 0 : 1;
+            return true;
+        }
+        if (std::string_view(argv[i]) == "--solve-levels" && i + 2 < argc)
+        {
+            auto first = static_cast<woc::u32>(std::max(0, std::atoi(argv[i + 1])));
+            auto last = static_cast<woc::u32>(std::max(0, std::atoi(argv[i + 2])));
+            auto node_limit = i + 3 < argc ? std::strtoull(argv[i + 3], nullptr, 10) : woc::SOLVER_DEFAULT_NODE_LIMIT;
+            bool approximate = i + 4 < argc && std::string_view(argv[i + 4]) == "approximate";
+            exit_code = 0;
+            for (auto level = first; level <= last; level++)
+            {
+                auto game_state = woc::game_init(level);
+                auto start = std::chrono::steady_clock::now();
+                auto result = woc::solver_solve(game_state, node_limit, approximate);
+                auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                std::cout << "level " << level << ": ";
+                if (result.solved)
+                {
+                    bool replayed = woc::solver_replay(game_state, result.actions);
+                    std::cout << "solved with " << result.balls_used << "/" << game_state.player.balls_available << " balls, "
+                        << result.winds_used << "/" << game_state.player.wind_available << " wind"
+                        << (replayed ? "" : " (REPLAY FAILED)") << (result.approximate ? ", maybe not the fewest" : "");
+                    exit_code |= !replayed;
+                } else if (result.approximate && !result.exhausted)
+                {
+                    std::cout << "no solution found by the approximate search";
+                    exit_code = 1;
+                } else {
+                    std::cout << (result.exhausted ? "unknown, node limit reached" : "UNSOLVABLE");
+                    exit_code = 1;
+                }
+                std::cout << ", " << result.nodes << " nodes in " << seconds << " s\n";
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    auto startup = woc::startup_trace_init();
+    int tool_exit_code = 0;
+    if (run_command_line_tool(argc, argv, tool_exit_code))
+    {
+        return tool_exit_code;
+    }
+
+    // Runs once main's locals are destroyed, anything still tagged by then was never freed.
+    std::atexit([] { woc::memory_report_leaks(std::cerr); });
+
+    // --soak-bot SECONDS [REPORT_SECONDS] hands the keyboard to a bot and quits after SECONDS.
+    // --memory-report prints memory use by tag whenever the level or menu page changes.
+    // --startup-benchmark [CSV_PATH] quits after the first presented frame and prints where the time went.
+    // --record-replays DIR saves every level attempt as a replay for --render-replays.
+    // --capture-dir DIR is where F12 screenshots and F10 recordings go.
+    // --input-latency prints the measured input to present latency on exit.
+    // --fps N|off limits the frame rate, to the monitor's refresh rate by default. --fps-adaptive drops to an even
+    // fraction of it when frames don't fit. --pacing-report prints the achieved frame intervals on exit.
+    // --netplay PLAYER LOCAL_PORT HOST:PORT starts a two player game against the peer at HOST:PORT, which runs
+    // the other PLAYER, 1 or 2. --net-delay MS and --net-loss PERCENT make this side's packets late or lost.
+    bool memory_report = false;
+    bool input_latency_report = false;
+    bool pacing_report = false;
+    auto frame_limiter_mode = woc::FrameLimiterMode::Fixed;
+    auto frame_limiter_fps = 0.0;
+    bool startup_benchmark = false;
+    auto startup_csv_path = std::string{};
+    auto replay_directory = std::string{};
+    auto capture_directory = std::string(woc::CAPTURE_DEFAULT_DIRECTORY);
+    auto soak_bot = std::optional<woc::SoakBot>{};
+    auto soak_seconds = 0.0;
+    auto soak_report_seconds = woc::SOAK_DEFAULT_REPORT_SECONDS;
+    auto netplay_player = 0u;
+    auto netplay_port = woc::NETPLAY_DEFAULT_PORT;
+    auto netplay_peer = std::string{};
+    auto netplay_conditions = woc::NetplayConditions{};
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string_view(argv[i]) == "--soak-bot" && i + 1 < argc)
+        {
+            soak_bot = woc::soak_bot_init(woc::START_LEVEL, woc::ENDLESS_START_LEVEL + 3, 1);
+            soak_seconds = std::atof(argv[i + 1]);
+            soak_report_seconds = i + 2 < argc ? std::atof(argv[i + 2]) : soak_report_seconds;
+        }
+        memory_report |= std::string_view(argv[i]) == "--memory-report";
+        input_latency_report |= std::string_view(argv[i]) == "--input-latency";
+        pacing_report |= std::string_view(argv[i]) == "--pacing-report";
+        if (std::string_view(argv[i]) == "--fps" && i + 1 < argc)
+        {
+            bool off = std::string_view(argv[i + 1]) == "off";
+            frame_limiter_mode = off ? woc::FrameLimiterMode::Off : frame_limiter_mode;
+            frame_limiter_fps = off ? 0.0 : std::atof(argv[i + 1]);
+        }
+        if (std::string_view(argv[i]) == "--fps-adaptive" && frame_limiter_mode != woc::FrameLimiterMode::Off)
+        {
+            frame_limiter_mode = woc::FrameLimiterMode::Adaptive;
+        }
+        if (std::string_view(argv[i]) == "--record-replays" && i + 1 < argc)
+        {
+            replay_directory = argv[i + 1];
+        }
+        if (std::string_view(argv[i]) == "--capture-dir" && i + 1 < argc)
+        {
+            capture_directory = argv[i + 1];
+        }
+        if (std::string_view(argv[i]) == "--netplay" && i + 3 < argc)
+        {
+            netplay_player = static_cast<woc::u32>(std::clamp(std::atoi(argv[i + 1]), 1, 2));
+            netplay_port = static_cast<woc::u16>(std::atoi(argv[i + 2]));
+            netplay_peer = argv[i + 3];
+        }
+        if (std::string_view(argv[i]) == "--net-delay" && i + 1 < argc)
+        {
+            netplay_conditions.delay_seconds = std::atof(argv[i + 1]) / 1000.0;
+        }
+        if (std::string_view(argv[i]) == "--net-loss" && i + 1 < argc)
+        {
+            netplay_conditions.loss = static_cast<woc::f32>(std::atof(argv[i + 1]) / 100.0);
+        }
+        if (std::string_view(argv[i]) == "--startup-benchmark")
+        {
+            startup_benchmark = true;
+            if (i + 1 < argc && std::string_view(argv[i + 1]).substr(0, 2) != "--")
+            {
+                startup_csv_path = argv[i + 1];
+            }
+        }
+    }
+
+    // Ahead of the window, a port that's taken shouldn't cost starting up first.
+    auto netplay = std::unique_ptr<woc::Netplay>{};
+    if (netplay_player)
+    {
+        netplay = std::make_unique<woc::Netplay>();
+        auto error = std::string{};
+        if (!woc::netplay_open(*netplay, netplay_player - 1, netplay_port, netplay_conditions, error)
+            || !woc::netplay_connect(*netplay, netplay_peer, error))
+        {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+
+    // Before any thread starts, see counters_publish.
+    woc::counters_publish();
+    woc::startup_trace_phase(startup, "arguments");
+
+    // Images and sounds decode on workers while the window and GL context come up.
+    woc::AssetPreload preload{};
+    woc::asset_preload_start(preload);
+    woc::startup_trace_phase(startup, "asset_preload_start");
+
+    auto menu_state = woc::menu_init(soak_bot || netplay ? woc::MenuPageType::Game : woc::MenuPageType::MainMenu, false, woc::ResolutionPreset::Resolution_1600x900);
+    auto window = woc::window_init(woc::menu_resolution_to_size(menu_state));
+    woc::startup_trace_phase(startup, "window_init");
+    auto renderer = woc::renderer_init(preload);
+    woc::Capture capture{};
+    woc::capture_start(capture, capture_directory);
+    renderer.capture = &capture;
+    auto frame_limiter = woc::frame_limiter_init(frame_limiter_mode, frame_limiter_fps);
+    renderer.frame_limiter = &frame_limiter;
+    woc::startup_trace_phase(startup, "renderer_init");
     auto game_state = std::optional<woc::GameState>{};
-    auto audio_state = woc::audio_init();
+    // Both peers start on the same level, the simulation adds the second paddle.
+    if (soak_bot || netplay)
+    {
+        game_state = woc::game_init(woc::START_LEVEL);
+    }
+    auto audio_state = woc::audio_init(preload);
+    woc::startup_trace_phase(startup, "audio_init");
+    woc::startup_trace_background(startup, "asset decode", preload.seconds);
 
+    auto previous_tag = woc::memory_tag_push(woc::MemoryTag::Fonts);
     GuiLoadStyleBluish();
+    auto gui_font = GuiGetFont();
+    woc::memory_set_external(woc::MemoryTag::Fonts, woc::memory_font_bytes(gui_font));
+    woc::memory_tag_pop(previous_tag);
+    woc::startup_trace_phase(startup, "gui_style");
+
+    woc::Simulation simulation{};
+    simulation.replay_directory = replay_directory;
+    simulation.netplay = netplay.get();
+    woc::simulation_start(simulation, audio_state);
+    woc::startup_trace_phase(startup, "simulation_start");
+    auto level_watcher = woc::levelfile_watch_init();
+    auto level_edits = std::vector<woc::LevelEdit>{};
+    auto level_editor = woc::editor_init();
+    woc::startup_trace_phase(startup, "levelfile_watch_init");
+    int exit_code = 0;
 
     bool keep_running_app = true;
     bool is_window_visible = true;
     Vector2 window_size = woc::window_size(window);
     woc::InputState app_input_state{};
-    auto update_app = [&window = window, &keep_running_app, &is_window_visible, &window_size, &app_input_state] ()
+    auto update_app = [&window = window, &keep_running_app, &is_window_visible, &window_size, &app_input_state, &capture] ()
     {
+        if (IsKeyPressed(KEY_F12))
+        {
+            woc::capture_request_screenshot(capture);
+        }
+        if (IsKeyPressed(KEY_F10))
+        {
+            woc::capture_toggle_recording(capture);
+        }
+
         app_input_state.game_menu_swap += IsKeyPressed(KEY_ESCAPE);
         app_input_state.restart_level += IsKeyPressed(KEY_R);
         app_input_state.new_game += IsKeyPressed(KEY_Y);
         app_input_state.send_ball += IsKeyDown(KEY_SPACE);
+        app_input_state.cast_gust += IsKeyPressed(KEY_W);
         
         auto move_left = IsKeyDown(KEY_A);
         auto move_right = IsKeyDown(KEY_D);
@@ -42,8 +459,18 @@ int main()
         }
     };
 
-    auto update_game = [&audio_state, &menu_state, &keep_running_app, &game_state, visible = &is_window_visible, window_size = &window_size, &renderer] (woc::InputState input)
+    auto update_game = [&simulation, &audio_state, &menu_state, &keep_running_app, &game_state, visible = &is_window_visible, window_size = &window_size, &renderer, &level_editor] (woc::InputState input, woc::f32 delta_seconds)
     {
+        // New games and the next level are made here, everything else that allocates tags itself.
+        auto previous_tag = woc::memory_tag_push(woc::MemoryTag::Game);
+
+        // The editor has its own keys, none of them should reach the game behind it.
+        if (menu_state.current_page == woc::MenuPageType::Editor)
+        {
+            input.new_game = 0;
+            input.restart_level = 0;
+        }
+
         if (input.new_game)
         {
             game_state = woc::game_init(woc::START_LEVEL);
@@ -51,7 +478,7 @@ int main()
         
         if (input.game_menu_swap)
         {
-            if (menu_state.current_page == woc::MenuPageType::Game)
+            if (menu_state.current_page == woc::MenuPageType::Game || menu_state.current_page == woc::MenuPageType::Editor)
             {
                 menu_state.current_page = woc::MenuPageType::MainMenu;
                 woc::audio_play_sound_randomize_pitch(audio_state, woc::AudioType::UIPageChange);
@@ -64,21 +491,11 @@ int main()
 
         if (game_state && input.restart_level)
         {
-            game_state = woc::game_init(game_state->current_level);
+            woc::simulation_request_rewind(simulation);
             woc::audio_play_sound(audio_state, woc::AudioType::SFXLevelLost);
         }
         
-        auto delta_seconds = GetFrameTime();
-
-        if (!IsSoundPlaying(audio_state.sounds.at((size_t)woc::AudioType::MusicBackground)))
-        {
-            audio_state.time_till_background_music -= delta_seconds;
-            if (audio_state.time_till_background_music < 0.f)
-            {
-                woc::audio_play_sound(audio_state, woc::AudioType::MusicBackground);
-                audio_state.time_till_background_music = static_cast<woc::f32>(GetRandomValue(10, 20));
-            }
-        }
+        woc::audio_update(audio_state, delta_seconds);
         
         switch (menu_state.current_page)
         {
@@ -94,10 +511,11 @@ int main()
             }
             case woc::MenuPageType::Game:
             {
-                woc::game_update(*game_state, input, audio_state, delta_seconds);
-                    
-                if (*visible)
+                // The simulation thread ticks the game, this only draws its latest snapshot.
+                if (*visible && game_state)
                 {
+                    woc::renderer_update_render_scale(renderer, menu_state, delta_seconds);
+                    woc::renderer_update_effects(renderer, *game_state, delta_seconds);
                     woc::renderer_prepare_rendering(renderer);
                     woc::renderer_render_world(renderer, *game_state, *window_size);
                     if (game_state->level_status == woc::LevelStatus::Won)
@@ -143,17 +561,148 @@ int main()
                 }
                 break; 
             }
+            case woc::MenuPageType::Editor:
+            {
+                // Opens on the level being played, and keeps its edits while the editor is left for the menu.
+                auto error = std::string{};
+                if (!level_editor.is_open && !woc::editor_open(level_editor, game_state ? game_state->current_level : woc::START_LEVEL, error))
+                {
+                    std::cerr << error << "\n";
+                    woc::menu_change_page(menu_state, woc::MenuPageType::MainMenu);
+                    break;
+                }
+                if (*visible)
+                {
+                    woc::renderer_prepare_rendering(renderer);
+                    woc::renderer_update_and_render_editor(renderer, level_editor, *window_size, delta_seconds);
+                    woc::renderer_finalize_rendering(renderer);
+                }
+                break;
+            }
         }
+        woc::memory_tag_pop(previous_tag);
     };
 
+    auto last_frame_seconds = woc::window_seconds_since_init(window);
+    auto idle_state = woc::menu_idle_init(menu_state, last_frame_seconds);
+    auto soak_log = woc::soak_log_init(last_frame_seconds, soak_report_seconds);
+    constexpr woc::u32 NO_LEVEL = std::numeric_limits<woc::u32>::max();
+    auto report_page = menu_state.current_page;
+    auto report_level = game_state ? game_state->current_level : NO_LEVEL;
+    auto prefetched_after_level = NO_LEVEL;
+    auto report_memory = [&report_page, &report_level] ()
+    {
+        auto label = std::string("page ") + woc::menu_page_title(report_page);
+        if (report_level != NO_LEVEL)
+        {
+            label += ", level " + std::to_string(report_level);
+        }
+        woc::memory_report(std::cout, label);
+    };
     while (keep_running_app)
     {
         menu_state.is_fullscreen = woc::window_is_fullscreen(window);
+        // raylib polls events at the end of EndDrawing, or in window_wait_events, which is just before this.
         update_app();
-        update_game(app_input_state);
+        auto input_time = std::chrono::steady_clock::now();
+
+        auto now_seconds = woc::window_seconds_since_init(window);
+        auto delta_seconds = static_cast<woc::f32>(now_seconds - last_frame_seconds);
+        last_frame_seconds = now_seconds;
+
+        woc::simulation_acquire(simulation, game_state);
+        woc::simulation_play_sounds(simulation, audio_state);
+        woc::levelfile_watch_poll(level_watcher, level_edits);
+        woc::simulation_submit_level_edits(simulation, level_edits);
+
+        auto level = game_state ? game_state->current_level : NO_LEVEL;
+        // Endless levels take a moment to generate, the next one is started as soon as a level is up. The last
+        // shipped level leads into the endless ones too, through the game won page.
+        if (level != NO_LEVEL && level != prefetched_after_level)
+        {
+            woc::game_prefetch_level(level + 1);
+            prefetched_after_level = level;
+        }
+        if (memory_report && (menu_state.current_page != report_page || level != report_level))
+        {
+            report_memory();
+            report_page = menu_state.current_page;
+            report_level = level;
+        }
+
+        if (soak_bot && game_state)
+        {
+            woc::u32 next_level = 0;
+            if (woc::soak_bot_next_level(*soak_bot, *game_state, delta_seconds, next_level))
+            {
+                game_state = woc::game_init(next_level);
+            }
+            auto bot_input = woc::soak_bot_input(*soak_bot, *game_state);
+            app_input_state.move_dir = bot_input.move_dir;
+            app_input_state.wind_dir_x = bot_input.wind_dir_x;
+            app_input_state.wind_dir_y = bot_input.wind_dir_y;
+            app_input_state.send_ball += bot_input.send_ball;
+            app_input_state.cast_gust += bot_input.cast_gust;
+
+            woc::soak_log_frame(soak_log, delta_seconds);
+            woc::soak_log_update(soak_log, now_seconds, *soak_bot, woc::soak_counts(*game_state, renderer.particles.count, audio_state.sounds_played), std::cout);
+            keep_running_app &= now_seconds - soak_log.start_seconds < soak_seconds;
+        }
+
+        // Straight to the simulation thread rather than after this frame is drawn, which used to add up to a frame.
+        woc::simulation_submit_input(simulation, app_input_state, input_time);
+
+        bool has_input_activity = woc::window_has_input_activity(window);
+        bool menu_idle = woc::menu_idle_update(idle_state, menu_state, has_input_activity, now_seconds);
+        if (is_window_visible && !menu_idle)
+        {
+            auto frames_presented = renderer.frames_presented;
+            update_game(app_input_state, delta_seconds);
+            if (menu_state.current_page == woc::MenuPageType::Game && renderer.frames_presented != frames_presented)
+            {
+                woc::simulation_record_present(simulation, std::chrono::steady_clock::now());
+            }
+        } else
+        {
+            // Nothing new to show, so skip BeginDrawing/EndDrawing. The simulation thread throttles itself while hidden.
+            woc::frame_limiter_skip(frame_limiter);
+            woc::audio_update(audio_state, delta_seconds);
+            woc::window_wait_events(window, is_window_visible ? woc::MENU_IDLE_WAIT_SECONDS : woc::HIDDEN_GAME_TICK_SECONDS);
+        }
+
+        if (startup_benchmark && renderer.frames_presented > 0)
+        {
+            woc::startup_trace_phase(startup, "first frame");
+            woc::startup_trace_report(startup, std::cout);
+            if (!startup_csv_path.empty() && !woc::startup_trace_append_csv(startup, startup_csv_path))
+            {
+                std::cerr << "Could not append to " << startup_csv_path << "\n";
+                exit_code = 1;
+            }
+            keep_running_app = false;
+        } else if (startup_benchmark && now_seconds > woc::STARTUP_BENCHMARK_TIMEOUT_SECONDS)
+        {
+            std::cerr << "No frame presented within " << woc::STARTUP_BENCHMARK_TIMEOUT_SECONDS << " s\n";
+            exit_code = 1;
+            keep_running_app = false;
+        }
+
+        auto simulation_mode = woc::SimulationMode::Paused;
+        if (menu_state.current_page == woc::MenuPageType::Game)
+        {
+            simulation_mode = is_window_visible ? woc::SimulationMode::Running : woc::SimulationMode::Throttled;
+        }
+        woc::simulation_submit(simulation, game_state, simulation_mode);
         app_input_state = woc::InputState{};
         
-        auto res_size = woc::menu_resolution_to_size(menu_state.resolution);
+        auto res_size = woc::menu_resolution_to_size(menu_state);
+        if (!menu_state.is_fullscreen && woc::window_was_resized(window) && !Vector2Equals(res_size, window_size))
+        {
+            // Dragged to a new size by the user, keep it rather than snapping back to the preset.
+            menu_state.resolution = woc::ResolutionPreset::Custom;
+            menu_state.custom_resolution = window_size;
+            res_size = window_size;
+        }
         if (!menu_state.is_fullscreen && !Vector2Equals(res_size, window_size)) 
         {
             woc::window_set_size(window, res_size);
@@ -162,10 +711,38 @@ int main()
         woc::audio_set_volume(audio_state, menu_state.volume);
     }
 
+    woc::simulation_stop(simulation);
+    woc::levelgen_prefetch_stop();
+    if (netplay)
+    {
+        woc::netplay_report(*netplay, std::cout);
+        woc::netplay_close(*netplay);
+    }
+    woc::levelfile_watch_deinit(level_watcher);
+    if (memory_report)
+    {
+        report_memory();
+    }
+    if (input_latency_report)
+    {
+        woc::simulation_report_latency(simulation, std::cout);
+    }
+    if (pacing_report)
+    {
+        woc::frame_limiter_report(frame_limiter, std::cout);
+    }
+
+    // Unlike the rest, frames still in flight would be lost.
+    woc::capture_stop(capture);
+    // After the capture worker is gone and this game's level stream with it. Snapshots the simulation still holds
+    // can keep a stream worker alive, counters_unpublish keeps the mapping for those.
+    game_state.reset();
+    woc::counters_unpublish();
+
     // Unnecessary before a program exit. OS cleans up.
     woc::renderer_deinit(renderer);
     woc::audio_deinit(audio_state);
     woc::window_deinit(window);
 
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
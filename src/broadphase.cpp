@@ -0,0 +1,233 @@
+﻿#include "broadphase.h"
+#include "levelgen.h"
+
+namespace woc
+{
+    constexpr u32 BROADPHASE_NONE = std::numeric_limits<u32>::max();
+
+    woc_internal i16 broadphase_cell(f32 value, f32 origin, i32 cell_count)
+    {
+        auto cell = std::clamp((value - origin) / BROADPHASE_CELL_SIZE, 0.f, static_cast<f32>(cell_count - 1));
+        return static_cast<i16>(cell);
+    }
+
+    woc_internal BroadphaseCells broadphase_cells(Broadphase& broadphase, Vector2 min, Vector2 max)
+    {
+        return BroadphaseCells {
+            .min_x = broadphase_cell(min.x, broadphase.origin.x, broadphase.width),
+            .min_y = broadphase_cell(min.y, broadphase.origin.y, broadphase.height),
+            .max_x = broadphase_cell(max.x, broadphase.origin.x, broadphase.width),
+            .max_y = broadphase_cell(max.y, broadphase.origin.y, broadphase.height)
+        };
+    }
+
+    woc_internal void broadphase_enemy_bounds(EnemyState& enemy_state, Vector2& min, Vector2& max)
+    {
+        auto half_extents = Vector2AddValue(levelgen_half_extents(enemy_state.size, enemy_state.rot), BROADPHASE_PADDING);
+        min = Vector2Subtract(enemy_state.pos, half_extents);
+        max = Vector2Add(enemy_state.pos, half_extents);
+    }
+
+    woc_internal BroadphaseCells broadphase_enemy_cells(Broadphase& broadphase, EnemyState& enemy_state)
+    {
+        Vector2 min, max;
+        broadphase_enemy_bounds(enemy_state, min, max);
+        return broadphase_cells(broadphase, min, max);
+    }
+
+    woc_internal i32 broadphase_cell_count(f32 min, f32 max)
+    {
+        auto count = static_cast<i32>(std::ceil((max - min) / BROADPHASE_CELL_SIZE));
+        return std::clamp(count, 1, BROADPHASE_MAX_CELLS_PER_AXIS);
+    }
+
+    woc_internal bool broadphase_contains(BroadphaseCells cells, i32 x, i32 y)
+    {
+        return x >= cells.min_x && x <= cells.max_x && y >= cells.min_y && y <= cells.max_y;
+    }
+
+    woc_internal void broadphase_insert(Broadphase& broadphase, i32 x, i32 y, u32 enemy)
+    {
+        auto node = broadphase.free_node;
+        if (node == BROADPHASE_NONE)
+        {
+            node = static_cast<u32>(broadphase.nodes.size());
+            broadphase.nodes.emplace_back();
+        } else {
+            broadphase.free_node = broadphase.nodes.at(node).next;
+        }
+        auto& head = broadphase.heads.at(y * broadphase.width + x);
+        broadphase.nodes.at(node) = BroadphaseNode { .enemy = enemy, .next = head };
+        head = node;
+    }
+
+    woc_internal void broadphase_remove(Broadphase& broadphase, i32 x, i32 y, u32 enemy)
+    {
+        auto* link = &broadphase.heads.at(y * broadphase.width + x);
+        while (*link != BROADPHASE_NONE)
+        {
+            auto index = *link;
+            auto& node = broadphase.nodes.at(index);
+            if (node.enemy == enemy)
+            {
+                *link = node.next;
+                node.next = broadphase.free_node;
+                broadphase.free_node = index;
+                return;
+            }
+            link = &node.next;
+        }
+        assert(false && "wall missing from a cell it was bucketed into");
+    }
+
+    void broadphase_build(Broadphase& broadphase, std::vector<EnemyState>& enemies)
+    {
+        // The default world is always covered, so the usual levels get the same grid whatever their walls.
+        auto grid_min = WORLD_MIN;
+        auto grid_max = WORLD_MAX;
+        for (auto& e : enemies)
+        {
+            Vector2 min, max;
+            broadphase_enemy_bounds(e, min, max);
+            grid_min = Vector2 { std::min(grid_min.x, min.x), std::min(grid_min.y, min.y) };
+            grid_max = Vector2 { std::max(grid_max.x, max.x), std::max(grid_max.y, max.y) };
+        }
+        broadphase.origin = grid_min;
+        broadphase.width = broadphase_cell_count(grid_min.x, grid_max.x);
+        broadphase.height = broadphase_cell_count(grid_min.y, grid_max.y);
+
+        broadphase.heads.assign(static_cast<size_t>(broadphase.width) * static_cast<size_t>(broadphase.height), BROADPHASE_NONE);
+        broadphase.nodes.clear();
+        broadphase.cells.resize(enemies.size());
+        broadphase.free_node = BROADPHASE_NONE;
+        for (u32 i = 0; i < enemies.size(); i++)
+        {
+            auto cells = broadphase_enemy_cells(broadphase, enemies.at(i));
+            broadphase.cells.at(i) = cells;
+            for (i32 y = cells.min_y; y <= cells.max_y; y++)
+            {
+                for (i32 x = cells.min_x; x <= cells.max_x; x++)
+                {
+                    broadphase_insert(broadphase, x, y, i);
+                }
+            }
+        }
+    }
+
+    void broadphase_move(Broadphase& broadphase, u32 enemy, EnemyState& enemy_state)
+    {
+        auto next = broadphase_enemy_cells(broadphase, enemy_state);
+        auto& current = broadphase.cells.at(enemy);
+        if (std::memcmp(&next, &current, sizeof(next)) == 0)
+        {
+            return;
+        }
+
+        for (i32 y = current.min_y; y <= current.max_y; y++)
+        {
+            for (i32 x = current.min_x; x <= current.max_x; x++)
+            {
+                if (!broadphase_contains(next, x, y))
+                {
+                    broadphase_remove(broadphase, x, y, enemy);
+                }
+            }
+        }
+        for (i32 y = next.min_y; y <= next.max_y; y++)
+        {
+            for (i32 x = next.min_x; x <= next.max_x; x++)
+            {
+                if (!broadphase_contains(current, x, y))
+                {
+                    broadphase_insert(broadphase, x, y, enemy);
+                }
+            }
+        }
+        current = next;
+    }
+
+    void broadphase_swap_remove(Broadphase& broadphase, u32 enemy)
+    {
+        auto removed = broadphase.cells.at(enemy);
+        for (i32 y = removed.min_y; y <= removed.max_y; y++)
+        {
+            for (i32 x = removed.min_x; x <= removed.max_x; x++)
+            {
+                broadphase_remove(broadphase, x, y, enemy);
+            }
+        }
+
+        auto last = static_cast<u32>(broadphase.cells.size() - 1);
+        if (enemy != last)
+        {
+            // Relabelled in place, the last wall keeps its spot in every cell's list.
+            auto moved = broadphase.cells.at(last);
+            for (i32 y = moved.min_y; y <= moved.max_y; y++)
+            {
+                for (i32 x = moved.min_x; x <= moved.max_x; x++)
+                {
+                    auto node = broadphase.heads.at(y * broadphase.width + x);
+                    while (broadphase.nodes.at(node).enemy != last)
+                    {
+                        node = broadphase.nodes.at(node).next;
+                    }
+                    broadphase.nodes.at(node).enemy = enemy;
+                }
+            }
+            broadphase.cells.at(enemy) = moved;
+        }
+        broadphase.cells.pop_back();
+    }
+
+    bool broadphase_query(Broadphase& broadphase, Vector2 min, Vector2 max, BroadphaseCandidates& out, u32& count)
+    {
+        count = 0;
+        if (broadphase.heads.empty())
+        {
+            return false;
+        }
+
+        auto cells = broadphase_cells(broadphase, min, max);
+        for (i32 y = cells.min_y; y <= cells.max_y; y++)
+        {
+            for (i32 x = cells.min_x; x <= cells.max_x; x++)
+            {
+                for (auto node = broadphase.heads.at(y * broadphase.width + x); node != BROADPHASE_NONE; node = broadphase.nodes.at(node).next)
+                {
+                    if (count == out.size())
+                    {
+                        return false;
+                    }
+                    out[count++] = broadphase.nodes.at(node).enemy;
+                }
+            }
+        }
+        // Walls spanning several of the cells show up once per cell.
+        std::sort(out.begin(), out.begin() + count);
+        count = static_cast<u32>(std::unique(out.begin(), out.begin() + count) - out.begin());
+        return true;
+    }
+
+    void broadphase_query_all(Broadphase& broadphase, Vector2 min, Vector2 max, std::vector<u32>& out)
+    {
+        out.clear();
+        if (broadphase.heads.empty())
+        {
+            return;
+        }
+
+        auto cells = broadphase_cells(broadphase, min, max);
+        for (i32 y = cells.min_y; y <= cells.max_y; y++)
+        {
+            for (i32 x = cells.min_x; x <= cells.max_x; x++)
+            {
+                for (auto node = broadphase.heads.at(y * broadphase.width + x); node != BROADPHASE_NONE; node = broadphase.nodes.at(node).next)
+                {
+                    out.emplace_back(broadphase.nodes.at(node).enemy);
+                }
+            }
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+namespace woc
+{
+    constexpr f32 BROADPHASE_CELL_SIZE = 100.f;
+    // Cells per axis are capped so a stray far away wall can't blow up the grid, walls past it share the edge cells.
+    constexpr i32 BROADPHASE_MAX_CELLS_PER_AXIS = 1024;
+    // Bounds are padded by this much so rounding in the collision test can't put a hit just outside them.
+    constexpr f32 BROADPHASE_PADDING = 1.f;
+    constexpr u32 BROADPHASE_MAX_CANDIDATES = 256;
+    using BroadphaseCandidates = std::array<u32, BROADPHASE_MAX_CANDIDATES>;
+
+    // Sizes the grid to the default world plus every wall's bounds, then buckets every wall. Walls moving out of
+    // the grid later land in the edge cells.
+    void broadphase_build(Broadphase& broadphase, std::vector<EnemyState>& enemies);
+    // Re-buckets one wall after it moved or turned, touching only the cells it left or entered.
+    void broadphase_move(Broadphase& broadphase, u32 enemy, EnemyState& enemy_state);
+    // Takes a wall out of its cells and gives the last wall its index, to match swap-removing it from the walls.
+    // Touches only the cells of those two walls.
+    void broadphase_swap_remove(Broadphase& broadphase, u32 enemy);
+    // Writes the walls whose bounds may overlap min..max to out in ascending order, so callers test them in the same
+    // order as a full scan would. Returns false when nothing is built or the candidates didn't fit, callers then
+    // have to test every wall.
+    bool broadphase_query(Broadphase& broadphase, Vector2 min, Vector2 max, BroadphaseCandidates& out, u32& count);
+    // The same without the cap, for tools asking about large areas like the editor's box selection.
+    void broadphase_query_all(Broadphase& broadphase, Vector2 min, Vector2 max, std::vector<u32>& out);
+}
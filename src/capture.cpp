@@ -0,0 +1,417 @@
+﻿#include "capture.h"
+#include "memory.h"
+#include "replay.h"
+
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+#if WOC_CAPTURE_PBO
+// raylib's own loader, already filled in by InitWindow. Only the declarations are used here.
+#include "external/glad.h"
+#endif
+
+namespace woc
+{
+    woc_internal void capture_write_screenshot(CaptureJob& job)
+    {
+        auto row_bytes = static_cast<size_t>(job.width) * 4;
+        if (job.bottom_up)
+        {
+            for (u32 y = 0; y < job.height / 2; y++)
+            {
+                std::swap_ranges(job.pixels.begin() + y * row_bytes, job.pixels.begin() + (y + 1) * row_bytes, job.pixels.begin() + (job.height - 1 - y) * row_bytes);
+            }
+        }
+        // The backbuffer's alpha is whatever blending left behind, a screenshot should be opaque.
+        for (size_t i = 3; i < job.pixels.size(); i += 4)
+        {
+            job.pixels.at(i) = 255;
+        }
+        auto image = Image {
+            .data = job.pixels.data(),
+            .width = static_cast<i32>(job.width),
+            .height = static_cast<i32>(job.height),
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+        };
+        if (ExportImage(image, job.path.c_str()))
+        {
+            std::cout << "Saved " << job.path << "\n";
+        } else {
+            std::cerr << job.path << ": can't write\n";
+        }
+    }
+
+    woc_internal void capture_worker_main(Capture& capture)
+    {
+        auto previous_tag = memory_tag_push(MemoryTag::Capture);
+        std::ofstream video;
+        std::string video_path;
+        std::vector<u8> planes;
+        auto job = CaptureJob{};
+        while (true)
+        {
+            {
+                std::unique_lock lock(capture.mutex);
+                if (!job.pixels.empty())
+                {
+                    capture.spare_pixels.push_back(std::move(job.pixels));
+                }
+                capture.wake.wait(lock, [&capture] { return capture.stopping || !capture.jobs.empty(); });
+                if (capture.jobs.empty())
+                {
+                    break;
+                }
+                job = std::move(capture.jobs.front());
+                capture.jobs.pop_front();
+            }
+
+            switch (job.type)
+            {
+                case CaptureJobType::VideoStart:
+                {
+                    video_path = job.path;
+                    video.open(video_path, std::ios::binary | std::ios::trunc);
+                    replay_write_y4m_header(video, job.width, job.height, CAPTURE_VIDEO_FPS);
+                    if (!video)
+                    {
+                        std::cerr << video_path << ": can't write\n";
+                    }
+                    break;
+                }
+                case CaptureJobType::Frame:
+                {
+                    if (job.video && video.is_open())
+                    {
+                        replay_write_y4m_frame(video, job.pixels.data(), job.width, job.height, job.bottom_up, planes);
+                    }
+                    // Last, it flips the pixels in place.
+                    if (job.screenshot)
+                    {
+                        capture_write_screenshot(job);
+                    }
+                    break;
+                }
+                case CaptureJobType::VideoEnd:
+                {
+                    video.close();
+                    if (video)
+                    {
+                        std::cout << "Saved " << video_path << "\n";
+                    } else {
+                        std::cerr << video_path << ": can't write\n";
+                    }
+                    video.clear();
+                    break;
+                }
+            }
+        }
+        memory_tag_pop(previous_tag);
+    }
+
+    woc_internal std::string capture_path(Capture& capture, const char* kind, u32 number, const char* extension)
+    {
+        std::ostringstream name;
+        name << kind << "-" << capture.session << "-" << std::setw(3) << std::setfill('0') << number << extension;
+        return (std::filesystem::path(capture.directory) / name.str()).string();
+    }
+
+    woc_internal void capture_push(Capture& capture, CaptureJob job)
+    {
+        {
+            std::scoped_lock lock(capture.mutex);
+            capture.jobs.push_back(std::move(job));
+        }
+        capture.wake.notify_one();
+    }
+
+    // Recycled from the worker, so recording doesn't allocate a frame's worth every frame.
+    woc_internal TaggedVector<u8, MemoryTag::Capture> capture_take_pixels(Capture& capture, size_t bytes)
+    {
+        auto pixels = TaggedVector<u8, MemoryTag::Capture>{};
+        {
+            std::scoped_lock lock(capture.mutex);
+            if (!capture.spare_pixels.empty())
+            {
+                pixels = std::move(capture.spare_pixels.back());
+                capture.spare_pixels.pop_back();
+            }
+        }
+        pixels.resize(bytes);
+        return pixels;
+    }
+
+    // 4:2:0 wants even dimensions, an odd row or column is left out.
+    woc_internal u32 capture_video_dimension(i32 pixels)
+    {
+        return static_cast<u32>(std::max(2, pixels)) & ~1u;
+    }
+
+    woc_internal bool capture_queue_full(Capture& capture)
+    {
+        std::scoped_lock lock(capture.mutex);
+        return capture.jobs.size() >= CAPTURE_MAX_QUEUED_FRAMES;
+    }
+
+    woc_internal void capture_collect(Capture& capture, bool wait);
+
+    woc_internal void capture_end_recording(Capture& capture)
+    {
+        // Frames still in flight belong to this recording, not after its end.
+        capture_collect(capture, true);
+        capture.recording = false;
+        capture_push(capture, CaptureJob { .type = CaptureJobType::VideoEnd });
+        auto frames = std::max<u64>(capture.video_frames, 1);
+        std::cout << "Recorded " << capture.video_frames << " frames, " << capture.frames_dropped << " dropped, main thread "
+            << std::fixed << std::setprecision(3) << capture.main_thread_seconds / static_cast<f64>(frames) * 1000.0 << " ms average, "
+            << capture.max_main_thread_seconds * 1000.0 << " ms worst per frame\n" << std::defaultfloat;
+    }
+
+#if WOC_CAPTURE_PBO
+    // Copies finished readbacks out oldest first. Stops at the first one the GPU hasn't got to, unless wait is set.
+    woc_internal void capture_collect(Capture& capture, bool wait)
+    {
+        for (u32 i = 0; i < CAPTURE_RING_SLOTS; i++)
+        {
+            auto& slot = capture.slots.at((capture.next_slot + i) % CAPTURE_RING_SLOTS);
+            if (!slot.pending)
+            {
+                continue;
+            }
+            auto fence = static_cast<GLsync>(slot.fence);
+            constexpr GLuint64 WAIT_NANOSECONDS = 1'000'000'000;
+            auto status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? WAIT_NANOSECONDS : 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            {
+                return;
+            }
+            glDeleteSync(fence);
+            slot.fence = nullptr;
+            slot.pending = false;
+
+            // A video frame the worker can't take in time is dropped, a screenshot always goes through.
+            if (!slot.screenshot && capture_queue_full(capture))
+            {
+                capture.frames_dropped++;
+                continue;
+            }
+            auto bytes = static_cast<size_t>(slot.width) * slot.height * 4;
+            auto job = CaptureJob {
+                .type = CaptureJobType::Frame,
+                .screenshot = slot.screenshot,
+                .video = slot.video,
+                .bottom_up = true,
+                .width = slot.width,
+                .height = slot.height,
+                .pixels = capture_take_pixels(capture, bytes),
+                .path = slot.screenshot ? capture_path(capture, "screenshot", capture.screenshots_taken++, ".png") : std::string{}
+            };
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            if (auto* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), GL_MAP_READ_BIT))
+            {
+                std::memcpy(job.pixels.data(), mapped, bytes);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                capture.video_frames += job.video;
+                capture_push(capture, std::move(job));
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    // Queues a readback into the next slot. Returns false when that slot's last readback isn't back yet.
+    woc_internal bool capture_read_back(Capture& capture, u32 width, u32 height, bool screenshot, bool video)
+    {
+        auto& slot = capture.slots.at(capture.next_slot);
+        if (slot.pending)
+        {
+            return false;
+        }
+        auto bytes = static_cast<size_t>(width) * height * 4;
+        if (slot.buffer == 0)
+        {
+            glGenBuffers(1, &slot.buffer);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (slot.buffer_bytes != bytes)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_READ);
+            slot.buffer_bytes = bytes;
+        }
+        // Whatever raylib still has batched belongs in this frame.
+        rlDrawRenderBatchActive();
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.pending = true;
+        slot.screenshot = screenshot;
+        slot.video = video;
+        slot.width = width;
+        slot.height = height;
+        capture.next_slot = (capture.next_slot + 1) % CAPTURE_RING_SLOTS;
+        return true;
+    }
+#else
+    woc_internal void capture_collect(Capture& capture, bool wait)
+    {
+        // Every readback is finished and handed over before capture_read_back returns.
+    }
+
+    woc_internal bool capture_read_back(Capture& capture, u32 width, u32 height, bool screenshot, bool video)
+    {
+        if (!screenshot && capture_queue_full(capture))
+        {
+            return false;
+        }
+        rlDrawRenderBatchActive();
+        auto* pixels = rlReadScreenPixels(static_cast<i32>(width), static_cast<i32>(height));
+        if (!pixels)
+        {
+            return false;
+        }
+        auto bytes = static_cast<size_t>(width) * height * 4;
+        auto job = CaptureJob {
+            .type = CaptureJobType::Frame,
+            .screenshot = screenshot,
+            .video = video,
+            .bottom_up = false,
+            .width = width,
+            .height = height,
+            .pixels = capture_take_pixels(capture, bytes),
+            .path = screenshot ? capture_path(capture, "screenshot", capture.screenshots_taken++, ".png") : std::string{}
+        };
+        std::memcpy(job.pixels.data(), pixels, bytes);
+        MemFree(pixels);
+        capture.video_frames += video;
+        capture_push(capture, std::move(job));
+        return true;
+    }
+#endif
+
+    void capture_start(Capture& capture, const std::string& directory)
+    {
+        capture.directory = directory;
+        capture.session = static_cast<u64>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        capture.slots = {};
+        capture.next_slot = 0;
+        capture.screenshot_requested = false;
+        capture.recording = false;
+        capture.video_width = 0;
+        capture.video_height = 0;
+        capture.screenshots_taken = 0;
+        capture.recordings_taken = 0;
+        capture.video_frames = 0;
+        capture.frames_dropped = 0;
+        capture.main_thread_seconds = 0.0;
+        capture.max_main_thread_seconds = 0.0;
+        capture.stopping = false;
+        capture.worker = std::thread(capture_worker_main, std::ref(capture));
+    }
+
+    void capture_stop(Capture& capture)
+    {
+        capture_collect(capture, true);
+        if (capture.recording)
+        {
+            capture_end_recording(capture);
+        }
+        {
+            std::scoped_lock lock(capture.mutex);
+            capture.stopping = true;
+        }
+        capture.wake.notify_one();
+        if (capture.worker.joinable())
+        {
+            capture.worker.join();
+        }
+#if WOC_CAPTURE_PBO
+        for (auto& slot : capture.slots)
+        {
+            if (slot.buffer != 0)
+            {
+                glDeleteBuffers(1, &slot.buffer);
+            }
+            slot = CaptureSlot{};
+        }
+#endif
+    }
+
+    void capture_request_screenshot(Capture& capture)
+    {
+        capture.screenshot_requested = true;
+    }
+
+    void capture_toggle_recording(Capture& capture)
+    {
+        if (capture.recording)
+        {
+            capture_end_recording(capture);
+            return;
+        }
+        std::error_code directory_error;
+        std::filesystem::create_directories(capture.directory, directory_error);
+        if (directory_error)
+        {
+            std::cerr << capture.directory << ": " << directory_error.message() << "\n";
+            return;
+        }
+        capture.video_width = capture_video_dimension(GetRenderWidth());
+        capture.video_height = capture_video_dimension(GetRenderHeight());
+        capture.recording = true;
+        capture.video_frames = 0;
+        capture.frames_dropped = 0;
+        capture.main_thread_seconds = 0.0;
+        capture.max_main_thread_seconds = 0.0;
+        capture_push(capture, CaptureJob {
+            .type = CaptureJobType::VideoStart,
+            .width = capture.video_width,
+            .height = capture.video_height,
+            .path = capture_path(capture, "recording", capture.recordings_taken++, ".y4m")
+        });
+    }
+
+    void capture_frame(Capture& capture)
+    {
+        bool in_flight = std::any_of(capture.slots.begin(), capture.slots.end(), [] (CaptureSlot& slot) { return slot.pending; });
+        if (!capture.recording && !capture.screenshot_requested && !in_flight)
+        {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+
+        capture_collect(capture, false);
+        auto width = static_cast<u32>(std::max(1, GetRenderWidth()));
+        auto height = static_cast<u32>(std::max(1, GetRenderHeight()));
+        if (capture.recording && (capture_video_dimension(GetRenderWidth()) != capture.video_width || capture_video_dimension(GetRenderHeight()) != capture.video_height))
+        {
+            std::cerr << "Window resized, recording stopped\n";
+            capture_end_recording(capture);
+        }
+        if (capture.recording || capture.screenshot_requested)
+        {
+            if (capture.screenshot_requested)
+            {
+                std::error_code directory_error;
+                std::filesystem::create_directories(capture.directory, directory_error);
+            }
+            // A screenshot taken while recording shares the video frame's readback and its even size.
+            auto read_width = capture.recording ? capture.video_width : width;
+            auto read_height = capture.recording ? capture.video_height : height;
+            if (capture_read_back(capture, read_width, read_height, capture.screenshot_requested, capture.recording))
+            {
+                capture.screenshot_requested = false;
+            } else if (capture.recording)
+            {
+                capture.frames_dropped++;
+            }
+        }
+
+        if (capture.recording)
+        {
+            auto seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+            capture.main_thread_seconds += seconds;
+            capture.max_main_thread_seconds = std::max(capture.max_main_thread_seconds, seconds);
+        }
+    }
+}
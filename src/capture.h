@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <condition_variable>
+#include <fstream>
+#include <string>
+
+// Reads frames back through a ring of pixel buffer objects, which needs desktop GL 3.2 for the fences. With 0 every
+// capture is a plain synchronous glReadPixels that waits for the GPU to finish the frame, for GLES and web builds.
+#ifndef WOC_CAPTURE_PBO
+#define WOC_CAPTURE_PBO 1
+#endif
+
+namespace woc
+{
+    // Frames in flight between glReadPixels and the copy out. The GPU has this many frames to finish one before
+    // the main thread would have to wait on it, a frame is dropped instead.
+    constexpr u32 CAPTURE_RING_SLOTS = 3;
+    // Frames waiting for the worker. Past this the disk isn't keeping up and new frames are dropped.
+    constexpr u32 CAPTURE_MAX_QUEUED_FRAMES = 8;
+    // Y4M has a fixed rate, recordings are meant to be made with vsync on at 60 Hz.
+    constexpr u32 CAPTURE_VIDEO_FPS = 60;
+    constexpr const char* CAPTURE_DEFAULT_DIRECTORY = "captures";
+
+    enum class CaptureJobType
+    {
+        Frame,
+        VideoStart,
+        VideoEnd,
+    };
+
+    struct CaptureJob
+    {
+        CaptureJobType type;
+        bool screenshot;
+        bool video;
+        bool bottom_up;
+        u32 width;
+        u32 height;
+        TaggedVector<u8, MemoryTag::Capture> pixels;
+        std::string path;
+    };
+
+    struct CaptureSlot
+    {
+        u32 buffer;
+        size_t buffer_bytes;
+        void* fence;
+        bool pending;
+        bool screenshot;
+        bool video;
+        u32 width;
+        u32 height;
+    };
+
+    // F12 saves a PNG screenshot, F10 starts and stops a Y4M recording. The main thread only issues readbacks and
+    // copies finished ones out, a worker thread converts and writes them.
+    struct Capture
+    {
+        // Main thread only.
+        std::string directory;
+        u64 session;
+        std::array<CaptureSlot, CAPTURE_RING_SLOTS> slots;
+        u32 next_slot;
+        bool screenshot_requested;
+        bool recording;
+        u32 video_width;
+        u32 video_height;
+        u32 screenshots_taken;
+        u32 recordings_taken;
+        u64 video_frames;
+        u64 frames_dropped;
+        f64 main_thread_seconds;
+        f64 max_main_thread_seconds;
+
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable wake;
+        // Guarded by mutex.
+        std::deque<CaptureJob> jobs;
+        std::vector<TaggedVector<u8, MemoryTag::Capture>> spare_pixels;
+        bool stopping;
+    };
+    void capture_start(Capture& capture, const std::string& directory);
+    // Finishes the frames still in flight and waits for the worker to write them. Needs the GL context still up.
+    void capture_stop(Capture& capture);
+    void capture_request_screenshot(Capture& capture);
+    void capture_toggle_recording(Capture& capture);
+    // Between the last draw and EndDrawing, renderer_finalize_rendering calls it.
+    void capture_frame(Capture& capture);
+}
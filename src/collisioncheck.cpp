@@ -0,0 +1,511 @@
+﻿#include "collisioncheck.h"
+#include "broadphase.h"
+#include "simulation.h"
+#include "soak.h"
+
+#include <iomanip>
+#include <ostream>
+#include <thread>
+
+namespace woc
+{
+    // The kernel as it first shipped, bugs included, kept as the oracle. Don't touch it when optimizing.
+    woc_internal CollisionResult collision_reference_sphere_collides_rectangle(
+        Vector2 sphere_pos, Vector2 sphere_dir, f32 sphere_radius, 
+        Vector2 rectangle_pos, Vector2 rectangle_size, Radian rectangle_rotation,
+        Vector2& out_normal)
+    {
+        out_normal = Vector2Zero();
+        
+        auto half_size = Vector2Scale(rectangle_size, 0.5f);
+        auto s_pos2 = Vector2Subtract(sphere_pos, rectangle_pos);
+        s_pos2 = Vector2Rotate(s_pos2, -rectangle_rotation.val);
+        auto rotated_dir = Vector2Rotate(s_pos2, -rectangle_rotation.val);
+
+        bool inside_x = true;
+        bool inside_y = true;
+        Vector2 test_point = s_pos2;
+        
+        if (s_pos2.x < -half_size.x) // LEFT
+        {
+            inside_x = false;
+            test_point.x = -half_size.x;
+            out_normal.x = -1.f;
+        } else if (s_pos2.x > half_size.x) // RIGHT
+        {
+            inside_x = false;
+            test_point.x = half_size.x;
+            out_normal.x = 1.f;
+        } 
+
+        if (s_pos2.y > half_size.y) // ABOVE
+        {
+            inside_y = false;
+            test_point.y = half_size.y;
+            out_normal.y = 1.f;
+        } else if (s_pos2.y < -half_size.y) // BELOW
+        {
+            inside_y = false;
+            test_point.y = -half_size.y;
+            out_normal.y = -1.f;
+        } 
+
+        // INSIDE
+        if (inside_y && inside_x)
+        {
+            auto current_t = std::numeric_limits<f32>::max();
+
+            auto back_dir = Vector2Scale(rotated_dir, -1.f);
+            if (!FloatEquals(back_dir.x, 0.f))
+            {
+                auto hit_left_t = (-half_size.x - s_pos2.x) / back_dir.x;
+                if (hit_left_t > 0.f && hit_left_t < current_t)
+                {
+                    out_normal = Vector2 { -1.f, 0.f };
+                    current_t = hit_left_t;
+                }
+                auto hit_right_t = (half_size.x - s_pos2.x) / back_dir.x;
+                if (hit_right_t > 0.f && hit_right_t < current_t)
+                {
+                    out_normal = Vector2 { 1.f, 0.f };
+                    current_t = hit_right_t;
+                }
+            }
+            
+            if (!FloatEquals(back_dir.y, 0.f))
+            {
+                auto hit_up_t = (half_size.y - s_pos2.y) / back_dir.y;
+                if (hit_up_t > 0.f && hit_up_t < current_t)
+                {
+                    out_normal = Vector2 { 0.f, 1.f };
+                    current_t = hit_up_t;
+                }
+                auto hit_below_t = (-half_size.y - s_pos2.y) / back_dir.y;
+                if (hit_below_t > 0.f && hit_below_t < current_t)
+                {
+                    out_normal = Vector2 { 0.f, -1.f };
+                }
+            }
+            
+            // For simplicity just return up vector now if we get inside the rectangle
+            // Ideally this should find the intersection point using the velocity
+            out_normal = Vector2Rotate(out_normal, rectangle_rotation.val);
+            return CollisionResult::Collision;
+        }
+
+        auto normal_dot = Vector2DotProduct(out_normal, rotated_dir);
+        if (normal_dot > 0.0f ||  Vector2DistanceSqr(s_pos2, test_point) > sphere_radius * sphere_radius)
+        {
+            return CollisionResult::NoCollision;
+        }
+
+        out_normal = Vector2Rotate(Vector2Normalize(out_normal), rectangle_rotation.val);
+        return CollisionResult::Collision;
+    }
+
+    // Relative to the size of the coordinates involved. Fixed point rounds to 1/65536 and looks its sines up
+    // in a table, float rounds to 24 bits; both stay far inside this.
+    constexpr f64 COLLISION_CHECK_TOLERANCE = 1e-3;
+    constexpr f32 COLLISION_CHECK_NORMAL_TOLERANCE = 1e-3f;
+
+    struct CollisionOutcome
+    {
+        CollisionResult result;
+        Vector2 normal;
+    };
+
+    woc_internal CollisionOutcome collision_check_reference(CollisionCase& c)
+    {
+        auto outcome = CollisionOutcome{};
+        outcome.result = collision_reference_sphere_collides_rectangle(c.sphere_pos, c.sphere_dir, c.sphere_radius, c.rectangle_pos, c.rectangle_size, c.rectangle_rotation, outcome.normal);
+        return outcome;
+    }
+
+    woc_internal CollisionOutcome collision_check_production(CollisionCase& c)
+    {
+        auto outcome = CollisionOutcome{};
+        outcome.result = sphere_collides_rectangle(c.sphere_pos, c.sphere_dir, c.sphere_radius, c.rectangle_pos, c.rectangle_size, c.rectangle_rotation, outcome.normal);
+        return outcome;
+    }
+
+    woc_internal bool collision_check_agrees(CollisionOutcome a, CollisionOutcome b)
+    {
+        return a.result == b.result
+            && (a.result == CollisionResult::NoCollision || Vector2Distance(a.normal, b.normal) <= COLLISION_CHECK_NORMAL_TOLERANCE);
+    }
+
+    // How far the case is, in world units, from flipping one of the reference's decisions: which side of an edge
+    // the ball is on, which way it heads, whether it touches, and which edge an inside ball left through.
+    // Worked out in doubles from the same formulas.
+    woc_internal bool collision_check_ambiguous(CollisionCase& c)
+    {
+        auto cos = std::cos(static_cast<f64>(c.rectangle_rotation.val));
+        auto sin = std::sin(static_cast<f64>(c.rectangle_rotation.val));
+        auto rx = static_cast<f64>(c.sphere_pos.x) - c.rectangle_pos.x;
+        auto ry = static_cast<f64>(c.sphere_pos.y) - c.rectangle_pos.y;
+        auto sx = rx * cos + ry * sin;
+        auto sy = -rx * sin + ry * cos;
+        auto dx = sx * cos + sy * sin;
+        auto dy = -sx * sin + sy * cos;
+        auto hx = 0.5 * c.rectangle_size.x;
+        auto hy = 0.5 * c.rectangle_size.y;
+        auto scale = 1.0 + std::abs(c.sphere_pos.x) + std::abs(c.sphere_pos.y) + std::abs(c.rectangle_pos.x) + std::abs(c.rectangle_pos.y) + hx + hy;
+        auto tolerance = COLLISION_CHECK_TOLERANCE * scale;
+
+        auto margin = std::min(std::abs(std::abs(sx) - hx), std::abs(std::abs(sy) - hy));
+        if (std::abs(sx) <= hx && std::abs(sy) <= hy)
+        {
+            // Leaving backwards along d: the nearest positive crossing wins, so a near tie can go either way.
+            margin = std::min({ margin, std::abs(dx), std::abs(dy) });
+            auto first_t = std::numeric_limits<f64>::max();
+            auto second_t = std::numeric_limits<f64>::max();
+            auto add = [&first_t, &second_t] (f64 distance, f64 speed)
+            {
+                auto t = speed != 0.0 ? distance / speed : 0.0;
+                if (t > 0.0)
+                {
+                    second_t = std::min(second_t, std::max(first_t, t));
+                    first_t = std::min(first_t, t);
+                }
+            };
+            add(-hx - sx, -dx);
+            add(hx - sx, -dx);
+            add(hy - sy, -dy);
+            add(-hy - sy, -dy);
+            if (second_t != std::numeric_limits<f64>::max())
+            {
+                margin = std::min(margin, (second_t - first_t) * std::sqrt(dx * dx + dy * dy));
+            }
+        } else {
+            auto nx = sx < -hx ? -1.0 : sx > hx ? 1.0 : 0.0;
+            auto ny = sy > hy ? 1.0 : sy < -hy ? -1.0 : 0.0;
+            auto px = std::clamp(sx, -hx, hx);
+            auto py = std::clamp(sy, -hy, hy);
+            auto distance = std::sqrt((sx - px) * (sx - px) + (sy - py) * (sy - py));
+            margin = std::min({ margin, std::abs(nx * dx + ny * dy), std::abs(distance - c.sphere_radius) });
+        }
+        return margin <= tolerance;
+    }
+
+    woc_internal bool collision_check_fails(CollisionCase& c)
+    {
+        return !collision_check_agrees(collision_check_reference(c), collision_check_production(c)) && !collision_check_ambiguous(c);
+    }
+
+    CollisionCase collision_check_generate(u64 seed, u64 index)
+    {
+        auto random = Random { .state = random_hash(seed, index) };
+        auto c = CollisionCase{};
+        c.rectangle_pos = Vector2 { random_f32(random, WORLD_MIN.x, WORLD_MAX.x), random_f32(random, WORLD_MIN.y, WORLD_MAX.y) };
+        c.rectangle_size = Vector2 { random_f32(random, 1.f, 400.f), random_f32(random, 1.f, 100.f) };
+        c.sphere_radius = random_u32(random, 0, 1) ? BALL_DEFAULT_RADIUS : random_f32(random, 0.f, 40.f);
+
+        // Levels are mostly axis aligned or quarter turned, which is also where the edge cases line up.
+        switch (random_u32(random, 0, 3))
+        {
+            case 0:
+                c.rectangle_rotation = Radian { 0.f };
+                break;
+            case 1:
+                c.rectangle_rotation = Radian { static_cast<f32>(random_u32(random, 0, 3)) * PI * 0.5f - PI };
+                break;
+            default:
+                c.rectangle_rotation = Radian { random_f32(random, -PI, PI) };
+                break;
+        }
+
+        auto half = Vector2Scale(c.rectangle_size, 0.5f);
+        auto reach = Vector2AddValue(half, 2.f * c.sphere_radius);
+        auto local = Vector2Zero();
+        auto placement = random_u32(random, 0, 99);
+        if (placement < 30)
+        {
+            local = Vector2 { random_f32(random, -half.x, half.x), random_f32(random, -half.y, half.y) };
+        } else if (placement < 80)
+        {
+            // Close to an edge, from either side.
+            local = Vector2 { random_f32(random, -reach.x, reach.x), random_f32(random, -reach.y, reach.y) };
+            auto& axis = random_u32(random, 0, 1) ? local.x : local.y;
+            auto& extent = &axis == &local.x ? half.x : half.y;
+            axis = (random_u32(random, 0, 1) ? 1.f : -1.f) * (extent + random_f32(random, -c.sphere_radius, c.sphere_radius));
+        } else if (placement < 92)
+        {
+            local = Vector2 { random_f32(random, -2.f * reach.x, 2.f * reach.x), random_f32(random, -2.f * reach.y, 2.f * reach.y) };
+        } else {
+            // Dead center, exactly on a corner or exactly on an edge.
+            auto exact = random_u32(random, 0, 2);
+            local = exact == 0 ? Vector2Zero() : exact == 1 ? half : Vector2 { half.x, 0.f };
+        }
+        c.sphere_pos = Vector2Add(c.rectangle_pos, Vector2Rotate(local, c.rectangle_rotation.val));
+
+        auto angle = random_f32(random, -PI, PI);
+        c.sphere_dir = random_u32(random, 0, 9) == 0 ? Vector2Zero() : Vector2 { std::cos(angle), std::sin(angle) };
+        return c;
+    }
+
+    CollisionCase collision_check_shrink(CollisionCase failing)
+    {
+        constexpr u32 MAX_ROUNDS = 1000;
+        auto round_to = [] (f32 value, f32 step) { return std::round(value / step) * step; };
+
+        bool progress = true;
+        for (u32 round = 0; progress && round < MAX_ROUNDS; round++)
+        {
+            progress = false;
+            auto attempt = [&failing, &progress] (auto change)
+            {
+                auto candidate = failing;
+                change(candidate);
+                if (std::memcmp(&candidate, &failing, sizeof(candidate)) != 0 && collision_check_fails(candidate))
+                {
+                    failing = candidate;
+                    progress = true;
+                }
+            };
+            attempt([] (CollisionCase& c) { c.sphere_pos = Vector2Subtract(c.sphere_pos, c.rectangle_pos); c.rectangle_pos = Vector2Zero(); });
+            attempt([] (CollisionCase& c) { c.rectangle_rotation = Radian { 0.f }; });
+            attempt([&round_to] (CollisionCase& c) { c.rectangle_rotation = Radian { round_to(c.rectangle_rotation.val, PI * 0.5f) }; });
+            attempt([] (CollisionCase& c) { c.sphere_dir = Vector2Zero(); });
+            attempt([] (CollisionCase& c) { c.sphere_radius = BALL_DEFAULT_RADIUS; });
+            for (auto step : { 10.f, 1.f, 0.1f })
+            {
+                attempt([&round_to, step] (CollisionCase& c) { c.rectangle_size = Vector2 { round_to(c.rectangle_size.x, step), round_to(c.rectangle_size.y, step) }; });
+                attempt([&round_to, step] (CollisionCase& c) { c.sphere_pos = Vector2 { round_to(c.sphere_pos.x, step), round_to(c.sphere_pos.y, step) }; });
+                attempt([&round_to, step] (CollisionCase& c) { c.rectangle_pos = Vector2 { round_to(c.rectangle_pos.x, step), round_to(c.rectangle_pos.y, step) }; });
+                attempt([&round_to, step] (CollisionCase& c) { c.sphere_radius = round_to(c.sphere_radius, step); });
+                attempt([&round_to, step] (CollisionCase& c) { c.rectangle_rotation = Radian { round_to(c.rectangle_rotation.val, step) }; });
+            }
+            attempt([] (CollisionCase& c) { c.rectangle_size = Vector2Scale(c.rectangle_size, 0.5f); });
+            attempt([] (CollisionCase& c) { c.sphere_pos = Vector2Lerp(c.rectangle_pos, c.sphere_pos, 0.5f); });
+        }
+        return failing;
+    }
+
+    woc_internal void collision_check_print(std::ostream& out, const char* label, CollisionCase c)
+    {
+        auto reference = collision_check_reference(c);
+        auto production = collision_check_production(c);
+        auto vector = [&out] (Vector2 v) -> std::ostream& { return out << v.x << "," << v.y; };
+        out << std::setprecision(9) << "  " << label << ": sphere pos=";
+        vector(c.sphere_pos) << " dir=";
+        vector(c.sphere_dir) << " radius=" << c.sphere_radius << ", rectangle pos=";
+        vector(c.rectangle_pos) << " size=";
+        vector(c.rectangle_size) << " rot=" << c.rectangle_rotation.val << "\n    reference " << static_cast<u32>(reference.result) << " normal=";
+        vector(reference.normal) << ", production " << static_cast<u32>(production.result) << " normal=";
+        vector(production.normal) << std::defaultfloat << "\n";
+    }
+
+    // Which wall a ball at p would hit first, the way the projectile loop looks for it.
+    struct CollisionHit
+    {
+        u32 enemy;
+        CollisionOutcome outcome;
+    };
+    constexpr u32 COLLISION_CHECK_NO_HIT = std::numeric_limits<u32>::max();
+
+    woc_internal CollisionCase collision_check_case(Projectile& p, EnemyState& e)
+    {
+        return CollisionCase {
+            .sphere_pos = p.pos,
+            .sphere_dir = p.dir,
+            .sphere_radius = BALL_DEFAULT_RADIUS,
+            .rectangle_pos = e.pos,
+            .rectangle_size = e.size,
+            .rectangle_rotation = e.rot
+        };
+    }
+
+    struct CollisionLevelFailure
+    {
+        u32 level;
+        u32 tick;
+        bool culling;
+        CollisionCase c;
+    };
+
+    struct CollisionCheckWorker
+    {
+        u64 ambiguous;
+        u64 mismatches;
+        u64 first_failure;
+        u64 level_tests;
+        u64 level_ambiguous;
+        u64 level_mismatches;
+        std::optional<CollisionLevelFailure> level_failure;
+    };
+
+    // The first hit among walls, or among candidates when culled is set, using either kernel.
+    woc_internal CollisionHit collision_check_first_hit(GameState& game_state, Projectile& p, bool culled, BroadphaseCandidates& candidates, u32 candidate_count, bool production)
+    {
+        auto count = culled ? candidate_count : static_cast<u32>(game_state.enemies.size());
+        for (u32 i = 0; i < count; i++)
+        {
+            auto enemy = culled ? candidates[i] : i;
+            auto c = collision_check_case(p, game_state.enemies.at(enemy));
+            auto outcome = production ? collision_check_production(c) : collision_check_reference(c);
+            if (outcome.result == CollisionResult::Collision)
+            {
+                return CollisionHit { .enemy = enemy, .outcome = outcome };
+            }
+        }
+        return CollisionHit { .enemy = COLLISION_CHECK_NO_HIT, .outcome = CollisionOutcome{} };
+    }
+
+    woc_internal void collision_check_level(u32 level, u64 seed, CollisionCheckWorker& worker)
+    {
+        auto game_state = game_init(level);
+        game_state.player.balls_available = std::max(game_state.player.balls_available, 200u);
+        game_state.player.wind_available = std::max(game_state.player.wind_available, 200u);
+        auto audio_state = AudioState{};
+        audio_state.defer_playback = true;
+        auto bot = soak_bot_init(level, level, random_hash(seed, level));
+        BroadphaseCandidates candidates;
+
+        auto ball_extents = Vector2 { BALL_DEFAULT_RADIUS, BALL_DEFAULT_RADIUS };
+        for (u32 tick = 0; tick < COLLISION_CHECK_LEVEL_TICKS && game_state.level_status == LevelStatus::InProgress; tick++)
+        {
+            auto input = soak_bot_input(bot, game_state);
+            game_update(game_state, input, audio_state, SIMULATION_TICK_SECONDS);
+            audio_state.deferred_sounds.clear();
+
+            for (auto& p : game_state.player_projectiles)
+            {
+                worker.level_tests++;
+                u32 candidate_count = 0;
+                bool culled = broadphase_query(game_state.broadphase, Vector2Subtract(p.pos, ball_extents), Vector2Add(p.pos, ball_extents), candidates, candidate_count);
+                auto full = collision_check_first_hit(game_state, p, false, candidates, candidate_count, false);
+                auto reference = collision_check_first_hit(game_state, p, culled, candidates, candidate_count, false);
+                auto production = collision_check_first_hit(game_state, p, culled, candidates, candidate_count, true);
+
+                // Culling has to be exact: the broadphase may only leave out walls the kernel would have missed.
+                auto failure = std::optional<CollisionLevelFailure>{};
+                if (full.enemy != reference.enemy)
+                {
+                    auto enemy = full.enemy != COLLISION_CHECK_NO_HIT ? full.enemy : reference.enemy;
+                    failure = CollisionLevelFailure { .level = level, .tick = tick, .culling = true, .c = collision_check_case(p, game_state.enemies.at(enemy)) };
+                } else if (reference.enemy != production.enemy || !collision_check_agrees(reference.outcome, production.outcome))
+                {
+                    // A kernel difference only counts when one of the walls involved gives it unambiguously.
+                    for (auto enemy : { reference.enemy, production.enemy })
+                    {
+                        if (enemy == COLLISION_CHECK_NO_HIT)
+                        {
+                            continue;
+                        }
+                        auto c = collision_check_case(p, game_state.enemies.at(enemy));
+                        if (collision_check_fails(c))
+                        {
+                            failure = CollisionLevelFailure { .level = level, .tick = tick, .culling = false, .c = c };
+                            break;
+                        }
+                    }
+                    worker.level_ambiguous += !failure;
+                }
+                if (failure)
+                {
+                    worker.level_mismatches++;
+                    if (!worker.level_failure)
+                    {
+                        worker.level_failure = failure;
+                    }
+                }
+            }
+        }
+    }
+
+    CollisionCheckResult collision_check_run(u64 cases, u64 seed, u32 threads, std::ostream& out)
+    {
+        threads = std::max(threads, 1u);
+        auto levels = std::vector<u32>{};
+        for (u32 level = START_LEVEL; level < ENDLESS_START_LEVEL + COLLISION_CHECK_ENDLESS_LEVELS; level++)
+        {
+            levels.emplace_back(level);
+        }
+
+        auto workers = std::vector<CollisionCheckWorker>(threads, CollisionCheckWorker {
+            .ambiguous = 0,
+            .mismatches = 0,
+            .first_failure = std::numeric_limits<u64>::max(),
+            .level_tests = 0,
+            .level_ambiguous = 0,
+            .level_mismatches = 0,
+            .level_failure = std::nullopt
+        });
+        std::atomic<u32> next_level = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            auto pool = std::vector<std::thread>{};
+            for (u32 t = 0; t < threads; t++)
+            {
+                pool.emplace_back([&, t]
+                {
+                    auto& worker = workers.at(t);
+                    for (auto index = static_cast<u64>(t); index < cases; index += threads)
+                    {
+                        auto c = collision_check_generate(seed, index);
+                        if (collision_check_agrees(collision_check_reference(c), collision_check_production(c)))
+                        {
+                            continue;
+                        }
+                        if (collision_check_ambiguous(c))
+                        {
+                            worker.ambiguous++;
+                            continue;
+                        }
+                        worker.mismatches++;
+                        worker.first_failure = std::min(worker.first_failure, index);
+                    }
+                    for (auto i = next_level.fetch_add(1); i < levels.size(); i = next_level.fetch_add(1))
+                    {
+                        collision_check_level(levels.at(i), seed, worker);
+                    }
+                });
+            }
+            for (auto& thread : pool)
+            {
+                thread.join();
+            }
+        }
+        auto seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+        auto result = CollisionCheckResult { .cases = cases };
+        auto first_failure = std::numeric_limits<u64>::max();
+        auto level_failure = std::optional<CollisionLevelFailure>{};
+        for (auto& worker : workers)
+        {
+            result.ambiguous += worker.ambiguous;
+            result.mismatches += worker.mismatches;
+            result.level_tests += worker.level_tests;
+            result.level_ambiguous += worker.level_ambiguous;
+            result.level_mismatches += worker.level_mismatches;
+            first_failure = std::min(first_failure, worker.first_failure);
+            if (worker.level_failure && (!level_failure || worker.level_failure->level < level_failure->level))
+            {
+                level_failure = worker.level_failure;
+            }
+        }
+
+        out << (WOC_FIXED_POINT_PHYSICS ? "fixed" : "float") << " physics, " << threads << " threads, " << seconds << " s\n";
+        out << "kernel: " << result.cases << " cases, " << result.mismatches << " mismatches, " << result.ambiguous << " ambiguous\n";
+        if (first_failure != std::numeric_limits<u64>::max())
+        {
+            auto c = collision_check_generate(seed, first_failure);
+            out << "case " << first_failure << " of seed " << seed << ":\n";
+            collision_check_print(out, "failing", c);
+            collision_check_print(out, "shrunk", collision_check_shrink(c));
+        }
+        out << "levels: " << levels.size() << " levels, " << result.level_tests << " ball tests, "
+            << result.level_mismatches << " mismatches, " << result.level_ambiguous << " ambiguous\n";
+        if (level_failure)
+        {
+            out << "level " << level_failure->level << " tick " << level_failure->tick
+                << (level_failure->culling ? ", broadphase culled a wall a full scan hits:\n" : ", kernel disagrees:\n");
+            collision_check_print(out, "failing", level_failure->c);
+            if (!level_failure->culling)
+            {
+                collision_check_print(out, "shrunk", collision_check_shrink(level_failure->c));
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+
+namespace woc
+{
+    constexpr u64 COLLISION_CHECK_DEFAULT_CASES = 8'000'000;
+    constexpr u32 COLLISION_CHECK_LEVEL_TICKS = 20'000;
+    constexpr u32 COLLISION_CHECK_ENDLESS_LEVELS = 8;
+
+    // One ball against one wall, as the projectile loop in game_update asks it.
+    struct CollisionCase
+    {
+        Vector2 sphere_pos;
+        Vector2 sphere_dir;
+        f32 sphere_radius;
+        Vector2 rectangle_pos;
+        Vector2 rectangle_size;
+        Radian rectangle_rotation;
+    };
+
+    struct CollisionCheckResult
+    {
+        u64 cases;
+        u64 ambiguous;
+        u64 mismatches;
+        u64 level_tests;
+        u64 level_ambiguous;
+        u64 level_mismatches;
+    };
+    // Pits sphere_collides_rectangle against a preserved copy of the original kernel on random cases, then plays
+    // levels with the soak bot and checks every ball's first hit through the broadphase against a full scan.
+    // Cases closer to a decision boundary than rounding can be trusted with are counted as ambiguous instead,
+    // they only come up when production does its math in another number format. The first mismatch of each
+    // kind is printed shrunk down to a small case.
+    CollisionCheckResult collision_check_run(u64 cases, u64 seed, u32 threads, std::ostream& out);
+    CollisionCase collision_check_generate(u64 seed, u64 index);
+    // Greedily simplifies a failing case for as long as it keeps failing.
+    CollisionCase collision_check_shrink(CollisionCase failing);
+}
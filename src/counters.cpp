@@ -0,0 +1,270 @@
+﻿#include "counters.h"
+
+#include <iomanip>
+#include <new>
+#include <ostream>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace woc
+{
+    // Zero initialized before anything runs, so allocations during static initialization can already count.
+    woc_global CounterRegistry counters_local_registry;
+    woc_global std::atomic<CounterRegistry*> counters_registry = &counters_local_registry;
+    // Which rows a live thread writes. Kept out of the registry, rows keep their index when it's published.
+    woc_global std::array<std::atomic<bool>, COUNTERS_MAX_THREADS> counters_row_taken;
+
+    // Gives the thread's row back when it exits.
+    struct CounterRowClaim
+    {
+        // 0 until the thread first counts, then its row + 1. COUNTERS_MAX_THREADS + 1 is the shared row.
+        u32 row;
+
+        ~CounterRowClaim()
+        {
+            if (row && row <= COUNTERS_MAX_THREADS)
+            {
+                counters_row_taken[row - 1].store(false, std::memory_order_release);
+            }
+            // Anything counted by later thread exit code goes to the shared row, the row may have a new owner.
+            row = COUNTERS_MAX_THREADS + 1;
+        }
+    };
+    woc_global thread_local CounterRowClaim counters_thread_row = {};
+
+    // Lowest row no live thread holds, or the shared row when they're all taken.
+    woc_internal u32 counters_claim_row(CounterRegistry& registry)
+    {
+        for (u32 row = 0; row < COUNTERS_MAX_THREADS; row++)
+        {
+            if (!counters_row_taken[row].exchange(true, std::memory_order_acquire))
+            {
+                auto claimed = registry.rows_claimed.load(std::memory_order_relaxed);
+                while (claimed <= row && !registry.rows_claimed.compare_exchange_weak(claimed, row + 1, std::memory_order_relaxed))
+                {
+                }
+                return row + 1;
+            }
+        }
+        return COUNTERS_MAX_THREADS + 1;
+    }
+
+    void counters_add(Counter counter, u64 amount)
+    {
+        auto index = static_cast<u32>(counter);
+        assert(index < COUNTER_FIRST_GAUGE);
+        auto& registry = *counters_registry.load(std::memory_order_relaxed);
+        auto& row = counters_thread_row.row;
+        if (!row)
+        {
+            row = counters_claim_row(registry);
+        }
+        if (row > COUNTERS_MAX_THREADS)
+        {
+            registry.shared.values[index].fetch_add(amount, std::memory_order_relaxed);
+            return;
+        }
+        // Only this thread writes here, readers see either the old total or the new one.
+        auto& value = registry.rows[row - 1].values[index];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void counters_set(Counter counter, u64 value)
+    {
+        auto index = static_cast<u32>(counter);
+        assert(index >= COUNTER_FIRST_GAUGE && index < COUNTER_COUNT);
+        counters_registry.load(std::memory_order_relaxed)->gauges.values[index].store(value, std::memory_order_relaxed);
+    }
+
+    u64 counters_read(CounterRegistry& registry, Counter counter)
+    {
+        auto index = static_cast<u32>(counter);
+        if (index >= COUNTER_FIRST_GAUGE)
+        {
+            return registry.gauges.values[index].load(std::memory_order_relaxed);
+        }
+        auto total = registry.shared.values[index].load(std::memory_order_relaxed);
+        auto rows = std::min(registry.rows_claimed.load(std::memory_order_relaxed), COUNTERS_MAX_THREADS);
+        for (u32 row = 0; row < rows; row++)
+        {
+            total += registry.rows[row].values[index].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    std::string counters_path(u64 pid)
+    {
+        return "/dev/shm/windsofchange-" + std::to_string(pid) + ".counters";
+    }
+
+#if defined(__linux__)
+    bool counters_publish()
+    {
+        auto local = counters_registry.load(std::memory_order_relaxed);
+        if (local != &counters_local_registry)
+        {
+            return true;
+        }
+
+        auto pid = static_cast<u64>(getpid());
+        auto path = counters_path(pid);
+        auto fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            std::cerr << "Failed to create " << path << "\n";
+            return false;
+        }
+        auto memory = ftruncate(fd, sizeof(CounterRegistry)) == 0
+            ? mmap(nullptr, sizeof(CounterRegistry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+            : MAP_FAILED;
+        close(fd);
+        if (memory == MAP_FAILED)
+        {
+            std::cerr << "Failed to map " << path << "\n";
+            unlink(path.c_str());
+            return false;
+        }
+
+        auto registry = new (memory) CounterRegistry{};
+        registry->version = COUNTERS_VERSION;
+        registry->counter_count = COUNTER_COUNT;
+        registry->max_threads = COUNTERS_MAX_THREADS;
+        registry->pid = pid;
+        for (u32 i = 0; i < COUNTER_COUNT; i++)
+        {
+            std::strncpy(registry->names.at(i).data(), COUNTER_NAMES.at(i), COUNTER_NAME_SIZE - 1);
+        }
+        // Only this thread has counted so far, its row keeps its index in the new registry.
+        auto copy = [] (CounterRow& from, CounterRow& to)
+        {
+            for (u32 i = 0; i < COUNTER_COUNT; i++)
+            {
+                to.values[i].store(from.values[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        };
+        copy(local->gauges, registry->gauges);
+        copy(local->shared, registry->shared);
+        for (u32 row = 0; row < COUNTERS_MAX_THREADS; row++)
+        {
+            copy(local->rows.at(row), registry->rows.at(row));
+        }
+        registry->rows_claimed.store(local->rows_claimed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        registry->is_open.store(1, std::memory_order_relaxed);
+        registry->magic.store(COUNTERS_MAGIC, std::memory_order_release);
+        counters_registry.store(registry, std::memory_order_release);
+        return true;
+    }
+
+    // Best called once every other thread that counts has been joined. One that isn't may still hold the
+    // registry pointer, so the mapping stays until the process exits and only the file goes.
+    void counters_unpublish()
+    {
+        auto registry = counters_registry.load(std::memory_order_relaxed);
+        if (registry == &counters_local_registry)
+        {
+            return;
+        }
+        counters_registry.store(&counters_local_registry, std::memory_order_release);
+        registry->is_open.store(0, std::memory_order_release);
+        unlink(counters_path(registry->pid).c_str());
+    }
+
+    bool counters_watch(u64 pid, f64 interval_seconds, std::ostream& out)
+    {
+        auto path = counters_path(pid);
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "No counters at " << path << ", is the game running as " << pid << "?\n";
+            return false;
+        }
+        struct stat info;
+        auto memory = fstat(fd, &info) == 0 && static_cast<u64>(info.st_size) == sizeof(CounterRegistry)
+            ? mmap(nullptr, sizeof(CounterRegistry), PROT_READ, MAP_SHARED, fd, 0)
+            : MAP_FAILED;
+        close(fd);
+        if (memory == MAP_FAILED)
+        {
+            std::cerr << "Failed to map " << path << ", or it's from a different build\n";
+            return false;
+        }
+        auto& registry = *static_cast<CounterRegistry*>(memory);
+        if (registry.magic.load(std::memory_order_acquire) != COUNTERS_MAGIC
+            || registry.version != COUNTERS_VERSION
+            || registry.counter_count != COUNTER_COUNT
+            || registry.max_threads != COUNTERS_MAX_THREADS)
+        {
+            std::cerr << path << " is from a different build\n";
+            munmap(memory, sizeof(CounterRegistry));
+            return false;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        auto read_all = [&registry]
+        {
+            auto values = std::array<u64, COUNTER_COUNT>{};
+            for (u32 i = 0; i < COUNTER_COUNT; i++)
+            {
+                values.at(i) = counters_read(registry, static_cast<Counter>(i));
+            }
+            return values;
+        };
+        auto start = Clock::now();
+        auto previous_time = start;
+        auto previous = read_all();
+        auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(interval_seconds));
+        while (registry.is_open.load(std::memory_order_acquire) && kill(static_cast<pid_t>(pid), 0) == 0)
+        {
+            std::this_thread::sleep_until(previous_time + interval);
+            auto now = Clock::now();
+            auto current = read_all();
+            auto seconds = std::chrono::duration<f64>(now - previous_time).count();
+            auto frames = static_cast<f64>(current.at(static_cast<u32>(Counter::Frames)) - previous.at(static_cast<u32>(Counter::Frames)));
+
+            out << std::fixed << std::setprecision(1) << std::chrono::duration<f64>(now - start).count() << " s\n";
+            for (u32 i = 0; i < COUNTER_COUNT; i++)
+            {
+                out << "  " << std::left << std::setw(COUNTER_NAME_SIZE) << registry.names.at(i).data() << std::right;
+                if (i >= COUNTER_FIRST_GAUGE)
+                {
+                    out << std::setw(14) << current.at(i) << "\n";
+                    continue;
+                }
+                auto delta = static_cast<f64>(current.at(i) - previous.at(i));
+                out << std::setw(14) << delta / seconds << "/s";
+                if (frames > 0.0 && i != static_cast<u32>(Counter::Frames))
+                {
+                    out << std::setw(14) << delta / frames << "/frame";
+                }
+                out << "\n";
+            }
+            out << std::defaultfloat << std::flush;
+            previous = current;
+            previous_time = now;
+        }
+        munmap(memory, sizeof(CounterRegistry));
+        return true;
+    }
+#else
+    bool counters_publish()
+    {
+        return false;
+    }
+
+    void counters_unpublish()
+    {
+    }
+
+    bool counters_watch(u64 pid, f64 interval_seconds, std::ostream& out)
+    {
+        std::cerr << "Watching counters isn't supported on this platform\n";
+        return false;
+    }
+#endif
+}
@@ -0,0 +1,99 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+#include <string>
+
+namespace woc
+{
+    enum class Counter : u32
+    {
+        // Totals, readers show them as rates.
+        Frames,
+        SimulationTicks,
+        // Sphere against rectangle tests run after the broadphase, and how many of those hit.
+        CollisionTests,
+        CollisionHits,
+        SoundsPlayed,
+        // Shapes submitted to raylib's batcher by the world renderer. rlgl merges them into far fewer GPU draws
+        // and doesn't say how many.
+        DrawCalls,
+        // Chunk files of a streamed level read from disk, and reads the simulation had to wait for.
+        ChunkLoads,
+        ChunkStalls,
+        // Ticks netplay simulated again after a misprediction, and polls that waited on the peer's inputs.
+        RollbackTicks,
+        NetplayStalls,
+        Allocations,
+        AllocatedBytes,
+        // Gauges, readers show the last value set.
+        Projectiles,
+        Enemies,
+        // Walls the world renderer drew last frame, out of Enemies.
+        VisibleWalls,
+        Effects,
+        Particles,
+        // From polling an input change to presenting the first frame that shows it.
+        InputLatencyMicroseconds,
+        Count
+    };
+    constexpr u32 COUNTER_COUNT = static_cast<u32>(Counter::Count);
+    constexpr u32 COUNTER_FIRST_GAUGE = static_cast<u32>(Counter::Projectiles);
+    constexpr u32 COUNTER_NAME_SIZE = 32;
+    constexpr std::array<const char*, COUNTER_COUNT> COUNTER_NAMES = {
+        "frames", "simulation_ticks", "collision_tests", "collision_hits", "sounds_played", "draw_calls",
+        "chunk_loads", "chunk_stalls", "rollback_ticks", "netplay_stalls", "allocations", "allocated_bytes", "projectiles", "enemies", "visible_walls",
+        "effects", "particles", "input_latency_us"
+    };
+
+    constexpr u32 COUNTERS_MAGIC = 0x43434F57; // "WOCC"
+    constexpr u32 COUNTERS_VERSION = 1;
+    // Threads alive past this many share one row and pay for an atomic add. A thread's row goes back to be reused
+    // when it exits.
+    constexpr u32 COUNTERS_MAX_THREADS = 32;
+    constexpr f64 COUNTERS_DEFAULT_WATCH_SECONDS = 1.0;
+
+    // One cache line per writer so threads never share one.
+    struct alignas(64) CounterRow
+    {
+        std::array<std::atomic<u64>, COUNTER_COUNT> values;
+    };
+
+    // Laid out as-is in the published file, which is all a reader in another process or language needs:
+    // check magic and version, read the names, then sum each counter over shared and the claimed rows and read
+    // gauges from their own row. Values are only ever read torn-free, never consistent with each other.
+    struct CounterRegistry
+    {
+        std::atomic<u32> magic;
+        u32 version;
+        u32 counter_count;
+        u32 max_threads;
+        u64 pid;
+        // Cleared when the game exits, the file goes away with it.
+        std::atomic<u32> is_open;
+        // Rows handed out so far. One given back keeps its totals, and the next thread to take it adds to them.
+        std::atomic<u32> rows_claimed;
+        std::array<std::array<char, COUNTER_NAME_SIZE>, COUNTER_COUNT> names;
+        CounterRow gauges;
+        CounterRow shared;
+        std::array<CounterRow, COUNTERS_MAX_THREADS> rows;
+    };
+    static_assert(std::atomic<u64>::is_always_lock_free);
+
+    // Each thread writes its own row with plain relaxed stores, no read-modify-write and no locks. Safe from
+    // any thread at any time, including before main, counts go to an in-process registry until it's published.
+    void counters_add(Counter counter, u64 amount);
+    void counters_set(Counter counter, u64 value);
+    u64 counters_read(CounterRegistry& registry, Counter counter);
+
+    // Maps the registry to counters_path() so other processes can watch it. Call before starting any thread.
+    // False where the platform isn't supported or the file can't be made, counting carries on in-process.
+    bool counters_publish();
+    // Removes the file, counting carries on in-process. Leaves the mapping to the process exit, so threads still
+    // running, like a level stream worker owned by a snapshot, can't write into unmapped memory.
+    void counters_unpublish();
+    std::string counters_path(u64 pid);
+    // Prints rates and gauges of the game running as pid every interval seconds, until it exits.
+    bool counters_watch(u64 pid, f64 interval_seconds, std::ostream& out);
+}
@@ -0,0 +1,767 @@
+﻿#include "editor.h"
+#include "broadphase.h"
+#include "memory.h"
+
+#include <numeric>
+
+namespace woc
+{
+    LevelEditor editor_init()
+    {
+        auto result = LevelEditor {
+            .is_open = false,
+            .game_state = {},
+            .selection = {},
+            .selected = {},
+            .undo = {},
+            .redo = {},
+            .snap = true,
+            .dirty = false,
+            .discard_armed = false,
+            .camera_pos = Vector2Zero(),
+            .camera_zoom = 0.9f,
+            .drag = EditorDrag::None,
+            .drag_start = Vector2Zero(),
+            .drag_offset = Vector2Zero(),
+            .drag_before = {},
+            .drag_anchor = EDITOR_NONE,
+            .placement_size = EDITOR_DEFAULT_WALL_SIZE,
+            .status = {},
+            .status_timer = 0.f,
+            .query = {}
+        };
+        return result;
+    }
+
+    woc_internal void editor_set_status(LevelEditor& editor, std::string status)
+    {
+        editor.status = std::move(status);
+        editor.status_timer = EDITOR_STATUS_SECONDS;
+    }
+
+    bool editor_open(LevelEditor& editor, u32 level, std::string& error)
+    {
+        // A streamed level's walls live in its chunk files, which the editor neither loads nor writes.
+        if (levelfile_exists(level))
+        {
+            auto definition = LevelDefinition{};
+            if (levelfile_load(level, definition, error) && definition.chunk_grid.size > 0.f)
+            {
+                error = levelfile_path(level) + ": streams its walls from chunk files, which the editor can't edit";
+                return false;
+            }
+            error.clear();
+        }
+
+        auto previous_tag = memory_tag_push(MemoryTag::Editor);
+        editor.is_open = true;
+        editor.game_state = game_init(level);
+        editor.selection.clear();
+        editor.selected.assign(editor.game_state.enemies.size(), 0);
+        editor.undo.clear();
+        editor.redo.clear();
+        editor.dirty = false;
+        editor.discard_armed = false;
+        editor.drag = EditorDrag::None;
+        editor_set_status(editor, "editing " + levelfile_path(level));
+        memory_tag_pop(previous_tag);
+        return true;
+    }
+
+    LevelDefinition editor_definition(LevelEditor& editor)
+    {
+        auto& game_state = editor.game_state;
+        return LevelDefinition {
+            .enemies = game_state.enemies,
+            .wind_zones = game_state.wind_zones,
+            .balls_available = game_state.player.balls_available,
+            .wind_available = game_state.player.wind_available,
+            .world_min = game_state.world_min,
+            .world_max = game_state.world_max,
+            .chunk_grid = {}
+        };
+    }
+
+    bool editor_save(LevelEditor& editor, std::string& error)
+    {
+        auto definition = editor_definition(editor);
+        if (!levelfile_save(editor.game_state.current_level, definition, error))
+        {
+            return false;
+        }
+        editor.dirty = false;
+        return true;
+    }
+
+    woc_internal bool editor_enemy_contains(EnemyState& e, Vector2 point)
+    {
+        auto local = Vector2Rotate(Vector2Subtract(point, e.pos), -e.rot.val);
+        return std::abs(local.x) <= e.size.x * 0.5f && std::abs(local.y) <= e.size.y * 0.5f;
+    }
+
+    u32 editor_pick(LevelEditor& editor, Vector2 point)
+    {
+        auto& enemies = editor.game_state.enemies;
+        broadphase_query_all(editor.game_state.broadphase, point, point, editor.query);
+        // Later walls are drawn on top.
+        for (auto it = editor.query.rbegin(); it != editor.query.rend(); it++)
+        {
+            if (editor_enemy_contains(enemies.at(*it), point))
+            {
+                return *it;
+            }
+        }
+        return EDITOR_NONE;
+    }
+
+    woc_internal void editor_clear_selection(LevelEditor& editor)
+    {
+        for (auto i : editor.selection)
+        {
+            editor.selected.at(i) = 0;
+        }
+        editor.selection.clear();
+    }
+
+    woc_internal void editor_set_selection(LevelEditor& editor, std::vector<u32>& indices)
+    {
+        editor_clear_selection(editor);
+        editor.selection = indices;
+        for (auto i : editor.selection)
+        {
+            editor.selected.at(i) = 1;
+        }
+    }
+
+    void editor_select(LevelEditor& editor, u32 enemy, bool toggle)
+    {
+        if (!toggle)
+        {
+            editor_clear_selection(editor);
+        }
+        if (enemy == EDITOR_NONE)
+        {
+            return;
+        }
+        auto it = std::lower_bound(editor.selection.begin(), editor.selection.end(), enemy);
+        if (editor.selected.at(enemy))
+        {
+            editor.selection.erase(it);
+            editor.selected.at(enemy) = 0;
+        } else {
+            editor.selection.insert(it, enemy);
+            editor.selected.at(enemy) = 1;
+        }
+    }
+
+    void editor_select_box(LevelEditor& editor, Vector2 a, Vector2 b, bool add)
+    {
+        auto min = Vector2 { std::min(a.x, b.x), std::min(a.y, b.y) };
+        auto max = Vector2 { std::max(a.x, b.x), std::max(a.y, b.y) };
+        if (!add)
+        {
+            editor_clear_selection(editor);
+        }
+        broadphase_query_all(editor.game_state.broadphase, min, max, editor.query);
+        auto previous_count = editor.selection.size();
+        for (auto i : editor.query)
+        {
+            auto pos = editor.game_state.enemies.at(i).pos;
+            if (pos.x >= min.x && pos.x <= max.x && pos.y >= min.y && pos.y <= max.y && !editor.selected.at(i))
+            {
+                editor.selected.at(i) = 1;
+                editor.selection.emplace_back(i);
+            }
+        }
+        std::inplace_merge(editor.selection.begin(), editor.selection.begin() + static_cast<i64>(previous_count), editor.selection.end());
+    }
+
+    woc_internal void editor_apply(LevelEditor& editor, EditorStep& step)
+    {
+        auto& enemies = editor.game_state.enemies;
+        auto& broadphase = editor.game_state.broadphase;
+        switch (step.type)
+        {
+            case EditorStepType::Modify:
+            {
+                for (u32 k = 0; k < step.indices.size(); k++)
+                {
+                    auto i = step.indices.at(k);
+                    std::swap(enemies.at(i), step.enemies.at(k));
+                    broadphase_move(broadphase, i, enemies.at(i));
+                }
+                break;
+            }
+            case EditorStepType::Insert:
+            {
+                // The indices are where the walls end up, so one merge pass puts them all back.
+                std::vector<EnemyState> merged;
+                merged.reserve(enemies.size() + step.enemies.size());
+                size_t next_old = 0;
+                size_t next_new = 0;
+                for (size_t i = 0; i < enemies.size() + step.enemies.size(); i++)
+                {
+                    if (next_new < step.indices.size() && step.indices.at(next_new) == i)
+                    {
+                        merged.emplace_back(step.enemies.at(next_new++));
+                    } else {
+                        merged.emplace_back(enemies.at(next_old++));
+                    }
+                }
+                enemies = std::move(merged);
+                step.enemies.clear();
+                step.type = EditorStepType::Remove;
+                break;
+            }
+            case EditorStepType::Remove:
+            {
+                step.enemies.clear();
+                size_t next_removed = 0;
+                size_t write = 0;
+                for (size_t i = 0; i < enemies.size(); i++)
+                {
+                    if (next_removed < step.indices.size() && step.indices.at(next_removed) == i)
+                    {
+                        step.enemies.emplace_back(enemies.at(i));
+                        next_removed++;
+                        continue;
+                    }
+                    if (write != i)
+                    {
+                        enemies.at(write) = enemies.at(i);
+                    }
+                    write++;
+                }
+                enemies.resize(write);
+                step.type = EditorStepType::Insert;
+                break;
+            }
+        }
+
+        // Whatever the step touched ends up selected, nothing is when it took walls away.
+        if (step.type != EditorStepType::Modify)
+        {
+            editor.selection.clear();
+            editor.selected.assign(enemies.size(), 0);
+            broadphase_build(broadphase, enemies);
+        }
+        if (step.type == EditorStepType::Insert)
+        {
+            editor_clear_selection(editor);
+        } else {
+            editor_set_selection(editor, step.indices);
+        }
+        editor.dirty = true;
+        editor.discard_armed = false;
+    }
+
+    // step has already been done and holds what reverts it.
+    woc_internal void editor_commit(LevelEditor& editor, EditorStep step)
+    {
+        editor.undo.emplace_back(std::move(step));
+        if (editor.undo.size() > EDITOR_MAX_UNDO_STEPS)
+        {
+            editor.undo.erase(editor.undo.begin());
+        }
+        editor.redo.clear();
+        editor.dirty = true;
+        editor.discard_armed = false;
+    }
+
+    woc_internal EditorStep editor_capture_selection(LevelEditor& editor)
+    {
+        auto result = EditorStep { .type = EditorStepType::Modify, .indices = editor.selection, .enemies = {} };
+        result.enemies.reserve(editor.selection.size());
+        for (auto i : editor.selection)
+        {
+            result.enemies.emplace_back(editor.game_state.enemies.at(i));
+        }
+        return result;
+    }
+
+    // Runs change on every selected wall as one undo step.
+    woc_internal void editor_modify_selection(LevelEditor& editor, auto&& change)
+    {
+        if (editor.selection.empty())
+        {
+            return;
+        }
+        auto step = editor_capture_selection(editor);
+        for (auto i : editor.selection)
+        {
+            auto& e = editor.game_state.enemies.at(i);
+            change(e);
+            // Moving walls are saved at their origin.
+            e.motion.origin = e.pos;
+            broadphase_move(editor.game_state.broadphase, i, e);
+        }
+        editor_commit(editor, std::move(step));
+    }
+
+    void editor_place(LevelEditor& editor, EnemyState enemy)
+    {
+        enemy.motion.origin = enemy.pos;
+        auto step = EditorStep {
+            .type = EditorStepType::Insert,
+            .indices = { static_cast<u32>(editor.game_state.enemies.size()) },
+            .enemies = { enemy }
+        };
+        editor_apply(editor, step);
+        editor_commit(editor, std::move(step));
+    }
+
+    void editor_delete_selection(LevelEditor& editor)
+    {
+        if (editor.selection.empty())
+        {
+            return;
+        }
+        auto step = EditorStep { .type = EditorStepType::Remove, .indices = editor.selection, .enemies = {} };
+        editor_apply(editor, step);
+        editor_commit(editor, std::move(step));
+    }
+
+    void editor_move_selection(LevelEditor& editor, Vector2 offset)
+    {
+        editor_modify_selection(editor, [offset] (EnemyState& e) { e.pos = Vector2Add(e.pos, offset); });
+    }
+
+    bool editor_undo(LevelEditor& editor)
+    {
+        if (editor.undo.empty())
+        {
+            return false;
+        }
+        auto step = std::move(editor.undo.back());
+        editor.undo.pop_back();
+        editor_apply(editor, step);
+        editor.redo.emplace_back(std::move(step));
+        return true;
+    }
+
+    bool editor_redo(LevelEditor& editor)
+    {
+        if (editor.redo.empty())
+        {
+            return false;
+        }
+        auto step = std::move(editor.redo.back());
+        editor.redo.pop_back();
+        editor_apply(editor, step);
+        editor.undo.emplace_back(std::move(step));
+        return true;
+    }
+
+    woc_internal f32 editor_snap(LevelEditor& editor, f32 value, f32 step)
+    {
+        return editor.snap ? std::round(value / step) * step : value;
+    }
+
+    woc_internal Vector2 editor_snap(LevelEditor& editor, Vector2 value)
+    {
+        return Vector2 { editor_snap(editor, value.x, EDITOR_SNAP_DISTANCE), editor_snap(editor, value.y, EDITOR_SNAP_DISTANCE) };
+    }
+
+    woc_internal Camera2D editor_camera(LevelEditor& editor, Vector2 framebuffer_size)
+    {
+        return Camera2D {
+            .offset = Vector2Scale(framebuffer_size, 0.5f),
+            .target = editor.camera_pos,
+            .rotation = 0.f,
+            .zoom = framebuffer_size.y / (WORLD_MAX.y - WORLD_MIN.y) * editor.camera_zoom
+        };
+    }
+
+    woc_internal Vector2 editor_resize_handle(EnemyState& e)
+    {
+        return Vector2Add(e.pos, Vector2Rotate(Vector2Scale(e.size, 0.5f), e.rot.val));
+    }
+
+    woc_internal Vector2 editor_rotate_handle(EnemyState& e, f32 zoom)
+    {
+        auto arm = Vector2 { 0.f, -(e.size.y * 0.5f + EDITOR_ROTATE_HANDLE_DISTANCE / zoom) };
+        return Vector2Add(e.pos, Vector2Rotate(arm, e.rot.val));
+    }
+
+    woc_internal f32 editor_wrap_angle(f32 angle)
+    {
+        return angle - 2.f * PI * std::round(angle / (2.f * PI));
+    }
+
+    woc_internal void editor_switch_level(LevelEditor& editor, i32 step)
+    {
+        auto level = static_cast<i32>(editor.game_state.current_level) + step;
+        if (level < 0)
+        {
+            return;
+        }
+        if (editor.dirty && !editor.discard_armed)
+        {
+            editor.discard_armed = true;
+            editor_set_status(editor, "unsaved changes, switch again to discard them");
+            return;
+        }
+        if (auto error = std::string{}; !editor_open(editor, static_cast<u32>(level), error))
+        {
+            editor_set_status(editor, error);
+        }
+    }
+
+    woc_internal void editor_begin_drag(LevelEditor& editor, EditorDrag drag, Vector2 mouse)
+    {
+        editor.drag = drag;
+        editor.drag_start = mouse;
+        editor.drag_offset = Vector2Zero();
+        if (drag == EditorDrag::Move || drag == EditorDrag::Resize || drag == EditorDrag::Rotate)
+        {
+            editor.drag_before = editor_capture_selection(editor);
+        }
+    }
+
+    woc_internal void editor_update_drag(LevelEditor& editor, Vector2 mouse, f32 zoom)
+    {
+        auto& enemies = editor.game_state.enemies;
+        auto& broadphase = editor.game_state.broadphase;
+        switch (editor.drag)
+        {
+            case EditorDrag::Move:
+            {
+                // The grabbed wall snaps to the grid and the rest keep their place relative to it.
+                auto anchor = std::lower_bound(editor.selection.begin(), editor.selection.end(), editor.drag_anchor) - editor.selection.begin();
+                auto anchor_pos = editor.drag_before.enemies.at(static_cast<size_t>(anchor)).pos;
+                auto target = editor_snap(editor, Vector2Add(anchor_pos, Vector2Subtract(mouse, editor.drag_start)));
+                auto offset = Vector2Subtract(target, anchor_pos);
+                if (Vector2Equals(offset, editor.drag_offset))
+                {
+                    break;
+                }
+                editor.drag_offset = offset;
+                for (u32 k = 0; k < editor.selection.size(); k++)
+                {
+                    auto i = editor.selection.at(k);
+                    auto& e = enemies.at(i);
+                    e.pos = Vector2Add(editor.drag_before.enemies.at(k).pos, offset);
+                    e.motion.origin = e.pos;
+                    broadphase_move(broadphase, i, e);
+                }
+                break;
+            }
+            case EditorDrag::Resize:
+            {
+                // Resizes about the center, so the opposite corner mirrors the handle.
+                auto i = editor.selection.front();
+                auto& e = enemies.at(i);
+                auto local = Vector2Rotate(Vector2Subtract(mouse, e.pos), -e.rot.val);
+                e.size = Vector2 {
+                    std::max(EDITOR_MIN_WALL_SIZE, editor_snap(editor, 2.f * std::abs(local.x), EDITOR_SNAP_DISTANCE)),
+                    std::max(EDITOR_MIN_WALL_SIZE, editor_snap(editor, 2.f * std::abs(local.y), EDITOR_SNAP_DISTANCE))
+                };
+                editor.placement_size = e.size;
+                broadphase_move(broadphase, i, e);
+                break;
+            }
+            case EditorDrag::Rotate:
+            {
+                auto i = editor.selection.front();
+                auto& e = enemies.at(i);
+                auto dir = Vector2Subtract(mouse, e.pos);
+                // The handle sits above the wall, at -y in its own frame.
+                auto angle = std::atan2(dir.y, dir.x) + PI * 0.5f;
+                e.rot = Radian { editor_wrap_angle(editor_snap(editor, angle, EDITOR_SNAP_ANGLE)) };
+                broadphase_move(broadphase, i, e);
+                break;
+            }
+            case EditorDrag::Pan:
+            {
+                editor.camera_pos = Vector2Subtract(editor.camera_pos, Vector2Scale(GetMouseDelta(), 1.f / zoom));
+                break;
+            }
+            case EditorDrag::None:
+            case EditorDrag::Select:
+            {
+                break;
+            }
+        }
+    }
+
+    woc_internal void editor_end_drag(LevelEditor& editor, Vector2 mouse, bool shift)
+    {
+        switch (editor.drag)
+        {
+            case EditorDrag::Select:
+            {
+                if (Vector2Equals(editor.drag_start, mouse))
+                {
+                    if (!shift)
+                    {
+                        editor_clear_selection(editor);
+                    }
+                } else {
+                    editor_select_box(editor, editor.drag_start, mouse, shift);
+                }
+                break;
+            }
+            case EditorDrag::Move:
+            case EditorDrag::Resize:
+            case EditorDrag::Rotate:
+            {
+                bool changed = false;
+                for (u32 k = 0; k < editor.selection.size() && !changed; k++)
+                {
+                    auto& before = editor.drag_before.enemies.at(k);
+                    auto& after = editor.game_state.enemies.at(editor.selection.at(k));
+                    changed = !Vector2Equals(before.pos, after.pos) || !Vector2Equals(before.size, after.size) || before.rot.val != after.rot.val;
+                }
+                if (changed)
+                {
+                    editor_commit(editor, std::move(editor.drag_before));
+                }
+                break;
+            }
+            case EditorDrag::None:
+            case EditorDrag::Pan:
+            {
+                break;
+            }
+        }
+        editor.drag_before = EditorStep{};
+        editor.drag = EditorDrag::None;
+    }
+
+    woc_internal void editor_handle_keys(LevelEditor& editor)
+    {
+        bool ctrl = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+        bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+        if (ctrl)
+        {
+            if (IsKeyPressed(KEY_Z))
+            {
+                bool done = shift ? editor_redo(editor) : editor_undo(editor);
+                editor_set_status(editor, done ? (shift ? "redone" : "undone") : (shift ? "nothing to redo" : "nothing to undo"));
+            }
+            if (IsKeyPressed(KEY_S))
+            {
+                auto error = std::string{};
+                editor_set_status(editor, editor_save(editor, error) ? "saved " + levelfile_path(editor.game_state.current_level) : error);
+            }
+            if (IsKeyPressed(KEY_A))
+            {
+                std::vector<u32> all(editor.game_state.enemies.size());
+                std::iota(all.begin(), all.end(), 0u);
+                editor_set_selection(editor, all);
+            }
+            return;
+        }
+
+        if (IsKeyPressed(KEY_DELETE) || IsKeyPressed(KEY_BACKSPACE))
+        {
+            editor_delete_selection(editor);
+        }
+        if (IsKeyPressed(KEY_Q) || IsKeyPressed(KEY_E))
+        {
+            auto step = IsKeyPressed(KEY_Q) ? -EDITOR_SNAP_ANGLE : EDITOR_SNAP_ANGLE;
+            editor_modify_selection(editor, [&editor, step] (EnemyState& e)
+            {
+                e.rot = Radian { editor_wrap_angle(editor_snap(editor, e.rot.val + step, EDITOR_SNAP_ANGLE)) };
+            });
+        }
+        if (IsKeyPressed(KEY_T))
+        {
+            editor_modify_selection(editor, [] (EnemyState& e)
+            {
+                e.type = e.type == EnemyType::Normal ? EnemyType::Indestructible : EnemyType::Normal;
+                e.contributes_to_win = e.type == EnemyType::Normal;
+                e.health = std::max(e.health, 1);
+            });
+        }
+        constexpr std::array<KeyboardKey, 4> HEALTH_KEYS = { KEY_ONE, KEY_TWO, KEY_THREE, KEY_FOUR };
+        for (u32 i = 0; i < HEALTH_KEYS.size(); i++)
+        {
+            if (IsKeyPressed(HEALTH_KEYS.at(i)))
+            {
+                editor_modify_selection(editor, [i] (EnemyState& e) { e.health = static_cast<i32>(i + 1); });
+            }
+        }
+        if (IsKeyPressed(KEY_G))
+        {
+            editor.snap = !editor.snap;
+            editor_set_status(editor, editor.snap ? "snapping on" : "snapping off");
+        }
+        if (IsKeyPressed(KEY_LEFT_BRACKET) || IsKeyPressed(KEY_RIGHT_BRACKET))
+        {
+            editor_switch_level(editor, IsKeyPressed(KEY_LEFT_BRACKET) ? -1 : 1);
+        }
+    }
+
+    woc_internal void editor_draw_outline(EnemyState& e, f32 thickness, Color color)
+    {
+        auto half = Vector2Scale(e.size, 0.5f);
+        auto corners = std::array<Vector2, 4> {
+            Vector2 { -half.x, -half.y },
+            Vector2 { half.x, -half.y },
+            Vector2 { half.x, half.y },
+            Vector2 { -half.x, half.y }
+        };
+        for (auto& corner : corners)
+        {
+            corner = Vector2Add(e.pos, Vector2Rotate(corner, e.rot.val));
+        }
+        for (u32 i = 0; i < corners.size(); i++)
+        {
+            DrawLineEx(corners.at(i), corners.at((i + 1) % corners.size()), thickness, color);
+        }
+    }
+
+    void renderer_update_and_render_editor(Renderer& renderer, LevelEditor& editor, Vector2 framebuffer_size, f32 frame_seconds)
+    {
+        // Edits, selection and undo history all grow from here.
+        auto previous_tag = memory_tag_push(MemoryTag::Editor);
+        auto& enemies = editor.game_state.enemies;
+        auto mouse_screen = GetMousePosition();
+        auto camera = editor_camera(editor, framebuffer_size);
+
+        // Zooms about the cursor, keeping the point under it in place.
+        if (auto wheel = GetMouseWheelMove(); wheel != 0.f && editor.drag == EditorDrag::None)
+        {
+            auto before = GetScreenToWorld2D(mouse_screen, camera);
+            editor.camera_zoom = Clamp(editor.camera_zoom * std::pow(1.15f, wheel), EDITOR_MIN_ZOOM, EDITOR_MAX_ZOOM);
+            camera = editor_camera(editor, framebuffer_size);
+            editor.camera_pos = Vector2Add(editor.camera_pos, Vector2Subtract(before, GetScreenToWorld2D(mouse_screen, camera)));
+            camera = editor_camera(editor, framebuffer_size);
+        }
+        auto mouse = GetScreenToWorld2D(mouse_screen, camera);
+        auto handle_radius = EDITOR_HANDLE_RADIUS / camera.zoom;
+        bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+        bool single = editor.selection.size() == 1;
+
+        if (editor.drag == EditorDrag::None)
+        {
+            if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+            {
+                auto hovered = editor_pick(editor, mouse);
+                if (single && Vector2Distance(mouse, editor_resize_handle(enemies.at(editor.selection.front()))) <= handle_radius)
+                {
+                    editor_begin_drag(editor, EditorDrag::Resize, mouse);
+                } else if (single && Vector2Distance(mouse, editor_rotate_handle(enemies.at(editor.selection.front()), camera.zoom)) <= handle_radius)
+                {
+                    editor_begin_drag(editor, EditorDrag::Rotate, mouse);
+                } else if (hovered != EDITOR_NONE && shift)
+                {
+                    editor_select(editor, hovered, true);
+                } else if (hovered != EDITOR_NONE)
+                {
+                    if (!editor.selected.at(hovered))
+                    {
+                        editor_select(editor, hovered, false);
+                    }
+                    editor.drag_anchor = hovered;
+                    editor_begin_drag(editor, EditorDrag::Move, mouse);
+                } else {
+                    editor_begin_drag(editor, EditorDrag::Select, mouse);
+                }
+            } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+            {
+                editor_place(editor, EnemyState {
+                    .pos = editor_snap(editor, mouse),
+                    .size = editor.placement_size,
+                    .health = 1,
+                    .rot = Radian { 0.f },
+                    .type = shift ? EnemyType::Indestructible : EnemyType::Normal,
+                    .contributes_to_win = !shift,
+                    .motion = {},
+                    .level_index = 0
+                });
+            } else if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE))
+            {
+                editor_begin_drag(editor, EditorDrag::Pan, mouse);
+            } else {
+                editor_handle_keys(editor);
+            }
+        } else {
+            editor_update_drag(editor, mouse, camera.zoom);
+            auto button = editor.drag == EditorDrag::Pan ? MOUSE_BUTTON_MIDDLE : MOUSE_BUTTON_LEFT;
+            if (IsMouseButtonReleased(button))
+            {
+                editor_end_drag(editor, mouse, shift);
+            }
+        }
+        auto hovered = editor.drag == EditorDrag::None ? editor_pick(editor, mouse) : EDITOR_NONE;
+
+        BeginMode2D(camera);
+        auto view_min = GetScreenToWorld2D(Vector2Zero(), camera);
+        auto view_max = GetScreenToWorld2D(framebuffer_size, camera);
+        auto line_width = 1.f / camera.zoom;
+
+        // Skipped once the lines would be closer than a few pixels.
+        constexpr f32 MIN_GRID_PIXELS = 6.f;
+        if (editor.snap && EDITOR_SNAP_DISTANCE * camera.zoom >= MIN_GRID_PIXELS)
+        {
+            for (auto x = std::floor(view_min.x / EDITOR_SNAP_DISTANCE) * EDITOR_SNAP_DISTANCE; x <= view_max.x; x += EDITOR_SNAP_DISTANCE)
+            {
+                DrawLineEx(Vector2 { x, view_min.y }, Vector2 { x, view_max.y }, line_width, EDITOR_GRID_COLOR);
+            }
+            for (auto y = std::floor(view_min.y / EDITOR_SNAP_DISTANCE) * EDITOR_SNAP_DISTANCE; y <= view_max.y; y += EDITOR_SNAP_DISTANCE)
+            {
+                DrawLineEx(Vector2 { view_min.x, y }, Vector2 { view_max.x, y }, line_width, EDITOR_GRID_COLOR);
+            }
+        }
+        auto& world_min = editor.game_state.world_min;
+        auto& world_max = editor.game_state.world_max;
+        auto world_rect = Rectangle { world_min.x, world_min.y, world_max.x - world_min.x, world_max.y - world_min.y };
+        DrawRectangleLinesEx(world_rect, 2.f * line_width, WALL_COLOR);
+        for (auto& zone : editor.game_state.wind_zones)
+        {
+            DrawRectangleV(Vector2Subtract(zone.pos, Vector2Scale(zone.size, 0.5f)), zone.size, EDITOR_ZONE_COLOR);
+        }
+        auto player_half_size = Vector2Scale(player_size(), 0.5f);
+        DrawRectangleV(Vector2 { -player_half_size.x, PLAYER_WORLD_Y - player_half_size.y }, player_size(), PLAYER_COLOR);
+
+        broadphase_query_all(editor.game_state.broadphase, view_min, view_max, editor.query);
+        for (auto i : editor.query)
+        {
+            renderer_draw_enemy(enemies.at(i));
+        }
+        for (auto i : editor.selection)
+        {
+            editor_draw_outline(enemies.at(i), 2.f * line_width, EDITOR_SELECTION_COLOR);
+        }
+        if (hovered != EDITOR_NONE)
+        {
+            editor_draw_outline(enemies.at(hovered), line_width, EDITOR_HOVER_COLOR);
+        }
+        if (editor.selection.size() == 1)
+        {
+            auto& e = enemies.at(editor.selection.front());
+            auto rotate_handle = editor_rotate_handle(e, camera.zoom);
+            DrawLineEx(Vector2Add(e.pos, Vector2Rotate(Vector2 { 0.f, -e.size.y * 0.5f }, e.rot.val)), rotate_handle, line_width, EDITOR_SELECTION_COLOR);
+            DrawCircleV(rotate_handle, handle_radius, EDITOR_SELECTION_COLOR);
+            DrawCircleV(editor_resize_handle(e), handle_radius, EDITOR_SELECTION_COLOR);
+        }
+        if (editor.drag == EditorDrag::Select)
+        {
+            auto min = Vector2 { std::min(editor.drag_start.x, mouse.x), std::min(editor.drag_start.y, mouse.y) };
+            auto max = Vector2 { std::max(editor.drag_start.x, mouse.x), std::max(editor.drag_start.y, mouse.y) };
+            auto box = Rectangle { min.x, min.y, max.x - min.x, max.y - min.y };
+            DrawRectangleRec(box, Fade(EDITOR_SELECTION_COLOR, 0.15f));
+            DrawRectangleLinesEx(box, line_width, EDITOR_SELECTION_COLOR);
+        }
+        EndMode2D();
+
+        constexpr i32 TEXT_SIZE = 20;
+        constexpr i32 MARGIN = 20;
+        auto summary = "LEVEL " + std::to_string(editor.game_state.current_level) + (editor.dirty ? "*" : "")
+            + "   " + std::to_string(enemies.size()) + " walls, " + std::to_string(editor.selection.size()) + " selected"
+            + "   snap " + (editor.snap ? "on" : "off");
+        DrawText(summary.c_str(), MARGIN, MARGIN, TEXT_SIZE, WALL_COLOR);
+        DrawText("LMB select/drag  SHIFT add  RMB place  MMB pan  WHEEL zoom  Q/E rotate  T type  1-4 health  DEL delete",
+            MARGIN, static_cast<i32>(framebuffer_size.y) - 2 * (TEXT_SIZE + MARGIN / 2), TEXT_SIZE, WALL_COLOR);
+        DrawText("CTRL+Z undo  CTRL+SHIFT+Z redo  CTRL+A all  CTRL+S save  G snap  [ ] level  ESC menu",
+            MARGIN, static_cast<i32>(framebuffer_size.y) - (TEXT_SIZE + MARGIN / 2), TEXT_SIZE, WALL_COLOR);
+        editor.status_timer = std::max(0.f, editor.status_timer - frame_seconds);
+        if (editor.status_timer > 0.f)
+        {
+            DrawText(editor.status.c_str(), MARGIN, MARGIN + TEXT_SIZE + MARGIN / 2, TEXT_SIZE, Fade(WALL_COLOR, std::min(1.f, editor.status_timer)));
+        }
+        memory_tag_pop(previous_tag);
+    }
+}
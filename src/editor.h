@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+#include "levelfile.h"
+
+#include <string>
+
+namespace woc
+{
+    // Snapping rounds positions and sizes to EDITOR_SNAP_DISTANCE and angles to EDITOR_SNAP_ANGLE.
+    constexpr f32 EDITOR_SNAP_DISTANCE = 25.f;
+    constexpr f32 EDITOR_SNAP_ANGLE = PI / 12.f;
+    constexpr f32 EDITOR_MIN_WALL_SIZE = 5.f;
+    constexpr Vector2 EDITOR_DEFAULT_WALL_SIZE = Vector2 { 100.f, 25.f };
+    constexpr u32 EDITOR_MAX_UNDO_STEPS = 256;
+    constexpr u32 EDITOR_NONE = std::numeric_limits<u32>::max();
+    // In screen pixels, so handles stay grabbable at any zoom.
+    constexpr f32 EDITOR_HANDLE_RADIUS = 7.f;
+    constexpr f32 EDITOR_ROTATE_HANDLE_DISTANCE = 30.f;
+    constexpr f32 EDITOR_MIN_ZOOM = 0.1f;
+    constexpr f32 EDITOR_MAX_ZOOM = 20.f;
+    constexpr f32 EDITOR_STATUS_SECONDS = 3.f;
+    constexpr Color EDITOR_SELECTION_COLOR = Color { 0xF2, 0x9E, 0x2E, 0xFF };
+    constexpr Color EDITOR_HOVER_COLOR = Color { 0xFF, 0xFF, 0xFF, 0xC0 };
+    constexpr Color EDITOR_GRID_COLOR = Color { 0x4F, 0x4D, 0x70, 0x30 };
+    constexpr Color EDITOR_ZONE_COLOR = Color { 0x52, 0x82, 0x7D, 0x30 };
+
+    // An undo step holds what to put back. Modify swaps its walls in at their indices, Insert puts its walls
+    // back at their ascending indices and Remove takes the walls at its indices out. Applying a step turns it
+    // into the step that reverts it, which is what redo replays.
+    enum class EditorStepType
+    {
+        Modify,
+        Insert,
+        Remove
+    };
+    struct EditorStep
+    {
+        EditorStepType type;
+        std::vector<u32> indices;
+        std::vector<EnemyState> enemies;
+    };
+
+    enum class EditorDrag
+    {
+        None,
+        Select,
+        Move,
+        Resize,
+        Rotate,
+        Pan
+    };
+
+    // Edits one level's walls in place. Picking, box selection and culling all go through
+    // game_state.broadphase, so with tens of thousands of walls none of them scan every wall.
+    struct LevelEditor
+    {
+        bool is_open;
+        GameState game_state;
+        // Sorted, with a flag per wall for constant time lookups.
+        std::vector<u32> selection;
+        std::vector<u8> selected;
+        std::vector<EditorStep> undo;
+        std::vector<EditorStep> redo;
+        bool snap;
+        bool dirty;
+        // Set by a level switch that would lose unsaved changes, the next one goes ahead.
+        bool discard_armed;
+        Vector2 camera_pos;
+        f32 camera_zoom;
+        EditorDrag drag;
+        Vector2 drag_start;
+        Vector2 drag_offset;
+        // The selection as it was when the drag started, committed as the undo step when it ends.
+        EditorStep drag_before;
+        u32 drag_anchor;
+        Vector2 placement_size;
+        std::string status;
+        f32 status_timer;
+        std::vector<u32> query;
+    };
+    LevelEditor editor_init();
+    // Starts over on level, from its file or the generator like game_init. Refuses streamed levels and leaves the
+    // editor as it was.
+    bool editor_open(LevelEditor& editor, u32 level, std::string& error);
+    LevelDefinition editor_definition(LevelEditor& editor);
+    // Writes the level file, which the level watcher then reloads into a running game of the same level.
+    bool editor_save(LevelEditor& editor, std::string& error);
+    // The topmost wall under point, or EDITOR_NONE.
+    u32 editor_pick(LevelEditor& editor, Vector2 point);
+    // Selects enemy alone, or adds or removes it from the selection when toggle is set. EDITOR_NONE clears it.
+    void editor_select(LevelEditor& editor, u32 enemy, bool toggle);
+    // Selects the walls whose centers lie in the box spanned by a and b, on top of the current selection if add is set.
+    void editor_select_box(LevelEditor& editor, Vector2 a, Vector2 b, bool add);
+    void editor_place(LevelEditor& editor, EnemyState enemy);
+    void editor_delete_selection(LevelEditor& editor);
+    void editor_move_selection(LevelEditor& editor, Vector2 offset);
+    bool editor_undo(LevelEditor& editor);
+    bool editor_redo(LevelEditor& editor);
+    void renderer_update_and_render_editor(Renderer& renderer, LevelEditor& editor, Vector2 framebuffer_size, f32 frame_seconds);
+}
@@ -0,0 +1,174 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+namespace woc
+{
+    // Q16.16. Only integer arithmetic, so results are bit-identical on every compiler, target and float setting.
+    constexpr i32 FIXED_FRACTION_BITS = 16;
+    constexpr i32 FIXED_ONE = 1 << FIXED_FRACTION_BITS;
+    // Sine table resolution, linearly interpolated. Worst case error is about a third of one Q16.16 step.
+    constexpr u32 FIXED_QUARTER_TURN_STEPS = 256;
+    constexpr u32 FIXED_TURN_STEPS = FIXED_QUARTER_TURN_STEPS * 4;
+
+    struct Fixed
+    {
+        i32 raw;
+    };
+
+    struct FixedVector2
+    {
+        Fixed x;
+        Fixed y;
+    };
+
+    // f32 <-> fixed conversions are exact scalings by a power of two plus one IEEE rounding, so they are
+    // as deterministic as the integer math in between. Anything past +-32768 doesn't fit in the i32, which is
+    // why physics_fits keeps worlds to FIXED_POINT_MAX_COORDINATE.
+    constexpr Fixed fixed_from_f32(f32 value)
+    {
+        assert(value > -32768.f && value < 32768.f);
+        return Fixed { static_cast<i32>(value * static_cast<f32>(FIXED_ONE)) };
+    }
+
+    constexpr f32 fixed_to_f32(Fixed value)
+    {
+        return static_cast<f32>(value.raw) / static_cast<f32>(FIXED_ONE);
+    }
+
+    constexpr FixedVector2 fixed_from_vector2(Vector2 value)
+    {
+        return FixedVector2 { fixed_from_f32(value.x), fixed_from_f32(value.y) };
+    }
+
+    constexpr Vector2 fixed_to_vector2(FixedVector2 value)
+    {
+        return Vector2 { fixed_to_f32(value.x), fixed_to_f32(value.y) };
+    }
+
+    constexpr Fixed operator+(Fixed a, Fixed b) { return Fixed { a.raw + b.raw }; }
+    constexpr Fixed operator-(Fixed a, Fixed b) { return Fixed { a.raw - b.raw }; }
+    constexpr Fixed operator-(Fixed a) { return Fixed { -a.raw }; }
+    constexpr Fixed operator*(Fixed a, Fixed b) { return Fixed { static_cast<i32>((static_cast<i64>(a.raw) * b.raw) >> FIXED_FRACTION_BITS) }; }
+    constexpr Fixed operator/(Fixed a, Fixed b) { return Fixed { static_cast<i32>((static_cast<i64>(a.raw) << FIXED_FRACTION_BITS) / b.raw) }; }
+    constexpr bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+    constexpr bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+
+    constexpr FixedVector2 operator+(FixedVector2 a, FixedVector2 b) { return FixedVector2 { a.x + b.x, a.y + b.y }; }
+    constexpr FixedVector2 operator-(FixedVector2 a, FixedVector2 b) { return FixedVector2 { a.x - b.x, a.y - b.y }; }
+    constexpr FixedVector2 operator*(FixedVector2 a, Fixed b) { return FixedVector2 { a.x * b, a.y * b }; }
+
+    constexpr Fixed fixed_dot(FixedVector2 a, FixedVector2 b)
+    {
+        // Sum the wide products before shifting so the result doesn't depend on evaluation order.
+        return Fixed { static_cast<i32>((static_cast<i64>(a.x.raw) * b.x.raw + static_cast<i64>(a.y.raw) * b.y.raw) >> FIXED_FRACTION_BITS) };
+    }
+
+    constexpr u64 fixed_isqrt(u64 value)
+    {
+        u64 result = 0;
+        u64 bit = 1ull << 62;
+        while (bit > value)
+        {
+            bit >>= 2;
+        }
+        while (bit)
+        {
+            if (value >= result + bit)
+            {
+                value -= result + bit;
+                result = (result >> 1) + bit;
+            } else {
+                result >>= 1;
+            }
+            bit >>= 2;
+        }
+        return result;
+    }
+
+    constexpr FixedVector2 fixed_normalize(FixedVector2 value)
+    {
+        auto length_sqr = static_cast<u64>(static_cast<i64>(value.x.raw) * value.x.raw + static_cast<i64>(value.y.raw) * value.y.raw);
+        auto length = Fixed { static_cast<i32>(fixed_isqrt(length_sqr)) };
+        return length.raw ? FixedVector2 { value.x / length, value.y / length } : value;
+    }
+
+    // Built at compile time from a Taylor series in double over a quarter turn, then mirrored out to a full turn
+    // plus one wrap-around entry. Constant folding only uses correctly rounded + - * /, so every compiler
+    // produces the same table.
+    constexpr std::array<i32, FIXED_TURN_STEPS + 1> fixed_build_sine_table()
+    {
+        constexpr f64 HALF_PI = 1.57079632679489661923;
+        std::array<i32, FIXED_TURN_STEPS + 1> result{};
+        for (u32 i = 0; i <= FIXED_QUARTER_TURN_STEPS; i++)
+        {
+            f64 x = HALF_PI * static_cast<f64>(i) / static_cast<f64>(FIXED_QUARTER_TURN_STEPS);
+            f64 term = x;
+            f64 sum = x;
+            for (i32 n = 1; n < 12; n++)
+            {
+                term *= -x * x / static_cast<f64>((2 * n) * (2 * n + 1));
+                sum += term;
+            }
+            result.at(i) = static_cast<i32>(sum * FIXED_ONE + 0.5);
+        }
+        for (u32 i = FIXED_QUARTER_TURN_STEPS + 1; i <= FIXED_TURN_STEPS; i++)
+        {
+            result.at(i) = i <= 2 * FIXED_QUARTER_TURN_STEPS
+                ? result.at(2 * FIXED_QUARTER_TURN_STEPS - i)
+                : -result.at(i - 2 * FIXED_QUARTER_TURN_STEPS);
+        }
+        return result;
+    }
+    inline constexpr auto FIXED_SINE_TABLE = fixed_build_sine_table();
+
+    // Position on the table in steps, with 16 fractional bits, wrapped to one turn.
+    constexpr u32 fixed_angle_to_steps(Fixed angle)
+    {
+        // FIXED_TURN_STEPS / 2pi in Q16.16.
+        constexpr i64 STEPS_PER_RADIAN = 10680707;
+        constexpr u32 TURN_MASK = (FIXED_TURN_STEPS << FIXED_FRACTION_BITS) - 1;
+        return static_cast<u32>((static_cast<i64>(angle.raw) * STEPS_PER_RADIAN) >> FIXED_FRACTION_BITS) & TURN_MASK;
+    }
+
+    constexpr Fixed fixed_sine_from_steps(u32 steps)
+    {
+        constexpr u32 TURN_MASK = (FIXED_TURN_STEPS << FIXED_FRACTION_BITS) - 1;
+        steps &= TURN_MASK;
+        auto step = steps >> FIXED_FRACTION_BITS;
+        auto fraction = static_cast<i64>(steps & (FIXED_ONE - 1));
+        auto a = FIXED_SINE_TABLE[step];
+        auto b = FIXED_SINE_TABLE[step + 1];
+        return Fixed { a + static_cast<i32>(((b - a) * fraction) >> FIXED_FRACTION_BITS) };
+    }
+
+    constexpr Fixed fixed_sin(Fixed angle)
+    {
+        return fixed_sine_from_steps(fixed_angle_to_steps(angle));
+    }
+
+    constexpr Fixed fixed_cos(Fixed angle)
+    {
+        return fixed_sine_from_steps(fixed_angle_to_steps(angle) + (FIXED_QUARTER_TURN_STEPS << FIXED_FRACTION_BITS));
+    }
+
+    constexpr FixedVector2 fixed_rotate(FixedVector2 value, Fixed angle)
+    {
+        auto steps = fixed_angle_to_steps(angle);
+        auto c = fixed_sine_from_steps(steps + (FIXED_QUARTER_TURN_STEPS << FIXED_FRACTION_BITS));
+        auto s = fixed_sine_from_steps(steps);
+        return FixedVector2 {
+            Fixed { static_cast<i32>((static_cast<i64>(value.x.raw) * c.raw - static_cast<i64>(value.y.raw) * s.raw) >> FIXED_FRACTION_BITS) },
+            Fixed { static_cast<i32>((static_cast<i64>(value.x.raw) * s.raw + static_cast<i64>(value.y.raw) * c.raw) >> FIXED_FRACTION_BITS) }
+        };
+    }
+
+    constexpr FixedVector2 fixed_reflect(FixedVector2 value, FixedVector2 normal)
+    {
+        auto twice_dot = fixed_dot(value, normal) * Fixed { 2 * FIXED_ONE };
+        return value - normal * twice_dot;
+    }
+
+    static_assert(fixed_sin(Fixed { 0 }).raw == 0);
+    static_assert(fixed_cos(Fixed { 0 }).raw == FIXED_ONE);
+}
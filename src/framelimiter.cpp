@@ -0,0 +1,182 @@
+﻿#include "framelimiter.h"
+
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+
+namespace woc
+{
+    using FrameClock = std::chrono::steady_clock;
+
+    woc_internal FrameClock::duration frame_limiter_duration(f64 seconds)
+    {
+        return std::chrono::duration_cast<FrameClock::duration>(std::chrono::duration<f64>(seconds));
+    }
+
+    FrameLimiter frame_limiter_init(FrameLimiterMode mode, f64 fps)
+    {
+        if (fps <= 0.0)
+        {
+            fps = static_cast<f64>(GetMonitorRefreshRate(GetCurrentMonitor()));
+        }
+        if (fps <= 0.0)
+        {
+            fps = FRAME_LIMITER_DEFAULT_FPS;
+        }
+        return FrameLimiter {
+            .mode = mode,
+            .target_seconds = 1.0 / fps,
+            .divisor = 1,
+            .deadline = FrameClock::now(),
+            .last_present = FrameClock::now(),
+            .has_last_present = false,
+            .spin_seconds = FRAME_LIMITER_MAX_SPIN_SECONDS,
+            .work_seconds = 0.0,
+            .work_seconds_average = 0.0,
+            .raise_timer = 0.0,
+            .stats = FramePacingStats {
+                .frames = 0,
+                .interval_mean = 0.0,
+                .interval_m2 = 0.0,
+                .interval_min = std::numeric_limits<f64>::max(),
+                .interval_max = 0.0,
+                .waits = 0,
+                .wake_error_total = 0.0,
+                .wake_error_max = 0.0,
+                .late_frames = 0
+            }
+        };
+    }
+
+    f64 frame_limiter_interval(FrameLimiter& limiter)
+    {
+        return limiter.target_seconds * limiter.divisor;
+    }
+
+    woc_internal void frame_limiter_adapt(FrameLimiter& limiter)
+    {
+        constexpr f64 AVERAGE_WEIGHT = 0.1;
+        // Slower when the average no longer fits with a little room, faster only when it would fit easily.
+        constexpr f64 OVER_BUDGET = 0.95;
+        constexpr f64 UNDER_BUDGET = 0.75;
+        limiter.work_seconds_average += (limiter.work_seconds - limiter.work_seconds_average) * AVERAGE_WEIGHT;
+        auto interval = frame_limiter_interval(limiter);
+        if (limiter.work_seconds_average > interval * OVER_BUDGET && limiter.divisor < FRAME_LIMITER_MAX_DIVISOR)
+        {
+            limiter.divisor++;
+            limiter.raise_timer = 0.0;
+            return;
+        }
+        auto faster_interval = limiter.target_seconds * (limiter.divisor - 1);
+        bool would_fit = limiter.divisor > 1 && limiter.work_seconds_average < faster_interval * UNDER_BUDGET;
+        limiter.raise_timer = would_fit ? limiter.raise_timer + interval : 0.0;
+        if (limiter.raise_timer > FRAME_LIMITER_RAISE_SECONDS)
+        {
+            limiter.divisor--;
+            limiter.raise_timer = 0.0;
+        }
+    }
+
+    void frame_limiter_wait(FrameLimiter& limiter)
+    {
+        auto now = FrameClock::now();
+        if (limiter.has_last_present)
+        {
+            limiter.work_seconds = std::chrono::duration<f64>(now - limiter.last_present).count();
+        }
+        if (limiter.mode == FrameLimiterMode::Off)
+        {
+            return;
+        }
+        if (limiter.mode == FrameLimiterMode::Adaptive && limiter.has_last_present)
+        {
+            frame_limiter_adapt(limiter);
+        }
+
+        auto interval = frame_limiter_duration(frame_limiter_interval(limiter));
+        limiter.deadline += interval;
+        // More than a frame behind, after a hitch or a skipped stretch. Start over from now instead of rushing
+        // out frames to catch up.
+        if (now > limiter.deadline + interval || !limiter.has_last_present)
+        {
+            limiter.deadline = now;
+            return;
+        }
+        if (now >= limiter.deadline)
+        {
+            limiter.stats.late_frames++;
+            return;
+        }
+
+        auto sleep_until = limiter.deadline - frame_limiter_duration(limiter.spin_seconds);
+        if (now < sleep_until)
+        {
+            std::this_thread::sleep_until(sleep_until);
+            // The margin tracks the worst recent oversleep, decaying so one bad wake doesn't spin forever.
+            constexpr f64 DECAY = 0.99;
+            constexpr f64 HEADROOM = 1.5;
+            auto overslept = std::chrono::duration<f64>(FrameClock::now() - sleep_until).count();
+            limiter.spin_seconds = std::clamp(std::max(limiter.spin_seconds * DECAY, overslept * HEADROOM), FRAME_LIMITER_MIN_SPIN_SECONDS, FRAME_LIMITER_MAX_SPIN_SECONDS);
+        }
+        while (FrameClock::now() < limiter.deadline)
+        {
+            // Spin, a yield here could hand the core away for a whole time slice.
+        }
+
+        auto wake_error = std::chrono::duration<f64>(FrameClock::now() - limiter.deadline).count();
+        limiter.stats.waits++;
+        limiter.stats.wake_error_total += wake_error;
+        limiter.stats.wake_error_max = std::max(limiter.stats.wake_error_max, wake_error);
+    }
+
+    void frame_limiter_presented(FrameLimiter& limiter)
+    {
+        auto now = FrameClock::now();
+        if (limiter.has_last_present)
+        {
+            auto interval = std::chrono::duration<f64>(now - limiter.last_present).count();
+            auto& stats = limiter.stats;
+            stats.frames++;
+            auto delta = interval - stats.interval_mean;
+            stats.interval_mean += delta / static_cast<f64>(stats.frames);
+            stats.interval_m2 += delta * (interval - stats.interval_mean);
+            stats.interval_min = std::min(stats.interval_min, interval);
+            stats.interval_max = std::max(stats.interval_max, interval);
+        }
+        limiter.last_present = now;
+        limiter.has_last_present = true;
+    }
+
+    void frame_limiter_skip(FrameLimiter& limiter)
+    {
+        limiter.has_last_present = false;
+    }
+
+    void frame_limiter_report(FrameLimiter& limiter, std::ostream& out)
+    {
+        constexpr f64 MS = 1000.0;
+        constexpr f64 US = 1000000.0;
+        auto& stats = limiter.stats;
+        const char* mode = limiter.mode == FrameLimiterMode::Off ? "off" : limiter.mode == FrameLimiterMode::Fixed ? "fixed" : "adaptive";
+        out << std::fixed << std::setprecision(3) << "frame pacing (" << mode << ", target " << limiter.target_seconds * MS << " ms";
+        if (limiter.mode == FrameLimiterMode::Adaptive)
+        {
+            out << ", now 1/" << limiter.divisor;
+        }
+        out << "): ";
+        if (stats.frames < 2)
+        {
+            out << "not enough frames\n" << std::defaultfloat;
+            return;
+        }
+        auto variance = stats.interval_m2 / static_cast<f64>(stats.frames - 1);
+        out << stats.frames << " intervals, mean " << stats.interval_mean * MS << " ms, stddev " << std::sqrt(variance) * MS
+            << " ms (variance " << variance * MS * MS << " ms^2), min " << stats.interval_min * MS << " ms, max " << stats.interval_max * MS << " ms";
+        if (limiter.mode != FrameLimiterMode::Off)
+        {
+            out << ", wake error mean " << std::setprecision(1) << stats.wake_error_total / static_cast<f64>(std::max<u64>(stats.waits, 1)) * US
+                << " us, max " << stats.wake_error_max * US << " us, " << stats.late_frames << " late";
+        }
+        out << "\n" << std::defaultfloat;
+    }
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+
+namespace woc
+{
+    // Used when the monitor doesn't report a refresh rate.
+    constexpr f64 FRAME_LIMITER_DEFAULT_FPS = 60.0;
+    // Sleeps wake up late by a scheduler-dependent amount, the last stretch before a deadline is spun instead.
+    // The margin follows the worst recent oversleep within these bounds.
+    constexpr f64 FRAME_LIMITER_MIN_SPIN_SECONDS = 0.0005;
+    constexpr f64 FRAME_LIMITER_MAX_SPIN_SECONDS = 0.004;
+    // Adaptive mode runs at the target rate divided by this at most, e.g. 60, 30, 20 or 15 fps.
+    constexpr u32 FRAME_LIMITER_MAX_DIVISOR = 4;
+    // How long render cost has to stay low before adaptive mode tries the next faster rate.
+    constexpr f64 FRAME_LIMITER_RAISE_SECONDS = 2.0;
+
+    enum class FrameLimiterMode
+    {
+        Off,
+        // Presents at the target rate, or as fast as possible when frames take longer.
+        Fixed,
+        // Drops to an even fraction of the target rate when render cost doesn't fit, which paces far more
+        // smoothly than missing every other deadline by a little.
+        Adaptive,
+    };
+
+    struct FramePacingStats
+    {
+        u64 frames;
+        // Welford's running mean and sum of squared deviations of the present to present interval.
+        f64 interval_mean;
+        f64 interval_m2;
+        f64 interval_min;
+        f64 interval_max;
+        // How far past its deadline each wait returned.
+        u64 waits;
+        f64 wake_error_total;
+        f64 wake_error_max;
+        u64 late_frames;
+    };
+
+    struct FrameLimiter
+    {
+        FrameLimiterMode mode;
+        f64 target_seconds;
+        u32 divisor;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point last_present;
+        bool has_last_present;
+        f64 spin_seconds;
+        // From one present to the next wait, so neither the wait nor a vsync block in EndDrawing counts.
+        f64 work_seconds;
+        f64 work_seconds_average;
+        f64 raise_timer;
+        FramePacingStats stats;
+    };
+    // fps 0 means the monitor's refresh rate. Needs the window to exist.
+    FrameLimiter frame_limiter_init(FrameLimiterMode mode, f64 fps);
+    // Off mode still has one, the monitor's refresh interval, for code that budgets against it.
+    f64 frame_limiter_interval(FrameLimiter& limiter);
+    // renderer_finalize_rendering calls this right before EndDrawing, so presents land on the deadlines and the
+    // input raylib polls in EndDrawing is as fresh as it can be.
+    void frame_limiter_wait(FrameLimiter& limiter);
+    // And this once EndDrawing returns.
+    void frame_limiter_presented(FrameLimiter& limiter);
+    // For loop iterations that don't present, so the gap isn't counted as one long frame.
+    void frame_limiter_skip(FrameLimiter& limiter);
+    void frame_limiter_report(FrameLimiter& limiter, std::ostream& out);
+}
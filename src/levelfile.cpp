@@ -0,0 +1,787 @@
+﻿#include "levelfile.h"
+#include "windfield.h"
+#include "broadphase.h"
+#include "memory.h"
+#include "levelstream.h"
+
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace woc
+{
+    std::string levelfile_path(u32 level)
+    {
+        return std::string(LEVEL_DIRECTORY) + "/level_" + std::to_string(level) + ".txt";
+    }
+
+    std::string levelfile_chunk_path(u32 level, u32 chunk)
+    {
+        return std::string(LEVEL_DIRECTORY) + "/level_" + std::to_string(level) + "/chunk_" + std::to_string(chunk) + ".txt";
+    }
+
+    bool levelfile_exists(u32 level)
+    {
+        std::error_code error;
+        return std::filesystem::is_regular_file(levelfile_path(level), error);
+    }
+
+    woc_internal bool levelfile_parse_f32(std::string_view text, f32& out)
+    {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+        return result.ec == std::errc{} && result.ptr == text.data() + text.size();
+    }
+
+    woc_internal bool levelfile_parse_u32(std::string_view text, u32& out)
+    {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+        return result.ec == std::errc{} && result.ptr == text.data() + text.size();
+    }
+
+    woc_internal bool levelfile_parse_vector2(std::string_view text, Vector2& out)
+    {
+        auto comma = text.find(',');
+        return comma != std::string_view::npos
+            && levelfile_parse_f32(text.substr(0, comma), out.x)
+            && levelfile_parse_f32(text.substr(comma + 1), out.y);
+    }
+
+    woc_internal bool levelfile_parse_points(std::string_view text, EnemyMotion& motion)
+    {
+        motion.point_count = 0;
+        while (!text.empty())
+        {
+            if (motion.point_count == ENEMY_PATH_MAX_POINTS)
+            {
+                return false;
+            }
+            auto end = std::min(text.find(';'), text.size());
+            if (!levelfile_parse_vector2(text.substr(0, end), motion.points.at(motion.point_count++)))
+            {
+                return false;
+            }
+            text.remove_prefix(std::min(end + 1, text.size()));
+        }
+        return motion.point_count > 0;
+    }
+
+    woc_internal std::string_view levelfile_next_token(std::string_view& line)
+    {
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+        {
+            line = {};
+            return {};
+        }
+        line.remove_prefix(start);
+        auto end = std::min(line.find_first_of(" \t\r"), line.size());
+        auto token = line.substr(0, end);
+        line.remove_prefix(end);
+        return token;
+    }
+
+    woc_internal bool levelfile_parse_wall(std::string_view line, EnemyState& out)
+    {
+        auto type = levelfile_next_token(line);
+        if (type != "normal" && type != "indestructible")
+        {
+            return false;
+        }
+        out = EnemyState{};
+        out.type = type == "normal" ? EnemyType::Normal : EnemyType::Indestructible;
+        out.contributes_to_win = out.type == EnemyType::Normal;
+
+        bool has_pos = false;
+        bool has_size = false;
+        for (auto token = levelfile_next_token(line); !token.empty(); token = levelfile_next_token(line))
+        {
+            auto equals = token.find('=');
+            if (equals == std::string_view::npos)
+            {
+                return false;
+            }
+            auto key = token.substr(0, equals);
+            auto value = token.substr(equals + 1);
+            bool ok = false;
+            u32 integer = 0;
+            if (key == "pos")
+            {
+                ok = has_pos = levelfile_parse_vector2(value, out.pos);
+            } else if (key == "size")
+            {
+                ok = has_size = levelfile_parse_vector2(value, out.size);
+            } else if (key == "rot")
+            {
+                ok = levelfile_parse_f32(value, out.rot.val);
+            } else if (key == "health")
+            {
+                ok = levelfile_parse_u32(value, integer);
+                out.health = static_cast<i32>(integer);
+            } else if (key == "win")
+            {
+                ok = levelfile_parse_u32(value, integer) && integer <= 1;
+                out.contributes_to_win = integer;
+            } else if (key == "spin")
+            {
+                ok = levelfile_parse_f32(value, out.motion.spin);
+            } else if (key == "period")
+            {
+                ok = levelfile_parse_f32(value, out.motion.period) && out.motion.period > 0.f;
+            } else if (key == "motion")
+            {
+                ok = value == "oscillate" || value == "path";
+                out.motion.type = value == "oscillate" ? EnemyMotionType::Oscillate : EnemyMotionType::Path;
+            } else if (key == "points")
+            {
+                ok = levelfile_parse_points(value, out.motion);
+            }
+            if (!ok)
+            {
+                return false;
+            }
+        }
+
+        auto& motion = out.motion;
+        if (motion.type != EnemyMotionType::None && (motion.period <= 0.f || motion.point_count == 0))
+        {
+            return false;
+        }
+        motion.origin = out.pos;
+        return has_pos && has_size;
+    }
+
+    woc_internal bool levelfile_parse_zone(std::string_view line, WindZone& out)
+    {
+        out = WindZone{};
+        u32 found = 0;
+        for (auto token = levelfile_next_token(line); !token.empty(); token = levelfile_next_token(line))
+        {
+            auto equals = token.find('=');
+            if (equals == std::string_view::npos)
+            {
+                return false;
+            }
+            auto key = token.substr(0, equals);
+            auto value = token.substr(equals + 1);
+            auto* target = key == "pos" ? &out.pos : key == "size" ? &out.size : key == "force" ? &out.force : nullptr;
+            if (!target || !levelfile_parse_vector2(value, *target))
+            {
+                return false;
+            }
+            found++;
+        }
+        return found == 3;
+    }
+
+    woc_internal bool levelfile_parse_world(std::string_view line, Vector2& min, Vector2& max)
+    {
+        u32 found = 0;
+        for (auto token = levelfile_next_token(line); !token.empty(); token = levelfile_next_token(line))
+        {
+            auto equals = token.find('=');
+            if (equals == std::string_view::npos)
+            {
+                return false;
+            }
+            auto key = token.substr(0, equals);
+            auto* target = key == "min" ? &min : key == "max" ? &max : nullptr;
+            if (!target || !levelfile_parse_vector2(token.substr(equals + 1), *target))
+            {
+                return false;
+            }
+            found++;
+        }
+        return found == 2 && min.x <= WORLD_MIN.x && min.y <= WORLD_MIN.y && max.x >= WORLD_MAX.x && max.y >= WORLD_MAX.y;
+    }
+
+    woc_internal bool levelfile_parse_chunks(std::string_view line, LevelChunkGrid& out)
+    {
+        u32 found = 0;
+        for (auto token = levelfile_next_token(line); !token.empty(); token = levelfile_next_token(line))
+        {
+            auto equals = token.find('=');
+            if (equals == std::string_view::npos)
+            {
+                return false;
+            }
+            auto key = token.substr(0, equals);
+            auto value = token.substr(equals + 1);
+            auto comma = value.find(',');
+            bool ok = false;
+            if (key == "size")
+            {
+                ok = levelfile_parse_f32(value, out.size) && out.size > 0.f;
+            } else if (key == "origin")
+            {
+                ok = levelfile_parse_vector2(value, out.origin);
+            } else if (key == "grid")
+            {
+                ok = comma != std::string_view::npos
+                    && levelfile_parse_u32(value.substr(0, comma), out.columns)
+                    && levelfile_parse_u32(value.substr(comma + 1), out.rows)
+                    && out.columns > 0 && out.rows > 0;
+            }
+            if (!ok)
+            {
+                return false;
+            }
+            found++;
+        }
+        if (found != 3)
+        {
+            return false;
+        }
+        out.chunks.assign(static_cast<size_t>(out.columns) * out.rows, LevelChunkInfo{});
+        return true;
+    }
+
+    woc_internal bool levelfile_parse_chunk(std::string_view line, LevelChunkGrid& grid)
+    {
+        u32 id;
+        if (grid.size <= 0.f || !levelfile_parse_u32(levelfile_next_token(line), id) || id >= grid.chunks.size())
+        {
+            return false;
+        }
+        auto& out = grid.chunks.at(id);
+        u32 found = 0;
+        for (auto token = levelfile_next_token(line); !token.empty(); token = levelfile_next_token(line))
+        {
+            auto equals = token.find('=');
+            if (equals == std::string_view::npos)
+            {
+                return false;
+            }
+            auto key = token.substr(0, equals);
+            auto* target = key == "first" ? &out.first_wall : key == "walls" ? &out.wall_count : key == "win" ? &out.win_walls : nullptr;
+            if (!target || !levelfile_parse_u32(token.substr(equals + 1), *target))
+            {
+                return false;
+            }
+            found++;
+        }
+        return found == 3 && out.win_walls <= out.wall_count;
+    }
+
+    bool levelfile_parse(std::string_view text, LevelDefinition& out, std::string& error)
+    {
+        out = LevelDefinition{};
+        u32 line_number = 0;
+        while (!text.empty())
+        {
+            line_number++;
+            auto end = std::min(text.find('\n'), text.size());
+            auto line = text.substr(0, end);
+            text.remove_prefix(std::min(end + 1, text.size()));
+            line = line.substr(0, std::min(line.find('#'), line.size()));
+
+            auto kind = levelfile_next_token(line);
+            bool ok = true;
+            if (kind.empty())
+            {
+                continue;
+            } else if (kind == "balls")
+            {
+                ok = levelfile_parse_u32(levelfile_next_token(line), out.balls_available);
+            } else if (kind == "wind")
+            {
+                ok = levelfile_parse_u32(levelfile_next_token(line), out.wind_available);
+            } else if (kind == "wall")
+            {
+                ok = levelfile_parse_wall(line, out.enemies.emplace_back());
+            } else if (kind == "zone")
+            {
+                ok = levelfile_parse_zone(line, out.wind_zones.emplace_back());
+            } else if (kind == "world")
+            {
+                ok = levelfile_parse_world(line, out.world_min, out.world_max);
+            } else if (kind == "chunks")
+            {
+                ok = levelfile_parse_chunks(line, out.chunk_grid);
+            } else if (kind == "chunk")
+            {
+                ok = levelfile_parse_chunk(line, out.chunk_grid);
+            } else {
+                ok = false;
+            }
+            if (!ok)
+            {
+                error = "line " + std::to_string(line_number) + ": can't read '" + std::string(kind) + std::string(line) + "'";
+                return false;
+            }
+        }
+        if (!out.enemies.empty() && out.chunk_grid.size > 0.f)
+        {
+            // A streamed level's walls all come from its chunks, walls here would overlap their level indices.
+            error = "walls next to chunks, a streamed level keeps its walls in the chunk files";
+            return false;
+        }
+        bool walls_fit = std::ranges::all_of(out.enemies, [] (EnemyState& e) { return physics_fits(e.pos, e.pos); });
+        if (!walls_fit || !physics_fits(out.world_min, out.world_max))
+        {
+            error = "world reaches past +-" + std::to_string(static_cast<i32>(FIXED_POINT_MAX_COORDINATE)) + ", more than fixed point physics can hold";
+            return false;
+        }
+        return true;
+    }
+
+    woc_internal void levelfile_write_f32(std::string& out, f32 value)
+    {
+        std::array<char, 32> buffer;
+        auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+        out.append(buffer.data(), result.ptr);
+    }
+
+    woc_internal void levelfile_write_vector2(std::string& out, const char* key, Vector2 value)
+    {
+        out += ' ';
+        out += key;
+        out += '=';
+        levelfile_write_f32(out, value.x);
+        out += ',';
+        levelfile_write_f32(out, value.y);
+    }
+
+    std::string levelfile_format_walls(std::vector<EnemyState>& walls)
+    {
+        std::string out;
+        for (auto& e : walls)
+        {
+            bool normal = e.type == EnemyType::Normal;
+            out += normal ? "wall normal" : "wall indestructible";
+            // Moving walls start at their motion's origin, which is where they were placed.
+            levelfile_write_vector2(out, "pos", e.motion.type != EnemyMotionType::None ? e.motion.origin : e.pos);
+            levelfile_write_vector2(out, "size", e.size);
+            out += " rot=";
+            levelfile_write_f32(out, e.rot.val);
+            out += " health=" + std::to_string(std::max(0, e.health));
+            if (e.contributes_to_win != normal)
+            {
+                out += e.contributes_to_win ? " win=1" : " win=0";
+            }
+            auto& motion = e.motion;
+            if (motion.spin != 0.f)
+            {
+                out += " spin=";
+                levelfile_write_f32(out, motion.spin);
+            }
+            if (motion.type != EnemyMotionType::None)
+            {
+                out += motion.type == EnemyMotionType::Oscillate ? " motion=oscillate period=" : " motion=path period=";
+                levelfile_write_f32(out, motion.period);
+                out += " points=";
+                for (u32 i = 0; i < motion.point_count; i++)
+                {
+                    out += i ? ";" : "";
+                    levelfile_write_f32(out, motion.points.at(i).x);
+                    out += ',';
+                    levelfile_write_f32(out, motion.points.at(i).y);
+                }
+            }
+            out += '\n';
+        }
+        return out;
+    }
+
+    std::string levelfile_format(LevelDefinition& level)
+    {
+        std::string out;
+        out += "balls " + std::to_string(level.balls_available) + "\n";
+        out += "wind " + std::to_string(level.wind_available) + "\n";
+        if (level.world_min.x != WORLD_MIN.x || level.world_min.y != WORLD_MIN.y || level.world_max.x != WORLD_MAX.x || level.world_max.y != WORLD_MAX.y)
+        {
+            out += "world";
+            levelfile_write_vector2(out, "min", level.world_min);
+            levelfile_write_vector2(out, "max", level.world_max);
+            out += '\n';
+        }
+        if (auto& grid = level.chunk_grid; grid.size > 0.f)
+        {
+            out += "chunks size=";
+            levelfile_write_f32(out, grid.size);
+            levelfile_write_vector2(out, "origin", grid.origin);
+            out += " grid=" + std::to_string(grid.columns) + "," + std::to_string(grid.rows) + "\n";
+            for (u32 i = 0; i < grid.chunks.size(); i++)
+            {
+                auto& chunk = grid.chunks.at(i);
+                if (chunk.wall_count)
+                {
+                    out += "chunk " + std::to_string(i) + " first=" + std::to_string(chunk.first_wall)
+                        + " walls=" + std::to_string(chunk.wall_count) + " win=" + std::to_string(chunk.win_walls) + "\n";
+                }
+            }
+        }
+        out += levelfile_format_walls(level.enemies);
+        for (auto& zone : level.wind_zones)
+        {
+            out += "zone";
+            levelfile_write_vector2(out, "pos", zone.pos);
+            levelfile_write_vector2(out, "size", zone.size);
+            levelfile_write_vector2(out, "force", zone.force);
+            out += '\n';
+        }
+        return out;
+    }
+
+    bool levelfile_load(u32 level, LevelDefinition& out, std::string& error)
+    {
+        auto path = levelfile_path(level);
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            error = path + ": can't open";
+            return false;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        if (!levelfile_parse(text.str(), out, error))
+        {
+            error = path + " " + error;
+            return false;
+        }
+        return true;
+    }
+
+    bool levelfile_save(u32 level, LevelDefinition& definition, std::string& error)
+    {
+        // Written next to the real file and renamed over it, so the watcher never sees half a level.
+        auto path = levelfile_path(level);
+        auto temporary_path = path + ".tmp";
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            file << levelfile_format(definition);
+            if (!file)
+            {
+                error = temporary_path + ": can't write";
+                return false;
+            }
+        }
+        std::error_code rename_error;
+        std::filesystem::rename(temporary_path, path, rename_error);
+        if (rename_error)
+        {
+            error = path + ": " + rename_error.message();
+            return false;
+        }
+        return true;
+    }
+
+    void levelfile_apply(LevelDefinition& level, GameState& game_state)
+    {
+        game_state.enemies = level.enemies;
+        for (u32 i = 0; i < game_state.enemies.size(); i++)
+        {
+            game_state.enemies.at(i).level_index = i;
+        }
+        game_state.wind_zones = level.wind_zones;
+        wind_field_build(game_state.wind_field, game_state.wind_zones, level.world_min, level.world_max);
+        game_state.player.balls_available = level.balls_available;
+        game_state.player.wind_available = level.wind_available;
+        game_state.world_min = level.world_min;
+        game_state.world_max = level.world_max;
+        game_state.chunks = LevelChunks{};
+        auto error = std::string{};
+        if (level.chunk_grid.size > 0.f && !level_stream_open(game_state, level.chunk_grid, error))
+        {
+            std::cerr << error << "\n";
+        }
+    }
+
+    woc_internal bool levelfile_same_enemy(EnemyState& a, EnemyState& b)
+    {
+        return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.size.x == b.size.x && a.size.y == b.size.y
+            && a.rot.val == b.rot.val && a.health == b.health && a.type == b.type && a.contributes_to_win == b.contributes_to_win
+            && std::memcmp(&a.motion, &b.motion, sizeof(EnemyMotion)) == 0;
+    }
+
+    woc_internal u64 levelfile_hash_enemy(EnemyState& e)
+    {
+        auto hash_f32 = [] (u64 h, f32 value)
+        {
+            u32 bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return random_hash(h, bits);
+        };
+        auto h = hash_f32(hash_f32(hash_f32(hash_f32(hash_f32(static_cast<u64>(e.type), e.pos.x), e.pos.y), e.size.x), e.size.y), e.rot.val);
+        return random_hash(h, static_cast<u64>(e.health));
+    }
+
+    // For every wall in before, the index of the wall in after it became, or NO_MATCH if it was deleted.
+    // modified marks the after walls that differ from their match.
+    constexpr u32 LEVELFILE_NO_MATCH = std::numeric_limits<u32>::max();
+    woc_internal void levelfile_match_enemies(LevelDefinition& before, LevelDefinition& after, std::vector<u32>& match, std::vector<bool>& modified)
+    {
+        auto& old_enemies = before.enemies;
+        auto& new_enemies = after.enemies;
+        match.assign(old_enemies.size(), LEVELFILE_NO_MATCH);
+        modified.assign(new_enemies.size(), false);
+
+        // Edits usually touch a few lines, so the untouched head and tail pair up directly.
+        size_t head = 0;
+        while (head < old_enemies.size() && head < new_enemies.size() && levelfile_same_enemy(old_enemies.at(head), new_enemies.at(head)))
+        {
+            match.at(head) = static_cast<u32>(head);
+            head++;
+        }
+        size_t tail = 0;
+        while (tail < old_enemies.size() - head && tail < new_enemies.size() - head
+            && levelfile_same_enemy(old_enemies.at(old_enemies.size() - 1 - tail), new_enemies.at(new_enemies.size() - 1 - tail)))
+        {
+            match.at(old_enemies.size() - 1 - tail) = static_cast<u32>(new_enemies.size() - 1 - tail);
+            tail++;
+        }
+
+        // In between, identical walls that moved lines still pair up. Whatever is left pairs in order as edits.
+        std::unordered_map<u64, std::vector<u32>> unmatched_old;
+        for (auto i = head; i < old_enemies.size() - tail; i++)
+        {
+            unmatched_old[levelfile_hash_enemy(old_enemies.at(i))].emplace_back(static_cast<u32>(i));
+        }
+        std::vector<bool> new_matched(new_enemies.size(), false);
+        for (auto j = head; j < new_enemies.size() - tail; j++)
+        {
+            auto bucket = unmatched_old.find(levelfile_hash_enemy(new_enemies.at(j)));
+            if (bucket == unmatched_old.end())
+            {
+                continue;
+            }
+            auto& candidates = bucket->second;
+            auto same = std::ranges::find_if(candidates, [&] (u32 i) { return levelfile_same_enemy(old_enemies.at(i), new_enemies.at(j)); });
+            if (same != candidates.end())
+            {
+                match.at(*same) = static_cast<u32>(j);
+                new_matched.at(j) = true;
+                candidates.erase(same);
+            }
+        }
+        size_t next_new = head;
+        for (auto i = head; i < old_enemies.size() - tail; i++)
+        {
+            if (match.at(i) != LEVELFILE_NO_MATCH)
+            {
+                continue;
+            }
+            while (next_new < new_enemies.size() - tail && new_matched.at(next_new))
+            {
+                next_new++;
+            }
+            if (next_new == new_enemies.size() - tail)
+            {
+                break;
+            }
+            match.at(i) = static_cast<u32>(next_new);
+            new_matched.at(next_new) = true;
+            modified.at(next_new) = true;
+        }
+    }
+
+    woc_internal void levelfile_patch_enemies(GameState& game_state, LevelDefinition& before, LevelDefinition& after)
+    {
+        std::vector<u32> match;
+        std::vector<bool> modified;
+        levelfile_match_enemies(before, after, match, modified);
+
+        std::vector<bool> present(after.enemies.size(), false);
+        std::erase_if(game_state.enemies, [&] (EnemyState& e)
+        {
+            if (e.level_index >= match.size() || match.at(e.level_index) == LEVELFILE_NO_MATCH)
+            {
+                return true;
+            }
+            auto old_index = e.level_index;
+            auto new_index = match.at(old_index);
+            if (modified.at(new_index))
+            {
+                // Keep the damage it already took, but never break a wall just by editing it.
+                auto damage = before.enemies.at(old_index).health - e.health;
+                auto& definition = after.enemies.at(new_index);
+                e = definition;
+                if (e.type == EnemyType::Normal)
+                {
+                    e.health = std::max(1, definition.health - damage);
+                }
+            }
+            e.level_index = new_index;
+            present.at(new_index) = true;
+            return false;
+        });
+        // Walls new to the file get added. Matched ones missing from the game were broken and stay broken.
+        std::vector<bool> matched(after.enemies.size(), false);
+        for (auto j : match)
+        {
+            if (j != LEVELFILE_NO_MATCH)
+            {
+                matched.at(j) = true;
+            }
+        }
+        for (u32 j = 0; j < after.enemies.size(); j++)
+        {
+            if (!present.at(j) && !matched.at(j))
+            {
+                auto& e = game_state.enemies.emplace_back(after.enemies.at(j));
+                e.level_index = j;
+            }
+        }
+        broadphase_build(game_state.broadphase, game_state.enemies);
+    }
+
+    void levelfile_patch(GameState& game_state, LevelDefinition& before, LevelDefinition& after)
+    {
+        // Walls of a streamed game come from its chunk files, which the level file's diff knows nothing about.
+        if (!game_state.chunks.stream)
+        {
+            levelfile_patch_enemies(game_state, before, after);
+        }
+
+        game_state.wind_zones = after.wind_zones;
+        wind_field_build(game_state.wind_field, game_state.wind_zones, after.world_min, after.world_max);
+        wind_field_update(game_state.wind_field, game_state.wind_gusts);
+
+        auto& player = game_state.player;
+        auto adjust = [] (u32 current, u32 from, u32 to)
+        {
+            return static_cast<u32>(std::max<i64>(0, static_cast<i64>(current) + static_cast<i64>(to) - static_cast<i64>(from)));
+        };
+        player.balls_available = adjust(player.balls_available, before.balls_available, after.balls_available);
+        player.wind_available = adjust(player.wind_available, before.wind_available, after.wind_available);
+        game_state.world_min = after.world_min;
+        game_state.world_max = after.world_max;
+    }
+
+    woc_internal bool levelfile_level_from_name(std::string_view name, u32& level)
+    {
+        constexpr std::string_view PREFIX = "level_";
+        constexpr std::string_view SUFFIX = ".txt";
+        if (name.size() <= PREFIX.size() + SUFFIX.size() || !name.starts_with(PREFIX) || !name.ends_with(SUFFIX))
+        {
+            return false;
+        }
+        return levelfile_parse_u32(name.substr(PREFIX.size(), name.size() - PREFIX.size() - SUFFIX.size()), level);
+    }
+
+    woc_internal i64 levelfile_write_time(u32 level)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(levelfile_path(level), error);
+        return error ? 0 : static_cast<i64>(time.time_since_epoch().count());
+    }
+
+    LevelWatcher levelfile_watch_init()
+    {
+        // The watcher keeps a parsed copy of every level file to diff edits against.
+        auto previous_tag = memory_tag_push(MemoryTag::Levels);
+        auto result = LevelWatcher { .inotify_fd = -1, .write_times = {} };
+#if defined(__linux__)
+        result.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        // Editors either rewrite the file or rename a new one over it.
+        if (result.inotify_fd >= 0 && inotify_add_watch(result.inotify_fd, LEVEL_DIRECTORY, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            close(result.inotify_fd);
+            result.inotify_fd = -1;
+        }
+#endif
+        if (result.inotify_fd < 0)
+        {
+            for (u32 level = START_LEVEL; level <= END_LEVEL; level++)
+            {
+                result.write_times.emplace_back(levelfile_write_time(level));
+            }
+        }
+
+        std::error_code error;
+        for (auto& entry : std::filesystem::directory_iterator(LEVEL_DIRECTORY, error))
+        {
+            u32 level;
+            auto definition = LevelDefinition{};
+            auto load_error = std::string{};
+            if (levelfile_level_from_name(entry.path().filename().string(), level) && levelfile_load(level, definition, load_error))
+            {
+                result.definitions[level] = std::move(definition);
+            }
+        }
+        memory_tag_pop(previous_tag);
+        return result;
+    }
+
+    void levelfile_watch_deinit(LevelWatcher& watcher)
+    {
+#if defined(__linux__)
+        if (watcher.inotify_fd >= 0)
+        {
+            close(watcher.inotify_fd);
+        }
+#endif
+        watcher.inotify_fd = -1;
+    }
+
+    woc_internal void levelfile_watch_changes(LevelWatcher& watcher, std::vector<u32>& changed_levels)
+    {
+        auto add = [&changed_levels] (u32 level)
+        {
+            if (std::ranges::find(changed_levels, level) == changed_levels.end())
+            {
+                changed_levels.emplace_back(level);
+            }
+        };
+#if defined(__linux__)
+        if (watcher.inotify_fd >= 0)
+        {
+            alignas(inotify_event) std::array<char, 4096> buffer;
+            for (auto length = read(watcher.inotify_fd, buffer.data(), buffer.size()); length > 0; length = read(watcher.inotify_fd, buffer.data(), buffer.size()))
+            {
+                for (auto* at = buffer.data(); at < buffer.data() + length;)
+                {
+                    auto* event = reinterpret_cast<inotify_event*>(at);
+                    u32 level;
+                    if (event->len && levelfile_level_from_name(event->name, level))
+                    {
+                        add(level);
+                    }
+                    at += sizeof(inotify_event) + event->len;
+                }
+            }
+            return;
+        }
+#endif
+        for (u32 level = START_LEVEL; level <= END_LEVEL; level++)
+        {
+            auto time = levelfile_write_time(level);
+            if (time != watcher.write_times.at(level - START_LEVEL))
+            {
+                watcher.write_times.at(level - START_LEVEL) = time;
+                add(level);
+            }
+        }
+    }
+
+    void levelfile_watch_poll(LevelWatcher& watcher, std::vector<LevelEdit>& edits)
+    {
+        auto previous_tag = memory_tag_push(MemoryTag::Levels);
+        woc_local std::vector<u32> changed_levels;
+        changed_levels.clear();
+        levelfile_watch_changes(watcher, changed_levels);
+        for (auto level : changed_levels)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto after = LevelDefinition{};
+            auto error = std::string{};
+            if (!levelfile_load(level, after, error))
+            {
+                std::cerr << error << "\n";
+                continue;
+            }
+            // A level first seen now diffs against nothing, which replaces every wall.
+            auto& before = watcher.definitions[level];
+            edits.emplace_back(LevelEdit { .level = level, .before = before, .after = after });
+            before = std::move(after);
+            auto milliseconds = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "reloaded " << levelfile_path(level) << " in " << milliseconds << " ms\n";
+        }
+        memory_tag_pop(previous_tag);
+    }
+}
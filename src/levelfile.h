@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace woc
+{
+    // Levels are text files in LEVEL_DIRECTORY named level_<n>.txt, one thing per line:
+    //   balls 1
+    //   wind 2
+    //   wall normal pos=0,0 size=200,25 rot=0 health=3
+    //   wall indestructible pos=-200,-300 size=400,25 rot=1.5707964 spin=0.5
+    //   wall normal pos=0,-200 size=100,25 health=1 motion=oscillate period=3 points=120,0
+    //   wall normal pos=0,-200 size=100,25 health=1 motion=path period=8 points=0,0;160,0;160,120;0,120
+    //   zone pos=0,0 size=300,200 force=1,0
+    //   world min=-3000,-4000 max=3000,500
+    //   chunks size=1000 origin=-3000,-4000 grid=6,5
+    //   chunk 7 first=0 walls=12 win=9
+    // Blank lines and # comments are skipped. Normal walls count towards winning unless they say win=0.
+    // world is optional and can only grow the world past WORLD_MIN..WORLD_MAX, the camera then scrolls.
+    // chunks marks a streamed level, its walls live in LEVEL_DIRECTORY/level_<n>/chunk_<id>.txt instead, one
+    // file per square of the grid, and each chunk line says which walls of the level one of them holds.
+    constexpr const char* LEVEL_DIRECTORY = "assets/levels";
+
+    struct LevelChunkInfo
+    {
+        // Walls of a streamed level are numbered chunk after chunk, these are the chunk's.
+        u32 first_wall;
+        u32 wall_count;
+        // How many of them count towards winning.
+        u32 win_walls;
+    };
+
+    // Chunk ids go row by row from origin. A size of 0 means the level isn't streamed.
+    struct LevelChunkGrid
+    {
+        f32 size;
+        Vector2 origin;
+        u32 columns;
+        u32 rows;
+        std::vector<LevelChunkInfo> chunks;
+    };
+
+    struct LevelDefinition
+    {
+        std::vector<EnemyState> enemies;
+        std::vector<WindZone> wind_zones;
+        u32 balls_available;
+        u32 wind_available;
+        Vector2 world_min = WORLD_MIN;
+        Vector2 world_max = WORLD_MAX;
+        LevelChunkGrid chunk_grid;
+    };
+
+    std::string levelfile_path(u32 level);
+    std::string levelfile_chunk_path(u32 level, u32 chunk);
+    bool levelfile_exists(u32 level);
+    // On failure error names the offending line.
+    bool levelfile_parse(std::string_view text, LevelDefinition& out, std::string& error);
+    // Floats are written in their shortest round-trip form, so parsing the result gives back the same bits.
+    std::string levelfile_format(LevelDefinition& level);
+    // Just the wall lines, which is all a chunk file holds.
+    std::string levelfile_format_walls(std::vector<EnemyState>& walls);
+    bool levelfile_load(u32 level, LevelDefinition& out, std::string& error);
+    bool levelfile_save(u32 level, LevelDefinition& definition, std::string& error);
+    void levelfile_apply(LevelDefinition& level, GameState& game_state);
+    // Brings a game started from before in line with after without restarting it. Walls that didn't change
+    // keep their health and motion, changed ones are updated in place keeping the damage they took, and
+    // resource counts move by the difference. Streamed levels only patch what's in the level file itself,
+    // chunk files aren't watched.
+    void levelfile_patch(GameState& game_state, LevelDefinition& before, LevelDefinition& after);
+
+    struct LevelEdit
+    {
+        u32 level;
+        LevelDefinition before;
+        LevelDefinition after;
+    };
+
+    // Notices level files being written, through inotify on Linux and by comparing modification times elsewhere,
+    // and keeps the last good version of each file to diff the next one against.
+    struct LevelWatcher
+    {
+        i32 inotify_fd;
+        std::vector<i64> write_times;
+        std::unordered_map<u32, LevelDefinition> definitions;
+    };
+    LevelWatcher levelfile_watch_init();
+    void levelfile_watch_deinit(LevelWatcher& watcher);
+    // Never blocks. Reloads every level file written since the last poll and appends an edit for each one that
+    // parsed. Files that don't parse are reported on stderr and keep their last good version.
+    void levelfile_watch_poll(LevelWatcher& watcher, std::vector<LevelEdit>& edits);
+}
@@ -0,0 +1,624 @@
+﻿#include "levelgen.h"
+#include "fixed.h"
+#include "windfield.h"
+
+#include <condition_variable>
+
+namespace woc
+{
+    Vector2 levelgen_half_extents(Vector2 size, Radian rot)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        auto angle = fixed_from_f32(rot.val);
+        auto c = Fixed { std::abs(fixed_cos(angle).raw) };
+        auto s = Fixed { std::abs(fixed_sin(angle).raw) };
+        auto half = fixed_from_vector2(Vector2Scale(size, 0.5f));
+        return fixed_to_vector2(FixedVector2 { c * half.x + s * half.y, s * half.x + c * half.y });
+#else
+        auto c = std::abs(std::cos(rot.val));
+        auto s = std::abs(std::sin(rot.val));
+        auto half = Vector2Scale(size, 0.5f);
+        return Vector2 { c * half.x + s * half.y, s * half.x + c * half.y };
+#endif
+    }
+
+    void levelgen_swept_bounds(EnemyState& enemy, Vector2& center, Vector2& half_extents)
+    {
+        auto& motion = enemy.motion;
+        // A spinning wall covers the circle through its corners, half width plus half height bounds that.
+        half_extents = motion.spin != 0.f
+            ? Vector2Scale(Vector2 { enemy.size.x + enemy.size.y, enemy.size.x + enemy.size.y }, 0.5f)
+            : levelgen_half_extents(enemy.size, enemy.rot);
+        switch (motion.type)
+        {
+            case EnemyMotionType::None:
+            {
+                center = enemy.pos;
+                break;
+            }
+            case EnemyMotionType::Oscillate:
+            {
+                center = motion.origin;
+                half_extents = Vector2Add(half_extents, Vector2 { std::abs(motion.points.at(0).x), std::abs(motion.points.at(0).y) });
+                break;
+            }
+            case EnemyMotionType::Path:
+            {
+                auto min = motion.points.at(0);
+                auto max = motion.points.at(0);
+                for (u32 i = 1; i < motion.point_count; i++)
+                {
+                    min = Vector2Min(min, motion.points.at(i));
+                    max = Vector2Max(max, motion.points.at(i));
+                }
+                center = Vector2Add(motion.origin, Vector2Scale(Vector2Add(min, max), 0.5f));
+                half_extents = Vector2Add(half_extents, Vector2Scale(Vector2Subtract(max, min), 0.5f));
+                break;
+            }
+        }
+    }
+
+    woc_internal bool levelgen_overlaps(std::vector<EnemyState>& enemies, Vector2 pos, Vector2 half_extents, EnemyState* ignore = nullptr)
+    {
+        for (auto& e : enemies)
+        {
+            if (&e == ignore)
+            {
+                continue;
+            }
+            Vector2 other_pos, other;
+            levelgen_swept_bounds(e, other_pos, other);
+            auto dx = std::abs(other_pos.x - pos.x) - (other.x + half_extents.x);
+            auto dy = std::abs(other_pos.y - pos.y) - (other.y + half_extents.y);
+            if (dx < LEVELGEN_WALL_PADDING && dy < LEVELGEN_WALL_PADDING)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    woc_internal void levelgen_place_wall(Random& random, std::vector<EnemyState>& enemies, EnemyType type)
+    {
+        constexpr std::array<Vector2, 4> SIZES = { WALL_SIZE_S, WALL_SIZE_DEFAULT, WALL_SIZE_L, WALL_SIZE_XL };
+        constexpr std::array<f32, 5> ROTATIONS = { 0.f, 0.f, PI / 2.f, PI / 4.f, -PI / 4.f };
+
+        for (u32 attempt = 0; attempt < LEVELGEN_PLACEMENT_ATTEMPTS; attempt++)
+        {
+            // Indestructible walls are there to shape bounces, so they lean towards the long sizes.
+            auto size_index = type == EnemyType::Indestructible ? random_u32(random, 1, 3) : random_u32(random, 0, 2);
+            auto size = SIZES.at(size_index);
+            auto rot = Radian { ROTATIONS.at(random_u32(random, 0, ROTATIONS.size() - 1)) };
+            auto half_extents = levelgen_half_extents(size, rot);
+            
+            auto min = Vector2Add(WORLD_MIN, half_extents);
+            auto max = Vector2 { WORLD_MAX.x - half_extents.x, LEVELGEN_LOWEST_WALL_Y - half_extents.y };
+            if (min.x >= max.x || min.y >= max.y)
+            {
+                continue;
+            }
+            auto pos = Vector2 { random_f32(random, min.x, max.x), random_f32(random, min.y, max.y) };
+            if (levelgen_overlaps(enemies, pos, half_extents))
+            {
+                continue;
+            }
+
+            bool normal = type == EnemyType::Normal;
+            enemies.emplace_back(EnemyState {
+                .pos = pos,
+                .size = size,
+                .health = normal ? static_cast<i32>(random_u32(random, 1, 3)) : 0,
+                .rot = rot,
+                .type = type,
+                .contributes_to_win = normal
+            });
+            return;
+        }
+    }
+
+    // Kinematic motion for a placed wall, kept only if its whole sweep stays in the wall area and clear of the others.
+    woc_internal void levelgen_add_motion(Random& random, std::vector<EnemyState>& enemies, EnemyState& enemy)
+    {
+        auto motion = EnemyMotion {
+            .type = EnemyMotionType::None,
+            .origin = enemy.pos,
+            .points = {},
+            .point_count = 0,
+            .period = random_f32(random, 2.f, 6.f),
+            .spin = 0.f,
+            .time = 0.f,
+            .vel = Vector2Zero()
+        };
+        switch (random_u32(random, 0, 2))
+        {
+            case 0:
+            {
+                motion.type = EnemyMotionType::Oscillate;
+                auto amplitude = random_f32(random, 40.f, 160.f);
+                motion.points.at(0) = random_u32(random, 0, 1) ? Vector2 { amplitude, 0.f } : Vector2 { 0.f, amplitude };
+                motion.point_count = 1;
+                break;
+            }
+            case 1:
+            {
+                auto speed = random_f32(random, 0.4f, 1.5f);
+                motion.spin = random_u32(random, 0, 1) ? speed : -speed;
+                break;
+            }
+            default:
+            {
+                // A rectangle loop starting where the wall was placed.
+                motion.type = EnemyMotionType::Path;
+                auto width = random_f32(random, -160.f, 160.f);
+                auto height = random_f32(random, -120.f, 120.f);
+                motion.points = { Vector2 { 0.f, 0.f }, Vector2 { width, 0.f }, Vector2 { width, height }, Vector2 { 0.f, height } };
+                motion.point_count = 4;
+                motion.period *= 2.f;
+                break;
+            }
+        }
+
+        auto moving = enemy;
+        moving.motion = motion;
+        Vector2 center, half_extents;
+        levelgen_swept_bounds(moving, center, half_extents);
+        auto min = Vector2Subtract(center, half_extents);
+        auto max = Vector2Add(center, half_extents);
+        if (min.x < WORLD_MIN.x || min.y < WORLD_MIN.y || max.x > WORLD_MAX.x || max.y > LEVELGEN_LOWEST_WALL_Y
+            || levelgen_overlaps(enemies, center, half_extents, &enemy))
+        {
+            return;
+        }
+        enemy.motion = motion;
+    }
+
+    GeneratedLevel levelgen_generate(u64 seed)
+    {
+        auto random = Random { .state = seed };
+        auto result = GeneratedLevel {
+            .seed = seed,
+            .enemies = {},
+            .wind_zones = {},
+            .balls_available = random_u32(random, 1, 3),
+            .wind_available = random_u32(random, 0, 3)
+        };
+
+        auto normal_walls = random_u32(random, LEVELGEN_MIN_NORMAL_WALLS, LEVELGEN_MAX_NORMAL_WALLS);
+        auto indestructible_walls = random_u32(random, 0, LEVELGEN_MAX_INDESTRUCTIBLE_WALLS);
+        result.enemies.reserve(normal_walls + indestructible_walls);
+        for (u32 i = 0; i < indestructible_walls; i++)
+        {
+            levelgen_place_wall(random, result.enemies, EnemyType::Indestructible);
+        }
+        for (u32 i = 0; i < normal_walls; i++)
+        {
+            levelgen_place_wall(random, result.enemies, EnemyType::Normal);
+        }
+
+        // Drawn after the walls so adding zones didn't reshuffle the layouts of earlier seeds.
+        auto zone_count = random_u32(random, 0, LEVELGEN_MAX_WIND_ZONES);
+        for (u32 i = 0; i < zone_count; i++)
+        {
+            auto size = Vector2 { random_f32(random, 200.f, 500.f), random_f32(random, 150.f, 400.f) };
+            // Eight fixed directions rather than a random angle keeps libm trig out of level generation.
+            constexpr f32 DIAGONAL = 0.70710678f;
+            constexpr std::array<Vector2, 8> DIRECTIONS = {{
+                { 1.f, 0.f }, { DIAGONAL, DIAGONAL }, { 0.f, 1.f }, { -DIAGONAL, DIAGONAL },
+                { -1.f, 0.f }, { -DIAGONAL, -DIAGONAL }, { 0.f, -1.f }, { DIAGONAL, -DIAGONAL }
+            }};
+            auto direction = DIRECTIONS.at(random_u32(random, 0, DIRECTIONS.size() - 1));
+            auto strength = random_f32(random, 0.4f, 1.2f);
+            result.wind_zones.emplace_back(WindZone {
+                .pos = Vector2 {
+                    random_f32(random, WORLD_MIN.x + size.x * 0.5f, WORLD_MAX.x - size.x * 0.5f),
+                    random_f32(random, WORLD_MIN.y + size.y * 0.5f, LEVELGEN_LOWEST_WALL_Y - size.y * 0.5f)
+                },
+                .size = size,
+                .force = Vector2Scale(direction, strength)
+            });
+        }
+
+        // Drawn last for the same reason.
+        for (auto& e : result.enemies)
+        {
+            if (random_f32(random, 0.f, 1.f) < LEVELGEN_MOVING_WALL_CHANCE)
+            {
+                levelgen_add_motion(random, result.enemies, e);
+            }
+        }
+        return result;
+    }
+
+    GeneratedLevel levelgen_generate_large(u64 seed, u32 wall_count)
+    {
+        auto random = Random { .state = seed };
+        auto result = GeneratedLevel {
+            .seed = seed,
+            .enemies = {},
+            .wind_zones = {},
+            .balls_available = 10,
+            .wind_available = 3
+        };
+
+        // Roughly square, so scrolling goes both ways.
+        auto cell = LEVELGEN_LARGE_CELL_SIZE;
+        auto columns = std::max(1u, static_cast<u32>(std::ceil(std::sqrt(static_cast<f32>(wall_count) * cell.y / cell.x))));
+        auto rows = (wall_count + columns - 1) / columns;
+        auto left = -static_cast<f32>(columns) * cell.x * 0.5f;
+        auto bottom = LEVELGEN_LOWEST_WALL_Y;
+        result.enemies.reserve(wall_count);
+        for (u32 i = 0; i < wall_count; i++)
+        {
+            auto center = Vector2 {
+                left + (static_cast<f32>(i % columns) + 0.5f) * cell.x,
+                bottom - (static_cast<f32>(i / columns) + 0.5f) * cell.y
+            };
+            auto size = Vector2 { random_f32(random, 60.f, 150.f), random_f32(random, 20.f, 25.f) };
+            auto rot = Radian { random_f32(random, -0.4f, 0.4f) };
+            // Jittered only as far as keeps the wall inside its own cell.
+            auto half_extents = levelgen_half_extents(size, rot);
+            auto slack = Vector2 {
+                std::max(0.f, cell.x * 0.5f - half_extents.x - LEVELGEN_WALL_PADDING * 0.5f),
+                std::max(0.f, cell.y * 0.5f - half_extents.y - LEVELGEN_WALL_PADDING * 0.5f)
+            };
+            auto pos = Vector2Add(center, Vector2 { random_f32(random, -slack.x, slack.x), random_f32(random, -slack.y, slack.y) });
+            bool normal = i % LEVELGEN_LARGE_INDESTRUCTIBLE_EVERY != 0;
+            bool in_default_world = pos.x > WORLD_MIN.x && pos.x < WORLD_MAX.x && pos.y > WORLD_MIN.y;
+            result.enemies.emplace_back(EnemyState {
+                .pos = pos,
+                .size = size,
+                .health = normal ? static_cast<i32>(random_u32(random, 1, 3)) : 0,
+                .rot = rot,
+                .type = normal ? EnemyType::Normal : EnemyType::Indestructible,
+                .contributes_to_win = normal && in_default_world
+            });
+        }
+
+        result.world_min = Vector2 {
+            std::min(WORLD_MIN.x, left - LEVELGEN_LARGE_WORLD_MARGIN),
+            std::min(WORLD_MIN.y, bottom - static_cast<f32>(rows) * cell.y - LEVELGEN_LARGE_WORLD_MARGIN)
+        };
+        result.world_max = Vector2 { std::max(WORLD_MAX.x, -left + LEVELGEN_LARGE_WORLD_MARGIN), WORLD_MAX.y };
+        return result;
+    }
+
+    void levelgen_apply(GeneratedLevel& level, GameState& game_state)
+    {
+        game_state.enemies = level.enemies;
+        game_state.wind_zones = level.wind_zones;
+        wind_field_build(game_state.wind_field, game_state.wind_zones, level.world_min, level.world_max);
+        game_state.player.balls_available = level.balls_available;
+        game_state.player.wind_available = level.wind_available;
+        game_state.world_min = level.world_min;
+        game_state.world_max = level.world_max;
+    }
+
+    // One randomized attempt from start: line up under a random x, launch, keep the ball alive and fire winds at
+    // random times. game_state is scratch space, reused so its vectors only allocate on the first playout.
+    woc_internal bool levelgen_playout(GameState& start, GameState& game_state, AudioState& audio_state, Random& random)
+    {
+        game_state = start;
+
+        constexpr f32 PADDLE_DEADZONE = 8.f;
+        auto player_half_width = static_cast<f32>(PLAYER_DEFAULT_WIDTH) * 0.5f;
+        auto launch_x = random_f32(random, WORLD_MIN.x + player_half_width, WORLD_MAX.x - player_half_width);
+        auto next_wind_seconds = random_f32(random, 0.2f, 4.f);
+        auto elapsed_seconds = 0.f;
+        while (game_state.level_status == LevelStatus::InProgress && elapsed_seconds < LEVELGEN_PLAYOUT_MAX_SECONDS)
+        {
+            auto& player = game_state.player;
+            auto input = InputState{};
+
+            auto target_x = launch_x;
+            auto lowest_y = WORLD_MIN.y;
+            for (auto& p : game_state.player_projectiles)
+            {
+                if (p.dir.y > 0.f && p.pos.y > lowest_y)
+                {
+                    lowest_y = p.pos.y;
+                    target_x = p.pos.x;
+                }
+            }
+            auto offset = target_x - player.pos_x;
+            input.move_dir = offset > PADDLE_DEADZONE ? 1 : (offset < -PADDLE_DEADZONE ? -1 : 0);
+            
+            if (game_state.player_projectiles.empty() && std::abs(launch_x - player.pos_x) <= PADDLE_DEADZONE)
+            {
+                input.send_ball = 1;
+                launch_x = random_f32(random, WORLD_MIN.x + player_half_width, WORLD_MAX.x - player_half_width);
+            }
+
+            if (player.wind_available && !game_state.player_projectiles.empty() && elapsed_seconds >= next_wind_seconds)
+            {
+                switch (random_u32(random, 0, 3))
+                {
+                    case 0: input.wind_dir_x = -1; break;
+                    case 1: input.wind_dir_x = 1; break;
+                    case 2: input.wind_dir_y = 1; break;
+                    default: input.wind_dir_y = -1; break;
+                }
+                next_wind_seconds = elapsed_seconds + random_f32(random, 0.5f, 6.f);
+            }
+
+            game_update(game_state, input, audio_state, LEVELGEN_PLAYOUT_TICK_SECONDS);
+            audio_state.deferred_sounds.clear();
+            elapsed_seconds += LEVELGEN_PLAYOUT_TICK_SECONDS;
+        }
+        return game_state.level_status == LevelStatus::Won;
+    }
+
+    // Candidates of a levelgen_search_verified, handed out in order to its workers.
+    struct LevelgenSearch
+    {
+        u64 level_seed;
+        std::atomic<bool>* cancel;
+        std::atomic<u32> next;
+        // LEVELGEN_MAX_CANDIDATES until one is found.
+        std::atomic<u32> lowest_solvable;
+        std::mutex mutex;
+        GeneratedLevel found;
+    };
+
+    // A candidate stops mattering once a lower one turned out solvable, or the search was cancelled.
+    woc_internal bool levelgen_search_skips(LevelgenSearch& search, u32 candidate)
+    {
+        return candidate > search.lowest_solvable.load(std::memory_order_relaxed)
+            || (search.cancel && search.cancel->load(std::memory_order_relaxed));
+    }
+
+    woc_internal u32 levelgen_count_win_walls(std::vector<EnemyState>& enemies)
+    {
+        return static_cast<u32>(std::ranges::count_if(enemies, [] (EnemyState& e) { return e.contributes_to_win; }));
+    }
+
+    // levelgen_is_solvable, giving up between playouts when search skips the candidate.
+    woc_internal bool levelgen_verify(GeneratedLevel& level, u64 playout_seed, LevelgenSearch* search, u32 candidate)
+    {
+        auto win_walls = levelgen_count_win_walls(level.enemies);
+        if (!win_walls)
+        {
+            return false;
+        }
+
+        // Every playout starts from the same state, with its wind field and broadphase built once up front.
+        auto start = game_init_empty(ENDLESS_START_LEVEL);
+        levelgen_apply(level, start);
+        broadphase_build(start.broadphase, start.enemies);
+        auto game_state = GameState{};
+        auto audio_state = AudioState{};
+        audio_state.defer_playback = true;
+
+        auto random = Random { .state = playout_seed };
+        auto fewest_left = win_walls;
+        for (u32 i = 0; i < LEVELGEN_PLAYOUTS_PER_CANDIDATE; i++)
+        {
+            if (search && levelgen_search_skips(*search, candidate))
+            {
+                return false;
+            }
+            if (i == LEVELGEN_FIRST_PASS_PLAYOUTS && static_cast<f32>(win_walls - fewest_left) < LEVELGEN_FIRST_PASS_MIN_PROGRESS * static_cast<f32>(win_walls))
+            {
+                return false;
+            }
+            if (levelgen_playout(start, game_state, audio_state, random))
+            {
+                return true;
+            }
+            fewest_left = std::min(fewest_left, levelgen_count_win_walls(game_state.enemies));
+        }
+        return false;
+    }
+
+    bool levelgen_is_solvable(GeneratedLevel& level, u64 playout_seed)
+    {
+        return levelgen_verify(level, playout_seed, nullptr, 0);
+    }
+
+    woc_internal u32 levelgen_worker_count()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    struct LevelgenCachedLevel
+    {
+        u32 level;
+        GeneratedLevel generated;
+    };
+
+    struct LevelgenPrefetch
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::thread worker;
+        std::optional<u32> pending;
+        std::atomic<bool> cancel;
+        // Oldest first.
+        std::deque<LevelgenCachedLevel> cached;
+    };
+
+    woc_global LevelgenPrefetch levelgen_prefetch_state;
+
+    // Call with the mutex held.
+    woc_internal LevelgenCachedLevel* levelgen_find_cached(LevelgenPrefetch& prefetch, u32 level)
+    {
+        auto found = std::ranges::find(prefetch.cached, level, &LevelgenCachedLevel::level);
+        return found != prefetch.cached.end() ? &*found : nullptr;
+    }
+
+    woc_internal void levelgen_cache(LevelgenPrefetch& prefetch, u32 level, GeneratedLevel generated)
+    {
+        if (levelgen_find_cached(prefetch, level))
+        {
+            return;
+        }
+        if (prefetch.cached.size() >= LEVELGEN_CACHED_LEVELS)
+        {
+            prefetch.cached.pop_front();
+        }
+        prefetch.cached.emplace_back(LevelgenCachedLevel { .level = level, .generated = std::move(generated) });
+    }
+
+    // Any worker_count gives the same level. Returns false when cancel was set before a solvable candidate was found.
+    woc_internal bool levelgen_search_verified(u32 level, u32 worker_count, std::atomic<bool>* cancel, GeneratedLevel& out)
+    {
+        LevelgenSearch search {
+            .level_seed = random_hash(level, 0x57494E44ull),
+            .cancel = cancel,
+            .next = 0,
+            .lowest_solvable = LEVELGEN_MAX_CANDIDATES,
+            .mutex = {},
+            .found = {}
+        };
+
+        // Workers take the next candidate as soon as they're done with one, instead of waiting for the slowest of a
+        // batch. They stop past the lowest solvable candidate so far, so when they're all done every lower one was
+        // checked in full and the result is the same on every machine.
+        auto worker_main = [&search]
+        {
+            while (true)
+            {
+                auto candidate = search.next.fetch_add(1, std::memory_order_relaxed);
+                if (candidate >= LEVELGEN_MAX_CANDIDATES || levelgen_search_skips(search, candidate))
+                {
+                    return;
+                }
+                auto seed = random_hash(search.level_seed, candidate);
+                auto generated = levelgen_generate(seed);
+                if (levelgen_verify(generated, seed, &search, candidate))
+                {
+                    std::scoped_lock lock(search.mutex);
+                    if (candidate < search.lowest_solvable.load(std::memory_order_relaxed))
+                    {
+                        search.lowest_solvable.store(candidate, std::memory_order_relaxed);
+                        search.found = std::move(generated);
+                    }
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (u32 i = 0; i < worker_count; i++)
+        {
+            workers.emplace_back(worker_main);
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        // Cancelling cuts candidates short, the lowest one found may not be the lowest there is.
+        if (cancel && cancel->load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        if (search.lowest_solvable.load(std::memory_order_relaxed) == LEVELGEN_MAX_CANDIDATES)
+        {
+            // Practically unreachable, a single normal wall in the open is always beatable.
+            assert(false);
+            out = levelgen_generate(search.level_seed);
+            return true;
+        }
+        out = std::move(search.found);
+        return true;
+    }
+
+    GeneratedLevel levelgen_generate_verified(u32 level)
+    {
+        auto& prefetch = levelgen_prefetch_state;
+        {
+            std::unique_lock lock(prefetch.mutex);
+            prefetch.finished.wait(lock, [&prefetch, level] { return prefetch.pending != level; });
+            if (auto cached = levelgen_find_cached(prefetch, level))
+            {
+                return cached->generated;
+            }
+        }
+
+        auto result = GeneratedLevel{};
+        levelgen_search_verified(level, levelgen_worker_count(), nullptr, result);
+        std::scoped_lock lock(prefetch.mutex);
+        levelgen_cache(prefetch, level, result);
+        return result;
+    }
+
+    void levelgen_prefetch(u32 level)
+    {
+        auto& prefetch = levelgen_prefetch_state;
+        std::unique_lock lock(prefetch.mutex);
+        if (prefetch.pending == level || levelgen_find_cached(prefetch, level))
+        {
+            return;
+        }
+        if (prefetch.worker.joinable())
+        {
+            prefetch.cancel.store(true, std::memory_order_relaxed);
+            lock.unlock();
+            prefetch.worker.join();
+            lock.lock();
+        }
+
+        prefetch.cancel.store(false, std::memory_order_relaxed);
+        prefetch.pending = level;
+        auto worker_count = std::max(1u, levelgen_worker_count() - std::min(levelgen_worker_count() - 1, LEVELGEN_PREFETCH_SPARE_CORES));
+        prefetch.worker = std::thread([&prefetch, level, worker_count]
+        {
+            auto previous_tag = memory_tag_push(MemoryTag::Levels);
+            auto generated = GeneratedLevel{};
+            bool done = levelgen_search_verified(level, worker_count, &prefetch.cancel, generated);
+            {
+                std::scoped_lock lock(prefetch.mutex);
+                if (done)
+                {
+                    levelgen_cache(prefetch, level, std::move(generated));
+                }
+                prefetch.pending = std::nullopt;
+            }
+            prefetch.finished.notify_all();
+            memory_tag_pop(previous_tag);
+        });
+    }
+
+    void levelgen_prefetch_stop()
+    {
+        auto& prefetch = levelgen_prefetch_state;
+        if (prefetch.worker.joinable())
+        {
+            prefetch.cancel.store(true, std::memory_order_relaxed);
+            prefetch.worker.join();
+        }
+    }
+
+    void levelgen_generate_verified_batch(u64 first_seed, u32 count, std::vector<GeneratedLevel>& out)
+    {
+        std::mutex out_mutex;
+        std::atomic<u64> next_seed = first_seed;
+        std::atomic<u32> found = 0;
+        auto worker_main = [&]
+        {
+            while (found.load(std::memory_order_relaxed) < count)
+            {
+                auto seed = next_seed.fetch_add(1, std::memory_order_relaxed);
+                auto candidate = levelgen_generate(seed);
+                if (!levelgen_is_solvable(candidate, seed))
+                {
+                    continue;
+                }
+                if (found.fetch_add(1, std::memory_order_relaxed) < count)
+                {
+                    std::scoped_lock lock(out_mutex);
+                    out.emplace_back(std::move(candidate));
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (u32 i = 0; i < levelgen_worker_count(); i++)
+        {
+            workers.emplace_back(worker_main);
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        std::ranges::sort(out, [] (GeneratedLevel& a, GeneratedLevel& b) { return a.seed < b.seed; });
+    }
+}
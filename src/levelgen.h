@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+namespace woc
+{
+    constexpr u32 LEVELGEN_MIN_NORMAL_WALLS = 2;
+    constexpr u32 LEVELGEN_MAX_NORMAL_WALLS = 8;
+    constexpr u32 LEVELGEN_MAX_INDESTRUCTIBLE_WALLS = 4;
+    constexpr u32 LEVELGEN_MAX_WIND_ZONES = 2;
+    constexpr f32 LEVELGEN_MOVING_WALL_CHANCE = 0.3f;
+    constexpr u32 LEVELGEN_PLACEMENT_ATTEMPTS = 32;
+    constexpr f32 LEVELGEN_WALL_PADDING = 30.f;
+    // Walls stay above this so the paddle always has room to line up a shot.
+    constexpr f32 LEVELGEN_LOWEST_WALL_Y = PLAYER_WORLD_Y - 150.f;
+    
+    // Headless playouts are ticked coarser than the live game, still well below a wall's thickness per tick.
+    constexpr f32 LEVELGEN_PLAYOUT_TICK_SECONDS = 1.f / 60.f;
+    constexpr f32 LEVELGEN_PLAYOUT_MAX_SECONDS = 45.f;
+    constexpr u32 LEVELGEN_PLAYOUTS_PER_CANDIDATE = 12;
+    // Candidates whose first playouts never break this share of their win walls are given up on early. Nearly all
+    // candidates are rejected, and most of them get nowhere, so this skips most of the playouts.
+    constexpr u32 LEVELGEN_FIRST_PASS_PLAYOUTS = 4;
+    constexpr f32 LEVELGEN_FIRST_PASS_MIN_PROGRESS = 0.5f;
+    constexpr u32 LEVELGEN_MAX_CANDIDATES = 4096;
+    // Verified levels kept around, enough for the one being played and the one prefetched after it.
+    constexpr u32 LEVELGEN_CACHED_LEVELS = 2;
+    // Cores a prefetch leaves to the simulation and render threads.
+    constexpr u32 LEVELGEN_PREFETCH_SPARE_CORES = 2;
+
+    // Large levels lay one wall per cell of a jittered grid growing up from the wall area, for stress testing
+    // scrolling and culling. Every LEVELGEN_LARGE_INDESTRUCTIBLE_EVERY-th wall is indestructible.
+    constexpr Vector2 LEVELGEN_LARGE_CELL_SIZE = Vector2 { 200.f, 150.f };
+    constexpr u32 LEVELGEN_LARGE_INDESTRUCTIBLE_EVERY = 8;
+    constexpr f32 LEVELGEN_LARGE_WORLD_MARGIN = 200.f;
+
+    struct GeneratedLevel
+    {
+        u64 seed;
+        std::vector<EnemyState> enemies;
+        std::vector<WindZone> wind_zones;
+        u32 balls_available;
+        u32 wind_available;
+        Vector2 world_min = WORLD_MIN;
+        Vector2 world_max = WORLD_MAX;
+    };
+
+    // Half size of a wall's axis-aligned bounds.
+    Vector2 levelgen_half_extents(Vector2 size, Radian rot);
+    // Axis-aligned bounds of everywhere a wall can be over its whole motion.
+    void levelgen_swept_bounds(EnemyState& enemy, Vector2& center, Vector2& half_extents);
+    // Same seed, same layout. Nothing here is checked for solvability.
+    GeneratedLevel levelgen_generate(u64 seed);
+    void levelgen_apply(GeneratedLevel& level, GameState& game_state);
+    // Runs randomized headless playouts and returns true as soon as one of them wins, or false once the first pass
+    // shows too little progress.
+    bool levelgen_is_solvable(GeneratedLevel& level, u64 playout_seed);
+    // Deterministic per level number. Candidates are checked in parallel, the lowest solvable one wins.
+    // Returns a cached or prefetched level when there is one, waiting for the prefetch if it's still running.
+    GeneratedLevel levelgen_generate_verified(u32 level);
+    // Starts verifying level on a background thread, so levelgen_generate_verified doesn't hold up the caller for
+    // the whole search. One at a time, starting another cancels an unfinished one. Main thread only.
+    void levelgen_prefetch(u32 level);
+    // Cancels the prefetch and joins its thread, before exit.
+    void levelgen_prefetch_stop();
+    // Fills out with count solvable levels from consecutive seeds, using every core.
+    void levelgen_generate_verified_batch(u64 first_seed, u32 count, std::vector<GeneratedLevel>& out);
+    // wall_count walls in a world sized to fit them. Only the walls inside the default world count towards
+    // winning, the rest is scenery to scroll through. Not checked for solvability, nor against physics_fits.
+    GeneratedLevel levelgen_generate_large(u64 seed, u32 wall_count);
+}
@@ -0,0 +1,469 @@
+﻿#include "levelstream.h"
+#include "levelgen.h"
+#include "broadphase.h"
+#include "memory.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+namespace woc
+{
+    woc_internal void level_stream_load(LevelStream& stream, u32 chunk, std::vector<EnemyState>& walls)
+    {
+        auto& info = stream.grid.chunks.at(chunk);
+        auto path = levelfile_chunk_path(stream.level, chunk);
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream text;
+        text << file.rdbuf();
+        auto definition = LevelDefinition{};
+        auto error = std::string{};
+        if (!file || !levelfile_parse(text.str(), definition, error) || definition.enemies.size() != info.wall_count)
+        {
+            // Loaded empty rather than half, the level is still playable without it.
+            std::cerr << path << ": can't load chunk " << error << "\n";
+            definition.enemies.clear();
+        }
+        walls = std::move(definition.enemies);
+        for (u32 i = 0; i < walls.size(); i++)
+        {
+            walls.at(i).level_index = info.first_wall + i;
+        }
+    }
+
+    // Drops the least recently wanted chunks that are done loading until the cache fits again.
+    woc_internal void level_stream_evict(LevelStream& stream)
+    {
+        while (stream.cache.size() > LEVEL_STREAM_CACHE_CHUNKS)
+        {
+            auto oldest = stream.cache.end();
+            for (auto it = stream.cache.begin(); it != stream.cache.end(); it++)
+            {
+                if (it->second.ready && (oldest == stream.cache.end() || it->second.last_wanted < oldest->second.last_wanted))
+                {
+                    oldest = it;
+                }
+            }
+            if (oldest == stream.cache.end())
+            {
+                return;
+            }
+            stream.cache.erase(oldest);
+            stream.evictions++;
+        }
+    }
+
+    woc_internal void level_stream_worker_main(LevelStream& stream)
+    {
+        auto previous_tag = memory_tag_push(MemoryTag::Levels);
+        auto walls = std::vector<EnemyState>{};
+        std::unique_lock lock(stream.mutex);
+        while (true)
+        {
+            stream.wake.wait(lock, [&stream] { return stream.stopping || !stream.requests.empty(); });
+            if (stream.stopping)
+            {
+                break;
+            }
+            auto chunk = stream.requests.front();
+            stream.requests.pop_front();
+            auto it = stream.cache.find(chunk);
+            if (it == stream.cache.end() || it->second.ready)
+            {
+                continue;
+            }
+
+            lock.unlock();
+            level_stream_load(stream, chunk, walls);
+            lock.lock();
+            // Requested chunks are never evicted before they're ready, so the entry is still there.
+            auto& entry = stream.cache.at(chunk);
+            entry.walls = std::move(walls);
+            entry.ready = true;
+            stream.loads++;
+            counters_add(Counter::ChunkLoads, 1);
+            level_stream_evict(stream);
+            stream.loaded.notify_all();
+        }
+        memory_tag_pop(previous_tag);
+    }
+
+    woc_internal void level_stream_close(LevelStream* stream)
+    {
+        {
+            std::scoped_lock lock(stream->mutex);
+            stream->stopping = true;
+        }
+        stream->wake.notify_all();
+        if (stream->worker.joinable())
+        {
+            stream->worker.join();
+        }
+        auto previous_tag = memory_tag_push(MemoryTag::Levels);
+        delete stream;
+        memory_tag_pop(previous_tag);
+    }
+
+    // Needs the lock held. Queues the chunk unless it's cached or already queued, at the front when someone waits on it.
+    woc_internal LevelStreamChunk& level_stream_request(LevelStream& stream, u32 chunk, bool urgent)
+    {
+        auto [it, inserted] = stream.cache.try_emplace(chunk, LevelStreamChunk { .ready = false, .last_wanted = 0, .walls = {} });
+        if (!it->second.ready && (inserted || urgent))
+        {
+            if (urgent)
+            {
+                stream.requests.push_front(chunk);
+            } else {
+                stream.requests.push_back(chunk);
+            }
+            stream.wake.notify_one();
+        }
+        return it->second;
+    }
+
+    // Copies the chunk's walls out, waiting for the worker if they aren't loaded yet.
+    woc_internal void level_stream_read(LevelStream& stream, u32 chunk, std::vector<EnemyState>& out)
+    {
+        std::unique_lock lock(stream.mutex);
+        auto* entry = &level_stream_request(stream, chunk, false);
+        // Newest of all, so finishing other loads can't evict it before it's copied out.
+        entry->last_wanted = ++stream.want_clock;
+        if (!entry->ready)
+        {
+            auto start = std::chrono::steady_clock::now();
+            level_stream_request(stream, chunk, true);
+            stream.loaded.wait(lock, [&stream, chunk] { auto it = stream.cache.find(chunk); return it != stream.cache.end() && it->second.ready; });
+            auto seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+            stream.stalls++;
+            stream.stall_seconds += seconds;
+            stream.max_stall_seconds = std::max(stream.max_stall_seconds, seconds);
+            counters_add(Counter::ChunkStalls, 1);
+            entry = &stream.cache.at(chunk);
+        }
+        out = entry->walls;
+    }
+
+    woc_internal void level_stream_prefetch(LevelStream& stream, std::vector<u32>& chunks)
+    {
+        std::scoped_lock lock(stream.mutex);
+        if (chunks == stream.wanted)
+        {
+            return;
+        }
+        stream.wanted = chunks;
+        stream.want_clock++;
+        for (auto chunk : chunks)
+        {
+            level_stream_request(stream, chunk, false).last_wanted = stream.want_clock;
+        }
+    }
+
+    woc_internal void level_stream_cell(LevelChunkGrid& grid, Vector2 pos, i32& x, i32& y)
+    {
+        x = std::clamp(static_cast<i32>(std::floor((pos.x - grid.origin.x) / grid.size)), 0, static_cast<i32>(grid.columns) - 1);
+        y = std::clamp(static_cast<i32>(std::floor((pos.y - grid.origin.y) / grid.size)), 0, static_cast<i32>(grid.rows) - 1);
+    }
+
+    // Adds every chunk overlapping min..max grown by radius chunks. Empty ones are left out, there's nothing to load.
+    woc_internal void level_stream_add_area(LevelChunkGrid& grid, Vector2 min, Vector2 max, i32 radius, std::vector<u32>& out)
+    {
+        i32 min_x, min_y, max_x, max_y;
+        level_stream_cell(grid, min, min_x, min_y);
+        level_stream_cell(grid, max, max_x, max_y);
+        min_x = std::max(min_x - radius, 0);
+        min_y = std::max(min_y - radius, 0);
+        max_x = std::min(max_x + radius, static_cast<i32>(grid.columns) - 1);
+        max_y = std::min(max_y + radius, static_cast<i32>(grid.rows) - 1);
+        for (i32 y = min_y; y <= max_y; y++)
+        {
+            for (i32 x = min_x; x <= max_x; x++)
+            {
+                auto chunk = static_cast<u32>(y) * grid.columns + static_cast<u32>(x);
+                if (grid.chunks.at(chunk).wall_count)
+                {
+                    out.emplace_back(chunk);
+                }
+            }
+        }
+    }
+
+    // The chunks around the paddle, every ball and the view, sorted. lookahead also adds where each ball is headed.
+    woc_internal void level_stream_chunks_around(GameState& game_state, i32 radius, bool lookahead, std::vector<u32>& out)
+    {
+        auto& grid = game_state.chunks.stream->grid;
+        out.clear();
+        auto paddle = Vector2 { game_state.player.pos_x, PLAYER_WORLD_Y };
+        level_stream_add_area(grid, paddle, paddle, radius, out);
+        if (game_state.second_player)
+        {
+            auto second_paddle = Vector2 { game_state.second_player->pos_x, PLAYER_WORLD_Y };
+            level_stream_add_area(grid, second_paddle, second_paddle, radius, out);
+        }
+        for (auto& p : game_state.player_projectiles)
+        {
+            level_stream_add_area(grid, p.pos, p.pos, radius, out);
+            if (lookahead)
+            {
+                auto& owner = p.owner == 0 ? game_state.player : *game_state.second_player;
+                auto ahead = Vector2Add(p.pos, Vector2Scale(p.dir, owner.ball_velocity * LEVEL_STREAM_LOOKAHEAD_SECONDS));
+                level_stream_add_area(grid, ahead, ahead, radius, out);
+            }
+        }
+        // The view itself is awake, the prefetch ring around it is as wide as the one around the balls. The renderer
+        // never shows past these bounds, see Camera::aspect.
+        Vector2 view_min, view_max;
+        camera_view_bounds(game_state.cam, 0.f, view_min, view_max);
+        level_stream_add_area(grid, view_min, view_max, radius - LEVEL_STREAM_AWAKE_RADIUS, out);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    woc_internal bool level_stream_same_wall(EnemyState& a, EnemyState& b)
+    {
+        return a.health == b.health && a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.rot.val == b.rot.val && a.motion.time == b.motion.time;
+    }
+
+    woc_internal std::vector<EnemyState>::iterator level_stream_asleep_at(LevelChunks& chunks, u32 level_index)
+    {
+        return std::ranges::lower_bound(chunks.asleep_walls, level_index, {}, &EnemyState::level_index);
+    }
+
+    // Takes the chunk's walls out of the game, remembering the ones that differ from the file.
+    woc_internal void level_stream_sleep(GameState& game_state, u32 chunk, std::vector<EnemyState>& file_walls, std::vector<EnemyState>& present)
+    {
+        auto& chunks = game_state.chunks;
+        auto& info = chunks.stream->grid.chunks.at(chunk);
+        level_stream_read(*chunks.stream, chunk, file_walls);
+
+        // Wall deaths swap-remove, so the chunk's walls can be anywhere in the game's order.
+        present.clear();
+        std::erase_if(game_state.enemies, [&present, &info] (EnemyState& e)
+        {
+            if (e.level_index < info.first_wall || e.level_index >= info.first_wall + info.wall_count)
+            {
+                return false;
+            }
+            present.emplace_back(e);
+            return true;
+        });
+        std::ranges::sort(present, {}, &EnemyState::level_index);
+
+        auto saved = std::vector<EnemyState>{};
+        size_t next = 0;
+        for (auto& wall : file_walls)
+        {
+            if (next < present.size() && present.at(next).level_index == wall.level_index)
+            {
+                auto& e = present.at(next++);
+                chunks.asleep_win_walls += e.contributes_to_win;
+                if (!level_stream_same_wall(e, wall))
+                {
+                    saved.emplace_back(e);
+                }
+            } else {
+                // Broken while awake.
+                saved.emplace_back(wall).health = 0;
+            }
+        }
+        chunks.asleep_walls.insert(level_stream_asleep_at(chunks, info.first_wall), saved.begin(), saved.end());
+    }
+
+    // Puts the chunk's walls back into the game as they were when it went to sleep.
+    woc_internal void level_stream_wake(GameState& game_state, u32 chunk, std::vector<EnemyState>& file_walls)
+    {
+        auto& chunks = game_state.chunks;
+        auto& info = chunks.stream->grid.chunks.at(chunk);
+        level_stream_read(*chunks.stream, chunk, file_walls);
+
+        auto saved_begin = level_stream_asleep_at(chunks, info.first_wall);
+        auto saved_end = level_stream_asleep_at(chunks, info.first_wall + info.wall_count);
+        auto saved = saved_begin;
+        for (auto& wall : file_walls)
+        {
+            auto* e = &wall;
+            if (saved != saved_end && saved->level_index == wall.level_index)
+            {
+                e = &*saved++;
+                if (e->health <= 0 && e->type != EnemyType::Indestructible)
+                {
+                    continue;
+                }
+            }
+            assert(!e->contributes_to_win || chunks.asleep_win_walls > 0);
+            chunks.asleep_win_walls -= e->contributes_to_win;
+            game_state.enemies.emplace_back(*e);
+        }
+        chunks.asleep_walls.erase(saved_begin, saved_end);
+    }
+
+    bool level_stream_open(GameState& game_state, LevelChunkGrid& grid, std::string& error)
+    {
+        // Chunk files check their own walls when they're parsed.
+        if (!physics_fits(game_state.world_min, game_state.world_max))
+        {
+            error = levelfile_path(game_state.current_level) + ": world reaches past +-" + std::to_string(static_cast<i32>(FIXED_POINT_MAX_COORDINATE))
+                + ", more than fixed point physics can hold";
+            return false;
+        }
+        auto previous_tag = memory_tag_push(MemoryTag::Levels);
+        auto* stream = new LevelStream{};
+        stream->level = game_state.current_level;
+        stream->grid = grid;
+        u32 win_walls = 0;
+        for (auto& chunk : grid.chunks)
+        {
+            win_walls += chunk.win_walls;
+        }
+        game_state.chunks = LevelChunks {
+            .stream = std::shared_ptr<LevelStream>(stream, level_stream_close),
+            .awake = {},
+            .asleep_walls = {},
+            .asleep_win_walls = win_walls
+        };
+        stream->worker = std::thread(level_stream_worker_main, std::ref(*stream));
+        memory_tag_pop(previous_tag);
+
+        auto around = std::vector<u32>{};
+        level_stream_chunks_around(game_state, LEVEL_STREAM_PREFETCH_RADIUS, true, around);
+        level_stream_prefetch(*stream, around);
+        return true;
+    }
+
+    void level_stream_update(GameState& game_state)
+    {
+        auto& chunks = game_state.chunks;
+        auto& stream = *chunks.stream;
+        // Reused between ticks, rewinds and restarts of the same thread.
+        thread_local std::vector<u32> awake;
+        thread_local std::vector<u32> changed;
+        thread_local std::vector<EnemyState> file_walls;
+        thread_local std::vector<EnemyState> present;
+
+        level_stream_chunks_around(game_state, LEVEL_STREAM_AWAKE_RADIUS, false, awake);
+        if (awake != chunks.awake)
+        {
+            changed.clear();
+            std::ranges::set_difference(chunks.awake, awake, std::back_inserter(changed));
+            for (auto chunk : changed)
+            {
+                level_stream_sleep(game_state, chunk, file_walls, present);
+            }
+            changed.clear();
+            std::ranges::set_difference(awake, chunks.awake, std::back_inserter(changed));
+            for (auto chunk : changed)
+            {
+                level_stream_wake(game_state, chunk, file_walls);
+            }
+            chunks.awake = awake;
+            broadphase_build(game_state.broadphase, game_state.enemies);
+        }
+
+        level_stream_chunks_around(game_state, LEVEL_STREAM_PREFETCH_RADIUS, true, awake);
+        level_stream_prefetch(stream, awake);
+    }
+
+    bool level_stream_write(u32 level, LevelDefinition& definition, f32 chunk_size, std::string& error)
+    {
+        if (definition.chunk_grid.size > 0.f)
+        {
+            error = levelfile_path(level) + ": already streamed";
+            return false;
+        }
+        if (chunk_size < LEVEL_STREAM_MIN_CHUNK_SIZE)
+        {
+            error = "chunks must be at least " + std::to_string(LEVEL_STREAM_MIN_CHUNK_SIZE) + " across";
+            return false;
+        }
+        if (!physics_fits(definition.world_min, definition.world_max))
+        {
+            error = levelfile_path(level) + ": world reaches past +-" + std::to_string(static_cast<i32>(FIXED_POINT_MAX_COORDINATE))
+                + ", more than fixed point physics can hold";
+            return false;
+        }
+
+        auto grid = LevelChunkGrid {
+            .size = chunk_size,
+            .origin = definition.world_min,
+            .columns = static_cast<u32>(std::max(1.f, std::ceil((definition.world_max.x - definition.world_min.x) / chunk_size))),
+            .rows = static_cast<u32>(std::max(1.f, std::ceil((definition.world_max.y - definition.world_min.y) / chunk_size))),
+            .chunks = {}
+        };
+        grid.chunks.assign(static_cast<size_t>(grid.columns) * grid.rows, LevelChunkInfo{});
+
+        // A wall belongs to the chunk its sweep is centered in. Kept within half a chunk of that, it can only
+        // reach into the neighbouring ones, which are always awake along with whatever it could touch.
+        std::vector<std::vector<EnemyState>> walls(grid.chunks.size());
+        for (auto& e : definition.enemies)
+        {
+            Vector2 center, half_extents;
+            levelgen_swept_bounds(e, center, half_extents);
+            if (half_extents.x > chunk_size * 0.5f || half_extents.y > chunk_size * 0.5f)
+            {
+                error = "a wall at " + std::to_string(e.pos.x) + "," + std::to_string(e.pos.y) + " reaches further than half a chunk";
+                return false;
+            }
+            if (!physics_fits(Vector2Subtract(center, half_extents), Vector2Add(center, half_extents)))
+            {
+                error = "a wall at " + std::to_string(e.pos.x) + "," + std::to_string(e.pos.y) + " moves past what fixed point physics can hold";
+                return false;
+            }
+            i32 x, y;
+            level_stream_cell(grid, center, x, y);
+            walls.at(static_cast<u32>(y) * grid.columns + static_cast<u32>(x)).emplace_back(e);
+        }
+
+        auto directory = std::filesystem::path(levelfile_chunk_path(level, 0)).parent_path();
+        std::error_code directory_error;
+        std::filesystem::remove_all(directory, directory_error);
+        std::filesystem::create_directories(directory, directory_error);
+        if (directory_error)
+        {
+            error = directory.string() + ": " + directory_error.message();
+            return false;
+        }
+        u32 first_wall = 0;
+        for (u32 i = 0; i < grid.chunks.size(); i++)
+        {
+            auto& chunk_walls = walls.at(i);
+            if (chunk_walls.empty())
+            {
+                continue;
+            }
+            auto& info = grid.chunks.at(i);
+            info.first_wall = first_wall;
+            info.wall_count = static_cast<u32>(chunk_walls.size());
+            info.win_walls = static_cast<u32>(std::ranges::count_if(chunk_walls, [] (EnemyState& e) { return e.contributes_to_win; }));
+            first_wall += info.wall_count;
+
+            auto path = levelfile_chunk_path(level, i);
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file << levelfile_format_walls(chunk_walls);
+            if (!file)
+            {
+                error = path + ": can't write";
+                return false;
+            }
+        }
+
+        auto header = definition;
+        header.enemies.clear();
+        header.chunk_grid = std::move(grid);
+        return levelfile_save(level, header, error);
+    }
+
+    void level_stream_report(LevelStream& stream, std::ostream& out)
+    {
+        std::scoped_lock lock(stream.mutex);
+        out << "level stream: " << stream.grid.columns << "x" << stream.grid.rows << " chunks of " << stream.grid.size << ", "
+            << stream.loads << " loads, " << stream.evictions << " evictions, " << stream.cache.size() << " cached, "
+            << stream.stalls << " stalls";
+        if (stream.stalls)
+        {
+            out << " (" << std::fixed << std::setprecision(2) << stream.stall_seconds / static_cast<f64>(stream.stalls) * 1000.0
+                << " ms average, " << stream.max_stall_seconds * 1000.0 << " ms worst)" << std::defaultfloat;
+        }
+        out << "\n";
+    }
+}
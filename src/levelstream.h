@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+#include "levelfile.h"
+
+#include <condition_variable>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+
+namespace woc
+{
+    // Chunks this many squares around the paddle and every ball are awake, as is every chunk the view overlaps.
+    // Only awake chunks have their walls in the game, so only they collide, move and get drawn.
+    constexpr i32 LEVEL_STREAM_AWAKE_RADIUS = 1;
+    // Waking needs the chunk's walls right away, so this much further out is loaded ahead on the worker.
+    constexpr i32 LEVEL_STREAM_PREFETCH_RADIUS = 2;
+    // Where each ball will be this much later is prefetched too, so fast balls don't outrun the loads.
+    constexpr f32 LEVEL_STREAM_LOOKAHEAD_SECONDS = 1.f;
+    // Parsed chunk files kept in memory. Past this the least recently wanted ones are dropped and read again if
+    // they're needed later.
+    constexpr u32 LEVEL_STREAM_CACHE_CHUNKS = 256;
+    // Smaller chunks would wake too many at a time to be worth streaming.
+    constexpr f32 LEVEL_STREAM_MIN_CHUNK_SIZE = 250.f;
+
+    struct LevelStreamChunk
+    {
+        // Set by the worker once walls holds the chunk file.
+        bool ready;
+        u64 last_wanted;
+        std::vector<EnemyState> walls;
+    };
+
+    // Loads the chunk files of one streamed level on a worker thread and keeps a bounded cache of them. The chunk
+    // files never change while it's open, so everything read from it is the same whenever and on whichever
+    // thread it's read, and game_update stays deterministic however far behind the worker is.
+    struct LevelStream
+    {
+        u32 level;
+        LevelChunkGrid grid;
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable loaded;
+        // Guarded by mutex.
+        std::unordered_map<u32, LevelStreamChunk> cache;
+        std::deque<u32> requests;
+        // The last set of chunks asked for, to skip asking again while nothing changed.
+        std::vector<u32> wanted;
+        u64 want_clock;
+        bool stopping;
+        u64 loads;
+        u64 evictions;
+        // Reads that had to wait for the disk because nothing prefetched the chunk in time.
+        u64 stalls;
+        f64 stall_seconds;
+        f64 max_stall_seconds;
+    };
+
+    // Starts streaming the game's level and puts every chunk to sleep. The first level_stream_update wakes the
+    // ones around the paddle, the worker starts on them right away. Refuses grids past what physics_fits allows,
+    // the game is left without walls then.
+    bool level_stream_open(GameState& game_state, LevelChunkGrid& grid, std::string& error);
+    // Wakes and sleeps chunks for where the paddle, balls and view are now and asks the worker for the ones
+    // they're heading to. game_update calls it at the start of every tick of a streamed level.
+    void level_stream_update(GameState& game_state);
+    // Splits a level file's walls into chunk files of chunk_size squares and rewrites the level file to stream
+    // them. Fails on walls whose whole motion doesn't fit in half a chunk, and on worlds past physics_fits.
+    bool level_stream_write(u32 level, LevelDefinition& definition, f32 chunk_size, std::string& error);
+    void level_stream_report(LevelStream& stream, std::ostream& out);
+}
@@ -0,0 +1,311 @@
+﻿#include "memory.h"
+#include "counters.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+
+// 1 routes every operator new through memory_alloc, charged to the thread's current tag. Off leaves the global
+// allocator alone and only tagged containers and raylib hooks are accounted.
+#ifndef WOC_COUNT_ALLOCATIONS
+#define WOC_COUNT_ALLOCATIONS 1
+#endif
+
+// 1 keeps every live block on a list, so leaks at shutdown are listed with the sequence number they were
+// allocated at. Costs a lock per allocation.
+#ifndef WOC_MEMORY_TRACK_ALLOCATIONS
+#define WOC_MEMORY_TRACK_ALLOCATIONS 0
+#endif
+
+namespace woc
+{
+    // In front of every block, keeps the 16 byte alignment malloc gives.
+    struct alignas(16) MemoryHeader
+    {
+        u64 size;
+        MemoryTag tag;
+#if WOC_MEMORY_TRACK_ALLOCATIONS
+        u64 sequence;
+        MemoryHeader* prev;
+        MemoryHeader* next;
+#endif
+    };
+
+    struct alignas(64) MemoryTagCounters
+    {
+        std::atomic<u64> bytes;
+        std::atomic<u64> peak_bytes;
+        std::atomic<u64> report_peak_bytes;
+        std::atomic<u64> allocations;
+        std::atomic<u64> total_allocations;
+        std::atomic<u64> external_bytes;
+    };
+
+    // All zero before anything runs, allocations during static initialization are accounted too.
+    woc_global std::array<MemoryTagCounters, MEMORY_TAG_COUNT> memory_tags;
+    woc_global thread_local MemoryTag memory_thread_tag = MemoryTag::Untagged;
+#if WOC_MEMORY_TRACK_ALLOCATIONS
+    woc_global std::mutex memory_list_mutex;
+    woc_global MemoryHeader* memory_list = nullptr;
+    woc_global u64 memory_next_sequence = 0;
+#endif
+
+    MemoryTag memory_tag_push(MemoryTag tag)
+    {
+        return std::exchange(memory_thread_tag, tag);
+    }
+
+    void memory_tag_pop(MemoryTag previous)
+    {
+        memory_thread_tag = previous;
+    }
+
+    woc_internal void memory_raise(std::atomic<u64>& peak, u64 value)
+    {
+        auto current = peak.load(std::memory_order_relaxed);
+        while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void* memory_alloc(size_t size, MemoryTag tag)
+    {
+        auto header = static_cast<MemoryHeader*>(std::malloc(sizeof(MemoryHeader) + size));
+        if (!header)
+        {
+            return nullptr;
+        }
+        header->size = size;
+        header->tag = tag;
+#if WOC_MEMORY_TRACK_ALLOCATIONS
+        {
+            std::scoped_lock lock(memory_list_mutex);
+            header->sequence = memory_next_sequence++;
+            header->prev = nullptr;
+            header->next = memory_list;
+            if (memory_list)
+            {
+                memory_list->prev = header;
+            }
+            memory_list = header;
+        }
+#endif
+
+        auto& counters = memory_tags.at(static_cast<u32>(tag));
+        auto bytes = counters.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        memory_raise(counters.peak_bytes, bytes);
+        memory_raise(counters.report_peak_bytes, bytes);
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.total_allocations.fetch_add(1, std::memory_order_relaxed);
+        counters_add(Counter::Allocations, 1);
+        counters_add(Counter::AllocatedBytes, size);
+        return header + 1;
+    }
+
+    void memory_free(void* memory)
+    {
+        if (!memory)
+        {
+            return;
+        }
+        auto header = static_cast<MemoryHeader*>(memory) - 1;
+        auto& counters = memory_tags.at(static_cast<u32>(header->tag));
+        counters.bytes.fetch_sub(header->size, std::memory_order_relaxed);
+        counters.allocations.fetch_sub(1, std::memory_order_relaxed);
+#if WOC_MEMORY_TRACK_ALLOCATIONS
+        {
+            std::scoped_lock lock(memory_list_mutex);
+            (header->prev ? header->prev->next : memory_list) = header->next;
+            if (header->next)
+            {
+                header->next->prev = header->prev;
+            }
+        }
+#endif
+        std::free(header);
+    }
+
+    // Keeps the block's tag, a buffer raylib grows stays charged to whoever first asked for it.
+    void* memory_realloc(void* memory, size_t size)
+    {
+        if (!memory)
+        {
+            return memory_alloc(size, memory_thread_tag);
+        }
+        auto header = static_cast<MemoryHeader*>(memory) - 1;
+        auto result = memory_alloc(size, header->tag);
+        if (result)
+        {
+            std::memcpy(result, memory, std::min<u64>(size, header->size));
+            memory_free(memory);
+        }
+        return result;
+    }
+
+    MemoryTagStats memory_stats(MemoryTag tag)
+    {
+        auto& counters = memory_tags.at(static_cast<u32>(tag));
+        return MemoryTagStats {
+            .bytes = counters.bytes.load(std::memory_order_relaxed),
+            .peak_bytes = counters.peak_bytes.load(std::memory_order_relaxed),
+            .report_peak_bytes = counters.report_peak_bytes.load(std::memory_order_relaxed),
+            .allocations = counters.allocations.load(std::memory_order_relaxed),
+            .total_allocations = counters.total_allocations.load(std::memory_order_relaxed),
+            .external_bytes = counters.external_bytes.load(std::memory_order_relaxed)
+        };
+    }
+
+    void memory_set_external(MemoryTag tag, u64 bytes)
+    {
+        memory_tags.at(static_cast<u32>(tag)).external_bytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    u64 memory_texture_bytes(Texture2D& texture)
+    {
+        u64 bytes = 0;
+        for (i32 level = 0; level < std::max(texture.mipmaps, 1); level++)
+        {
+            bytes += static_cast<u64>(GetPixelDataSize(std::max(texture.width >> level, 1), std::max(texture.height >> level, 1), texture.format));
+        }
+        return texture.id ? bytes : 0;
+    }
+
+    u64 memory_sound_bytes(Sound& sound)
+    {
+        return static_cast<u64>(sound.frameCount) * sound.stream.channels * (sound.stream.sampleSize / 8);
+    }
+
+    u64 memory_font_bytes(Font& font)
+    {
+        auto bytes = memory_texture_bytes(font.texture);
+        if (font.recs)
+        {
+            bytes += static_cast<u64>(font.glyphCount) * sizeof(Rectangle);
+        }
+        if (font.glyphs)
+        {
+            bytes += static_cast<u64>(font.glyphCount) * sizeof(GlyphInfo);
+            for (i32 i = 0; i < font.glyphCount; i++)
+            {
+                auto& image = font.glyphs[i].image;
+                bytes += image.data ? static_cast<u64>(GetPixelDataSize(image.width, image.height, image.format)) : 0;
+            }
+        }
+        return bytes;
+    }
+
+    void memory_report(std::ostream& out, std::string_view label)
+    {
+        constexpr f64 KB = 1024.0;
+        out << "memory, " << label << ":\n" << std::fixed << std::setprecision(1)
+            << "  " << std::left << std::setw(12) << "tag" << std::right
+            << std::setw(12) << "KB" << std::setw(12) << "peak KB" << std::setw(12) << "window KB"
+            << std::setw(10) << "blocks" << std::setw(12) << "raylib KB" << "\n";
+        u64 heap = 0;
+        u64 external = 0;
+        for (u32 i = 0; i < MEMORY_TAG_COUNT; i++)
+        {
+            auto stats = memory_stats(static_cast<MemoryTag>(i));
+            memory_tags.at(i).report_peak_bytes.store(stats.bytes, std::memory_order_relaxed);
+            heap += stats.bytes;
+            external += stats.external_bytes;
+            if (!stats.total_allocations && !stats.external_bytes)
+            {
+                continue;
+            }
+            out << "  " << std::left << std::setw(12) << MEMORY_TAG_NAMES.at(i) << std::right
+                << std::setw(12) << static_cast<f64>(stats.bytes) / KB
+                << std::setw(12) << static_cast<f64>(stats.peak_bytes) / KB
+                << std::setw(12) << static_cast<f64>(stats.report_peak_bytes) / KB
+                << std::setw(10) << stats.allocations
+                << std::setw(12) << static_cast<f64>(stats.external_bytes) / KB << "\n";
+        }
+        out << "  total " << static_cast<f64>(heap) / KB << " KB heap, " << static_cast<f64>(external) / KB << " KB held by raylib\n"
+            << std::defaultfloat;
+    }
+
+    bool memory_report_leaks(std::ostream& out)
+    {
+        bool leaked = false;
+        for (u32 i = 0; i < MEMORY_TAG_COUNT; i++)
+        {
+            auto stats = memory_stats(static_cast<MemoryTag>(i));
+            if (static_cast<MemoryTag>(i) == MemoryTag::Untagged || !stats.allocations)
+            {
+                continue;
+            }
+            leaked = true;
+            out << "leaked " << stats.bytes << " bytes in " << stats.allocations << " blocks tagged " << MEMORY_TAG_NAMES.at(i) << "\n";
+        }
+#if WOC_MEMORY_TRACK_ALLOCATIONS
+        std::scoped_lock lock(memory_list_mutex);
+        u32 listed = 0;
+        for (auto header = memory_list; header && listed < MEMORY_MAX_LISTED_LEAKS; header = header->next)
+        {
+            if (header->tag != MemoryTag::Untagged)
+            {
+                out << "  block " << header->sequence << ", " << header->size << " bytes, " << MEMORY_TAG_NAMES.at(static_cast<u32>(header->tag)) << "\n";
+                listed++;
+            }
+        }
+#endif
+        return leaked;
+    }
+}
+
+extern "C"
+{
+    void* woc_rl_malloc(size_t size)
+    {
+        return woc::memory_alloc(size, woc::memory_thread_tag);
+    }
+
+    void* woc_rl_calloc(size_t count, size_t size)
+    {
+        auto memory = woc::memory_alloc(count * size, woc::memory_thread_tag);
+        if (memory)
+        {
+            std::memset(memory, 0, count * size);
+        }
+        return memory;
+    }
+
+    void* woc_rl_realloc(void* memory, size_t size)
+    {
+        return woc::memory_realloc(memory, size);
+    }
+
+    void woc_rl_free(void* memory)
+    {
+        woc::memory_free(memory);
+    }
+}
+
+#if WOC_COUNT_ALLOCATIONS
+// GCC inlines a replaced delete into std code it can see the new of, then warns that free() doesn't match.
+#if defined(__GNUC__)
+#define WOC_ALLOCATOR_NOINLINE __attribute__((noinline))
+#else
+#define WOC_ALLOCATOR_NOINLINE
+#endif
+
+void* operator new(std::size_t size)
+{
+    if (auto memory = woc::memory_alloc(size ? size : 1, woc::memory_thread_tag))
+    {
+        return memory;
+    }
+    throw std::bad_alloc{};
+}
+
+WOC_ALLOCATOR_NOINLINE void operator delete(void* memory) noexcept
+{
+    woc::memory_free(memory);
+}
+
+WOC_ALLOCATOR_NOINLINE void operator delete(void* memory, std::size_t size) noexcept
+{
+    woc::memory_free(memory);
+}
+#endif
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+
+namespace woc
+{
+    constexpr u32 MEMORY_TAG_COUNT = static_cast<u32>(MemoryTag::Count);
+    constexpr std::array<const char*, MEMORY_TAG_COUNT> MEMORY_TAG_NAMES = {
+        "untagged", "game", "rewind", "particles", "levels", "editor", "ui", "audio", "textures", "fonts", "capture"
+    };
+    // Leaked blocks listed one by one at shutdown, with WOC_MEMORY_TRACK_ALLOCATIONS.
+    constexpr u32 MEMORY_MAX_LISTED_LEAKS = 20;
+
+    struct MemoryTagStats
+    {
+        u64 bytes;
+        u64 peak_bytes;
+        // Highest since the last memory_report.
+        u64 report_peak_bytes;
+        u64 allocations;
+        u64 total_allocations;
+        // Held by raylib outside our heap: decoded sounds, texture and font pixels, sized from what it hands back.
+        u64 external_bytes;
+    };
+
+    // Tags this thread's allocations until the matching pop. Takes and hands back the tag it replaces:
+    //     auto previous = memory_tag_push(MemoryTag::Audio);
+    //     ...
+    //     memory_tag_pop(previous);
+    MemoryTag memory_tag_push(MemoryTag tag);
+    void memory_tag_pop(MemoryTag previous);
+    void* memory_realloc(void* memory, size_t size);
+    MemoryTagStats memory_stats(MemoryTag tag);
+
+    void memory_set_external(MemoryTag tag, u64 bytes);
+    u64 memory_texture_bytes(Texture2D& texture);
+    u64 memory_sound_bytes(Sound& sound);
+    u64 memory_font_bytes(Font& font);
+
+    // A table of every tag's current and peak use, then starts a new peak window. label says what the window covered.
+    void memory_report(std::ostream& out, std::string_view label);
+    // Tagged memory still allocated. Call once everything that owns any has been destroyed. Untagged memory isn't
+    // checked, the standard library keeps some of its own until after main returns.
+    bool memory_report_leaks(std::ostream& out);
+}
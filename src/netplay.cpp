@@ -0,0 +1,664 @@
+﻿#include "netplay.h"
+#include "counters.h"
+
+#include <iomanip>
+#include <ostream>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace woc
+{
+    constexpr u32 NETPLAY_SAVED_STATES = NETPLAY_MAX_ROLLBACK_TICKS + 1;
+
+    // Only what game_update reads, at the precision it reads it, so the peer decodes exactly what was simulated.
+    woc_internal InputState netplay_normalize_input(InputState input)
+    {
+        return InputState {
+            .move_dir = std::clamp(input.move_dir, -1, 1),
+            .wind_dir_x = std::clamp(input.wind_dir_x, -1, 1),
+            .wind_dir_y = std::clamp(input.wind_dir_y, -1, 1),
+            .send_ball = input.send_ball != 0,
+            .cast_gust = input.cast_gust != 0
+        };
+    }
+
+    woc_internal bool netplay_same_input(InputState& a, InputState& b)
+    {
+        return a.move_dir == b.move_dir && a.wind_dir_x == b.wind_dir_x && a.wind_dir_y == b.wind_dir_y
+            && a.send_ball == b.send_ball && a.cast_gust == b.cast_gust;
+    }
+
+    // The peer's last known input held, a gust is a press so it isn't repeated.
+    woc_internal InputState netplay_predict_input(Netplay& netplay)
+    {
+        auto remote = 1 - netplay.local_player;
+        auto input = netplay.inputs.at(remote).at((netplay.remote_input_end - 1) % NETPLAY_INPUT_HISTORY);
+        input.cast_gust = 0;
+        return input;
+    }
+
+    // Packets are the peer's view of the same build, so values go over as they are in memory.
+    template<typename T>
+    woc_internal void netplay_write(std::vector<u8>& out, T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto offset = out.size();
+        out.resize(offset + sizeof(T));
+        std::memcpy(out.data() + offset, &value, sizeof(T));
+    }
+
+    template<typename T>
+    woc_internal bool netplay_read(const u8*& at, const u8* end, T& value)
+    {
+        if (end - at < static_cast<std::ptrdiff_t>(sizeof(T)))
+        {
+            return false;
+        }
+        std::memcpy(&value, at, sizeof(T));
+        at += sizeof(T);
+        return true;
+    }
+
+#if defined(__linux__)
+    bool netplay_open(Netplay& netplay, u32 local_player, u16 local_port, NetplayConditions conditions, std::string& error)
+    {
+        netplay.transport = NetplayTransport {
+            .socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0),
+            .local_port = local_port,
+            .peer_address = 0,
+            .peer_port = 0,
+            .conditions = conditions,
+            .random = Random { .state = random_hash(local_player, local_port) },
+            .delayed = {},
+            .last_send = {}
+        };
+        netplay.local_player = local_player;
+        netplay.game = 0;
+        netplay.stats = NetplayStats{};
+        auto& transport = netplay.transport;
+        if (transport.socket < 0)
+        {
+            error = "Can't create a UDP socket";
+            return false;
+        }
+        auto address = sockaddr_in{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(local_port);
+        auto address_size = static_cast<socklen_t>(sizeof(address));
+        if (bind(transport.socket, reinterpret_cast<sockaddr*>(&address), address_size) != 0
+            || getsockname(transport.socket, reinterpret_cast<sockaddr*>(&address), &address_size) != 0)
+        {
+            error = "Can't bind UDP port " + std::to_string(local_port);
+            netplay_close(netplay);
+            return false;
+        }
+        transport.local_port = ntohs(address.sin_port);
+        return true;
+    }
+
+    bool netplay_connect(Netplay& netplay, const std::string& peer, std::string& error)
+    {
+        auto colon = peer.rfind(':');
+        auto host = peer.substr(0, colon);
+        auto port = colon == std::string::npos ? NETPLAY_DEFAULT_PORT : static_cast<u16>(std::atoi(peer.c_str() + colon + 1));
+        auto hints = addrinfo{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0 || !found)
+        {
+            error = "Can't resolve " + host;
+            return false;
+        }
+        netplay.transport.peer_address = reinterpret_cast<sockaddr_in*>(found->ai_addr)->sin_addr.s_addr;
+        netplay.transport.peer_port = htons(port);
+        freeaddrinfo(found);
+        return true;
+    }
+
+    void netplay_close(Netplay& netplay)
+    {
+        if (netplay.transport.socket >= 0)
+        {
+            close(netplay.transport.socket);
+            netplay.transport.socket = -1;
+        }
+        netplay.transport.delayed.clear();
+    }
+
+    woc_internal void netplay_socket_send(NetplayTransport& transport, std::vector<u8>& bytes)
+    {
+        auto address = sockaddr_in{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = transport.peer_address;
+        address.sin_port = transport.peer_port;
+        // A full send buffer drops the packet like the network would, the next one repeats it.
+        sendto(transport.socket, bytes.data(), bytes.size(), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+
+    // Returns the packet's size, 0 once there's nothing left to read.
+    woc_internal size_t netplay_socket_receive(NetplayTransport& transport, u8* buffer, size_t capacity)
+    {
+        while (true)
+        {
+            auto address = sockaddr_in{};
+            auto address_size = static_cast<socklen_t>(sizeof(address));
+            auto size = recvfrom(transport.socket, buffer, capacity, 0, reinterpret_cast<sockaddr*>(&address), &address_size);
+            if (size <= 0)
+            {
+                return 0;
+            }
+            if (address.sin_addr.s_addr == transport.peer_address && address.sin_port == transport.peer_port)
+            {
+                return static_cast<size_t>(size);
+            }
+        }
+    }
+#else
+    bool netplay_open(Netplay& netplay, u32 local_player, u16 local_port, NetplayConditions conditions, std::string& error)
+    {
+        netplay.transport = NetplayTransport { .socket = -1 };
+        error = "Netplay needs UDP sockets, which this build only has on Linux";
+        return false;
+    }
+
+    bool netplay_connect(Netplay& netplay, const std::string& peer, std::string& error)
+    {
+        error = "Netplay isn't open";
+        return false;
+    }
+
+    void netplay_close(Netplay& netplay)
+    {
+        netplay.transport.delayed.clear();
+    }
+
+    woc_internal void netplay_socket_send(NetplayTransport& transport, std::vector<u8>& bytes)
+    {
+    }
+
+    woc_internal size_t netplay_socket_receive(NetplayTransport& transport, u8* buffer, size_t capacity)
+    {
+        return 0;
+    }
+#endif
+
+    // Drops or holds back the packet per the conditions, then sends whatever's due.
+    woc_internal void netplay_send(Netplay& netplay, std::vector<u8>& bytes)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto& transport = netplay.transport;
+        auto& conditions = transport.conditions;
+        auto now = Clock::now();
+        transport.last_send = now;
+        netplay.stats.packets_sent++;
+        if (conditions.loss > 0.f && random_f32(transport.random, 0.f, 1.f) < conditions.loss)
+        {
+            netplay.stats.packets_dropped++;
+        } else if (conditions.delay_seconds > 0.0 || conditions.jitter_seconds > 0.0) {
+            auto delay = conditions.delay_seconds + static_cast<f64>(random_f32(transport.random, 0.f, 1.f)) * conditions.jitter_seconds;
+            transport.delayed.emplace_back(NetplayDelayedPacket {
+                .send_time = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(delay)),
+                .bytes = bytes
+            });
+        } else {
+            netplay_socket_send(transport, bytes);
+        }
+    }
+
+    woc_internal void netplay_send_due(NetplayTransport& transport)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::erase_if(transport.delayed, [&transport, now] (NetplayDelayedPacket& packet)
+        {
+            if (packet.send_time > now)
+            {
+                return false;
+            }
+            netplay_socket_send(transport, packet.bytes);
+            return true;
+        });
+    }
+
+    // Every local input the peer hasn't acknowledged, what the peer's own inputs have reached and the newest
+    // state hash.
+    woc_internal void netplay_send_inputs(Netplay& netplay)
+    {
+        std::vector<u8> packet;
+        auto first = netplay.remote_acked;
+        auto count = std::min(netplay.local_input_end - first, NETPLAY_MAX_PACKET_INPUTS);
+        auto hash = netplay.local_hash_count ? netplay.local_hashes.at((netplay.local_hash_count - 1) % netplay.local_hashes.size()) : NetplayHash{};
+        netplay_write(packet, NETPLAY_MAGIC);
+        netplay_write(packet, netplay.game);
+        netplay_write(packet, first);
+        netplay_write(packet, netplay.remote_input_end);
+        netplay_write(packet, hash.tick);
+        netplay_write(packet, hash.hash);
+        netplay_write(packet, static_cast<u8>(count));
+        for (u32 i = 0; i < count; i++)
+        {
+            auto& input = netplay.inputs.at(netplay.local_player).at((first + i) % NETPLAY_INPUT_HISTORY);
+            netplay_write(packet, static_cast<i8>(input.move_dir));
+            netplay_write(packet, static_cast<i8>(input.wind_dir_x));
+            netplay_write(packet, static_cast<i8>(input.wind_dir_y));
+            netplay_write(packet, static_cast<u8>(input.send_ball));
+            netplay_write(packet, static_cast<u8>(input.cast_gust));
+        }
+        netplay_send(netplay, packet);
+    }
+
+    woc_internal void netplay_check_hash(Netplay& netplay, NetplayHash remote)
+    {
+        if (remote.tick <= netplay.checked_hash_tick)
+        {
+            return;
+        }
+        for (u32 i = 0; i < std::min<u32>(netplay.local_hash_count, netplay.local_hashes.size()); i++)
+        {
+            auto& local = netplay.local_hashes.at(i);
+            if (local.tick == remote.tick)
+            {
+                netplay.checked_hash_tick = remote.tick;
+                netplay.stats.hash_checks++;
+                if (local.hash != remote.hash)
+                {
+                    netplay.stats.desyncs++;
+                    std::cerr << "netplay: desync at tick " << remote.tick << " of game " << netplay.game << "\n";
+                }
+                return;
+            }
+        }
+        // Not hashed here yet.
+        if (remote.tick >= netplay.next_hash_tick)
+        {
+            netplay.pending_remote_hash = remote;
+        }
+    }
+
+    woc_internal void netplay_receive_packet(Netplay& netplay, const u8* at, const u8* end)
+    {
+        u32 magic, game, first, ack;
+        NetplayHash hash;
+        u8 count;
+        bool valid = netplay_read(at, end, magic) && netplay_read(at, end, game) && netplay_read(at, end, first)
+            && netplay_read(at, end, ack) && netplay_read(at, end, hash.tick) && netplay_read(at, end, hash.hash)
+            && netplay_read(at, end, count) && magic == NETPLAY_MAGIC && end - at == static_cast<std::ptrdiff_t>(count) * 5;
+        if (!valid || game != netplay.game)
+        {
+            netplay.stats.packets_ignored++;
+            return;
+        }
+        netplay.stats.packets_received++;
+        netplay.remote_acked = std::clamp(ack, netplay.remote_acked, netplay.local_input_end);
+
+        auto remote = 1 - netplay.local_player;
+        // Never overwrite inputs a rollback could still need. The peer can't get this far ahead without stalling.
+        auto input_limit = netplay.tick + NETPLAY_INPUT_HISTORY - NETPLAY_SAVED_STATES;
+        for (u32 i = 0; i < count; i++)
+        {
+            i8 move_dir = 0, wind_dir_x = 0, wind_dir_y = 0;
+            u8 send_ball = 0, cast_gust = 0;
+            netplay_read(at, end, move_dir);
+            netplay_read(at, end, wind_dir_x);
+            netplay_read(at, end, wind_dir_y);
+            netplay_read(at, end, send_ball);
+            netplay_read(at, end, cast_gust);
+            auto t = first + i;
+            // Already have it, or a late packet that skips past ones still missing.
+            if (t != netplay.remote_input_end || t >= input_limit)
+            {
+                continue;
+            }
+            auto input = netplay_normalize_input(InputState {
+                .move_dir = move_dir,
+                .wind_dir_x = wind_dir_x,
+                .wind_dir_y = wind_dir_y,
+                .send_ball = send_ball,
+                .cast_gust = cast_gust
+            });
+            netplay.inputs.at(remote).at(t % NETPLAY_INPUT_HISTORY) = input;
+            if (t < netplay.tick && !netplay_same_input(netplay.used_remote_inputs.at(t % NETPLAY_INPUT_HISTORY), input))
+            {
+                netplay.rollback_from = std::min(netplay.rollback_from, t);
+            }
+            netplay.remote_input_end++;
+        }
+        if (hash.tick)
+        {
+            netplay_check_hash(netplay, hash);
+        }
+    }
+
+    woc_internal void netplay_simulate(Netplay& netplay, GameState& game_state, u32 tick, AudioState& audio_state)
+    {
+        auto remote = 1 - netplay.local_player;
+        auto remote_input = tick < netplay.remote_input_end ? netplay.inputs.at(remote).at(tick % NETPLAY_INPUT_HISTORY) : netplay_predict_input(netplay);
+        netplay.used_remote_inputs.at(tick % NETPLAY_INPUT_HISTORY) = remote_input;
+        std::array<InputState, 2> inputs;
+        inputs.at(netplay.local_player) = netplay.inputs.at(netplay.local_player).at(tick % NETPLAY_INPUT_HISTORY);
+        inputs.at(remote) = remote_input;
+        game_update_players(game_state, inputs, audio_state, NETPLAY_TICK_SECONDS);
+    }
+
+    woc_internal void netplay_rollback(Netplay& netplay, GameState& game_state, AudioState& audio_state)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        auto from = netplay.rollback_from;
+        assert(netplay.tick - from <= NETPLAY_MAX_ROLLBACK_TICKS);
+        // The ticks being replayed played their sounds when they were predicted.
+        auto sounds = audio_state.deferred_sounds.size();
+        // Copy-assigning reuses the vectors' capacity, so rolling back doesn't allocate once the ring is warm.
+        game_state = netplay.saved.at(from % NETPLAY_SAVED_STATES);
+        for (auto t = from; t < netplay.tick; t++)
+        {
+            if (t != from)
+            {
+                netplay.saved.at(t % NETPLAY_SAVED_STATES) = game_state;
+            }
+            netplay_simulate(netplay, game_state, t, audio_state);
+        }
+        audio_state.deferred_sounds.resize(sounds);
+        netplay.rollback_from = NETPLAY_NO_ROLLBACK;
+
+        auto ticks = netplay.tick - from;
+        auto& stats = netplay.stats;
+        stats.rollbacks++;
+        stats.rollback_ticks += ticks;
+        stats.max_rollback_ticks = std::max(stats.max_rollback_ticks, ticks);
+        stats.max_rollback_seconds = std::max(stats.max_rollback_seconds, std::chrono::duration<f64>(Clock::now() - start).count());
+        counters_add(Counter::RollbackTicks, ticks);
+    }
+
+    // Hashes every NETPLAY_HASH_INTERVAL_TICKS-th state once both inputs before it are known, so no rollback
+    // can change it any more.
+    woc_internal void netplay_hash_confirmed(Netplay& netplay, GameState& game_state)
+    {
+        auto confirmed = std::min(netplay.tick, netplay.remote_input_end);
+        for (; netplay.next_hash_tick <= confirmed; netplay.next_hash_tick += NETPLAY_HASH_INTERVAL_TICKS)
+        {
+            auto t = netplay.next_hash_tick;
+            // Stalling keeps every tick from the oldest unconfirmed one on in the ring.
+            assert(t + NETPLAY_SAVED_STATES >= netplay.tick);
+            auto& state = t == netplay.tick ? game_state : netplay.saved.at(t % NETPLAY_SAVED_STATES);
+            netplay.local_hashes.at(netplay.local_hash_count % netplay.local_hashes.size()) = NetplayHash { .tick = t, .hash = game_hash(state) };
+            netplay.local_hash_count++;
+            if (auto pending = netplay.pending_remote_hash; pending && pending->tick <= t)
+            {
+                netplay.pending_remote_hash = std::nullopt;
+                netplay_check_hash(netplay, *pending);
+            }
+        }
+    }
+
+    woc_internal void netplay_log_confirmed(Netplay& netplay)
+    {
+        if (!netplay.keep_confirmed_inputs)
+        {
+            return;
+        }
+        auto confirmed = std::min(netplay.local_input_end, netplay.remote_input_end);
+        for (auto t = static_cast<u32>(netplay.confirmed_inputs.size()); t < confirmed; t++)
+        {
+            netplay.confirmed_inputs.push_back({ netplay.inputs.at(0).at(t % NETPLAY_INPUT_HISTORY), netplay.inputs.at(1).at(t % NETPLAY_INPUT_HISTORY) });
+        }
+    }
+
+    void netplay_begin_game(Netplay& netplay, GameState& game_state)
+    {
+        assert(game_state.second_player);
+        netplay.game++;
+        netplay.tick = 0;
+        for (auto& inputs : netplay.inputs)
+        {
+            inputs.fill(InputState{});
+        }
+        netplay.used_remote_inputs.fill(InputState{});
+        // Both peers hold still for the input delay, so those inputs are known without asking.
+        netplay.local_input_end = NETPLAY_INPUT_DELAY_TICKS;
+        netplay.remote_input_end = NETPLAY_INPUT_DELAY_TICKS;
+        netplay.remote_acked = NETPLAY_INPUT_DELAY_TICKS;
+        netplay.rollback_from = NETPLAY_NO_ROLLBACK;
+        netplay.next_hash_tick = NETPLAY_HASH_INTERVAL_TICKS;
+        netplay.local_hash_count = 0;
+        netplay.pending_remote_hash = std::nullopt;
+        netplay.checked_hash_tick = 0;
+        netplay.confirmed_inputs.clear();
+    }
+
+    bool netplay_poll(Netplay& netplay, GameState& game_state, AudioState& audio_state)
+    {
+        auto& transport = netplay.transport;
+        netplay_send_due(transport);
+        std::array<u8, 512> buffer;
+        while (auto size = netplay_socket_receive(transport, buffer.data(), buffer.size()))
+        {
+            netplay_receive_packet(netplay, buffer.data(), buffer.data() + size);
+        }
+        if (netplay.rollback_from < netplay.tick)
+        {
+            netplay_rollback(netplay, game_state, audio_state);
+        }
+        netplay.rollback_from = NETPLAY_NO_ROLLBACK;
+        netplay_hash_confirmed(netplay, game_state);
+        netplay_log_confirmed(netplay);
+
+        bool can_advance = netplay.tick < netplay.remote_input_end + NETPLAY_MAX_ROLLBACK_TICKS;
+        if (!can_advance)
+        {
+            netplay.stats.stalls++;
+            counters_add(Counter::NetplayStalls, 1);
+        }
+        // Stalled, paused or done, the peer still needs acks and whatever of ours got lost.
+        if (std::chrono::steady_clock::now() - transport.last_send >= std::chrono::duration<f32>(NETPLAY_TICK_SECONDS))
+        {
+            netplay_send_inputs(netplay);
+        }
+        return can_advance;
+    }
+
+    void netplay_advance(Netplay& netplay, GameState& game_state, InputState input, AudioState& audio_state)
+    {
+        assert(netplay.tick < netplay.remote_input_end + NETPLAY_MAX_ROLLBACK_TICKS);
+        auto input_tick = netplay.tick + NETPLAY_INPUT_DELAY_TICKS;
+        netplay.inputs.at(netplay.local_player).at(input_tick % NETPLAY_INPUT_HISTORY) = netplay_normalize_input(input);
+        netplay.local_input_end = input_tick + 1;
+        netplay_send_inputs(netplay);
+
+        netplay.saved.at(netplay.tick % NETPLAY_SAVED_STATES) = game_state;
+        netplay_simulate(netplay, game_state, netplay.tick, audio_state);
+        netplay.tick++;
+        netplay.stats.ticks++;
+    }
+
+    f64 netplay_measure_rollback(GameState& game_state, u32 repeats)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto audio_state = AudioState{};
+        audio_state.defer_playback = true;
+        std::array<InputState, 2> inputs = {};
+        auto players = std::span<InputState>(inputs.data(), game_state.second_player ? 2 : 1);
+        std::array<GameState, NETPLAY_SAVED_STATES> saved;
+        auto state = game_state;
+        f64 worst = 0.0;
+        // The first run fills the ring, after that the copies reuse its capacity like a running session's do.
+        for (u32 repeat = 0; repeat <= repeats; repeat++)
+        {
+            auto start = Clock::now();
+            saved.at(0) = game_state;
+            state = saved.at(0);
+            for (u32 t = 1; t <= NETPLAY_MAX_ROLLBACK_TICKS; t++)
+            {
+                game_update_players(state, players, audio_state, NETPLAY_TICK_SECONDS);
+                saved.at(t) = state;
+            }
+            audio_state.deferred_sounds.clear();
+            auto seconds = std::chrono::duration<f64>(Clock::now() - start).count();
+            worst = repeat ? std::max(worst, seconds) : worst;
+        }
+        return worst;
+    }
+
+    void netplay_report(Netplay& netplay, std::ostream& out)
+    {
+        auto& stats = netplay.stats;
+        out << "player " << netplay.local_player + 1 << ": " << stats.ticks << " ticks, " << stats.stalls << " stalls, "
+            << stats.rollbacks << " rollbacks";
+        if (stats.rollbacks)
+        {
+            out << " of " << std::fixed << std::setprecision(1) << static_cast<f64>(stats.rollback_ticks) / static_cast<f64>(stats.rollbacks)
+                << " ticks on average, " << stats.max_rollback_ticks << " at most, slowest " << std::setprecision(3)
+                << stats.max_rollback_seconds * 1000.0 << " ms" << std::defaultfloat;
+        }
+        out << "; " << stats.packets_sent << " packets sent, " << stats.packets_dropped << " dropped, " << stats.packets_received
+            << " received, " << stats.packets_ignored << " ignored; " << stats.hash_checks << " hash checks, " << stats.desyncs << " desyncs\n";
+    }
+
+    woc_internal GameState netplay_test_game(u32 level)
+    {
+        auto game_state = game_init(level);
+        // Enough to keep both paddles playing for the whole test.
+        game_state.player.balls_available = std::max(game_state.player.balls_available, 1000u);
+        game_state.player.wind_available = std::max(game_state.player.wind_available, 1000u);
+        game_add_second_player(game_state);
+        return game_state;
+    }
+
+    // Changes every so often, at different times for each paddle so predictions keep going wrong.
+    woc_internal InputState netplay_test_input(u32 level, u32 player, u32 tick)
+    {
+        auto period = 20 + 13 * player;
+        auto random = Random { .state = random_hash(random_hash(level, player), tick / period) };
+        auto input = InputState{};
+        input.move_dir = static_cast<i32>(random_u32(random, 0, 2)) - 1;
+        input.send_ball = random_u32(random, 0, 3) == 0;
+        input.wind_dir_x = static_cast<i32>(random_u32(random, 0, 8) / 4) - 1;
+        input.cast_gust = tick % period == 0 && random_u32(random, 0, 3) == 0;
+        return input;
+    }
+
+    // Ticks inputs straight through from the start and hashes the state before tick.
+    woc_internal u64 netplay_test_reference_hash(u32 level, std::vector<std::array<InputState, 2>>& inputs, u32 tick)
+    {
+        auto game_state = netplay_test_game(level);
+        auto audio_state = AudioState{};
+        audio_state.defer_playback = true;
+        for (u32 t = 0; t < tick; t++)
+        {
+            game_update_players(game_state, inputs.at(t), audio_state, NETPLAY_TICK_SECONDS);
+            audio_state.deferred_sounds.clear();
+        }
+        return game_hash(game_state);
+    }
+
+    bool netplay_loopback_test(u32 level, f64 seconds, NetplayConditions conditions, std::ostream& out)
+    {
+        using Clock = std::chrono::steady_clock;
+        // Latency past the rollback window stalls both peers, which only slows the test down. Going this long
+        // without getting anywhere means the peers lost each other.
+        auto stuck = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(2.0));
+        std::array<Netplay, 2> peers;
+        std::array<std::optional<GameState>, 2> games;
+        auto error = std::string{};
+        for (u32 player = 0; player < 2; player++)
+        {
+            if (!netplay_open(peers.at(player), player, 0, conditions, error))
+            {
+                out << error << "\n";
+                return false;
+            }
+        }
+        for (u32 player = 0; player < 2; player++)
+        {
+            if (!netplay_connect(peers.at(player), "127.0.0.1:" + std::to_string(peers.at(1 - player).transport.local_port), error))
+            {
+                out << error << "\n";
+                return false;
+            }
+        }
+
+        auto ticks = static_cast<u32>(std::lround(seconds / NETPLAY_TICK_SECONDS));
+        auto run_peer = [level, ticks, stuck, &peers, &games] (u32 player)
+        {
+            auto& netplay = peers.at(player);
+            auto& game_state = games.at(player);
+            game_state = netplay_test_game(level);
+            auto audio_state = AudioState{};
+            audio_state.defer_playback = true;
+            netplay.keep_confirmed_inputs = true;
+            netplay_begin_game(netplay, *game_state);
+
+            auto frame = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(NETPLAY_TICK_SECONDS));
+            auto next_frame = Clock::now();
+            auto last_progress = next_frame;
+            // Keeps answering once done, until both peers have each other's inputs for every tick.
+            auto done = [&netplay, ticks]
+            {
+                return netplay.confirmed_inputs.size() >= ticks + NETPLAY_INPUT_DELAY_TICKS && netplay.remote_acked >= netplay.local_input_end;
+            };
+            while (!done() && Clock::now() - last_progress < stuck)
+            {
+                next_frame += frame;
+                auto confirmed = netplay.confirmed_inputs.size();
+                if (netplay_poll(netplay, *game_state, audio_state) && netplay.tick < ticks)
+                {
+                    netplay_advance(netplay, *game_state, netplay_test_input(level, player, netplay.tick), audio_state);
+                    last_progress = Clock::now();
+                }
+                if (netplay.confirmed_inputs.size() != confirmed)
+                {
+                    last_progress = Clock::now();
+                }
+                audio_state.deferred_sounds.clear();
+                std::this_thread::sleep_until(next_frame);
+            }
+        };
+        std::thread second(run_peer, 1u);
+        run_peer(0);
+        second.join();
+
+        bool passed = true;
+        for (auto& netplay : peers)
+        {
+            netplay_report(netplay, out);
+            passed &= netplay.stats.desyncs == 0 && netplay.confirmed_inputs.size() >= ticks;
+            netplay_close(netplay);
+        }
+        auto& first_inputs = peers.at(0).confirmed_inputs;
+        auto& second_inputs = peers.at(1).confirmed_inputs;
+        auto compared = static_cast<u32>(std::min(first_inputs.size(), second_inputs.size()));
+        bool same_inputs = std::equal(first_inputs.begin(), first_inputs.begin() + compared, second_inputs.begin(),
+            [] (std::array<InputState, 2>& a, std::array<InputState, 2>& b) { return netplay_same_input(a[0], b[0]) && netplay_same_input(a[1], b[1]); });
+        out << "confirmed inputs " << (same_inputs ? "match" : "DIFFER") << " over " << compared << " ticks\n";
+        passed &= same_inputs;
+
+        // Every hash a peer kept came out of its rollbacks, check it against ticking its confirmed inputs straight.
+        for (auto& netplay : peers)
+        {
+            if (!netplay.local_hash_count)
+            {
+                continue;
+            }
+            auto& last = netplay.local_hashes.at((netplay.local_hash_count - 1) % netplay.local_hashes.size());
+            bool matches = last.tick <= netplay.confirmed_inputs.size()
+                && netplay_test_reference_hash(level, netplay.confirmed_inputs, last.tick) == last.hash;
+            out << "player " << netplay.local_player + 1 << " at tick " << last.tick << " " << (matches ? "matches" : "DOESN'T MATCH") << " a straight run\n";
+            passed &= matches;
+        }
+
+        auto worst = netplay_measure_rollback(*games.at(0), 20);
+        bool fits = worst <= NETPLAY_ROLLBACK_BUDGET_SECONDS;
+        out << "worst case rollback of " << NETPLAY_MAX_ROLLBACK_TICKS << " ticks on the final state: " << std::fixed << std::setprecision(3)
+            << worst * 1000.0 << " ms of a " << NETPLAY_ROLLBACK_BUDGET_SECONDS * 1000.0 << " ms budget" << (fits ? "" : ", OVER BUDGET") << "\n" << std::defaultfloat;
+        passed &= fits;
+        out << (passed ? "passed" : "FAILED") << "\n";
+        return passed;
+    }
+}
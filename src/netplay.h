@@ -0,0 +1,145 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+#include <limits>
+#include <string>
+
+namespace woc
+{
+    // Netplay ticks slower than the single player simulation so the rollback window below covers a real
+    // connection's latency. Balls still move well under a wall's thickness per tick.
+    constexpr f32 NETPLAY_TICK_SECONDS = 1.f / 60.f;
+    // How far back a late input can reach. Past this the game stops advancing until the peer's inputs arrive.
+    constexpr u32 NETPLAY_MAX_ROLLBACK_TICKS = 8;
+    // Local inputs apply this many ticks after they're polled, which hides that much latency without rolling back.
+    constexpr u32 NETPLAY_INPUT_DELAY_TICKS = 2;
+    // Inputs kept per paddle. Each packet repeats the local ones the peer hasn't acknowledged, so the next
+    // packet covers a lost one, up to this many inputs each.
+    constexpr u32 NETPLAY_INPUT_HISTORY = 64;
+    constexpr u32 NETPLAY_MAX_PACKET_INPUTS = 32;
+    // Both peers hash the state every this many ticks once both inputs for it are in, and compare.
+    constexpr u32 NETPLAY_HASH_INTERVAL_TICKS = 60;
+    // A rollback has to fit in one frame next to everything else the frame does.
+    constexpr f64 NETPLAY_ROLLBACK_BUDGET_SECONDS = 1.0 / 60.0;
+    constexpr u16 NETPLAY_DEFAULT_PORT = 7777;
+    constexpr u32 NETPLAY_MAGIC = 0x4E434F57; // "WOCN"
+    constexpr u32 NETPLAY_NO_ROLLBACK = std::numeric_limits<u32>::max();
+
+    // Applied to outgoing packets, so two peers on one machine see the latency and loss of a real connection.
+    struct NetplayConditions
+    {
+        f64 delay_seconds;
+        // Added to the delay, uniformly between 0 and this. Packets can arrive out of order.
+        f64 jitter_seconds;
+        f32 loss;
+    };
+
+    struct NetplayDelayedPacket
+    {
+        std::chrono::steady_clock::time_point send_time;
+        std::vector<u8> bytes;
+    };
+
+    struct NetplayTransport
+    {
+        // UDP, non-blocking. -1 when closed.
+        i32 socket;
+        u16 local_port;
+        // IPv4, both in network byte order. Packets from anywhere else are ignored.
+        u32 peer_address;
+        u16 peer_port;
+        NetplayConditions conditions;
+        Random random;
+        std::vector<NetplayDelayedPacket> delayed;
+        std::chrono::steady_clock::time_point last_send;
+    };
+
+    struct NetplayHash
+    {
+        u32 tick;
+        u64 hash;
+    };
+
+    struct NetplayStats
+    {
+        u64 ticks;
+        // netplay_poll calls that couldn't advance because the peer's inputs were too far behind.
+        u64 stalls;
+        u64 rollbacks;
+        u64 rollback_ticks;
+        u32 max_rollback_ticks;
+        // Restoring, re-simulating and saving again, for the slowest rollback.
+        f64 max_rollback_seconds;
+        u64 packets_sent;
+        // By NetplayConditions::loss.
+        u64 packets_dropped;
+        u64 packets_received;
+        // From an older or newer game than this one, or malformed.
+        u64 packets_ignored;
+        u64 hash_checks;
+        u64 desyncs;
+    };
+
+    // One peer of a two player game kept in step GGPO style. Each tick runs straight away with the local input
+    // and a prediction of the peer's, the peer's last input held. Every state is saved before it's ticked, and
+    // once the peer's real input for an already simulated tick turns out different from the prediction, the
+    // state before it is restored and everything since is ticked again. Only inputs cross the network, so both
+    // peers have to run the same build, and builds for different platforms need WOC_FIXED_POINT_PHYSICS.
+    struct Netplay
+    {
+        NetplayTransport transport;
+        // 0 plays GameState::player, 1 second_player.
+        u32 local_player;
+        // Games begun since netplay_open. Both peers count the same, so packets of another game are told apart.
+        u32 game;
+        // The next tick to simulate, game_state is the state before it.
+        u32 tick;
+        // inputs[player][t % NETPLAY_INPUT_HISTORY] for tick t, normalized to what crosses the network.
+        std::array<std::array<InputState, NETPLAY_INPUT_HISTORY>, 2> inputs;
+        // The peer's input each simulated tick used, received or predicted.
+        std::array<InputState, NETPLAY_INPUT_HISTORY> used_remote_inputs;
+        // Inputs are known for every tick before these.
+        u32 local_input_end;
+        u32 remote_input_end;
+        // The peer has the local inputs before this.
+        u32 remote_acked;
+        // The earliest tick simulated with a wrong prediction, or NETPLAY_NO_ROLLBACK.
+        u32 rollback_from;
+        // saved[t % size] is the state before tick t, for the ticks a rollback can reach.
+        std::array<GameState, NETPLAY_MAX_ROLLBACK_TICKS + 1> saved;
+        u32 next_hash_tick;
+        std::array<NetplayHash, 4> local_hashes;
+        u32 local_hash_count;
+        std::optional<NetplayHash> pending_remote_hash;
+        // Packets repeat the newest hash until there's a newer one, each is compared once.
+        u32 checked_hash_tick;
+        // Set by tests, every tick's inputs for both paddles once both are known.
+        bool keep_confirmed_inputs;
+        std::vector<std::array<InputState, 2>> confirmed_inputs;
+        NetplayStats stats;
+    };
+
+    // Binds local_port, or any free port for 0. UDP needs Linux for now, elsewhere this fails.
+    bool netplay_open(Netplay& netplay, u32 local_player, u16 local_port, NetplayConditions conditions, std::string& error);
+    // peer is host:port, or just host for NETPLAY_DEFAULT_PORT.
+    bool netplay_connect(Netplay& netplay, const std::string& peer, std::string& error);
+    void netplay_close(Netplay& netplay);
+    // Both peers call this on the same state whenever a game starts, after game_add_second_player.
+    void netplay_begin_game(Netplay& netplay, GameState& game_state);
+    // Reads the peer's packets, rolls back if they contradict a prediction and keeps the peer up to date.
+    // Returns false while the game is too far ahead of the peer's inputs to advance.
+    bool netplay_poll(Netplay& netplay, GameState& game_state, AudioState& audio_state);
+    // Ticks the game once, after netplay_poll returned true. input is for the local paddle and applies
+    // NETPLAY_INPUT_DELAY_TICKS from now.
+    void netplay_advance(Netplay& netplay, GameState& game_state, InputState input, AudioState& audio_state);
+    // The worst case a rollback can cost on this state: saving it, restoring it and re-simulating
+    // NETPLAY_MAX_ROLLBACK_TICKS ticks with a save before each. Slowest of repeats runs, in seconds.
+    f64 netplay_measure_rollback(GameState& game_state, u32 repeats);
+    void netplay_report(Netplay& netplay, std::ostream& out);
+    // Plays level for seconds between two peers on 127.0.0.1 under conditions, with scripted inputs. Passes if
+    // neither peer saw a desync, both confirmed the same inputs, both rolled back to what ticking those inputs
+    // straight through gives, and the worst case rollback fits NETPLAY_ROLLBACK_BUDGET_SECONDS.
+    bool netplay_loopback_test(u32 level, f64 seconds, NetplayConditions conditions, std::ostream& out);
+}
@@ -0,0 +1,186 @@
+﻿#include "particles.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WOC_PARTICLES_SSE2 1
+#else
+#define WOC_PARTICLES_SSE2 0
+#endif
+
+namespace woc
+{
+    ParticlePool particles_init(u64 seed)
+    {
+        auto array = [] { return TaggedVector<f32, MemoryTag::Particles>(PARTICLE_CAPACITY, 0.f); };
+        return ParticlePool {
+            .pos_x = array(),
+            .pos_y = array(),
+            .vel_x = array(),
+            .vel_y = array(),
+            .angle = array(),
+            .spin = array(),
+            .life = array(),
+            .inv_lifetime = array(),
+            .size = array(),
+            .stretch = array(),
+            .drag = array(),
+            .gravity = array(),
+            .color = TaggedVector<Color, MemoryTag::Particles>(PARTICLE_CAPACITY),
+            .count = 0,
+            .random = Random { .state = seed }
+        };
+    }
+
+    void particles_clear(ParticlePool& pool)
+    {
+        pool.count = 0;
+    }
+
+    void particles_emit(ParticlePool& pool, const ParticleEmitter& emitter, Vector2 pos, Vector2 size, Radian rot, Vector2 dir, u32 count)
+    {
+        auto& random = pool.random;
+        count = std::min(count, PARTICLE_CAPACITY - pool.count);
+        auto base_angle = Vector2Equals(dir, Vector2Zero()) ? 0.f : std::atan2(dir.y, dir.x);
+        auto spread = Vector2Equals(dir, Vector2Zero()) ? PI : emitter.spread;
+        auto half_size = Vector2Scale(size, 0.5f);
+        for (u32 n = 0; n < count; n++)
+        {
+            auto i = pool.count++;
+            auto offset = Vector2Rotate(Vector2 { random_f32(random, -half_size.x, half_size.x), random_f32(random, -half_size.y, half_size.y) }, rot.val);
+            auto angle = base_angle + random_f32(random, -spread, spread);
+            auto speed = random_f32(random, emitter.speed_min, emitter.speed_max);
+            auto lifetime = random_f32(random, emitter.lifetime_min, emitter.lifetime_max);
+            pool.pos_x[i] = pos.x + offset.x;
+            pool.pos_y[i] = pos.y + offset.y;
+            pool.vel_x[i] = std::cos(angle) * speed;
+            pool.vel_y[i] = std::sin(angle) * speed;
+            pool.angle[i] = emitter.stretch > 1.f ? angle : random_f32(random, -PI, PI);
+            pool.spin[i] = random_f32(random, -emitter.spin_max, emitter.spin_max);
+            pool.life[i] = lifetime;
+            pool.inv_lifetime[i] = 1.f / lifetime;
+            pool.size[i] = random_f32(random, emitter.size_min, emitter.size_max);
+            pool.stretch[i] = emitter.stretch;
+            pool.drag[i] = emitter.drag;
+            pool.gravity[i] = emitter.gravity;
+            pool.color[i] = emitter.color;
+        }
+    }
+
+    woc_internal void particles_swap_remove(ParticlePool& pool, u32 i)
+    {
+        auto last = --pool.count;
+        for (auto* values : { &pool.pos_x, &pool.pos_y, &pool.vel_x, &pool.vel_y, &pool.angle, &pool.spin, &pool.life, &pool.inv_lifetime, &pool.size, &pool.stretch, &pool.drag, &pool.gravity })
+        {
+            (*values)[i] = (*values)[last];
+        }
+        pool.color[i] = pool.color[last];
+    }
+
+    void particles_update(ParticlePool& pool, f32 delta_seconds)
+    {
+        u32 i = 0;
+#if WOC_PARTICLES_SSE2
+        // Rounded up to whole vectors, the slots past count are scratch.
+        auto padded_count = (pool.count + 3) & ~3u;
+        const auto dt = _mm_set1_ps(delta_seconds);
+        const auto one = _mm_set1_ps(1.f);
+        const auto zero = _mm_setzero_ps();
+        for (; i < padded_count; i += 4)
+        {
+            auto damping = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(&pool.drag[i]), dt)), zero);
+            auto vel_x = _mm_mul_ps(_mm_loadu_ps(&pool.vel_x[i]), damping);
+            auto vel_y = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&pool.vel_y[i]), damping), _mm_mul_ps(_mm_loadu_ps(&pool.gravity[i]), dt));
+            _mm_storeu_ps(&pool.vel_x[i], vel_x);
+            _mm_storeu_ps(&pool.vel_y[i], vel_y);
+            _mm_storeu_ps(&pool.pos_x[i], _mm_add_ps(_mm_loadu_ps(&pool.pos_x[i]), _mm_mul_ps(vel_x, dt)));
+            _mm_storeu_ps(&pool.pos_y[i], _mm_add_ps(_mm_loadu_ps(&pool.pos_y[i]), _mm_mul_ps(vel_y, dt)));
+            _mm_storeu_ps(&pool.angle[i], _mm_add_ps(_mm_loadu_ps(&pool.angle[i]), _mm_mul_ps(_mm_loadu_ps(&pool.spin[i]), dt)));
+            _mm_storeu_ps(&pool.life[i], _mm_sub_ps(_mm_loadu_ps(&pool.life[i]), dt));
+        }
+#else
+        for (; i < pool.count; i++)
+        {
+            auto damping = std::max(0.f, 1.f - pool.drag[i] * delta_seconds);
+            pool.vel_x[i] *= damping;
+            pool.vel_y[i] = pool.vel_y[i] * damping + pool.gravity[i] * delta_seconds;
+            pool.pos_x[i] += pool.vel_x[i] * delta_seconds;
+            pool.pos_y[i] += pool.vel_y[i] * delta_seconds;
+            pool.angle[i] += pool.spin[i] * delta_seconds;
+            pool.life[i] -= delta_seconds;
+        }
+#endif
+
+        // Order doesn't matter for drawing, so expired particles are replaced by the last live one.
+        for (i = 0; i < pool.count;)
+        {
+            if (pool.life[i] <= 0.f)
+            {
+                particles_swap_remove(pool, i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    u32 particles_draw(ParticlePool& pool, Vector2 view_min, Vector2 view_max)
+    {
+        if (!pool.count)
+        {
+            return 0;
+        }
+
+        // Submitted in chunks that always fit rlgl's vertex buffer, which then only flushes when it's full,
+        // so every particle on screen costs a handful of draw calls at most.
+        constexpr u32 QUADS_PER_CHUNK = 1024;
+        rlSetTexture(rlGetTextureIdDefault());
+        u32 drawn = 0;
+        for (u32 i = 0; i < pool.count; i++)
+        {
+            // Nothing is larger than its stretched size, so that much slack keeps every visible one.
+            auto reach = pool.size[i] * pool.stretch[i];
+            if (pool.pos_x[i] + reach < view_min.x || pool.pos_x[i] - reach > view_max.x
+                || pool.pos_y[i] + reach < view_min.y || pool.pos_y[i] - reach > view_max.y)
+            {
+                continue;
+            }
+            if (drawn % QUADS_PER_CHUNK == 0)
+            {
+                if (drawn)
+                {
+                    rlEnd();
+                }
+                rlCheckRenderBatchLimit(static_cast<i32>(QUADS_PER_CHUNK * 4));
+                rlBegin(RL_QUADS);
+            }
+            drawn++;
+
+            // Shrinks and fades out over its lifetime.
+            auto alpha = std::min(pool.life[i] * pool.inv_lifetime[i], 1.f);
+            auto half_width = pool.size[i] * alpha * 0.5f;
+            auto half_length = half_width * pool.stretch[i];
+            auto c = std::cos(pool.angle[i]);
+            auto s = std::sin(pool.angle[i]);
+            auto along = Vector2 { c * half_length, s * half_length };
+            auto across = Vector2 { -s * half_width, c * half_width };
+            auto color = pool.color[i];
+            rlColor4ub(color.r, color.g, color.b, static_cast<u8>(static_cast<f32>(color.a) * alpha));
+
+            auto center = Vector2 { pool.pos_x[i], pool.pos_y[i] };
+            auto corner = [&center, &along, &across] (f32 a, f32 b, f32 u, f32 v)
+            {
+                rlTexCoord2f(u, v);
+                rlVertex2f(center.x + along.x * a + across.x * b, center.y + along.y * a + across.y * b);
+            };
+            corner(-1.f, -1.f, 0.f, 0.f);
+            corner(-1.f, 1.f, 0.f, 1.f);
+            corner(1.f, 1.f, 1.f, 1.f);
+            corner(1.f, -1.f, 1.f, 0.f);
+        }
+        if (drawn)
+        {
+            rlEnd();
+        }
+        rlSetTexture(0);
+        return drawn;
+    }
+}
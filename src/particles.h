@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+namespace woc
+{
+    // A multiple of the SIMD width, so the update kernel can run past the last live particle without a tail.
+    constexpr u32 PARTICLE_CAPACITY = 1 << 16;
+
+    // Ranges each particle's starting values are drawn from. spread is the half angle around the emit direction,
+    // drag the fraction of speed lost per second.
+    struct ParticleEmitter
+    {
+        f32 speed_min;
+        f32 speed_max;
+        f32 spread;
+        f32 lifetime_min;
+        f32 lifetime_max;
+        f32 size_min;
+        f32 size_max;
+        // Length over width. Stretched particles are drawn along their starting direction.
+        f32 stretch;
+        f32 spin_max;
+        f32 drag;
+        f32 gravity;
+        Color color;
+    };
+
+    // Chunks of a broken wall, tumbling and falling.
+    constexpr ParticleEmitter PARTICLE_SHARDS = {
+        .speed_min = 60.f, .speed_max = 260.f, .spread = PI,
+        .lifetime_min = 0.5f, .lifetime_max = 1.1f,
+        .size_min = 3.f, .size_max = 8.f, .stretch = 1.f,
+        .spin_max = 12.f, .drag = 0.8f, .gravity = 600.f,
+        .color = WALL_COLOR
+    };
+    // Slow puffs left where something broke.
+    constexpr ParticleEmitter PARTICLE_DUST = {
+        .speed_min = 10.f, .speed_max = 60.f, .spread = PI,
+        .lifetime_min = 0.4f, .lifetime_max = 0.9f,
+        .size_min = 6.f, .size_max = 14.f, .stretch = 1.f,
+        .spin_max = 2.f, .drag = 2.f, .gravity = -30.f,
+        .color = Color { 0xFF, 0xFF, 0xFF, 0xA0 }
+    };
+    // Fast streaks thrown ahead of a ball leaving the world.
+    constexpr ParticleEmitter PARTICLE_SPARKS = {
+        .speed_min = 200.f, .speed_max = 500.f, .spread = 0.6f,
+        .lifetime_min = 0.2f, .lifetime_max = 0.5f,
+        .size_min = 1.5f, .size_max = 3.f, .stretch = 4.f,
+        .spin_max = 0.f, .drag = 3.f, .gravity = 0.f,
+        .color = BALL_COLOR
+    };
+
+    // Allocates every array at full capacity up front, nothing after this allocates.
+    ParticlePool particles_init(u64 seed);
+    void particles_clear(ParticlePool& pool);
+    // Spawns count particles at random points of the rotated rectangle pos/size, heading along dir or anywhere
+    // if dir is zero. Whatever doesn't fit in the pool is dropped.
+    void particles_emit(ParticlePool& pool, const ParticleEmitter& emitter, Vector2 pos, Vector2 size, Radian rot, Vector2 dir, u32 count);
+    // Integrates every live particle, then swap-removes the expired ones.
+    void particles_update(ParticlePool& pool, f32 delta_seconds);
+    // Draws the live particles inside view_min..view_max as quads in one rlgl batch, returns how many.
+    u32 particles_draw(ParticlePool& pool, Vector2 view_min, Vector2 view_max);
+}
@@ -0,0 +1,389 @@
+﻿#include "replay.h"
+#include "particles.h"
+#include "simulation.h"
+#include "window.h"
+
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace woc
+{
+    woc_internal std::string_view replay_next_token(std::string_view& line)
+    {
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+        {
+            line = {};
+            return {};
+        }
+        line.remove_prefix(start);
+        auto end = std::min(line.find_first_of(" \t\r"), line.size());
+        auto token = line.substr(0, end);
+        line.remove_prefix(end);
+        return token;
+    }
+
+    template <typename T>
+    woc_internal bool replay_parse_number(std::string_view text, T& out, i32 base = 10)
+    {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), out, base);
+        return !text.empty() && result.ec == std::errc{} && result.ptr == text.data() + text.size();
+    }
+
+    woc_internal bool replay_same_input(InputState& a, InputState& b)
+    {
+        return a.move_dir == b.move_dir && a.wind_dir_x == b.wind_dir_x && a.wind_dir_y == b.wind_dir_y
+            && a.send_ball == b.send_ball && a.cast_gust == b.cast_gust;
+    }
+
+    std::string replay_format(Replay& replay)
+    {
+        std::ostringstream out;
+        out << "replay " << REPLAY_VERSION << "\n";
+        out << "level " << replay.level << "\n";
+        out << "hash " << std::hex << std::setw(16) << std::setfill('0') << replay.hash << std::dec << "\n";
+        for (size_t i = 0; i < replay.inputs.size();)
+        {
+            auto& input = replay.inputs.at(i);
+            size_t count = 1;
+            while (i + count < replay.inputs.size() && replay_same_input(replay.inputs.at(i + count), input))
+            {
+                count++;
+            }
+            out << count << " " << input.move_dir << " " << input.wind_dir_x << " " << input.wind_dir_y
+                << " " << input.send_ball << " " << input.cast_gust << "\n";
+            i += count;
+        }
+        return out.str();
+    }
+
+    bool replay_parse(std::string_view text, Replay& out, std::string& error)
+    {
+        out = Replay{};
+        u32 line_number = 0;
+        u32 version = 0;
+        while (!text.empty())
+        {
+            line_number++;
+            auto end = std::min(text.find('\n'), text.size());
+            auto line = text.substr(0, end);
+            text.remove_prefix(std::min(end + 1, text.size()));
+            line = line.substr(0, std::min(line.find('#'), line.size()));
+            auto whole_line = line;
+
+            auto kind = replay_next_token(line);
+            bool ok = true;
+            if (kind.empty())
+            {
+                continue;
+            } else if (kind == "replay")
+            {
+                ok = replay_parse_number(replay_next_token(line), version) && version == REPLAY_VERSION;
+            } else if (kind == "level")
+            {
+                ok = replay_parse_number(replay_next_token(line), out.level);
+            } else if (kind == "hash")
+            {
+                ok = replay_parse_number(replay_next_token(line), out.hash, 16);
+            } else {
+                u32 count = 0;
+                auto input = InputState{};
+                ok = version == REPLAY_VERSION
+                    && replay_parse_number(kind, count)
+                    && replay_parse_number(replay_next_token(line), input.move_dir)
+                    && replay_parse_number(replay_next_token(line), input.wind_dir_x)
+                    && replay_parse_number(replay_next_token(line), input.wind_dir_y)
+                    && replay_parse_number(replay_next_token(line), input.send_ball)
+                    && replay_parse_number(replay_next_token(line), input.cast_gust);
+                if (ok)
+                {
+                    out.inputs.insert(out.inputs.end(), count, input);
+                }
+            }
+            ok &= replay_next_token(line).empty();
+            if (!ok)
+            {
+                error = "line " + std::to_string(line_number) + ": can't read '" + std::string(whole_line) + "'";
+                return false;
+            }
+        }
+        if (version != REPLAY_VERSION)
+        {
+            error = "not a version " + std::to_string(REPLAY_VERSION) + " replay";
+            return false;
+        }
+        return true;
+    }
+
+    bool replay_load(const std::string& path, Replay& out, std::string& error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            error = path + ": can't open";
+            return false;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        if (!replay_parse(text.str(), out, error))
+        {
+            error = path + " " + error;
+            return false;
+        }
+        return true;
+    }
+
+    bool replay_save(const std::string& path, Replay& replay, std::string& error)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << replay_format(replay);
+        if (!file)
+        {
+            error = path + ": can't write";
+            return false;
+        }
+        return true;
+    }
+
+    bool replay_video_format_parse(std::string_view text, ReplayVideoFormat& out)
+    {
+        if (text == "png")
+        {
+            out = ReplayVideoFormat::Png;
+            return true;
+        }
+        if (text == "y4m")
+        {
+            out = ReplayVideoFormat::Y4m;
+            return true;
+        }
+        return false;
+    }
+
+    void replay_write_y4m_header(std::ostream& out, u32 width, u32 height, u32 fps)
+    {
+        out << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+    }
+
+    // Full range BT.601 in 16.16 fixed point, which is what C420jpeg in the header promises. Chroma is taken
+    // from the sum of each 2x2 block, hence the extra 2 bits of shift.
+    void replay_write_y4m_frame(std::ostream& out, const u8* rgba, u32 width, u32 height, bool bottom_up, std::vector<u8>& planes)
+    {
+        auto chroma_width = width / 2;
+        auto chroma_height = height / 2;
+        planes.resize(width * height + 2 * chroma_width * chroma_height);
+        auto* y_plane = planes.data();
+        auto* u_plane = y_plane + width * height;
+        auto* v_plane = u_plane + chroma_width * chroma_height;
+        // GL reads rows back bottom first, a negative stride walks them top first without a copy.
+        auto stride = static_cast<i64>(width) * 4;
+        auto* top_row = bottom_up ? rgba + (height - 1) * stride : rgba;
+        stride = bottom_up ? -stride : stride;
+        for (u32 y = 0; y < height; y++)
+        {
+            auto* row = top_row + y * stride;
+            for (u32 x = 0; x < width; x++)
+            {
+                i32 r = row[x * 4 + 0];
+                i32 g = row[x * 4 + 1];
+                i32 b = row[x * 4 + 2];
+                y_plane[y * width + x] = static_cast<u8>((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+            }
+        }
+        for (u32 cy = 0; cy < chroma_height; cy++)
+        {
+            for (u32 cx = 0; cx < chroma_width; cx++)
+            {
+                i32 r = 0;
+                i32 g = 0;
+                i32 b = 0;
+                for (u32 corner = 0; corner < 4; corner++)
+                {
+                    auto* pixel = top_row + (cy * 2 + corner / 2) * stride + (cx * 2 + corner % 2) * 4;
+                    r += pixel[0];
+                    g += pixel[1];
+                    b += pixel[2];
+                }
+                constexpr i32 OFFSET = (128 << 18) + (1 << 17);
+                u_plane[cy * chroma_width + cx] = static_cast<u8>(std::clamp((-11056 * r - 21712 * g + 32768 * b + OFFSET) >> 18, 0, 255));
+                v_plane[cy * chroma_width + cx] = static_cast<u8>(std::clamp((32768 * r - 27440 * g - 5328 * b + OFFSET) >> 18, 0, 255));
+            }
+        }
+        out << "FRAME\n";
+        out.write(reinterpret_cast<const char*>(planes.data()), static_cast<std::streamsize>(planes.size()));
+    }
+
+    bool replay_render(const std::string& replay_path, const std::string& output_directory, ReplayVideoFormat format, std::ostream& log)
+    {
+        auto replay = Replay{};
+        std::string error;
+        if (!replay_load(replay_path, replay, error))
+        {
+            std::cerr << error << "\n";
+            return false;
+        }
+
+        auto stem = std::filesystem::path(replay_path).stem().string();
+        auto output_path = std::filesystem::path(output_directory) / (format == ReplayVideoFormat::Y4m ? stem + ".y4m" : stem);
+        std::error_code directory_error;
+        std::filesystem::create_directories(format == ReplayVideoFormat::Y4m ? output_path.parent_path() : output_path, directory_error);
+        if (directory_error)
+        {
+            std::cerr << output_path.string() << ": " << directory_error.message() << "\n";
+            return false;
+        }
+        std::ofstream video;
+        if (format == ReplayVideoFormat::Y4m)
+        {
+            video.open(output_path, std::ios::binary | std::ios::trunc);
+            replay_write_y4m_header(video, REPLAY_VIDEO_WIDTH, REPLAY_VIDEO_HEIGHT, REPLAY_VIDEO_FPS);
+            if (!video)
+            {
+                std::cerr << output_path.string() << ": can't write\n";
+                return false;
+            }
+        }
+
+        // Starts decoding before the window exists, like the game does.
+        auto preload = AssetPreload{};
+        asset_preload_start(preload);
+        auto size = Vector2 { static_cast<f32>(REPLAY_VIDEO_WIDTH), static_cast<f32>(REPLAY_VIDEO_HEIGHT) };
+        SetTraceLogLevel(LOG_WARNING);
+        SetConfigFlags(FLAG_WINDOW_HIDDEN);
+        auto window = window_init(size);
+        auto renderer = renderer_init(preload);
+        // Seeded from the replay rather than the clock, so rendering it twice gives the same frames.
+        renderer.particles = particles_init(replay.hash);
+
+        auto game_state = game_init(replay.level);
+        auto audio_state = AudioState{};
+        audio_state.defer_playback = true;
+        constexpr u32 TICKS_PER_FRAME = static_cast<u32>(1.f / (SIMULATION_TICK_SECONDS * REPLAY_VIDEO_FPS) + 0.5f);
+        constexpr f32 FRAME_SECONDS = 1.f / REPLAY_VIDEO_FPS;
+        auto total_ticks = replay.inputs.size() + static_cast<size_t>(REPLAY_TAIL_SECONDS / SIMULATION_TICK_SECONDS);
+
+        bool ok = true;
+        u32 frame = 0;
+        std::vector<u8> planes;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t tick = 0; tick < total_ticks && ok; frame++)
+        {
+            for (u32 i = 0; i < TICKS_PER_FRAME && tick < total_ticks; i++, tick++)
+            {
+                auto input = tick < replay.inputs.size() ? replay.inputs.at(tick) : InputState{};
+                game_update(game_state, input, audio_state, SIMULATION_TICK_SECONDS);
+                audio_state.deferred_sounds.clear();
+                if (tick + 1 == replay.inputs.size() && game_hash(game_state) != replay.hash)
+                {
+                    log << replay_path << ": diverged from the recording by its last input, the level probably changed since\n";
+                }
+            }
+            renderer_update_effects(renderer, game_state, FRAME_SECONDS);
+
+            renderer_prepare_rendering(renderer);
+            renderer_render_world(renderer, game_state, size);
+            // Read back before the swap, the back buffer is undefined after it.
+            rlDrawRenderBatchActive();
+            auto* pixels = rlReadScreenPixels(static_cast<i32>(REPLAY_VIDEO_WIDTH), static_cast<i32>(REPLAY_VIDEO_HEIGHT));
+            renderer_finalize_rendering(renderer);
+            if (!pixels)
+            {
+                std::cerr << replay_path << ": can't read back frame " << frame << "\n";
+                ok = false;
+                break;
+            }
+
+            if (format == ReplayVideoFormat::Y4m)
+            {
+                replay_write_y4m_frame(video, pixels, REPLAY_VIDEO_WIDTH, REPLAY_VIDEO_HEIGHT, false, planes);
+                ok = static_cast<bool>(video);
+            } else {
+                auto image = Image {
+                    .data = pixels,
+                    .width = static_cast<i32>(REPLAY_VIDEO_WIDTH),
+                    .height = static_cast<i32>(REPLAY_VIDEO_HEIGHT),
+                    .mipmaps = 1,
+                    .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+                };
+                std::ostringstream name;
+                name << "frame-" << std::setw(6) << std::setfill('0') << frame << ".png";
+                ok = ExportImage(image, (output_path / name.str()).string().c_str());
+            }
+            MemFree(pixels);
+            if (!ok)
+            {
+                std::cerr << output_path.string() << ": can't write frame " << frame << "\n";
+            }
+        }
+        auto seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+        renderer_deinit(renderer);
+        window_deinit(window);
+        log << replay_path << ": " << frame << " frames to " << output_path.string() << " in " << std::fixed << std::setprecision(2)
+            << seconds << " s (" << static_cast<f64>(frame) / std::max(seconds, 1e-9) << " frames/s)" << std::defaultfloat << "\n";
+        return ok;
+    }
+
+    u32 replay_render_batch(std::vector<std::string>& replay_paths, const std::string& output_directory, ReplayVideoFormat format, u32 jobs, std::ostream& log)
+    {
+        u32 failures = 0;
+#if defined(__linux__)
+        // Anything still buffered would be written again by every child.
+        log.flush();
+        std::cerr.flush();
+        u32 running = 0;
+        auto wait_one = [&failures, &running] ()
+        {
+            i32 status = 0;
+            if (wait(&status) > 0)
+            {
+                failures += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+                running--;
+            }
+        };
+        for (auto& path : replay_paths)
+        {
+            if (running >= std::max(jobs, 1u))
+            {
+                wait_one();
+            }
+            auto pid = fork();
+            if (pid == 0)
+            {
+                bool ok = replay_render(path, output_directory, format, log);
+                log.flush();
+                std::cerr.flush();
+                // Skips atexit handlers and static destructors, those belong to the parent.
+                _exit(ok ? 0 : 1);
+            }
+            if (pid < 0)
+            {
+                std::cerr << path << ": can't fork\n";
+                failures++;
+                continue;
+            }
+            running++;
+        }
+        while (running)
+        {
+            wait_one();
+        }
+#else
+        // No fork here. One at a time still works, the window is torn down between replays.
+        for (auto& path : replay_paths)
+        {
+            failures += !replay_render(path, output_directory, format, log);
+        }
+#endif
+        return failures;
+    }
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+#include <string>
+
+namespace woc
+{
+    // Replays are text files holding one level attempt from game_init on, one input per simulation tick:
+    //   replay 1
+    //   level 3
+    //   hash 9f2c01d4be6a7713
+    //   240 0 0 0 0 0
+    //   12 1 0 0 1 0
+    // Input lines are a repeat count then move_dir, wind_dir_x, wind_dir_y, send_ball and cast_gust. hash is
+    // game_hash after the last input, so re-simulating can tell when a level file changed underneath it.
+    constexpr u32 REPLAY_VERSION = 1;
+    constexpr u32 REPLAY_VIDEO_FPS = 60;
+    constexpr u32 REPLAY_VIDEO_WIDTH = 1280;
+    constexpr u32 REPLAY_VIDEO_HEIGHT = 720;
+    // Keeps rendering after the last input so the video shows how the level ended.
+    constexpr f32 REPLAY_TAIL_SECONDS = 2.f;
+
+    struct Replay
+    {
+        u32 level;
+        u64 hash;
+        std::vector<InputState> inputs;
+    };
+    std::string replay_format(Replay& replay);
+    // On failure error names the offending line.
+    bool replay_parse(std::string_view text, Replay& out, std::string& error);
+    bool replay_load(const std::string& path, Replay& out, std::string& error);
+    bool replay_save(const std::string& path, Replay& replay, std::string& error);
+
+    enum class ReplayVideoFormat
+    {
+        // One numbered file per frame in a directory named after the replay.
+        Png,
+        // Uncompressed 4:2:0 video in a single file, which ffmpeg and most players read as is.
+        Y4m,
+    };
+    bool replay_video_format_parse(std::string_view text, ReplayVideoFormat& out);
+    void replay_write_y4m_header(std::ostream& out, u32 width, u32 height, u32 fps);
+    // rgba is width * height pixels, with even dimensions. planes is scratch space kept between frames.
+    void replay_write_y4m_frame(std::ostream& out, const u8* rgba, u32 width, u32 height, bool bottom_up, std::vector<u8>& planes);
+    // Re-simulates one replay and draws every video frame through renderer_render_world into a hidden window.
+    // Opens and closes its own window, so it can only run once at a time per process.
+    bool replay_render(const std::string& replay_path, const std::string& output_directory, ReplayVideoFormat format, std::ostream& log);
+    // Renders each replay in its own process, jobs at a time, since a process only gets one GL context.
+    // Returns how many failed. Needs a GL driver but no desktop, e.g. Mesa llvmpipe under xvfb-run.
+    u32 replay_render_batch(std::vector<std::string>& replay_paths, const std::string& output_directory, ReplayVideoFormat format, u32 jobs, std::ostream& log);
+}
@@ -0,0 +1,392 @@
+﻿#include "rewind.h"
+#include "broadphase.h"
+#include "memory.h"
+
+namespace woc
+{
+    static_assert(std::is_trivially_copyable_v<PlayerState> && std::is_trivially_copyable_v<EnemyState>);
+
+    enum class RewindEnemyOp : u8
+    {
+        Remove,
+        Modify,
+        Append
+    };
+
+    struct RewindReader
+    {
+        const u8* at;
+        const u8* end;
+    };
+
+    template <typename T>
+    woc_internal void rewind_write(std::vector<u8>& out, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto size = out.size();
+        out.resize(size + sizeof(T));
+        std::memcpy(out.data() + size, &value, sizeof(T));
+    }
+
+    template <typename T>
+    woc_internal void rewind_write_vector(std::vector<u8>& out, std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        rewind_write(out, static_cast<u32>(values.size()));
+        auto size = out.size();
+        out.resize(size + values.size() * sizeof(T));
+        if (!values.empty())
+        {
+            std::memcpy(out.data() + size, values.data(), values.size() * sizeof(T));
+        }
+    }
+
+    template <typename T>
+    woc_internal T rewind_read(RewindReader& reader)
+    {
+        assert(reader.at + sizeof(T) <= reader.end);
+        T result;
+        std::memcpy(&result, reader.at, sizeof(T));
+        reader.at += sizeof(T);
+        return result;
+    }
+
+    template <typename T>
+    woc_internal void rewind_read_vector(RewindReader& reader, std::vector<T>& values)
+    {
+        auto count = rewind_read<u32>(reader);
+        assert(reader.at + count * sizeof(T) <= reader.end);
+        values.resize(count);
+        if (count)
+        {
+            std::memcpy(values.data(), reader.at, count * sizeof(T));
+        }
+        reader.at += count * sizeof(T);
+    }
+
+    // Walls only ever lose health, disappear or follow their motion, so a wall from the same place is the same wall.
+    // Moving walls are told apart by where their motion is anchored instead.
+    woc_internal bool rewind_same_enemy(EnemyState& a, EnemyState& b)
+    {
+        // Exact compares on purpose, Vector2Equals' tolerance test costs more than the whole rest of the diff.
+        bool moving = enemy_is_moving(a);
+        if (moving != enemy_is_moving(b) || a.size.x != b.size.x || a.size.y != b.size.y || a.type != b.type)
+        {
+            return false;
+        }
+        if (moving)
+        {
+            return a.motion.origin.x == b.motion.origin.x && a.motion.origin.y == b.motion.origin.y;
+        }
+        return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.rot.val == b.rot.val;
+    }
+
+    // Greedy two-pointer diff. Removals and in-place changes stay small; anything else degrades to
+    // remove-all plus append-all, which is still correct.
+    woc_internal void rewind_write_enemy_delta(std::vector<u8>& out, std::vector<EnemyState>& previous, std::vector<EnemyState>& current)
+    {
+        auto count_offset = out.size();
+        u32 op_count = 0;
+        rewind_write(out, op_count);
+
+        constexpr size_t SKIP_BLOCK = 64;
+        size_t j = 0;
+        for (size_t i = 0; i < previous.size(); i++)
+        {
+            // Most walls are untouched between keyframes. Byte compares can miss a match on padding, which only
+            // costs falling back to the field compare below.
+            while (i + SKIP_BLOCK <= previous.size() && j + SKIP_BLOCK <= current.size()
+                && std::memcmp(previous.data() + i, current.data() + j, SKIP_BLOCK * sizeof(EnemyState)) == 0)
+            {
+                i += SKIP_BLOCK;
+                j += SKIP_BLOCK;
+            }
+            if (i == previous.size())
+            {
+                break;
+            }
+            
+            auto& p = previous.at(i);
+            if (j < current.size() && rewind_same_enemy(p, current.at(j)))
+            {
+                auto& c = current.at(j);
+                if (p.health != c.health || p.contributes_to_win != c.contributes_to_win
+                    || (enemy_is_moving(c) && std::memcmp(&p, &c, sizeof(EnemyState)) != 0))
+                {
+                    rewind_write(out, RewindEnemyOp::Modify);
+                    rewind_write(out, static_cast<u32>(i));
+                    rewind_write(out, c);
+                    op_count++;
+                }
+                j++;
+            } else {
+                rewind_write(out, RewindEnemyOp::Remove);
+                rewind_write(out, static_cast<u32>(i));
+                op_count++;
+            }
+        }
+        for (; j < current.size(); j++)
+        {
+            rewind_write(out, RewindEnemyOp::Append);
+            rewind_write(out, current.at(j));
+            op_count++;
+        }
+        std::memcpy(out.data() + count_offset, &op_count, sizeof(op_count));
+    }
+
+    woc_internal void rewind_read_enemy_delta(RewindReader& reader, std::vector<EnemyState>& enemies, std::vector<EnemyState>& scratch)
+    {
+        auto op_count = rewind_read<u32>(reader);
+        scratch.clear();
+        size_t next = 0;
+        for (u32 op = 0; op < op_count; op++)
+        {
+            auto type = rewind_read<RewindEnemyOp>(reader);
+            if (type == RewindEnemyOp::Append)
+            {
+                while (next < enemies.size())
+                {
+                    scratch.emplace_back(enemies.at(next++));
+                }
+                scratch.emplace_back(rewind_read<EnemyState>(reader));
+                continue;
+            }
+
+            auto index = rewind_read<u32>(reader);
+            while (next < index)
+            {
+                scratch.emplace_back(enemies.at(next++));
+            }
+            if (type == RewindEnemyOp::Modify)
+            {
+                scratch.emplace_back(rewind_read<EnemyState>(reader));
+            }
+            next = index + 1;
+        }
+        while (next < enemies.size())
+        {
+            scratch.emplace_back(enemies.at(next++));
+        }
+        std::swap(enemies, scratch);
+    }
+
+    woc_internal void rewind_encode(RewindBuffer& buffer, GameState& game_state, bool full)
+    {
+        auto& out = buffer.scratch_bytes;
+        out.clear();
+        rewind_write(out, game_state.id);
+        rewind_write(out, game_state.current_level);
+        rewind_write(out, game_state.time_scale);
+        rewind_write(out, game_state.level_status);
+        rewind_write(out, game_state.player);
+        rewind_write(out, game_state.second_player);
+        rewind_write(out, game_state.cam);
+        // These change every tick, so storing them whole is as small as any diff. The wind field is rebuilt
+        // from the gusts on the next tick.
+        rewind_write_vector(out, game_state.player_projectiles);
+        rewind_write_vector(out, game_state.dead_projectile_effects);
+        rewind_write_vector(out, game_state.dead_enemy_effects);
+        rewind_write(out, game_state.dead_projectile_effects_spawned);
+        rewind_write(out, game_state.dead_enemy_effects_spawned);
+        rewind_write_vector(out, game_state.wind_gusts);
+        // Small next to the walls, and only streamed levels have any.
+        rewind_write_vector(out, game_state.chunks.awake);
+        rewind_write_vector(out, game_state.chunks.asleep_walls);
+        rewind_write(out, game_state.chunks.asleep_win_walls);
+        if (full)
+        {
+            rewind_write_vector(out, game_state.enemies);
+        } else {
+            rewind_write_enemy_delta(out, buffer.previous.enemies, game_state.enemies);
+        }
+    }
+
+    woc_internal void rewind_decode(RewindBuffer& buffer, RewindKeyframe& keyframe, GameState& game_state)
+    {
+        auto reader = RewindReader { buffer.bytes.data() + keyframe.offset, buffer.bytes.data() + keyframe.offset + keyframe.size };
+        game_state.id = rewind_read<u64>(reader);
+        game_state.current_level = rewind_read<u32>(reader);
+        game_state.time_scale = rewind_read<f32>(reader);
+        game_state.level_status = rewind_read<LevelStatus>(reader);
+        game_state.player = rewind_read<PlayerState>(reader);
+        game_state.second_player = rewind_read<std::optional<PlayerState>>(reader);
+        game_state.cam = rewind_read<Camera>(reader);
+        rewind_read_vector(reader, game_state.player_projectiles);
+        rewind_read_vector(reader, game_state.dead_projectile_effects);
+        rewind_read_vector(reader, game_state.dead_enemy_effects);
+        game_state.dead_projectile_effects_spawned = rewind_read<u32>(reader);
+        game_state.dead_enemy_effects_spawned = rewind_read<u32>(reader);
+        rewind_read_vector(reader, game_state.wind_gusts);
+        rewind_read_vector(reader, game_state.chunks.awake);
+        rewind_read_vector(reader, game_state.chunks.asleep_walls);
+        game_state.chunks.asleep_win_walls = rewind_read<u32>(reader);
+        if (keyframe.full)
+        {
+            rewind_read_vector(reader, game_state.enemies);
+        } else {
+            rewind_read_enemy_delta(reader, game_state.enemies, buffer.scratch_enemies);
+        }
+        broadphase_build(game_state.broadphase, game_state.enemies);
+        assert(reader.at == reader.end);
+    }
+
+    woc_internal RewindKeyframe& rewind_keyframe(RewindBuffer& buffer, u32 index)
+    {
+        return buffer.keyframes.at((buffer.first_keyframe + index) % REWIND_MAX_KEYFRAMES);
+    }
+
+    woc_internal void rewind_drop_oldest(RewindBuffer& buffer)
+    {
+        buffer.first_keyframe = (buffer.first_keyframe + 1) % REWIND_MAX_KEYFRAMES;
+        buffer.keyframe_count--;
+        // Deltas without the full keyframe they build on can't be decoded anymore.
+        while (buffer.keyframe_count && !rewind_keyframe(buffer, 0).full)
+        {
+            buffer.first_keyframe = (buffer.first_keyframe + 1) % REWIND_MAX_KEYFRAMES;
+            buffer.keyframe_count--;
+        }
+    }
+
+    woc_internal void rewind_capture(RewindBuffer& buffer, GameState& game_state)
+    {
+        while (buffer.keyframe_count && buffer.tick - rewind_keyframe(buffer, 0).tick > REWIND_HISTORY_TICKS)
+        {
+            rewind_drop_oldest(buffer);
+        }
+        if (buffer.keyframe_count == REWIND_MAX_KEYFRAMES)
+        {
+            rewind_drop_oldest(buffer);
+        }
+
+        bool full = buffer.keyframe_count == 0 || buffer.keyframes_since_full + 1 >= REWIND_FULL_KEYFRAME_INTERVAL;
+        rewind_encode(buffer, game_state, full);
+        auto size = buffer.scratch_bytes.size();
+        if (size > buffer.bytes.size())
+        {
+            // A single state larger than the whole budget, nothing sensible to keep.
+            buffer.keyframe_count = 0;
+            return;
+        }
+
+        auto offset = buffer.write_offset + size > buffer.bytes.size() ? 0 : buffer.write_offset;
+        // Keyframes sit in the arena oldest first from write_offset on. Wrapping around skips the tail, which holds the oldest ones.
+        auto overwritten = [offset, size, tail = buffer.write_offset] (RewindKeyframe& k)
+        {
+            return (offset == 0 && k.offset >= tail) || (k.offset < offset + size && offset < k.offset + k.size);
+        };
+        while (buffer.keyframe_count && overwritten(rewind_keyframe(buffer, 0)))
+        {
+            rewind_drop_oldest(buffer);
+        }
+        if (!full && buffer.keyframe_count == 0)
+        {
+            // The chain this delta built on was just overwritten.
+            full = true;
+            rewind_encode(buffer, game_state, full);
+            size = buffer.scratch_bytes.size();
+            offset = buffer.write_offset + size > buffer.bytes.size() ? 0 : buffer.write_offset;
+        }
+
+        std::memcpy(buffer.bytes.data() + offset, buffer.scratch_bytes.data(), size);
+        buffer.write_offset = offset + size;
+        rewind_keyframe(buffer, buffer.keyframe_count++) = RewindKeyframe { .tick = buffer.tick, .offset = offset, .size = size, .full = full };
+        buffer.keyframes_since_full = full ? 0 : buffer.keyframes_since_full + 1;
+        buffer.previous = game_state;
+    }
+
+    RewindBuffer rewind_init()
+    {
+        return RewindBuffer {
+            .bytes = TaggedVector<u8, MemoryTag::Rewind>(REWIND_BUFFER_BYTES),
+            .write_offset = 0,
+            .keyframes = TaggedVector<RewindKeyframe, MemoryTag::Rewind>(REWIND_MAX_KEYFRAMES),
+            .first_keyframe = 0,
+            .keyframe_count = 0,
+            .keyframes_since_full = 0,
+            .inputs = TaggedVector<InputState, MemoryTag::Rewind>(REWIND_HISTORY_TICKS),
+            .tick = 0,
+            .previous = {},
+            .scratch_enemies = {},
+            .scratch_bytes = {}
+        };
+    }
+
+    void rewind_reset(RewindBuffer& buffer, GameState& game_state)
+    {
+        buffer.write_offset = 0;
+        buffer.first_keyframe = 0;
+        buffer.keyframe_count = 0;
+        buffer.keyframes_since_full = 0;
+        buffer.tick = 0;
+        // The scratch buffers and previous state grow here.
+        auto previous_tag = memory_tag_push(MemoryTag::Rewind);
+        rewind_capture(buffer, game_state);
+        memory_tag_pop(previous_tag);
+    }
+
+    void rewind_record(RewindBuffer& buffer, GameState& game_state, InputState& input)
+    {
+        buffer.inputs.at(buffer.tick % REWIND_HISTORY_TICKS) = input;
+        buffer.tick++;
+        if (buffer.tick % REWIND_KEYFRAME_TICKS == 0)
+        {
+            auto previous_tag = memory_tag_push(MemoryTag::Rewind);
+            rewind_capture(buffer, game_state);
+            memory_tag_pop(previous_tag);
+        }
+    }
+
+    bool rewind_step_back(RewindBuffer& buffer, GameState& game_state, AudioState& audio_state, f32 seconds)
+    {
+        if (!buffer.keyframe_count)
+        {
+            return false;
+        }
+        auto ticks_back = static_cast<u64>(seconds / SIMULATION_TICK_SECONDS);
+        auto target_tick = std::max(buffer.tick - std::min(ticks_back, buffer.tick), rewind_keyframe(buffer, 0).tick);
+
+        u32 index = buffer.keyframe_count - 1;
+        while (rewind_keyframe(buffer, index).tick > target_tick)
+        {
+            index--;
+        }
+        u32 anchor = index;
+        while (!rewind_keyframe(buffer, anchor).full)
+        {
+            anchor--;
+        }
+        for (u32 i = anchor; i <= index; i++)
+        {
+            rewind_decode(buffer, rewind_keyframe(buffer, i), buffer.previous);
+        }
+
+        // Everything after the restored keyframe belongs to the future we're leaving.
+        auto& keyframe = rewind_keyframe(buffer, index);
+        buffer.keyframe_count = index + 1;
+        buffer.write_offset = keyframe.offset + keyframe.size;
+        buffer.keyframes_since_full = index - anchor;
+        buffer.tick = keyframe.tick;
+
+        game_state = buffer.previous;
+        auto sound_count = audio_state.deferred_sounds.size();
+        while (buffer.tick < target_tick)
+        {
+            auto input = buffer.inputs.at(buffer.tick % REWIND_HISTORY_TICKS);
+            game_update(game_state, input, audio_state, SIMULATION_TICK_SECONDS);
+            buffer.tick++;
+        }
+        // The re-simulated ticks were already heard the first time round.
+        audio_state.deferred_sounds.resize(sound_count);
+        return true;
+    }
+
+    size_t rewind_bytes_used(RewindBuffer& buffer)
+    {
+        size_t result = 0;
+        for (u32 i = 0; i < buffer.keyframe_count; i++)
+        {
+            result += rewind_keyframe(buffer, i).size;
+        }
+        return result;
+    }
+}
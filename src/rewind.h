@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+#include "simulation.h"
+
+namespace woc
+{
+    // How far one rewind goes back.
+    constexpr f32 REWIND_SECONDS = 3.f;
+    constexpr u32 REWIND_KEYFRAME_TICKS = 24;
+    // Every Nth keyframe stores the whole state, the ones between only store what changed since the previous keyframe.
+    constexpr u32 REWIND_FULL_KEYFRAME_INTERVAL = 16;
+    constexpr u32 REWIND_HISTORY_TICKS = static_cast<u32>(10.f / SIMULATION_TICK_SECONDS);
+    constexpr u32 REWIND_MAX_KEYFRAMES = REWIND_HISTORY_TICKS / REWIND_KEYFRAME_TICKS + REWIND_FULL_KEYFRAME_INTERVAL;
+    // Oldest keyframes are dropped when either this or REWIND_HISTORY_TICKS runs out.
+    constexpr size_t REWIND_BUFFER_BYTES = 16 * 1024 * 1024;
+
+    struct RewindKeyframe
+    {
+        u64 tick;
+        size_t offset;
+        size_t size;
+        bool full;
+    };
+
+    // Owned by the simulation thread. All storage is allocated up front, except the scratch states and
+    // encode buffer which grow to the largest level seen and then stay put.
+    struct RewindBuffer
+    {
+        TaggedVector<u8, MemoryTag::Rewind> bytes;
+        size_t write_offset;
+        TaggedVector<RewindKeyframe, MemoryTag::Rewind> keyframes;
+        u32 first_keyframe;
+        u32 keyframe_count;
+        u32 keyframes_since_full;
+        // inputs[t % REWIND_HISTORY_TICKS] took the game from tick t to t + 1.
+        TaggedVector<InputState, MemoryTag::Rewind> inputs;
+        u64 tick;
+
+        GameState previous;
+        std::vector<EnemyState> scratch_enemies;
+        std::vector<u8> scratch_bytes;
+    };
+    RewindBuffer rewind_init();
+    // Forgets all history and keyframes game_state as tick 0.
+    void rewind_reset(RewindBuffer& buffer, GameState& game_state);
+    // Call after every tick with the input that tick ran with.
+    void rewind_record(RewindBuffer& buffer, GameState& game_state, InputState& input);
+    // Restores the keyframe at or before the target tick and re-simulates up to it. History past the target is dropped.
+    bool rewind_step_back(RewindBuffer& buffer, GameState& game_state, AudioState& audio_state, f32 seconds);
+    size_t rewind_bytes_used(RewindBuffer& buffer);
+}
@@ -0,0 +1,358 @@
+﻿#include "simulation.h"
+#include "rewind.h"
+#include "memory.h"
+#include "replay.h"
+
+#include <filesystem>
+#include <iomanip>
+#include <ostream>
+
+namespace woc
+{
+    woc_internal u64 simulation_game_id(std::optional<GameState>& game_state)
+    {
+        return game_state ? game_state->id : 0;
+    }
+
+    woc_internal void simulation_save_replay(Simulation& simulation, Replay& replay, std::optional<GameState>& game_state, u64 session)
+    {
+        if (simulation.replay_directory.empty() || !game_state || replay.inputs.empty())
+        {
+            return;
+        }
+        replay.hash = game_hash(*game_state);
+        auto name = std::to_string(session) + "-" + std::to_string(game_state->id) + "-level-" + std::to_string(replay.level) + ".replay";
+        std::string error;
+        std::error_code directory_error;
+        std::filesystem::create_directories(simulation.replay_directory, directory_error);
+        if (!replay_save((std::filesystem::path(simulation.replay_directory) / name).string(), replay, error))
+        {
+            std::cerr << error << "\n";
+        }
+    }
+
+    // Folds every pending event up to until into held and returns the input for the tick ending then.
+    woc_internal InputState simulation_take_input(std::vector<InputEvent>& events, size_t& next_event, InputState& held,
+        std::chrono::steady_clock::time_point until, std::chrono::steady_clock::time_point& input_time)
+    {
+        u32 gusts = 0;
+        for (; next_event < events.size() && events.at(next_event).time <= until; next_event++)
+        {
+            auto& event = events.at(next_event);
+            held = event.input;
+            gusts += event.input.cast_gust;
+            input_time = event.time;
+        }
+        auto input = held;
+        input.cast_gust = gusts;
+        held.cast_gust = 0;
+        return input;
+    }
+
+    woc_internal void simulation_thread_main(Simulation& simulation, AudioState audio_state)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        audio_state.defer_playback = true;
+        auto previous_tag = memory_tag_push(MemoryTag::Game);
+        auto game_state = std::optional<GameState>{};
+        auto rewind_buffer = rewind_init();
+        auto level_edits = std::vector<LevelEdit>{};
+        auto input_events = std::vector<InputEvent>{};
+        size_t next_input_event = 0;
+        auto held_input = InputState{};
+        auto input_time = Clock::time_point{};
+        // Game ids restart with the process, the session keeps one run's replays from overwriting the last.
+        auto replay_session = static_cast<u64>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        auto replay = Replay{};
+        bool replay_recording = false;
+        u64 tick = 0;
+        f32 accumulator = 0.f;
+        auto previous_time = Clock::now();
+        while (simulation.running.load(std::memory_order_acquire))
+        {
+            bool publish = false;
+            SimulationMode mode;
+            u32 rewind_requests;
+            {
+                std::scoped_lock lock(simulation.mutex);
+                auto& mailbox = simulation.mailbox;
+                if (mailbox.has_replacement)
+                {
+                    if (replay_recording)
+                    {
+                        simulation_save_replay(simulation, replay, game_state, replay_session);
+                    }
+                    game_state = std::move(mailbox.replacement);
+                    mailbox.replacement = std::nullopt;
+                    mailbox.has_replacement = false;
+                    accumulator = 0.f;
+                    publish = true;
+                    if (game_state && simulation.netplay)
+                    {
+                        game_add_second_player(*game_state);
+                        netplay_begin_game(*simulation.netplay, *game_state);
+                    }
+                    if (game_state)
+                    {
+                        rewind_reset(rewind_buffer, *game_state);
+                    }
+                    // Replays start from game_init, anything else wouldn't re-simulate to the same place.
+                    replay_recording = game_state && !simulation.replay_directory.empty() && !simulation.netplay;
+                    replay.level = game_state ? game_state->current_level : 0;
+                    replay.inputs.clear();
+                }
+                input_events.erase(input_events.begin(), input_events.begin() + static_cast<std::ptrdiff_t>(next_input_event));
+                next_input_event = 0;
+                input_events.insert(input_events.end(), mailbox.input_events.begin(), mailbox.input_events.end());
+                mailbox.input_events.clear();
+                mode = mailbox.mode;
+                rewind_requests = std::exchange(mailbox.rewind_requests, 0u);
+                std::swap(level_edits, mailbox.level_edits);
+            }
+
+            for (auto& edit : level_edits)
+            {
+                // The peer wouldn't see the edit.
+                if (game_state && game_state->current_level == edit.level && !simulation.netplay)
+                {
+                    levelfile_patch(*game_state, edit.before, edit.after);
+                    // History from before the edit would undo it.
+                    rewind_reset(rewind_buffer, *game_state);
+                    publish = true;
+                    // Replays play back against the level file as it is then, so this one can't be reproduced.
+                    replay_recording = false;
+                }
+            }
+            level_edits.clear();
+
+            // A won level is already handing over to the next one, there's nothing to take back. Netplay games
+            // belong to both players.
+            if (rewind_requests && game_state && game_state->level_status != LevelStatus::Won && !simulation.netplay)
+            {
+                publish |= rewind_step_back(rewind_buffer, *game_state, audio_state, REWIND_SECONDS * static_cast<f32>(rewind_requests));
+                if (replay_recording)
+                {
+                    replay.inputs.resize(rewind_buffer.tick);
+                }
+            }
+
+            auto frame_start = Clock::now();
+            auto elapsed_seconds = std::chrono::duration<f32>(frame_start - previous_time).count();
+            previous_time = frame_start;
+
+            // A hidden window still has to keep up with the peer.
+            bool simulate = game_state
+                && mode != SimulationMode::Paused
+                && !(mode == SimulationMode::Throttled && game_can_pause(*game_state) && !simulation.netplay);
+            auto tick_seconds = simulation.netplay ? NETPLAY_TICK_SECONDS : SIMULATION_TICK_SECONDS;
+            if (simulate)
+            {
+                accumulator = std::min(accumulator + elapsed_seconds, SIMULATION_MAX_CATCH_UP_SECONDS);
+                while (accumulator >= tick_seconds)
+                {
+                    // Held back until the peer's inputs catch up, the time isn't lost. Rollbacks happen in here too.
+                    if (simulation.netplay)
+                    {
+                        publish = true;
+                        if (!netplay_poll(*simulation.netplay, *game_state, audio_state))
+                        {
+                            break;
+                        }
+                    }
+                    // This tick stands for the game time ending accumulator - tick seconds before now.
+                    auto tick_end = frame_start - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f32>(accumulator - tick_seconds));
+                    auto input = simulation_take_input(input_events, next_input_event, held_input, tick_end, input_time);
+                    if (simulation.netplay)
+                    {
+                        netplay_advance(*simulation.netplay, *game_state, input, audio_state);
+                    } else {
+                        game_update(*game_state, input, audio_state, SIMULATION_TICK_SECONDS);
+                        rewind_record(rewind_buffer, *game_state, input);
+                    }
+                    if (replay_recording)
+                    {
+                        replay.inputs.push_back(input);
+                    }
+                    accumulator -= tick_seconds;
+                    tick++;
+                    publish = true;
+                }
+            } else {
+                // Nothing to apply them to. Keep what's held, a press from before the pause shouldn't fire after it.
+                simulation_take_input(input_events, next_input_event, held_input, frame_start, input_time);
+                if (game_state && simulation.netplay)
+                {
+                    // The peer waits on this side's inputs, it still gets acks and resends. A rollback this makes
+                    // is published with the next tick.
+                    netplay_poll(*simulation.netplay, *game_state, audio_state);
+                }
+            }
+
+            if (game_state)
+            {
+                counters_set(Counter::Projectiles, game_state->player_projectiles.size());
+                counters_set(Counter::Enemies, game_state->enemies.size());
+                counters_set(Counter::Effects, game_state->dead_projectile_effects.size() + game_state->dead_enemy_effects.size() + game_state->wind_gusts.size());
+            }
+
+            if (!audio_state.deferred_sounds.empty())
+            {
+                std::scoped_lock lock(simulation.mutex);
+                auto& sounds = simulation.mailbox.sounds;
+                sounds.insert(sounds.end(), audio_state.deferred_sounds.begin(), audio_state.deferred_sounds.end());
+                audio_state.deferred_sounds.clear();
+            }
+
+            if (publish)
+            {
+                // Copy-assigning into a recycled slot reuses its vectors' capacity, so steady state doesn't allocate.
+                auto& snapshot = triple_buffer_back(simulation.snapshots);
+                snapshot.game_state = game_state;
+                snapshot.tick = tick;
+                snapshot.input_time = input_time;
+                triple_buffer_publish(simulation.snapshots);
+            }
+
+            auto sleep_seconds = mode == SimulationMode::Throttled && !simulation.netplay ? HIDDEN_GAME_TICK_SECONDS : static_cast<f64>(tick_seconds);
+            std::this_thread::sleep_until(frame_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(sleep_seconds)));
+        }
+        if (replay_recording)
+        {
+            simulation_save_replay(simulation, replay, game_state, replay_session);
+        }
+        memory_tag_pop(previous_tag);
+    }
+
+    void simulation_start(Simulation& simulation, AudioState& audio_state)
+    {
+        simulation.mailbox = SimulationMailbox {
+            .has_replacement = false,
+            .replacement = std::nullopt,
+            .input_events = {},
+            .mode = SimulationMode::Paused,
+            .rewind_requests = 0,
+            .level_edits = {},
+            .sounds = {}
+        };
+        simulation.submitted_game_id = 0;
+        simulation.submitted_input = InputState{};
+        simulation.acquired_input_time = {};
+        simulation.presented_input_time = {};
+        simulation.latency_samples = 0;
+        simulation.latency_total_seconds = 0.0;
+        simulation.latency_max_seconds = 0.0;
+        simulation.running.store(true, std::memory_order_release);
+        simulation.thread = std::thread(simulation_thread_main, std::ref(simulation), audio_state);
+    }
+
+    void simulation_stop(Simulation& simulation)
+    {
+        simulation.running.store(false, std::memory_order_release);
+        if (simulation.thread.joinable())
+        {
+            simulation.thread.join();
+        }
+    }
+
+    void simulation_acquire(Simulation& simulation, std::optional<GameState>& game_state)
+    {
+        if (!triple_buffer_acquire(simulation.snapshots))
+        {
+            return;
+        }
+
+        // Snapshots of a game the main thread already replaced are stale, keep showing the new one.
+        auto& snapshot = triple_buffer_front(simulation.snapshots);
+        auto game_id = simulation_game_id(game_state);
+        if (game_id == simulation.submitted_game_id && simulation_game_id(snapshot.game_state) == game_id)
+        {
+            std::swap(game_state, snapshot.game_state);
+            simulation.acquired_input_time = snapshot.input_time;
+        }
+    }
+
+    void simulation_submit(Simulation& simulation, std::optional<GameState>& game_state, SimulationMode mode)
+    {
+        auto game_id = simulation_game_id(game_state);
+        std::scoped_lock lock(simulation.mutex);
+        auto& mailbox = simulation.mailbox;
+        if (game_id != simulation.submitted_game_id)
+        {
+            auto previous_tag = memory_tag_push(MemoryTag::Game);
+            mailbox.replacement = game_state;
+            memory_tag_pop(previous_tag);
+            mailbox.has_replacement = true;
+            simulation.submitted_game_id = game_id;
+        }
+        mailbox.mode = mode;
+    }
+
+    void simulation_submit_input(Simulation& simulation, InputState input, std::chrono::steady_clock::time_point time)
+    {
+        // Only the fields game_update reads, the rest is handled on the main thread.
+        auto& last = simulation.submitted_input;
+        bool changed = input.move_dir != last.move_dir || input.wind_dir_x != last.wind_dir_x || input.wind_dir_y != last.wind_dir_y
+            || (input.send_ball != 0) != (last.send_ball != 0) || input.cast_gust != 0;
+        if (!changed)
+        {
+            return;
+        }
+        last = input;
+        std::scoped_lock lock(simulation.mutex);
+        simulation.mailbox.input_events.push_back(InputEvent { .time = time, .input = input });
+    }
+
+    void simulation_record_present(Simulation& simulation, std::chrono::steady_clock::time_point present_time)
+    {
+        if (simulation.acquired_input_time <= simulation.presented_input_time)
+        {
+            return;
+        }
+        auto seconds = std::chrono::duration<f64>(present_time - simulation.acquired_input_time).count();
+        simulation.presented_input_time = simulation.acquired_input_time;
+        simulation.latency_samples++;
+        simulation.latency_total_seconds += seconds;
+        simulation.latency_max_seconds = std::max(simulation.latency_max_seconds, seconds);
+        counters_set(Counter::InputLatencyMicroseconds, static_cast<u64>(seconds * 1e6));
+    }
+
+    void simulation_report_latency(Simulation& simulation, std::ostream& out)
+    {
+        if (simulation.latency_samples == 0)
+        {
+            out << "input to present: no samples\n";
+            return;
+        }
+        out << "input to present: " << simulation.latency_samples << " samples, " << std::fixed << std::setprecision(2)
+            << simulation.latency_total_seconds / static_cast<f64>(simulation.latency_samples) * 1000.0 << " ms average, "
+            << simulation.latency_max_seconds * 1000.0 << " ms worst\n" << std::defaultfloat;
+    }
+
+    void simulation_request_rewind(Simulation& simulation)
+    {
+        std::scoped_lock lock(simulation.mutex);
+        simulation.mailbox.rewind_requests++;
+    }
+
+    void simulation_submit_level_edits(Simulation& simulation, std::vector<LevelEdit>& edits)
+    {
+        if (edits.empty())
+        {
+            return;
+        }
+        std::scoped_lock lock(simulation.mutex);
+        auto& pending = simulation.mailbox.level_edits;
+        std::move(edits.begin(), edits.end(), std::back_inserter(pending));
+        edits.clear();
+    }
+
+    void simulation_play_sounds(Simulation& simulation, AudioState& audio_state)
+    {
+        {
+            std::scoped_lock lock(simulation.mutex);
+            std::swap(simulation.sounds_to_play, simulation.mailbox.sounds);
+        }
+        audio_play_deferred(audio_state, simulation.sounds_to_play);
+    }
+}
@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+#include "levelfile.h"
+#include "netplay.h"
+
+#include <iosfwd>
+
+namespace woc
+{
+    constexpr f32 SIMULATION_TICK_SECONDS = 1.f / 240.f;
+    // After a stall the simulation drops time beyond this instead of spiralling through a long catch-up.
+    constexpr f32 SIMULATION_MAX_CATCH_UP_SECONDS = 0.25f;
+
+    // Single producer, single consumer. The writer always has a free slot to fill and the reader always
+    // gets the most recently published one, so neither side ever waits on the other.
+    template <typename T>
+    struct TripleBuffer
+    {
+        static constexpr u8 INDEX_MASK = 0b011;
+        static constexpr u8 FRESH_BIT = 0b100;
+
+        std::array<T, 3> slots;
+        std::atomic<u8> middle = 1;
+        u8 back = 0;
+        u8 front = 2;
+    };
+
+    template <typename T>
+    T& triple_buffer_back(TripleBuffer<T>& buffer)
+    {
+        return buffer.slots.at(buffer.back);
+    }
+
+    template <typename T>
+    void triple_buffer_publish(TripleBuffer<T>& buffer)
+    {
+        auto previous = buffer.middle.exchange(static_cast<u8>(buffer.back | TripleBuffer<T>::FRESH_BIT), std::memory_order_acq_rel);
+        buffer.back = previous & TripleBuffer<T>::INDEX_MASK;
+    }
+
+    // Returns true if a newer slot was published since the last call.
+    template <typename T>
+    bool triple_buffer_acquire(TripleBuffer<T>& buffer)
+    {
+        if (!(buffer.middle.load(std::memory_order_relaxed) & TripleBuffer<T>::FRESH_BIT))
+        {
+            return false;
+        }
+        auto previous = buffer.middle.exchange(buffer.front, std::memory_order_acq_rel);
+        buffer.front = previous & TripleBuffer<T>::INDEX_MASK;
+        return true;
+    }
+
+    template <typename T>
+    T& triple_buffer_front(TripleBuffer<T>& buffer)
+    {
+        return buffer.slots.at(buffer.front);
+    }
+
+    enum class SimulationMode
+    {
+        Paused,
+        Running,
+        Throttled,
+    };
+
+    // One change to the game's input, stamped with when the main thread polled it. move_dir, wind_dir and
+    // send_ball hold until the next event, cast_gust counts presses since the previous one.
+    struct InputEvent
+    {
+        std::chrono::steady_clock::time_point time;
+        InputState input;
+    };
+
+    struct GameSnapshot
+    {
+        std::optional<GameState> game_state;
+        u64 tick;
+        // The newest input event this state has seen, for measuring input to present latency.
+        std::chrono::steady_clock::time_point input_time;
+    };
+
+    // Written by the main thread, read by the simulation thread. Guarded by Simulation::mutex.
+    struct SimulationMailbox
+    {
+        bool has_replacement;
+        std::optional<GameState> replacement;
+        std::vector<InputEvent> input_events;
+        SimulationMode mode;
+        u32 rewind_requests;
+        std::vector<LevelEdit> level_edits;
+        std::vector<DeferredSound> sounds;
+    };
+
+    struct Simulation
+    {
+        std::thread thread;
+        std::atomic<bool> running;
+        std::mutex mutex;
+        SimulationMailbox mailbox;
+        TripleBuffer<GameSnapshot> snapshots;
+        // Set before simulation_start. Every level attempt is saved there as a replay once the game is replaced
+        // or the simulation stops, see replay.h. Empty saves nothing.
+        std::string replay_directory;
+        // Set before simulation_start for a two player game against a peer, see netplay.h. Every game handed over
+        // gets the second paddle and ticks through the rollback session at NETPLAY_TICK_SECONDS instead.
+        Netplay* netplay;
+
+        // Main thread only.
+        u64 submitted_game_id;
+        std::vector<DeferredSound> sounds_to_play;
+        InputState submitted_input;
+        std::chrono::steady_clock::time_point acquired_input_time;
+        std::chrono::steady_clock::time_point presented_input_time;
+        u64 latency_samples;
+        f64 latency_total_seconds;
+        f64 latency_max_seconds;
+    };
+    void simulation_start(Simulation& simulation, AudioState& audio_state);
+    void simulation_stop(Simulation& simulation);
+    // Swaps the latest snapshot into game_state, unless the main thread replaced the game since.
+    void simulation_acquire(Simulation& simulation, std::optional<GameState>& game_state);
+    // Hands game_state to the simulation if it was replaced by a new game_init.
+    void simulation_submit(Simulation& simulation, std::optional<GameState>& game_state, SimulationMode mode);
+    // Call straight after polling, before the frame is drawn. Only changes are queued, and each one is applied
+    // from the tick its time falls in rather than the start of the next batch of ticks.
+    void simulation_submit_input(Simulation& simulation, InputState input, std::chrono::steady_clock::time_point time);
+    // Call after presenting a frame of the game, samples the latency from the newest input it showed.
+    void simulation_record_present(Simulation& simulation, std::chrono::steady_clock::time_point present_time);
+    void simulation_report_latency(Simulation& simulation, std::ostream& out);
+    // Steps the running game back REWIND_SECONDS on the simulation thread.
+    void simulation_request_rewind(Simulation& simulation);
+    // Patches the running game if it is on one of the edited levels, at the start of the next simulation step.
+    void simulation_submit_level_edits(Simulation& simulation, std::vector<LevelEdit>& edits);
+    void simulation_play_sounds(Simulation& simulation, AudioState& audio_state);
+}
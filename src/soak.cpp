@@ -0,0 +1,212 @@
+﻿#include "soak.h"
+
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace woc
+{
+    SoakBot soak_bot_init(u32 first_level, u32 last_level, u64 seed)
+    {
+        auto result = SoakBot {
+            .random = Random { .state = seed },
+            .first_level = first_level,
+            .last_level = std::max(first_level, last_level),
+            .game_id = 0,
+            .level_seconds = 0.f,
+            .aim_x = 0.f,
+            .levels_played = 0,
+            .levels_won = 0
+        };
+        return result;
+    }
+
+    woc_internal void soak_bot_pick_aim(SoakBot& bot, GameState& game_state)
+    {
+        bot.aim_x = 0.f;
+        if (!game_state.enemies.empty())
+        {
+            auto& e = game_state.enemies.at(random_u32(bot.random, 0, static_cast<u32>(game_state.enemies.size() - 1)));
+            bot.aim_x = Clamp(e.pos.x, WORLD_MIN.x, WORLD_MAX.x);
+        }
+    }
+
+    InputState soak_bot_input(SoakBot& bot, GameState& game_state)
+    {
+        constexpr f32 DEADBAND = 12.f;
+        constexpr f32 PLAYER_MAX_SPEED = 750.f;
+        constexpr u32 RANDOM_WIND_ODDS = 4000;
+
+        auto input = InputState{};
+        if (game_state.level_status != LevelStatus::InProgress)
+        {
+            return input;
+        }
+        if (bot.game_id != game_state.id)
+        {
+            bot.game_id = game_state.id;
+            soak_bot_pick_aim(bot, game_state);
+        }
+
+        // The ball coming down that gets to the player's line first. A reversing wind makes the velocity
+        // negative, which flips where every ball is really heading.
+        auto& player = game_state.player;
+        auto heading = player.ball_velocity < 0.f ? -1.f : 1.f;
+        const Projectile* nearest = nullptr;
+        for (auto& p : game_state.player_projectiles)
+        {
+            if (p.dir.y * heading > 0.f && (!nearest || p.pos.y > nearest->pos.y))
+            {
+                nearest = &p;
+            }
+        }
+
+        auto target_x = bot.aim_x;
+        if (nearest)
+        {
+            auto dir = Vector2Scale(nearest->dir, heading);
+            auto distance = (PLAYER_WORLD_Y - nearest->pos.y) / dir.y;
+            target_x = nearest->pos.x + dir.x * distance;
+            auto seconds = distance / std::max(std::abs(player.ball_velocity), 1.f);
+            bool leaving = target_x < WORLD_MIN.x || target_x > WORLD_MAX.x;
+            bool reachable = std::abs(target_x - player.pos_x) <= PLAYER_MAX_SPEED * seconds;
+            if (leaving)
+            {
+                // Turns it back towards the middle.
+                input.wind_dir_x = target_x < 0.f ? 1 : -1;
+            } else if (!reachable)
+            {
+                input.wind_dir_y = -1;
+            }
+            if (!reachable && PLAYER_WORLD_Y - nearest->pos.y < GUST_OFFSET_Y + GUST_RADIUS)
+            {
+                input.cast_gust = 1;
+            }
+        } else if (std::abs(target_x - player.pos_x) < DEADBAND && player.ball_cd <= 0.f)
+        {
+            input.send_ball = 1;
+            soak_bot_pick_aim(bot, game_state);
+        }
+        input.move_dir = static_cast<i32>(target_x > player.pos_x + DEADBAND) - static_cast<i32>(target_x < player.pos_x - DEADBAND);
+
+        // Now and then a wind for no reason, so every direction gets played.
+        if (random_u32(bot.random, 0, RANDOM_WIND_ODDS) == 0)
+        {
+            input.wind_dir_x = static_cast<i32>(random_u32(bot.random, 0, 2)) - 1;
+            input.wind_dir_y = input.wind_dir_x ? 0 : 1;
+        }
+        return input;
+    }
+
+    bool soak_bot_next_level(SoakBot& bot, GameState& game_state, f32 delta_seconds, u32& level)
+    {
+        bot.level_seconds += delta_seconds;
+        // Waits for the end of level slow down, like a player reading the overlay.
+        bool finished = game_state.level_status != LevelStatus::InProgress && game_state.time_scale <= 0.f;
+        if (!finished && bot.level_seconds < SOAK_MAX_LEVEL_SECONDS)
+        {
+            return false;
+        }
+        bot.levels_played++;
+        bot.levels_won += game_state.level_status == LevelStatus::Won;
+        bot.level_seconds = 0.f;
+        level = game_state.current_level >= bot.last_level || game_state.current_level < bot.first_level
+            ? bot.first_level
+            : game_state.current_level + 1;
+        return true;
+    }
+
+    SoakCounts soak_counts(GameState& game_state, u64 particles, u64 sounds)
+    {
+        return SoakCounts {
+            .level = game_state.current_level,
+            .walls = game_state.enemies.size(),
+            .projectiles = game_state.player_projectiles.size(),
+            .projectile_effects = game_state.dead_projectile_effects.size(),
+            .enemy_effects = game_state.dead_enemy_effects.size(),
+            .gusts = game_state.wind_gusts.size(),
+            .particles = particles,
+            .sounds = sounds
+        };
+    }
+
+    SoakLog soak_log_init(f64 now_seconds, f64 report_seconds)
+    {
+        auto resident_bytes = soak_resident_bytes();
+        auto result = SoakLog {
+            .start_seconds = now_seconds,
+            .next_report_seconds = now_seconds + report_seconds,
+            .report_seconds = report_seconds,
+            .start_resident_bytes = resident_bytes,
+            .last_resident_bytes = resident_bytes,
+            .frame_seconds = {}
+        };
+        // A minute of ticks at the simulation rate, so logging doesn't allocate as it goes.
+        result.frame_seconds.reserve(static_cast<size_t>(report_seconds * 240.0));
+        return result;
+    }
+
+    void soak_log_frame(SoakLog& log, f32 frame_seconds)
+    {
+        log.frame_seconds.emplace_back(frame_seconds);
+    }
+
+    woc_internal f32 soak_percentile(std::vector<f32>& values, f32 fraction)
+    {
+        auto index = static_cast<size_t>(fraction * static_cast<f32>(values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + static_cast<i64>(index), values.end());
+        return values.at(index);
+    }
+
+    void soak_log_update(SoakLog& log, f64 now_seconds, SoakBot& bot, SoakCounts counts, std::ostream& out)
+    {
+        if (now_seconds < log.next_report_seconds || log.frame_seconds.empty())
+        {
+            return;
+        }
+        log.next_report_seconds += log.report_seconds;
+
+        auto& frames = log.frame_seconds;
+        auto frame_count = frames.size();
+        auto p50 = soak_percentile(frames, 0.5f);
+        auto p95 = soak_percentile(frames, 0.95f);
+        auto p99 = soak_percentile(frames, 0.99f);
+        auto max = *std::max_element(frames.begin(), frames.end());
+        frames.clear();
+
+        constexpr f64 MB = 1024.0 * 1024.0;
+        auto resident_bytes = soak_resident_bytes();
+        auto minutes = (now_seconds - log.start_seconds) / 60.0;
+        // Microseconds, headless ticks take a few of them and windowed frames thousands.
+        out << std::fixed << std::setprecision(2) << "soak " << minutes << " min: " << std::setprecision(1)
+            << frame_count << " frames, us p50 " << p50 * 1e6f << " p95 " << p95 * 1e6f
+            << " p99 " << p99 * 1e6f << " max " << max * 1e6f
+            << ", rss " << static_cast<f64>(resident_bytes) / MB << " MB ("
+            << std::showpos << (static_cast<f64>(resident_bytes) - static_cast<f64>(log.last_resident_bytes)) / MB << ", "
+            << (static_cast<f64>(resident_bytes) - static_cast<f64>(log.start_resident_bytes)) / MB << std::noshowpos << " total)"
+            << ", level " << counts.level << " (" << bot.levels_won << "/" << bot.levels_played << " won)"
+            << ", walls " << counts.walls << " balls " << counts.projectiles
+            << " ball effects " << counts.projectile_effects << " wall effects " << counts.enemy_effects
+            << " gusts " << counts.gusts << " particles " << counts.particles << " sounds " << counts.sounds
+            << std::defaultfloat << std::endl;
+        log.last_resident_bytes = resident_bytes;
+    }
+
+    u64 soak_resident_bytes()
+    {
+#if defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        u64 total_pages = 0;
+        u64 resident_pages = 0;
+        if (statm >> total_pages >> resident_pages)
+        {
+            return resident_pages * static_cast<u64>(sysconf(_SC_PAGESIZE));
+        }
+#endif
+        return 0;
+    }
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+
+namespace woc
+{
+    constexpr f64 SOAK_DEFAULT_REPORT_SECONDS = 60.0;
+    // Balls can settle into a loop that never hits anything, the bot moves on after this much game time.
+    constexpr f32 SOAK_MAX_LEVEL_SECONDS = 180.f;
+
+    // Plays like a person at the keyboard would: chases the ball coming down, launches at a wall when nothing
+    // is in the air and spends wind on balls it can't reach. Random enough to wander through every code path.
+    struct SoakBot
+    {
+        Random random;
+        u32 first_level;
+        u32 last_level;
+        u64 game_id;
+        f32 level_seconds;
+        f32 aim_x;
+        u32 levels_played;
+        u32 levels_won;
+    };
+    SoakBot soak_bot_init(u32 first_level, u32 last_level, u64 seed);
+    InputState soak_bot_input(SoakBot& bot, GameState& game_state);
+    // True once game_state is done with, level is then the one to game_init next.
+    bool soak_bot_next_level(SoakBot& bot, GameState& game_state, f32 delta_seconds, u32& level);
+
+    // Everything that should stay flat over hours of play.
+    struct SoakCounts
+    {
+        u32 level;
+        u64 walls;
+        u64 projectiles;
+        u64 projectile_effects;
+        u64 enemy_effects;
+        u64 gusts;
+        u64 particles;
+        u64 sounds;
+    };
+    SoakCounts soak_counts(GameState& game_state, u64 particles, u64 sounds);
+
+    struct SoakLog
+    {
+        f64 start_seconds;
+        f64 next_report_seconds;
+        f64 report_seconds;
+        u64 start_resident_bytes;
+        u64 last_resident_bytes;
+        std::vector<f32> frame_seconds;
+    };
+    SoakLog soak_log_init(f64 now_seconds, f64 report_seconds);
+    void soak_log_frame(SoakLog& log, f32 frame_seconds);
+    // Prints one line of frame time percentiles, memory and counts every report_seconds.
+    void soak_log_update(SoakLog& log, f64 now_seconds, SoakBot& bot, SoakCounts counts, std::ostream& out);
+    // 0 where the platform isn't supported.
+    u64 soak_resident_bytes();
+}
@@ -0,0 +1,417 @@
+﻿#include "solver.h"
+
+namespace woc
+{
+    struct SolverNode
+    {
+        GameState game_state;
+        u32 tick;
+    };
+
+    struct SolverShared
+    {
+        std::vector<f32> launch_xs;
+        std::vector<std::atomic<u64>> transpositions;
+        std::atomic<u64> nodes;
+        std::atomic<bool> found;
+        std::atomic<bool> exhausted;
+        u64 node_limit;
+        bool approximate;
+        std::mutex result_mutex;
+        std::vector<SolverAction> result_actions;
+    };
+
+    struct SolverWorker
+    {
+        SolverShared& shared;
+        AudioState audio_state;
+        // One node per search depth, reused across siblings so cloning a state never allocates once warm.
+        // A deque so growing it never moves the nodes the callers up the stack are still holding.
+        std::deque<SolverNode> stack;
+        std::vector<SolverAction> path;
+    };
+
+    woc_internal void solver_step(AudioState& audio_state, SolverNode& node, InputState input)
+    {
+        game_update(node.game_state, input, audio_state, SOLVER_TICK_SECONDS);
+        audio_state.deferred_sounds.clear();
+        node.tick++;
+    }
+
+    woc_internal i32 solver_move_towards(PlayerState& player, f32 x)
+    {
+        constexpr f32 PADDLE_DEADZONE = 6.f;
+        auto offset = x - player.pos_x;
+        return offset > PADDLE_DEADZONE ? 1 : (offset < -PADDLE_DEADZONE ? -1 : 0);
+    }
+
+    // Follows the lowest ball that is still falling, otherwise lets the paddle coast.
+    woc_internal InputState solver_track_input(GameState& game_state)
+    {
+        auto input = InputState{};
+        auto lowest_y = WORLD_MIN.y;
+        for (auto& p : game_state.player_projectiles)
+        {
+            if (p.dir.y > 0.f && p.pos.y > lowest_y)
+            {
+                lowest_y = p.pos.y;
+                input.move_dir = solver_move_towards(game_state.player, p.pos.x);
+            }
+        }
+        return input;
+    }
+
+    // A ball goes straight up from the paddle, so the x positions worth trying are the middles of walls
+    // and of the gaps between them. The grid covers open space and shots that only work after a bounce.
+    woc_internal std::vector<f32> solver_launch_positions(GameState& game_state)
+    {
+        constexpr f32 MIN_LAUNCH_SPACING = 4.f;
+        auto half_width = static_cast<f32>(PLAYER_DEFAULT_WIDTH) * 0.5f;
+        auto min = WORLD_MIN.x + half_width;
+        auto max = WORLD_MAX.x - half_width;
+
+        std::vector<f32> result;
+        std::vector<std::pair<f32, f32>> spans;
+        for (auto& e : game_state.enemies)
+        {
+            auto half_extents = levelgen_half_extents(e.size, e.rot);
+            spans.emplace_back(e.pos.x - half_extents.x, e.pos.x + half_extents.x);
+            if (e.contributes_to_win)
+            {
+                result.emplace_back(e.pos.x);
+            }
+        }
+        std::ranges::sort(spans);
+        for (size_t i = 1; i < spans.size(); i++)
+        {
+            if (spans.at(i).first - spans.at(i - 1).second > BALL_DEFAULT_RADIUS * 2.f)
+            {
+                result.emplace_back((spans.at(i).first + spans.at(i - 1).second) * 0.5f);
+            }
+        }
+        for (u32 i = 0; i < SOLVER_LAUNCH_POSITIONS; i++)
+        {
+            result.emplace_back(min + (max - min) * static_cast<f32>(i) / static_cast<f32>(SOLVER_LAUNCH_POSITIONS - 1));
+        }
+
+        // Geometry first, they are the likeliest shots.
+        for (auto& x : result)
+        {
+            x = Clamp(x, min, max);
+        }
+        std::vector<f32> unique;
+        for (auto x : result)
+        {
+            if (std::ranges::none_of(unique, [x] (f32 u) { return std::abs(u - x) < MIN_LAUNCH_SPACING; }))
+            {
+                unique.emplace_back(x);
+            }
+        }
+        return unique;
+    }
+
+    woc_internal bool solver_is_over(SolverNode& node)
+    {
+        return node.game_state.level_status != LevelStatus::InProgress || node.tick >= SOLVER_MAX_TICKS;
+    }
+
+    // Drives the paddle to x and holds send_ball until the ball is out. Gives up on the launch at the tick limit.
+    woc_internal void solver_launch(AudioState& audio_state, SolverNode& node, f32 x)
+    {
+        while (!solver_is_over(node) && node.game_state.player_projectiles.empty())
+        {
+            auto input = InputState{};
+            input.move_dir = solver_move_towards(node.game_state.player, x);
+            input.send_ball = input.move_dir == 0;
+            solver_step(audio_state, node, input);
+        }
+    }
+
+    // Runs until the next decision: the end of the interval, the last ball leaving, or the level ending.
+    woc_internal void solver_fly(AudioState& audio_state, SolverNode& node, i32 wind_dir_x, i32 wind_dir_y)
+    {
+        for (u32 i = 0; i < SOLVER_DECISION_TICKS && !solver_is_over(node) && !node.game_state.player_projectiles.empty(); i++)
+        {
+            auto input = solver_track_input(node.game_state);
+            if (i == 0)
+            {
+                input.wind_dir_x = wind_dir_x;
+                input.wind_dir_y = wind_dir_y;
+            }
+            solver_step(audio_state, node, input);
+        }
+    }
+
+    woc_internal u64 solver_hash_f32(u64 h, f32 value, f32 step)
+    {
+        return random_hash(h, static_cast<u64>(static_cast<i64>(std::floor(value / step))));
+    }
+
+    woc_internal u64 solver_hash_approximate(GameState& game_state)
+    {
+        auto& player = game_state.player;
+        u64 h = random_hash(player.balls_available, player.wind_available);
+        h = solver_hash_f32(h, player.pos_x, SOLVER_HASH_POSITION_STEP);
+        h = solver_hash_f32(h, player.vel, 10.f);
+        h = solver_hash_f32(h, player.ball_velocity, 1.f);
+        h = solver_hash_f32(h, player.active_wind_ability ? player.active_wind_ability->timer : -1.f, 0.05f);
+        for (auto& p : game_state.player_projectiles)
+        {
+            h = solver_hash_f32(h, p.pos.x, SOLVER_HASH_POSITION_STEP);
+            h = solver_hash_f32(h, p.pos.y, SOLVER_HASH_POSITION_STEP);
+            h = solver_hash_f32(h, p.dir.x, 0.01f);
+            h = solver_hash_f32(h, p.dir.y, 0.01f);
+        }
+        // Static walls are identified by where they are and their health, moving ones also by how far along they are.
+        for (auto& e : game_state.enemies)
+        {
+            h = solver_hash_f32(h, e.pos.x + e.pos.y * 4096.f, 1.f);
+            h = random_hash(h, static_cast<u64>(e.health));
+            if (enemy_is_moving(e))
+            {
+                h = solver_hash_f32(h, e.motion.time, 0.05f);
+                h = solver_hash_f32(h, e.rot.val, 0.05f);
+            }
+        }
+        return h;
+    }
+
+    // game_hash covers the exact bits of the state. The tick is in too, a state that failed with less time left
+    // can still win with more.
+    woc_internal u64 solver_hash(SolverShared& shared, SolverNode& node)
+    {
+        if (shared.approximate)
+        {
+            return solver_hash_approximate(node.game_state);
+        }
+        return random_hash(game_hash(node.game_state), node.tick);
+    }
+
+    // Entries pack the hash in the upper bits and the largest budget that already failed from that state in the low byte.
+    // Writers race freely, a lost update only costs a repeated search.
+    woc_internal bool solver_transposition_failed(SolverShared& shared, u64 hash, u32 budget)
+    {
+        auto& entry = shared.transpositions.at(hash & ((1ull << SOLVER_TRANSPOSITION_BITS) - 1));
+        auto value = entry.load(std::memory_order_relaxed);
+        return (value & ~0xFFull) == (hash & ~0xFFull) && (value & 0xFFull) > budget;
+    }
+
+    woc_internal void solver_transposition_store(SolverShared& shared, u64 hash, u32 budget)
+    {
+        auto& entry = shared.transpositions.at(hash & ((1ull << SOLVER_TRANSPOSITION_BITS) - 1));
+        entry.store((hash & ~0xFFull) | std::min(budget + 1, 0xFFu), std::memory_order_relaxed);
+    }
+
+    woc_internal bool solver_should_stop(SolverShared& shared)
+    {
+        if (shared.found.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+        if (shared.nodes.fetch_add(1, std::memory_order_relaxed) >= shared.node_limit)
+        {
+            shared.exhausted.store(true, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    woc_internal SolverNode& solver_child(SolverWorker& worker, u32 depth, SolverNode& parent)
+    {
+        if (worker.stack.size() <= depth)
+        {
+            worker.stack.resize(depth + 1);
+        }
+        auto& child = worker.stack.at(depth);
+        // Copy assignment keeps the child's vector capacity, so this is a memcpy once the stack is warm.
+        child = parent;
+        return child;
+    }
+
+    woc_internal bool solver_search(SolverWorker& worker, SolverNode& node, u32 depth, u32 budget);
+
+    woc_internal bool solver_record_win(SolverWorker& worker)
+    {
+        std::scoped_lock lock(worker.shared.result_mutex);
+        if (!worker.shared.found.exchange(true))
+        {
+            worker.shared.result_actions = worker.path;
+        }
+        return true;
+    }
+
+    woc_internal bool solver_try_launch(SolverWorker& worker, SolverNode& node, u32 depth, u32 budget, u32 launch_index)
+    {
+        auto& child = solver_child(worker, depth + 1, node);
+        auto x = worker.shared.launch_xs.at(launch_index);
+        worker.path.emplace_back(SolverAction { .tick = child.tick, .type = SolverActionType::Launch, .launch_x = x, .wind_dir_x = 0, .wind_dir_y = 0 });
+        solver_launch(worker.audio_state, child, x);
+        bool won = solver_search(worker, child, depth + 1, budget - 1);
+        worker.path.pop_back();
+        return won;
+    }
+
+    woc_internal bool solver_search(SolverWorker& worker, SolverNode& node, u32 depth, u32 budget)
+    {
+        constexpr std::array<std::array<i32, 2>, 4> WIND_DIRS = {{ { -1, 0 }, { 1, 0 }, { 0, 1 }, { 0, -1 } }};
+        auto& player = node.game_state.player;
+
+        // Decisions that have only one option are played in place instead of branching.
+        while (true)
+        {
+            if (node.game_state.level_status == LevelStatus::Won)
+            {
+                return solver_record_win(worker);
+            }
+            if (solver_is_over(node) || solver_should_stop(worker.shared))
+            {
+                return false;
+            }
+            
+            bool launching = node.game_state.player_projectiles.empty();
+            // Bound: without a ball in flight, winning takes at least one more ball.
+            if (launching && (budget == 0 || player.balls_available == 0))
+            {
+                return false;
+            }
+            bool can_wind = !launching && budget > 0 && player.wind_available && !player.active_wind_ability;
+            if (launching || can_wind)
+            {
+                break;
+            }
+            solver_fly(worker.audio_state, node, 0, 0);
+        }
+
+        auto hash = solver_hash(worker.shared, node);
+        if (solver_transposition_failed(worker.shared, hash, budget))
+        {
+            return false;
+        }
+
+        if (node.game_state.player_projectiles.empty())
+        {
+            for (u32 i = 0; i < worker.shared.launch_xs.size(); i++)
+            {
+                if (solver_try_launch(worker, node, depth, budget, i))
+                {
+                    return true;
+                }
+            }
+        } else {
+            for (auto [x, y] : WIND_DIRS)
+            {
+                auto& child = solver_child(worker, depth + 1, node);
+                worker.path.emplace_back(SolverAction { .tick = child.tick, .type = SolverActionType::Wind, .launch_x = 0.f, .wind_dir_x = x, .wind_dir_y = y });
+                solver_fly(worker.audio_state, child, x, y);
+                bool won = solver_search(worker, child, depth + 1, budget - 1);
+                worker.path.pop_back();
+                if (won)
+                {
+                    return true;
+                }
+            }
+            
+            // Holding the wind is the last option, so it reuses this node rather than a copy.
+            solver_fly(worker.audio_state, node, 0, 0);
+            if (solver_search(worker, node, depth, budget))
+            {
+                return true;
+            }
+        }
+
+        if (!worker.shared.found.load(std::memory_order_relaxed) && !worker.shared.exhausted.load(std::memory_order_relaxed))
+        {
+            solver_transposition_store(worker.shared, hash, budget);
+        }
+        return false;
+    }
+
+    SolverResult solver_solve(GameState& level, u64 node_limit, bool approximate)
+    {
+        auto shared = SolverShared {
+            .launch_xs = solver_launch_positions(level),
+            .transpositions = std::vector<std::atomic<u64>>(1ull << SOLVER_TRANSPOSITION_BITS),
+            .nodes = 0,
+            .found = false,
+            .exhausted = false,
+            .node_limit = node_limit,
+            .approximate = approximate,
+            .result_mutex = {},
+            .result_actions = {}
+        };
+        auto root = SolverNode { .game_state = level, .tick = 0 };
+        auto max_budget = level.player.balls_available + level.player.wind_available;
+        auto launch_count = static_cast<u32>(shared.launch_xs.size());
+        auto worker_count = std::clamp(std::thread::hardware_concurrency(), 1u, launch_count);
+        
+        // The first launch splits the tree into independent subtrees, handed out to workers as they free up.
+        for (u32 budget = 1; budget <= max_budget && !shared.found && !shared.exhausted; budget++)
+        {
+            std::atomic<u32> next_launch = 0;
+            auto worker_main = [&]
+            {
+                auto worker = SolverWorker { .shared = shared, .audio_state = AudioState{}, .stack = {}, .path = {} };
+                worker.audio_state.defer_playback = true;
+                for (auto i = next_launch.fetch_add(1); i < launch_count && !shared.found && !shared.exhausted; i = next_launch.fetch_add(1))
+                {
+                    solver_try_launch(worker, root, 0, budget, i);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (u32 i = 0; i < worker_count; i++)
+            {
+                workers.emplace_back(worker_main);
+            }
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        auto result = SolverResult {
+            .solved = shared.found,
+            .exhausted = !shared.found && shared.exhausted,
+            .approximate = approximate,
+            .balls_used = 0,
+            .winds_used = 0,
+            .nodes = std::min(shared.nodes.load(), node_limit),
+            .actions = std::move(shared.result_actions)
+        };
+        for (auto& action : result.actions)
+        {
+            result.balls_used += action.type == SolverActionType::Launch;
+            result.winds_used += action.type == SolverActionType::Wind;
+        }
+        return result;
+    }
+
+    bool solver_replay(GameState& level, std::vector<SolverAction>& actions)
+    {
+        auto audio_state = AudioState{};
+        audio_state.defer_playback = true;
+        auto node = SolverNode { .game_state = level, .tick = 0 };
+        size_t next = 0;
+        while (!solver_is_over(node))
+        {
+            if (node.game_state.player_projectiles.empty())
+            {
+                if (next == actions.size() || actions.at(next).type != SolverActionType::Launch)
+                {
+                    return false;
+                }
+                solver_launch(audio_state, node, actions.at(next++).launch_x);
+                continue;
+            }
+
+            auto input = solver_track_input(node.game_state);
+            if (next < actions.size() && actions.at(next).type == SolverActionType::Wind && actions.at(next).tick == node.tick)
+            {
+                input.wind_dir_x = actions.at(next).wind_dir_x;
+                input.wind_dir_y = actions.at(next).wind_dir_y;
+                next++;
+            }
+            solver_step(audio_state, node, input);
+        }
+        return node.game_state.level_status == LevelStatus::Won;
+    }
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+#include "simulation.h"
+#include "levelgen.h"
+
+namespace woc
+{
+    // Searched at the live tick rate so a solution replays exactly in the real game.
+    constexpr f32 SOLVER_TICK_SECONDS = SIMULATION_TICK_SECONDS;
+    // While a ball is in flight, a wind may be fired on every DECISION_TICKS-th tick.
+    constexpr u32 SOLVER_DECISION_TICKS = 60;
+    // Evenly spread launch points, on top of the ones aimed at walls and at the gaps between them.
+    constexpr u32 SOLVER_LAUNCH_POSITIONS = 12;
+    constexpr u32 SOLVER_MAX_TICKS = static_cast<u32>(60.f / SOLVER_TICK_SECONDS);
+    constexpr u64 SOLVER_DEFAULT_NODE_LIMIT = 20'000'000;
+    // 2^20 entries, 8 MB. Keyed on the exact state and tick, so only true transpositions are cut and the fewest
+    // resources found, or UNSOLVABLE, is exact up to 56 bit hash collisions.
+    constexpr u32 SOLVER_TRANSPOSITION_BITS = 20;
+    // Approximate searches key on positions rounded to this, and leave out timers and effects. That also cuts
+    // near-identical states and ball loops, which is far faster but can miss wins.
+    constexpr f32 SOLVER_HASH_POSITION_STEP = 2.f;
+
+    enum class SolverActionType
+    {
+        Launch,
+        Wind
+    };
+
+    struct SolverAction
+    {
+        u32 tick;
+        SolverActionType type;
+        f32 launch_x;
+        i32 wind_dir_x;
+        i32 wind_dir_y;
+    };
+
+    struct SolverResult
+    {
+        bool solved;
+        // Set when the node limit stopped the search, so an unsolved result proves nothing.
+        bool exhausted;
+        // Neither an unsolved result nor the resources used are a proven minimum, see SOLVER_HASH_POSITION_STEP.
+        bool approximate;
+        u32 balls_used;
+        u32 winds_used;
+        u64 nodes;
+        std::vector<SolverAction> actions;
+    };
+
+    // Iterative deepening on balls + winds used, so the first win found uses the fewest resources.
+    // Launch points come from a fixed grid plus the level's geometry, see solver_launch_positions.
+    // The paddle is driven by a fixed policy between decisions: line up for a launch, then follow the lowest falling ball.
+    SolverResult solver_solve(GameState& level, u64 node_limit = SOLVER_DEFAULT_NODE_LIMIT, bool approximate = false);
+    // Plays the actions back with the same policy and returns true if they win the level.
+    bool solver_replay(GameState& level, std::vector<SolverAction>& actions);
+}
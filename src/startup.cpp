@@ -0,0 +1,104 @@
+﻿#include "startup.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+
+namespace woc
+{
+    StartupTrace startup_trace_init()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto result = StartupTrace {
+            .start = now,
+            .last = now,
+            .phases = {},
+            .phase_count = 0,
+            .background = {},
+            .background_count = 0
+        };
+        return result;
+    }
+
+    void startup_trace_phase(StartupTrace& trace, const char* name)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (trace.phase_count < STARTUP_MAX_PHASES)
+        {
+            trace.phases.at(trace.phase_count++) = StartupPhase { .name = name, .seconds = std::chrono::duration<f64>(now - trace.last).count() };
+        }
+        trace.last = now;
+    }
+
+    void startup_trace_background(StartupTrace& trace, const char* name, f64 seconds)
+    {
+        if (trace.background_count < STARTUP_MAX_PHASES)
+        {
+            trace.background.at(trace.background_count++) = StartupPhase { .name = name, .seconds = seconds };
+        }
+    }
+
+    f64 startup_trace_total(StartupTrace& trace)
+    {
+        return std::chrono::duration<f64>(trace.last - trace.start).count();
+    }
+
+    void startup_trace_report(StartupTrace& trace, std::ostream& out)
+    {
+        constexpr f64 MS = 1000.0;
+        auto total = startup_trace_total(trace);
+        out << std::fixed << std::setprecision(2);
+        f64 elapsed = 0.0;
+        for (u32 i = 0; i < trace.phase_count; i++)
+        {
+            auto& phase = trace.phases.at(i);
+            elapsed += phase.seconds;
+            out << "  " << std::left << std::setw(24) << phase.name << std::right
+                << std::setw(10) << phase.seconds * MS << " ms"
+                << std::setw(7) << std::setprecision(1) << (total > 0.0 ? phase.seconds / total * 100.0 : 0.0) << "%"
+                << std::setprecision(2) << std::setw(10) << elapsed * MS << " ms\n";
+        }
+        for (u32 i = 0; i < trace.background_count; i++)
+        {
+            auto& phase = trace.background.at(i);
+            out << "  " << std::left << std::setw(24) << phase.name << std::right << std::setw(10) << phase.seconds * MS << " ms in the background\n";
+        }
+        out << "first frame after " << total * MS << " ms\n" << std::defaultfloat;
+    }
+
+    bool startup_trace_append_csv(StartupTrace& trace, const std::string& path)
+    {
+        bool is_new = !std::filesystem::exists(path);
+        auto file = std::ofstream(path, std::ios::app);
+        if (!file)
+        {
+            std::cerr << "Failed to open " << path << "\n";
+            return false;
+        }
+        if (is_new)
+        {
+            file << "total_ms";
+            for (u32 i = 0; i < trace.phase_count; i++)
+            {
+                file << "," << trace.phases.at(i).name;
+            }
+            for (u32 i = 0; i < trace.background_count; i++)
+            {
+                file << "," << trace.background.at(i).name;
+            }
+            file << "\n";
+        }
+        file << std::fixed << std::setprecision(3) << startup_trace_total(trace) * 1000.0;
+        for (u32 i = 0; i < trace.phase_count; i++)
+        {
+            file << "," << trace.phases.at(i).seconds * 1000.0;
+        }
+        for (u32 i = 0; i < trace.background_count; i++)
+        {
+            file << "," << trace.background.at(i).seconds * 1000.0;
+        }
+        file << "\n";
+        return true;
+    }
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+#include <iosfwd>
+#include <string>
+
+namespace woc
+{
+    constexpr u32 STARTUP_MAX_PHASES = 16;
+    // --startup-benchmark gives up if nothing was presented by then, a hidden window never presents.
+    constexpr f64 STARTUP_BENCHMARK_TIMEOUT_SECONDS = 10.0;
+
+    struct StartupPhase
+    {
+        const char* name;
+        f64 seconds;
+    };
+
+    // Each phase is the time since the one before it, the first since startup_trace_init.
+    struct StartupTrace
+    {
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point last;
+        std::array<StartupPhase, STARTUP_MAX_PHASES> phases;
+        u32 phase_count;
+        // Work overlapping the phases, such as the asset preload. Shown but not added to the total.
+        std::array<StartupPhase, STARTUP_MAX_PHASES> background;
+        u32 background_count;
+    };
+    StartupTrace startup_trace_init();
+    void startup_trace_phase(StartupTrace& trace, const char* name);
+    void startup_trace_background(StartupTrace& trace, const char* name, f64 seconds);
+    f64 startup_trace_total(StartupTrace& trace);
+    void startup_trace_report(StartupTrace& trace, std::ostream& out);
+    // One line per run, with a header when the file is new, to track time to first frame across builds.
+    bool startup_trace_append_csv(StartupTrace& trace, const std::string& path);
+}
@@ -0,0 +1,232 @@
+﻿#include "windfield.h"
+#include "fixed.h"
+
+#if !WOC_FIXED_POINT_PHYSICS && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define WOC_WIND_FIELD_SSE2 1
+#else
+#define WOC_WIND_FIELD_SSE2 0
+#endif
+
+namespace woc
+{
+    // Building the grid has to match across builds too when the physics is fixed point.
+    woc_internal f32 wind_field_mul_add(f32 value, f32 a, f32 b)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_f32(fixed_from_f32(value) + fixed_from_f32(a) * fixed_from_f32(b));
+#else
+        return value + a * b;
+#endif
+    }
+
+    woc_internal f32 wind_field_distance(Vector2 a, Vector2 b)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        auto delta = fixed_from_vector2(a) - fixed_from_vector2(b);
+        auto length_sqr = static_cast<u64>(static_cast<i64>(delta.x.raw) * delta.x.raw + static_cast<i64>(delta.y.raw) * delta.y.raw);
+        return fixed_to_f32(Fixed { static_cast<i32>(fixed_isqrt(length_sqr)) });
+#else
+        return Vector2Distance(a, b);
+#endif
+    }
+
+    woc_internal void wind_field_resize(WindField& field, Vector2 world_min, Vector2 world_max)
+    {
+        // The default world comes out at WIND_FIELD_CELL_SIZE exactly, so its levels keep the same grid.
+        auto extent = Vector2Subtract(world_max, world_min);
+        constexpr auto MAX_CELLS = static_cast<f32>(WIND_FIELD_MAX_NODES_PER_AXIS - 1);
+        field.origin = world_min;
+        field.cell_size = std::max({ WIND_FIELD_CELL_SIZE, extent.x / MAX_CELLS, extent.y / MAX_CELLS });
+        field.width = std::min(static_cast<u32>(std::ceil(extent.x / field.cell_size)) + 1, WIND_FIELD_MAX_NODES_PER_AXIS);
+        field.height = std::min(static_cast<u32>(std::ceil(extent.y / field.cell_size)) + 1, WIND_FIELD_MAX_NODES_PER_AXIS);
+    }
+
+    woc_internal void wind_field_allocate(WindField& field)
+    {
+        if (field.width == 0)
+        {
+            // Gusts in a game that never built its field.
+            wind_field_resize(field, WORLD_MIN, WORLD_MAX);
+        }
+        if (field.x.empty())
+        {
+            auto node_count = field.width * field.height;
+            field.base_x.assign(node_count, 0.f);
+            field.base_y.assign(node_count, 0.f);
+            field.x.assign(node_count, 0.f);
+            field.y.assign(node_count, 0.f);
+        }
+    }
+
+    woc_internal Vector2 wind_field_node_pos(WindField& field, u32 x, u32 y)
+    {
+        return Vector2 { field.origin.x + static_cast<f32>(x) * field.cell_size, field.origin.y + static_cast<f32>(y) * field.cell_size };
+    }
+
+    void wind_field_build(WindField& field, std::vector<WindZone>& zones, Vector2 world_min, Vector2 world_max)
+    {
+        field = WindField{};
+        wind_field_resize(field, world_min, world_max);
+        if (zones.empty())
+        {
+            return;
+        }
+
+        wind_field_allocate(field);
+        for (u32 y = 0; y < field.height; y++)
+        {
+            for (u32 x = 0; x < field.width; x++)
+            {
+                auto node = wind_field_node_pos(field, x, y);
+                auto i = y * field.width + x;
+                for (auto& zone : zones)
+                {
+                    // 1 inside the zone, fading to 0 over WIND_ZONE_FALLOFF outside it.
+                    auto outside_x = std::max(0.f, std::abs(node.x - zone.pos.x) - zone.size.x * 0.5f);
+                    auto outside_y = std::max(0.f, std::abs(node.y - zone.pos.y) - zone.size.y * 0.5f);
+                    auto weight = std::max(0.f, 1.f - std::max(outside_x, outside_y) / WIND_ZONE_FALLOFF);
+                    field.base_x.at(i) = wind_field_mul_add(field.base_x.at(i), zone.force.x, weight);
+                    field.base_y.at(i) = wind_field_mul_add(field.base_y.at(i), zone.force.y, weight);
+                }
+            }
+        }
+        field.x = field.base_x;
+        field.y = field.base_y;
+    }
+
+    void wind_field_update(WindField& field, std::vector<WindGust>& gusts)
+    {
+        if (gusts.empty() && !field.stamped)
+        {
+            return;
+        }
+
+        wind_field_allocate(field);
+        std::ranges::copy(field.base_x, field.x.begin());
+        std::ranges::copy(field.base_y, field.y.begin());
+        for (auto& gust : gusts)
+        {
+            // Only the nodes under the gust's radius need touching.
+            auto strength = gust.timer / gust.duration;
+            auto min_x = static_cast<i32>(std::floor((gust.pos.x - gust.radius - field.origin.x) / field.cell_size));
+            auto max_x = static_cast<i32>(std::ceil((gust.pos.x + gust.radius - field.origin.x) / field.cell_size));
+            auto min_y = static_cast<i32>(std::floor((gust.pos.y - gust.radius - field.origin.y) / field.cell_size));
+            auto max_y = static_cast<i32>(std::ceil((gust.pos.y + gust.radius - field.origin.y) / field.cell_size));
+            for (auto y = std::max(min_y, 0); y <= std::min(max_y, static_cast<i32>(field.height) - 1); y++)
+            {
+                for (auto x = std::max(min_x, 0); x <= std::min(max_x, static_cast<i32>(field.width) - 1); x++)
+                {
+                    auto node = wind_field_node_pos(field, static_cast<u32>(x), static_cast<u32>(y));
+                    auto falloff = std::max(0.f, 1.f - wind_field_distance(node, gust.pos) / gust.radius);
+                    auto i = static_cast<u32>(y) * field.width + static_cast<u32>(x);
+                    field.x.at(i) = wind_field_mul_add(field.x.at(i), gust.force.x * strength, falloff);
+                    field.y.at(i) = wind_field_mul_add(field.y.at(i), gust.force.y * strength, falloff);
+                }
+            }
+        }
+        field.stamped = !gusts.empty();
+    }
+
+#if WOC_FIXED_POINT_PHYSICS
+    // Integer weights so sampling stays bit-identical along with the rest of the fixed-point physics.
+    woc_internal void wind_field_sample_one(WindField& field, f32 pos_x, f32 pos_y, f32& out_x, f32& out_y)
+    {
+        auto max_x = Fixed { static_cast<i32>(field.width - 1) * FIXED_ONE - 1 };
+        auto max_y = Fixed { static_cast<i32>(field.height - 1) * FIXED_ONE - 1 };
+        auto inv_cell = fixed_from_f32(1.f / field.cell_size);
+        auto gx = std::clamp(fixed_from_f32(pos_x - field.origin.x) * inv_cell, Fixed { 0 }, max_x, [] (Fixed a, Fixed b) { return a < b; });
+        auto gy = std::clamp(fixed_from_f32(pos_y - field.origin.y) * inv_cell, Fixed { 0 }, max_y, [] (Fixed a, Fixed b) { return a < b; });
+        auto ix = static_cast<u32>(gx.raw >> FIXED_FRACTION_BITS);
+        auto iy = static_cast<u32>(gy.raw >> FIXED_FRACTION_BITS);
+        auto fx = Fixed { gx.raw & (FIXED_ONE - 1) };
+        auto fy = Fixed { gy.raw & (FIXED_ONE - 1) };
+        auto i = iy * field.width + ix;
+        auto bilinear = [i, fx, fy, width = field.width] (std::vector<f32>& grid)
+        {
+            auto a = fixed_from_f32(grid[i]);
+            auto b = fixed_from_f32(grid[i + 1]);
+            auto c = fixed_from_f32(grid[i + width]);
+            auto d = fixed_from_f32(grid[i + width + 1]);
+            auto top = a + (b - a) * fx;
+            auto bottom = c + (d - c) * fx;
+            return fixed_to_f32(top + (bottom - top) * fy);
+        };
+        out_x = bilinear(field.x);
+        out_y = bilinear(field.y);
+    }
+#else
+    woc_internal void wind_field_sample_one(WindField& field, f32 pos_x, f32 pos_y, f32& out_x, f32& out_y)
+    {
+        auto max_x = static_cast<f32>(field.width - 1) - 0.001f;
+        auto max_y = static_cast<f32>(field.height - 1) - 0.001f;
+        auto gx = Clamp((pos_x - field.origin.x) * (1.f / field.cell_size), 0.f, max_x);
+        auto gy = Clamp((pos_y - field.origin.y) * (1.f / field.cell_size), 0.f, max_y);
+        auto ix = static_cast<u32>(gx);
+        auto iy = static_cast<u32>(gy);
+        auto fx = gx - static_cast<f32>(ix);
+        auto fy = gy - static_cast<f32>(iy);
+        auto i = iy * field.width + ix;
+        auto bilinear = [i, fx, fy, width = field.width] (std::vector<f32>& grid)
+        {
+            auto top = Lerp(grid[i], grid[i + 1], fx);
+            auto bottom = Lerp(grid[i + width], grid[i + width + 1], fx);
+            return Lerp(top, bottom, fy);
+        };
+        out_x = bilinear(field.x);
+        out_y = bilinear(field.y);
+    }
+#endif
+
+    void wind_field_sample(WindField& field, const f32* xs, const f32* ys, f32* out_x, f32* out_y, u32 count)
+    {
+        if (field.x.empty())
+        {
+            std::fill_n(out_x, count, 0.f);
+            std::fill_n(out_y, count, 0.f);
+            return;
+        }
+
+        u32 i = 0;
+#if WOC_WIND_FIELD_SSE2
+        // Grid coordinates, weights and the four corner blends run four balls wide. SSE2 has no gather,
+        // so only the corner loads are scalar.
+        const auto min_x = _mm_set1_ps(field.origin.x);
+        const auto min_y = _mm_set1_ps(field.origin.y);
+        const auto inv_cell = _mm_set1_ps(1.f / field.cell_size);
+        const auto max_x = _mm_set1_ps(static_cast<f32>(field.width - 1) - 0.001f);
+        const auto max_y = _mm_set1_ps(static_cast<f32>(field.height - 1) - 0.001f);
+        const auto width = _mm_set1_ps(static_cast<f32>(field.width));
+        const auto zero = _mm_setzero_ps();
+        auto blend = [] (__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); };
+        for (; i + 4 <= count; i += 4)
+        {
+            auto gx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(xs + i), min_x), inv_cell), zero), max_x);
+            auto gy = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ys + i), min_y), inv_cell), zero), max_y);
+            auto cell_x = _mm_cvtepi32_ps(_mm_cvttps_epi32(gx));
+            auto cell_y = _mm_cvtepi32_ps(_mm_cvttps_epi32(gy));
+            auto fx = _mm_sub_ps(gx, cell_x);
+            auto fy = _mm_sub_ps(gy, cell_y);
+
+            alignas(16) std::array<i32, 4> index;
+            _mm_store_si128(reinterpret_cast<__m128i*>(index.data()), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cell_y, width), cell_x)));
+            auto corners = [&index] (std::vector<f32>& grid, u32 offset)
+            {
+                return _mm_setr_ps(grid[index[0] + offset], grid[index[1] + offset], grid[index[2] + offset], grid[index[3] + offset]);
+            };
+            auto sample = [&] (std::vector<f32>& grid)
+            {
+                auto top = blend(corners(grid, 0), corners(grid, 1), fx);
+                auto bottom = blend(corners(grid, field.width), corners(grid, field.width + 1), fx);
+                return blend(top, bottom, fy);
+            };
+            _mm_storeu_ps(out_x + i, sample(field.x));
+            _mm_storeu_ps(out_y + i, sample(field.y));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            wind_field_sample_one(field, xs[i], ys[i], out_x[i], out_y[i]);
+        }
+    }
+}
@@ -0,0 +1,21 @@
+﻿#pragma once
+
+#include "windsofchange.h"
+
+namespace woc
+{
+    // Nodes are this far apart unless the world is too big for WIND_FIELD_MAX_NODES_PER_AXIS of them.
+    constexpr f32 WIND_FIELD_CELL_SIZE = 50.f;
+    constexpr u32 WIND_FIELD_MAX_NODES_PER_AXIS = 512;
+    // Zone edges fade over this distance so balls don't snap when they cross one.
+    constexpr f32 WIND_ZONE_FALLOFF = 50.f;
+
+    // Samples the grid at each (xs[i], ys[i]) with bilinear interpolation, four balls per SIMD step where available.
+    // An empty field (no zones, no gusts) returns zero wind.
+    void wind_field_sample(WindField& field, const f32* xs, const f32* ys, f32* out_x, f32* out_y, u32 count);
+    // Sizes the grid to the level's world and bakes its zones into the base grid. Leaves the grid empty if there
+    // are none, but keeps the size for gusts.
+    void wind_field_build(WindField& field, std::vector<WindZone>& zones, Vector2 world_min, Vector2 world_max);
+    // Re-stamps the active gusts over the base grid. Does nothing while there are none and nothing to clear.
+    void wind_field_update(WindField& field, std::vector<WindGust>& gusts);
+}
@@ -2,11 +2,12 @@
 
 namespace woc
 {
-    Window window_init()
+    Window window_init(Vector2 size)
     {
-        constexpr u32 w = 1920;
-        constexpr u32 h = 1080;
-        InitWindow(w, h, "Winds of Change");
+        auto w = static_cast<u32>(std::max(1, static_cast<i32>(size.x)));
+        auto h = static_cast<u32>(std::max(1, static_cast<i32>(size.y)));
+        SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+        InitWindow(static_cast<i32>(w), static_cast<i32>(h), "Winds of Change");
         // ESC is used for menu navigation, so it should not be the exit key
         SetExitKey(0);
         return Window{ .width = w, .height = h };
@@ -37,7 +38,7 @@ namespace woc
 
     bool window_is_visible(Window& window)
     {
-        return !IsWindowHidden();
+        return !IsWindowHidden() && !IsWindowMinimized();
     }
 
     void window_deinit(Window& window)
@@ -47,10 +48,18 @@ namespace woc
 
     Vector2 window_size(Window& window)
     {
+        // The window is resizable, so ask raylib rather than trusting the last size we requested.
+        window.width = static_cast<u32>(GetScreenWidth());
+        window.height = static_cast<u32>(GetScreenHeight());
         auto result = Vector2{ static_cast<f32>(window.width), static_cast<f32>(window.height) };
         return result;
     }
 
+    bool window_was_resized(Window& window)
+    {
+        return IsWindowResized();
+    }
+
     void window_set_size(Window& window, Vector2 size)
     {
         assert(size.x > 0.f);
@@ -65,8 +74,46 @@ namespace woc
         return GetFrameTime();
     }
 
-    f32 window_seconds_since_init(Window& window)
+    f64 window_seconds_since_init(Window& window)
     {
-        return static_cast<f32>(GetTime());
+        return GetTime();
+    }
+
+    void window_poll_events(Window& window)
+    {
+        PollInputEvents();
+    }
+
+    bool window_has_input_activity(Window& window)
+    {
+        // Nothing else reads raylib's key/char queues. A wait that already drained them hands over what it saw,
+        // otherwise the key it woke up for would leave the page idle.
+        bool keyboard = std::exchange(window.pending_input_activity, false);
+        keyboard |= GetKeyPressed() != 0;
+        keyboard |= GetCharPressed() != 0;
+        bool mouse = !Vector2Equals(GetMouseDelta(), Vector2Zero())
+            || GetMouseWheelMove() != 0.f
+            || IsMouseButtonDown(MOUSE_BUTTON_LEFT)
+            || IsMouseButtonReleased(MOUSE_BUTTON_LEFT)
+            || IsMouseButtonDown(MOUSE_BUTTON_RIGHT);
+        return keyboard || mouse || IsWindowResized();
+    }
+
+    bool window_wait_events(Window& window, f64 timeout_seconds)
+    {
+        // raylib doesn't expose glfwWaitEventsTimeout, so sleep in short slices and poll in between.
+        constexpr auto POLL_SLICE = std::chrono::milliseconds(8);
+        auto deadline = GetTime() + timeout_seconds;
+        do
+        {
+            std::this_thread::sleep_for(POLL_SLICE);
+            window_poll_events(window);
+            if (window_has_input_activity(window) || !window_is_running(window))
+            {
+                window.pending_input_activity = true;
+                return true;
+            }
+        } while (GetTime() < deadline);
+        return false;
     }
 }
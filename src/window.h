@@ -7,9 +7,12 @@ namespace woc
     struct Window {
         u32 width;
         u32 height;
+        // Activity window_wait_events saw and drained, reported by the next window_has_input_activity.
+        bool pending_input_activity;
     };
 
-    Window window_init();
+    // Opens at size straight away, so the first frames don't go to a window about to be resized.
+    Window window_init(Vector2 size);
     void window_close(Window& window);
     bool window_is_running(Window& window);
     void window_set_fullscreen(Window& window, bool fullscreen);
@@ -17,7 +20,14 @@ namespace woc
     bool window_is_visible(Window& window);
     void window_deinit(Window& window);
     Vector2 window_size(Window& window);
+    bool window_was_resized(Window& window);
     void window_set_size(Window& window, Vector2 size);
     f32 window_delta_seconds(Window& window);
-    f32 window_seconds_since_init(Window& window);
+    f64 window_seconds_since_init(Window& window);
+    // Polls input without presenting, for frames that skip BeginDrawing/EndDrawing.
+    void window_poll_events(Window& window);
+    // Drains raylib's key and char queues, IsKeyPressed and IsKeyDown still see those keys.
+    bool window_has_input_activity(Window& window);
+    // Blocks until there is input activity or the timeout runs out. Returns true on activity.
+    bool window_wait_events(Window& window, f64 timeout_seconds);
 }
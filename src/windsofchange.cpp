@@ -1,4 +1,21 @@
 ﻿#include "windsofchange.h"
+#include "levelgen.h"
+#include "fixed.h"
+#include "windfield.h"
+#include "broadphase.h"
+#include "particles.h"
+#include "levelfile.h"
+#include "editor.h"
+#include "soak.h"
+#include "collisioncheck.h"
+#include "counters.h"
+#include "memory.h"
+#include "startup.h"
+#include "replay.h"
+#include "capture.h"
+#include "framelimiter.h"
+#include "levelstream.h"
+#include "netplay.h"
 
 namespace woc
 {
@@ -35,271 +52,32 @@ namespace woc
 
     woc_internal void game_load_level(GameState& game_state)
     {
-        auto& enemies = game_state.enemies;
-        auto world_size = Vector2Subtract(WORLD_MAX, WORLD_MIN);
-        switch (game_state.current_level)
+        // Past the shipped levels a file still wins over the generator, so handmade extra levels can be tried out.
+        if (game_state.current_level < ENDLESS_START_LEVEL || levelfile_exists(game_state.current_level))
         {
-            case 0:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { 0.f, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 3,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                game_state.player.balls_available = 1;
-                break;
-            }
-            case 1:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { -200.f, -300.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { -200.f, -100.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                game_state.player.balls_available = 1;
-                break;
-            }
-            case 2:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { -200.f, -300.f },
-                    .size = WALL_SIZE_L,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { -200.f, 300.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 0,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-                game_state.player.balls_available = 1;
-                game_state.player.wind_available = 1;
-                break;
-            }
-            case 3:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 0.5f, 200.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 1.5f + 50.f, 200.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-                    
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 0.5f + 200.f, -200.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 1.5f + 250.f, -200.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-                    
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 1.0f + WALL_SIZE_DEFAULT.x * 0.5f + 200.f, -400.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                game_state.player.balls_available = 1;
-                game_state.player.wind_available = 2;
-                break;
-            }
-            case 4:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 0.5f, 200.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_XL.x * 1.5f + 50.f, 200.f },
-                    .size = WALL_SIZE_XL,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Indestructible,
-                    .contributes_to_win = false
-                });
-
-                auto center = WORLD_MIN.x + WALL_SIZE_XL.x;
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { center + -0.5f * WALL_SIZE_DEFAULT.x, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { center + -2.5f * WALL_SIZE_DEFAULT.x, -100.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { center + 0.5f * WALL_SIZE_DEFAULT.x + 50, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { center + 2.5f * WALL_SIZE_DEFAULT.x + 50, -100.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                    
-                game_state.player.balls_available = 2;
-                game_state.player.wind_available = 2;
-                break;
-            }
-            case 5:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MAX.x - WALL_SIZE_DEFAULT.x, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { PI / 2.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { 0.f, WORLD_MIN.y + WALL_SIZE_DEFAULT.y },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                game_state.player.balls_available = 1;
-                game_state.player.wind_available = 1;
-                break;
-            }
-            case 6:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MAX.x - WALL_SIZE_DEFAULT.x, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { PI / 2.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_DEFAULT.x * 5, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { PI / 2.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_DEFAULT.x, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { PI / 2.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { 0.f, WORLD_MIN.y + WALL_SIZE_DEFAULT.y },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                game_state.player.balls_available = 1;
-                game_state.player.wind_available = 1;
-                break;
-            }
-            case 7:
-            {
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MAX.x - WALL_SIZE_DEFAULT.x, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { PI / 2.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { WORLD_MIN.x + WALL_SIZE_DEFAULT.x, 0.f },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 2,
-                    .rot = Radian { PI / 2.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                enemies.emplace_back(EnemyState {
-                    .pos = Vector2 { 0.f, WORLD_MIN.y + WALL_SIZE_DEFAULT.y },
-                    .size = WALL_SIZE_DEFAULT,
-                    .health = 1,
-                    .rot = Radian { 0.f },
-                    .type = EnemyType::Normal,
-                    .contributes_to_win = true
-                });
-                game_state.player.balls_available = 1;
-                game_state.player.wind_available = 2;
-                break;
-            }
-            default:
+            auto level = LevelDefinition{};
+            auto error = std::string{};
+            if (!levelfile_load(game_state.current_level, level, error))
             {
-                break;
+                std::cerr << error << "\n";
+                // What parsed is still played, but not in a world the camera's fixed point math can't hold.
+                if (!physics_fits(level.world_min, level.world_max))
+                {
+                    level = LevelDefinition{};
+                }
             }
+            levelfile_apply(level, game_state);
+        } else {
+            auto generated = levelgen_generate_verified(game_state.current_level);
+            levelgen_apply(generated, game_state);
         }
     }
 
-    GameState game_init(u32 level)
+    GameState game_init_empty(u32 level)
     {
+        woc_local std::atomic<u64> next_game_id = 1;
         auto result = woc::GameState{
+            .id = next_game_id.fetch_add(1, std::memory_order_relaxed),
             .current_level = level,
             .time_scale = 1.0,
             .level_status = LevelStatus::InProgress,
@@ -317,13 +95,27 @@ namespace woc
                 .height = woc::WORLD_MAX.y - woc::WORLD_MIN.y,
                 .rot = woc::Radian { 0.0 },
                 .zoom = 1.0f,
+                .aspect = woc::CAMERA_ASPECT,
             },
             .enemies = {},
             .player_projectiles = {},
         };
+        return result;
+    }
+
+    void game_prefetch_level(u32 level)
+    {
+        if (level >= ENDLESS_START_LEVEL && !levelfile_exists(level))
+        {
+            levelgen_prefetch(level);
+        }
+    }
 
+    GameState game_init(u32 level)
+    {
+        auto result = game_init_empty(level);
         game_load_level(result);
-        
+        broadphase_build(result.broadphase, result.enemies);
         return result;
     }
 
@@ -336,12 +128,201 @@ namespace woc
         return dist_sqr <= combined_r * combined_r;
     }
 
+    // Every multiply-add and trig call in game_update goes through these, sphere_collides_rectangle has its own fixed version. The float versions are what the game
+    // always did, but fused multiply-adds and libm trig make their results vary between builds. The fixed versions
+    // convert in, do integer math and convert out, so they can't.
+    woc_internal f32 physics_mul_add(f32 value, f32 a, f32 b)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_f32(fixed_from_f32(value) + fixed_from_f32(a) * fixed_from_f32(b));
+#else
+        return value + a * b;
+#endif
+    }
+
+    woc_internal Vector2 physics_move(Vector2 pos, Vector2 dir, f32 distance)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_vector2(fixed_from_vector2(pos) + fixed_from_vector2(dir) * fixed_from_f32(distance));
+#else
+        return Vector2Add(pos, Vector2Scale(dir, distance));
+#endif
+    }
+
+    woc_internal Vector2 physics_rotate(Vector2 v, f32 angle)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_vector2(fixed_rotate(fixed_from_vector2(v), fixed_from_f32(angle)));
+#else
+        return Vector2Rotate(v, angle);
+#endif
+    }
+
+    // Bends dir towards force, keeping it unit length.
+    woc_internal Vector2 physics_steer(Vector2 dir, Vector2 force, f32 delta_seconds)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_vector2(fixed_normalize(fixed_from_vector2(dir) + fixed_from_vector2(force) * fixed_from_f32(delta_seconds)));
+#else
+        return Vector2Normalize(Vector2Add(dir, Vector2Scale(force, delta_seconds)));
+#endif
+    }
+
+    woc_internal Vector2 physics_reflect(Vector2 v, Vector2 normal)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_vector2(fixed_reflect(fixed_from_vector2(v), fixed_from_vector2(normal)));
+#else
+        return Vector2Reflect(v, normal);
+#endif
+    }
+
+    woc_internal f32 physics_sin(f32 angle)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return fixed_to_f32(fixed_sin(fixed_from_f32(angle)));
+#else
+        return std::sin(angle);
+#endif
+    }
+
+    // Bounces a ball moving at dir * speed off a wall moving at wall_vel and turning at spin, arm being the ball's
+    // offset from the wall's center. The reflection happens in the wall's frame, so a wall moving into a ball
+    // throws it forward and one moving away can't be hit at all. Only the new direction is kept, every ball
+    // shares the player's speed.
+    woc_internal Vector2 physics_reflect_moving(Vector2 dir, f32 speed, Vector2 normal, Vector2 wall_vel, f32 spin, Vector2 arm)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        auto n = fixed_from_vector2(normal);
+        auto w = fixed_from_f32(spin);
+        auto r = fixed_from_vector2(arm);
+        auto surface = fixed_from_vector2(wall_vel) + FixedVector2 { -(w * r.y), w * r.x };
+        auto relative = fixed_from_vector2(dir) * fixed_from_f32(speed) - surface;
+        if (!(fixed_dot(relative, n) < Fixed { 0 }))
+        {
+            return dir;
+        }
+        auto result = fixed_reflect(relative, n) + surface;
+        if (!result.x.raw && !result.y.raw)
+        {
+            return physics_reflect(dir, normal);
+        }
+        result = fixed_normalize(result);
+        return fixed_to_vector2(speed < 0.f ? FixedVector2 { -result.x, -result.y } : result);
+#else
+        auto surface = Vector2Add(wall_vel, Vector2 { -spin * arm.y, spin * arm.x });
+        auto relative = Vector2Subtract(Vector2Scale(dir, speed), surface);
+        if (Vector2DotProduct(relative, normal) >= 0.f)
+        {
+            return dir;
+        }
+        auto result = Vector2Add(Vector2Reflect(relative, normal), surface);
+        if (Vector2LengthSqr(result) == 0.f)
+        {
+            return physics_reflect(dir, normal);
+        }
+        result = Vector2Normalize(result);
+        return speed < 0.f ? Vector2Negate(result) : result;
+#endif
+    }
+
     // Returns normal of collision or zero vector if no collision.
     enum class CollisionResult
     {
         NoCollision = 0,
         Collision = 1,
     };
+#if WOC_FIXED_POINT_PHYSICS
+    // Same tests as the float version below, but converted once and with the rectangle's sine and cosine
+    // looked up once, which is what keeps this path ahead of the float one.
+    woc_internal CollisionResult sphere_collides_rectangle(
+        Vector2 sphere_pos, Vector2 sphere_dir, f32 sphere_radius, 
+        Vector2 rectangle_pos, Vector2 rectangle_size, Radian rectangle_rotation,
+        Vector2& out_normal)
+    {
+        out_normal = Vector2Zero();
+
+        auto steps = fixed_angle_to_steps(fixed_from_f32(rectangle_rotation.val));
+        auto c = static_cast<i64>(fixed_sine_from_steps(steps + (FIXED_QUARTER_TURN_STEPS << FIXED_FRACTION_BITS)).raw);
+        auto s = static_cast<i64>(fixed_sine_from_steps(steps).raw);
+        auto rotate = [c, s] (FixedVector2 v, i64 sign)
+        {
+            return FixedVector2 {
+                Fixed { static_cast<i32>((v.x.raw * c - v.y.raw * s * sign) >> FIXED_FRACTION_BITS) },
+                Fixed { static_cast<i32>((v.x.raw * s * sign + v.y.raw * c) >> FIXED_FRACTION_BITS) }
+            };
+        };
+
+        auto half_size = fixed_from_vector2(Vector2Scale(rectangle_size, 0.5f));
+        auto s_pos2 = rotate(fixed_from_vector2(sphere_pos) - fixed_from_vector2(rectangle_pos), -1);
+        auto rotated_dir = rotate(s_pos2, -1);
+
+        bool inside_x = true;
+        bool inside_y = true;
+        auto test_point = s_pos2;
+        auto normal = FixedVector2 { Fixed { 0 }, Fixed { 0 } };
+        if (s_pos2.x < -half_size.x)
+        {
+            inside_x = false;
+            test_point.x = -half_size.x;
+            normal.x = Fixed { -FIXED_ONE };
+        } else if (s_pos2.x > half_size.x)
+        {
+            inside_x = false;
+            test_point.x = half_size.x;
+            normal.x = Fixed { FIXED_ONE };
+        }
+        if (s_pos2.y > half_size.y)
+        {
+            inside_y = false;
+            test_point.y = half_size.y;
+            normal.y = Fixed { FIXED_ONE };
+        } else if (s_pos2.y < -half_size.y)
+        {
+            inside_y = false;
+            test_point.y = -half_size.y;
+            normal.y = Fixed { -FIXED_ONE };
+        }
+
+        if (inside_y && inside_x)
+        {
+            auto current_t = Fixed { std::numeric_limits<i32>::max() };
+            auto back_dir = FixedVector2 { -rotated_dir.x, -rotated_dir.y };
+            auto try_hit = [&current_t, &normal] (Fixed distance, Fixed speed, FixedVector2 hit_normal)
+            {
+                auto t = distance / speed;
+                if (t > Fixed { 0 } && t < current_t)
+                {
+                    normal = hit_normal;
+                    current_t = t;
+                }
+            };
+            if (back_dir.x.raw)
+            {
+                try_hit(-half_size.x - s_pos2.x, back_dir.x, FixedVector2 { Fixed { -FIXED_ONE }, Fixed { 0 } });
+                try_hit(half_size.x - s_pos2.x, back_dir.x, FixedVector2 { Fixed { FIXED_ONE }, Fixed { 0 } });
+            }
+            if (back_dir.y.raw)
+            {
+                try_hit(half_size.y - s_pos2.y, back_dir.y, FixedVector2 { Fixed { 0 }, Fixed { FIXED_ONE } });
+                try_hit(-half_size.y - s_pos2.y, back_dir.y, FixedVector2 { Fixed { 0 }, Fixed { -FIXED_ONE } });
+            }
+            out_normal = fixed_to_vector2(rotate(normal, 1));
+            return CollisionResult::Collision;
+        }
+
+        auto delta = s_pos2 - test_point;
+        auto distance_sqr = static_cast<i64>(delta.x.raw) * delta.x.raw + static_cast<i64>(delta.y.raw) * delta.y.raw;
+        auto radius = static_cast<i64>(fixed_from_f32(sphere_radius).raw);
+        if (fixed_dot(normal, rotated_dir) > Fixed { 0 } || distance_sqr > radius * radius)
+        {
+            return CollisionResult::NoCollision;
+        }
+
+        out_normal = fixed_to_vector2(rotate(fixed_normalize(normal), 1));
+        return CollisionResult::Collision;
+    }
+#else
     woc_internal CollisionResult sphere_collides_rectangle(
         Vector2 sphere_pos, Vector2 sphere_dir, f32 sphere_radius, 
         Vector2 rectangle_pos, Vector2 rectangle_size, Radian rectangle_rotation,
@@ -434,178 +415,229 @@ namespace woc
         out_normal = Vector2Rotate(Vector2Normalize(out_normal), rectangle_rotation.val);
         return CollisionResult::Collision;
     }
+#endif
 
-    void game_update(GameState& game_state, InputState& input, AudioState& audio_state, f32 delta_seconds)
+    bool enemy_is_moving(EnemyState& enemy)
     {
-        constexpr f32 PLAYER_MIN_VEL = -750.0f;
-        constexpr f32 PLAYER_MAX_VEL = 750.0f;
-        constexpr f32 PLAYER_ACCELERATION = 1500.0f;
-        constexpr f32 GROUND_FRICTION = 750.0f;
+        return enemy.motion.type != EnemyMotionType::None || enemy.motion.spin != 0.f;
+    }
 
-        if (game_state.level_status != LevelStatus::InProgress)
+    woc_internal void enemy_update_motion(EnemyState& enemy, f32 delta_seconds)
+    {
+        auto& motion = enemy.motion;
+        auto previous_pos = enemy.pos;
+        if (motion.type != EnemyMotionType::None)
         {
-            game_state.time_scale = std::max(0.0f, game_state.time_scale - delta_seconds);
-        }
-        delta_seconds *= game_state.time_scale;
-
-        game_state.player.accel = static_cast<f32>(input.move_dir) * PLAYER_ACCELERATION;
-        // TODO: Friction should let you go in the opposite direction.
-        if (game_state.player.vel < 0.0f) {
-            game_state.player.accel += GROUND_FRICTION;
-        } else {
-            game_state.player.accel -= GROUND_FRICTION;
+            assert(motion.period > 0.f);
+            motion.time += delta_seconds;
+            if (motion.time >= motion.period)
+            {
+                motion.time -= motion.period;
+            }
         }
-
-        game_state.player.vel += game_state.player.accel * delta_seconds;
-        game_state.player.vel = Clamp(game_state.player.vel, PLAYER_MIN_VEL, PLAYER_MAX_VEL);
-        game_state.player.pos_x += game_state.player.vel * delta_seconds;
-        game_state.player.pos_x = Clamp(game_state.player.pos_x, WORLD_MIN.x + static_cast<f32>(PLAYER_DEFAULT_WIDTH) * 0.5f, WORLD_MAX.x - static_cast<f32>(PLAYER_DEFAULT_WIDTH) * 0.5f);
-
-        std::erase_if(game_state.dead_projectile_effects, [delta_seconds, &vel = game_state.player.ball_velocity] (ProjectileDeadEffect& dead_projectile)
-        {
-            auto alpha = dead_projectile.timer / PROJECTILE_DEAD_EFFECT_DURATION;
-            auto eased_alpha = ease_in_cubic(alpha);
-            dead_projectile.pos = Vector2Add(dead_projectile.pos, Vector2Scale(dead_projectile.dir, vel * delta_seconds * eased_alpha));
-            dead_projectile.timer -= delta_seconds;
-            return dead_projectile.timer <= 0.f;
-        });
-        std::erase_if(game_state.player_projectiles, [&audio_state, &dbe = game_state.dead_projectile_effects] (Projectile& p)
+        switch (motion.type)
         {
-            if (p.pos.x < WORLD_MIN.x | p.pos.x > WORLD_MAX.x | p.pos.y < WORLD_MIN.y | p.pos.y > WORLD_MAX.y)
+            case EnemyMotionType::None:
             {
-                audio_play_sound_randomize_pitch(audio_state, AudioType::SFXBallDisappear);
-                dbe.emplace_back(ProjectileDeadEffect {
-                    .pos = p.pos,
-                    .dir = p.dir,
-                    .timer = PROJECTILE_DEAD_EFFECT_DURATION
-                });
-                return true;
+                break;
             }
-            return false;
-        });
-
-        // Without proper mixing, limit to 1 impact sound each frame
-        bool collide_indestructible = false;
-        bool collide_wall = false;
-        for (auto& p : game_state.player_projectiles)
+            case EnemyMotionType::Oscillate:
+            {
+                enemy.pos = physics_move(motion.origin, motion.points.at(0), physics_sin(2.f * PI * motion.time / motion.period));
+                break;
+            }
+            case EnemyMotionType::Path:
+            {
+                assert(motion.point_count > 0 && motion.point_count <= ENEMY_PATH_MAX_POINTS);
+                auto leg_seconds = motion.period / static_cast<f32>(motion.point_count);
+                auto leg = std::min(static_cast<u32>(motion.time / leg_seconds), motion.point_count - 1);
+                auto alpha = physics_mul_add(motion.time, -static_cast<f32>(leg), leg_seconds) / leg_seconds;
+                auto from = motion.points.at(leg);
+                auto to = motion.points.at((leg + 1) % motion.point_count);
+                enemy.pos = Vector2Add(motion.origin, physics_move(from, Vector2Subtract(to, from), alpha));
+                break;
+            }
+        }
+        if (motion.spin != 0.f)
         {
-            p.pos = Vector2Add(p.pos, Vector2Scale(p.dir, game_state.player.ball_velocity * delta_seconds));
-            p.time_since_last_collision += delta_seconds;
-            if (p.time_since_last_collision > MIN_TIME_BETWEEN_COLLISIONS)
+            enemy.rot.val = physics_mul_add(enemy.rot.val, motion.spin, delta_seconds);
+            if (enemy.rot.val > PI)
             {
-                for (auto& e : game_state.enemies)
-                {
-                    Vector2 collision_normal = Vector2Zero();
-                    auto collision = sphere_collides_rectangle(p.pos, p.dir, BALL_DEFAULT_RADIUS, e.pos, e.size, e.rot, collision_normal);
-                    if (collision == CollisionResult::Collision)
-                    {
-                        assert(!Vector2Equals(collision_normal, Vector2Zero()));
-                        p.time_since_last_collision = 0.f;
-                        p.dir = Vector2Reflect(p.dir, collision_normal);
-                        e.health--;
-                        collide_wall |= e.type != EnemyType::Indestructible;
-                        collide_indestructible |= e.type == EnemyType::Indestructible;
-                        break;
-                    }
-                }
-                
-                Vector2 collision_normal = Vector2Zero();
-                auto collision  = sphere_collides_rectangle(p.pos, p.dir, BALL_DEFAULT_RADIUS, player_pos(game_state.player), player_size(), Radian { 0.0f }, collision_normal);
-                if (collision == CollisionResult::Collision)
-                {
-                    assert(!Vector2Equals(collision_normal, Vector2Zero()));
-                    p.time_since_last_collision = 0.f;
-                    p.dir = Vector2Reflect(p.dir, collision_normal);
-                    collide_indestructible = true;
-                    break;
-                }
+                enemy.rot.val -= 2.f * PI;
+            } else if (enemy.rot.val < -PI)
+            {
+                enemy.rot.val += 2.f * PI;
             }
         }
+        motion.vel = delta_seconds > 0.f ? Vector2Scale(Vector2Subtract(enemy.pos, previous_pos), 1.f / delta_seconds) : Vector2Zero();
+    }
 
-        if (collide_indestructible)
+    // One axis of the camera, moved towards target and kept inside the world, or centered where the view covers it all.
+    woc_internal f32 camera_follow_axis(f32 current, f32 target, f32 world_min, f32 world_max, f32 view_min, f32 view_max, f32 delta_seconds)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        // Level streaming wakes the chunks in view, so the camera has to match across builds too. The blend is
+        // rate * dt / (1 + rate * dt), the implicit step of the same approach, in place of std::exp. Raw values are
+        // widened since a world can span more than Fixed holds.
+        i64 min = fixed_from_f32(world_min).raw;
+        i64 max = fixed_from_f32(world_max).raw;
+        auto half_view = (static_cast<i64>(fixed_from_f32(view_max).raw) - fixed_from_f32(view_min).raw) / 2;
+        if (max - min <= 2 * half_view)
         {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::SFXIndestructibleImpact);
+            return fixed_to_f32(Fixed { static_cast<i32>((min + max) / 2) });
         }
-        if (collide_wall)
+        auto step = fixed_from_f32(CAMERA_FOLLOW_RATE) * fixed_from_f32(delta_seconds);
+        auto blend = step / (Fixed { FIXED_ONE } + step);
+        i64 from = fixed_from_f32(current).raw;
+        auto next = from + (((fixed_from_f32(target).raw - from) * blend.raw) >> FIXED_FRACTION_BITS);
+        return fixed_to_f32(Fixed { static_cast<i32>(std::clamp(next, min + half_view, max - half_view)) });
+#else
+        auto half_view = (view_max - view_min) * 0.5f;
+        if (world_max - world_min <= 2.f * half_view)
         {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWallImpact);
+            return (world_min + world_max) * 0.5f;
         }
+        auto blend = 1.f - std::exp(-CAMERA_FOLLOW_RATE * delta_seconds);
+        return Clamp(Lerp(current, target, blend), world_min + half_view, world_max - half_view);
+#endif
+    }
 
-        std::erase_if(game_state.dead_enemy_effects, [delta_seconds] (EnemyDeadEffect& dead_effect)
-        {
-            dead_effect.timer -= delta_seconds;
-            return dead_effect.timer <= 0.f;
-        });
-        std::erase_if(game_state.enemies, [&dee = game_state.dead_enemy_effects, &audio_state] (EnemyState& e)
+    // Centers the view on the world where it fits, the default world always does. Bigger worlds scroll after the
+    // ball closest to the paddle, or the paddle when nothing's in flight. Only level streaming reads the camera
+    // back, to keep the chunks in view awake.
+    woc_internal void game_update_camera(GameState& game_state, f32 delta_seconds)
+    {
+        auto& cam = game_state.cam;
+        auto focus = player_pos(game_state.player);
+        auto closest_y = -std::numeric_limits<f32>::infinity();
+        for (auto& p : game_state.player_projectiles)
         {
-            if (e.health <= 0 && e.type != EnemyType::Indestructible)
+            if (p.pos.y > closest_y)
             {
-                audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWallDisappear);
-                dee.emplace_back(EnemyDeadEffect {
-                    .pos = e.pos,
-                    .size = e.size,
-                    .rot = e.rot,
-                    .timer = ENEMY_DEAD_EFFECT_DURATION
-                });
-                return true;
+                closest_y = p.pos.y;
+                focus = p.pos;
             }
-            return false;
-        });
+        }
+
+        Vector2 view_min, view_max;
+        camera_view_bounds(cam, 0.f, view_min, view_max);
+        cam.pos.x = camera_follow_axis(cam.pos.x, focus.x, game_state.world_min.x, game_state.world_max.x, view_min.x, view_max.x, delta_seconds);
+        cam.pos.y = camera_follow_axis(cam.pos.y, focus.y, game_state.world_min.y, game_state.world_max.y, view_min.y, view_max.y, delta_seconds);
+    }
+
+    woc_internal u32 game_player_count(GameState& game_state)
+    {
+        return game_state.second_player ? 2 : 1;
+    }
+
+    woc_internal PlayerState& game_player(GameState& game_state, u32 owner)
+    {
+        return owner == 0 ? game_state.player : *game_state.second_player;
+    }
+
+    woc_internal void player_update_movement(GameState& game_state, PlayerState& player, InputState& input, f32 delta_seconds)
+    {
+        constexpr f32 PLAYER_MIN_VEL = -750.0f;
+        constexpr f32 PLAYER_MAX_VEL = 750.0f;
+        constexpr f32 PLAYER_ACCELERATION = 1500.0f;
+        constexpr f32 GROUND_FRICTION = 750.0f;
+
+        player.accel = static_cast<f32>(input.move_dir) * PLAYER_ACCELERATION;
+        // TODO: Friction should let you go in the opposite direction.
+        if (player.vel < 0.0f) {
+            player.accel += GROUND_FRICTION;
+        } else {
+            player.accel -= GROUND_FRICTION;
+        }
+
+        player.vel = physics_mul_add(player.vel, player.accel, delta_seconds);
+        player.vel = Clamp(player.vel, PLAYER_MIN_VEL, PLAYER_MAX_VEL);
+        player.pos_x = physics_mul_add(player.pos_x, player.vel, delta_seconds);
+        player.pos_x = Clamp(player.pos_x, game_state.world_min.x + static_cast<f32>(PLAYER_DEFAULT_WIDTH) * 0.5f, game_state.world_max.x - static_cast<f32>(PLAYER_DEFAULT_WIDTH) * 0.5f);
+    }
+
+    woc_internal void player_cast_gust(GameState& game_state, PlayerState& player, InputState& input, AudioState& audio_state, f32 delta_seconds)
+    {
+        player.gust_cd = std::max(0.f, player.gust_cd - delta_seconds);
+        if (input.cast_gust && player.wind_available && player.gust_cd <= 0.f)
+        {
+            audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWind);
+            game_state.wind_gusts.emplace_back(WindGust {
+                .pos = Vector2 { player.pos_x, PLAYER_WORLD_Y - GUST_OFFSET_Y },
+                .force = Vector2 { 0.f, -GUST_FORCE },
+                .radius = GUST_RADIUS,
+                .timer = GUST_DURATION,
+                .duration = GUST_DURATION
+            });
+            player.wind_available--;
+            player.gust_cd = GUST_CD;
+        }
+    }
 
-        game_state.player.ball_cd = std::max(0.f, game_state.player.ball_cd - delta_seconds);
-        if (input.send_ball && game_state.player.balls_available && game_state.player.ball_cd <= 0.f)
+    woc_internal void player_send_ball(GameState& game_state, PlayerState& player, u32 owner, InputState& input, AudioState& audio_state, f32 delta_seconds)
+    {
+        player.ball_cd = std::max(0.f, player.ball_cd - delta_seconds);
+        if (input.send_ball && player.balls_available && player.ball_cd <= 0.f)
         {
             audio_play_sound_randomize_pitch(audio_state, AudioType::SFXSendBall);
             game_state.player_projectiles.emplace_back(Projectile {
-                .pos = Vector2Add(player_pos(game_state.player), Vector2 { 0.f, -BALL_DEFAULT_Y_OFFSET }),
+                .pos = Vector2Add(player_pos(player), Vector2 { 0.f, -BALL_DEFAULT_Y_OFFSET }),
                 .dir = Vector2 { 0, -1 },
-                .time_since_last_collision = 0.f
+                .time_since_last_collision = 0.f,
+                .owner = owner
             });
-            game_state.player.balls_available--;
-            game_state.player.ball_cd = BALL_DEFAULT_CD;
+            player.balls_available--;
+            player.ball_cd = BALL_DEFAULT_CD;
         }
+    }
 
-        if (!game_state.player.active_wind_ability && game_state.player.wind_available && !game_state.player_projectiles.empty())
+    woc_internal void player_update_wind_ability(GameState& game_state, PlayerState& player, u32 owner, InputState& input, AudioState& audio_state, f32 delta_seconds)
+    {
+        auto has_balls = std::ranges::any_of(game_state.player_projectiles, [owner] (Projectile& p) { return p.owner == owner; });
+        if (!player.active_wind_ability && player.wind_available && has_balls)
         {
             if (input.wind_dir_x) {
                 audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWind);
-                game_state.player.active_wind_ability = WindAbility {
+                player.active_wind_ability = WindAbility {
                     .timer = WIND_DURATION,
                     .angle = Radian { .val = static_cast<f32>(input.wind_dir_x) * PI / 4 },
-                    .ball_current_velocity = game_state.player.ball_velocity,
-                    .ball_target_velocity = game_state.player.ball_velocity
+                    .ball_current_velocity = player.ball_velocity,
+                    .ball_target_velocity = player.ball_velocity
                 };
-                game_state.player.wind_available--;
+                player.wind_available--;
             } else if (input.wind_dir_y == 1) {
                 audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWind);
-                game_state.player.active_wind_ability = WindAbility {
+                player.active_wind_ability = WindAbility {
                     .timer = WIND_DURATION,
                     .angle = Radian { .val = 0 },
-                    .ball_current_velocity = game_state.player.ball_velocity,
-                    .ball_target_velocity = game_state.player.ball_velocity * 1.5f
+                    .ball_current_velocity = player.ball_velocity,
+                    .ball_target_velocity = player.ball_velocity * 1.5f
                 };
-                game_state.player.wind_available--;
+                player.wind_available--;
             } else if (input.wind_dir_y == -1) {
                 audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWind);
-                game_state.player.active_wind_ability = WindAbility {
+                player.active_wind_ability = WindAbility {
                     .timer = WIND_DURATION,
                     .angle = Radian { 0.0f },
-                    .ball_current_velocity = game_state.player.ball_velocity,
-                    .ball_target_velocity = game_state.player.ball_velocity * -1.0f
+                    .ball_current_velocity = player.ball_velocity,
+                    .ball_target_velocity = player.ball_velocity * -1.0f
                 };
-                game_state.player.wind_available--;
+                player.wind_available--;
             }
         }
-        if (auto& wind = game_state.player.active_wind_ability)
+        if (auto& wind = player.active_wind_ability)
         {
             auto wind_delta = std::min(delta_seconds, wind->timer);
             f32 delta_decimal = Clamp(wind_delta / WIND_DURATION, 0.0f, 1.0f);
             f32 total_delta_velocity = wind->ball_target_velocity - wind->ball_current_velocity;
-            game_state.player.ball_velocity += total_delta_velocity * delta_decimal;
+            player.ball_velocity = physics_mul_add(player.ball_velocity, total_delta_velocity, delta_decimal);
 
             for (auto& p : game_state.player_projectiles)
             {
-                p.dir = Vector2Rotate(p.dir, delta_decimal * wind->angle.val);
+                if (p.owner == owner)
+                {
+                    p.dir = physics_rotate(p.dir, delta_decimal * wind->angle.val);
+                }
             }
 
             wind->timer -= wind_delta;
@@ -614,13 +646,233 @@ namespace woc
                 wind = std::nullopt;
             } 
         }
+    }
+
+    void game_update(GameState& game_state, InputState& input, AudioState& audio_state, f32 delta_seconds)
+    {
+        game_update_players(game_state, std::span<InputState> { &input, 1 }, audio_state, delta_seconds);
+    }
+
+    void game_update_players(GameState& game_state, std::span<InputState> inputs, AudioState& audio_state, f32 delta_seconds)
+    {
+        auto player_count = game_player_count(game_state);
+        assert(inputs.size() == player_count);
+
+        if (game_state.level_status != LevelStatus::InProgress)
+        {
+            game_state.time_scale = std::max(0.0f, game_state.time_scale - delta_seconds);
+        }
+        delta_seconds *= game_state.time_scale;
+
+        for (u32 i = 0; i < player_count; i++)
+        {
+            player_update_movement(game_state, game_player(game_state, i), inputs[i], delta_seconds);
+        }
+
+        if (game_state.chunks.stream)
+        {
+            level_stream_update(game_state);
+        }
+        // States put together outside game_init (the solver, level generation) get their broadphase here.
+        if (game_state.broadphase.cells.size() != game_state.enemies.size())
+        {
+            broadphase_build(game_state.broadphase, game_state.enemies);
+        }
+        for (u32 i = 0; i < game_state.enemies.size(); i++)
+        {
+            auto& e = game_state.enemies[i];
+            if (enemy_is_moving(e))
+            {
+                enemy_update_motion(e, delta_seconds);
+                broadphase_move(game_state.broadphase, i, e);
+            }
+        }
+
+        std::erase_if(game_state.dead_projectile_effects, [delta_seconds, &vel = game_state.player.ball_velocity] (ProjectileDeadEffect& dead_projectile)
+        {
+            auto alpha = dead_projectile.timer / PROJECTILE_DEAD_EFFECT_DURATION;
+            auto eased_alpha = ease_in_cubic(alpha);
+            dead_projectile.pos = physics_move(dead_projectile.pos, dead_projectile.dir, vel * delta_seconds * eased_alpha);
+            dead_projectile.timer -= delta_seconds;
+            return dead_projectile.timer <= 0.f;
+        });
+        game_state.dead_projectile_effects_spawned += static_cast<u32>(std::erase_if(game_state.player_projectiles, [&audio_state, &dbe = game_state.dead_projectile_effects, min = game_state.world_min, max = game_state.world_max] (Projectile& p)
+        {
+            if (p.pos.x < min.x | p.pos.x > max.x | p.pos.y < min.y | p.pos.y > max.y)
+            {
+                audio_play_sound_randomize_pitch(audio_state, AudioType::SFXBallDisappear);
+                dbe.emplace_back(ProjectileDeadEffect {
+                    .pos = p.pos,
+                    .dir = p.dir,
+                    .timer = PROJECTILE_DEAD_EFFECT_DURATION
+                });
+                return true;
+            }
+            return false;
+        }));
+
+        std::erase_if(game_state.wind_gusts, [delta_seconds] (WindGust& gust)
+        {
+            gust.timer -= delta_seconds;
+            return gust.timer <= 0.f;
+        });
+        for (u32 i = 0; i < player_count; i++)
+        {
+            player_cast_gust(game_state, game_player(game_state, i), inputs[i], audio_state, delta_seconds);
+        }
+        wind_field_update(game_state.wind_field, game_state.wind_gusts);
+
+        if (!game_state.wind_field.x.empty())
+        {
+            // Sampled in batches off the stack so the SIMD kernel gets flat arrays without allocating.
+            constexpr u32 WIND_SAMPLE_BATCH = 64;
+            std::array<f32, WIND_SAMPLE_BATCH> xs, ys, wind_x, wind_y;
+            auto& projectiles = game_state.player_projectiles;
+            for (size_t first = 0; first < projectiles.size(); first += WIND_SAMPLE_BATCH)
+            {
+                auto count = static_cast<u32>(std::min<size_t>(WIND_SAMPLE_BATCH, projectiles.size() - first));
+                for (u32 i = 0; i < count; i++)
+                {
+                    xs[i] = projectiles[first + i].pos.x;
+                    ys[i] = projectiles[first + i].pos.y;
+                }
+                wind_field_sample(game_state.wind_field, xs.data(), ys.data(), wind_x.data(), wind_y.data(), count);
+                for (u32 i = 0; i < count; i++)
+                {
+                    if (wind_x[i] != 0.f || wind_y[i] != 0.f)
+                    {
+                        auto& p = projectiles[first + i];
+                        p.dir = physics_steer(p.dir, Vector2 { wind_x[i], wind_y[i] }, delta_seconds);
+                    }
+                }
+            }
+        }
 
-        if (game_state.level_status == LevelStatus::InProgress && !std::ranges::any_of(game_state.enemies, [] (EnemyState& e) { return e.contributes_to_win; })) 
+        // Without proper mixing, limit to 1 impact sound each frame
+        bool collide_indestructible = false;
+        bool collide_wall = false;
+        u64 collision_tests = 0;
+        u64 collision_hits = 0;
+        BroadphaseCandidates candidates;
+        for (auto& p : game_state.player_projectiles)
+        {
+            auto ball_velocity = game_player(game_state, p.owner).ball_velocity;
+            p.pos = physics_move(p.pos, p.dir, ball_velocity * delta_seconds);
+            p.time_since_last_collision += delta_seconds;
+            if (p.time_since_last_collision > MIN_TIME_BETWEEN_COLLISIONS)
+            {
+                auto ball_extents = Vector2 { BALL_DEFAULT_RADIUS, BALL_DEFAULT_RADIUS };
+                u32 candidate_count = 0;
+                bool culled = broadphase_query(game_state.broadphase, Vector2Subtract(p.pos, ball_extents), Vector2Add(p.pos, ball_extents), candidates, candidate_count);
+                auto enemy_count = culled ? candidate_count : static_cast<u32>(game_state.enemies.size());
+                for (u32 c = 0; c < enemy_count; c++)
+                {
+                    auto& e = game_state.enemies.at(culled ? candidates[c] : c);
+                    Vector2 collision_normal = Vector2Zero();
+                    auto collision = sphere_collides_rectangle(p.pos, p.dir, BALL_DEFAULT_RADIUS, e.pos, e.size, e.rot, collision_normal);
+                    collision_tests++;
+                    if (collision == CollisionResult::Collision)
+                    {
+                        assert(!Vector2Equals(collision_normal, Vector2Zero()));
+                        collision_hits++;
+                        p.time_since_last_collision = 0.f;
+                        if (enemy_is_moving(e))
+                        {
+                            p.dir = physics_reflect_moving(p.dir, ball_velocity, collision_normal, e.motion.vel, e.motion.spin, Vector2Subtract(p.pos, e.pos));
+                        } else {
+                            p.dir = physics_reflect(p.dir, collision_normal);
+                        }
+                        e.health--;
+                        collide_wall |= e.type != EnemyType::Indestructible;
+                        collide_indestructible |= e.type == EnemyType::Indestructible;
+                        break;
+                    }
+                }
+                
+                bool paddle_hit = false;
+                for (u32 i = 0; i < player_count && !paddle_hit; i++)
+                {
+                    Vector2 collision_normal = Vector2Zero();
+                    auto collision  = sphere_collides_rectangle(p.pos, p.dir, BALL_DEFAULT_RADIUS, player_pos(game_player(game_state, i)), player_size(), Radian { 0.0f }, collision_normal);
+                    collision_tests++;
+                    if (collision == CollisionResult::Collision)
+                    {
+                        assert(!Vector2Equals(collision_normal, Vector2Zero()));
+                        collision_hits++;
+                        p.time_since_last_collision = 0.f;
+                        p.dir = physics_reflect(p.dir, collision_normal);
+                        collide_indestructible = true;
+                        paddle_hit = true;
+                    }
+                }
+                if (paddle_hit)
+                {
+                    break;
+                }
+            }
+        }
+
+        counters_add(Counter::SimulationTicks, 1);
+        counters_add(Counter::CollisionTests, collision_tests);
+        counters_add(Counter::CollisionHits, collision_hits);
+
+        if (collide_indestructible)
+        {
+            audio_play_sound_randomize_pitch(audio_state, AudioType::SFXIndestructibleImpact);
+        }
+        if (collide_wall)
+        {
+            audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWallImpact);
+        }
+
+        std::erase_if(game_state.dead_enemy_effects, [delta_seconds] (EnemyDeadEffect& dead_effect)
+        {
+            dead_effect.timer -= delta_seconds;
+            return dead_effect.timer <= 0.f;
+        });
+        // Swap-removed, so a death costs the same in a level of a hundred thousand walls as in one of ten. Only
+        // the last wall changes index.
+        auto& enemies = game_state.enemies;
+        assert(game_state.broadphase.cells.size() == enemies.size());
+        for (u32 i = 0; i < enemies.size();)
+        {
+            auto& e = enemies[i];
+            if (e.health > 0 || e.type == EnemyType::Indestructible)
+            {
+                i++;
+                continue;
+            }
+            audio_play_sound_randomize_pitch(audio_state, AudioType::SFXWallDisappear);
+            game_state.dead_enemy_effects.emplace_back(EnemyDeadEffect {
+                .pos = e.pos,
+                .size = e.size,
+                .rot = e.rot,
+                .timer = ENEMY_DEAD_EFFECT_DURATION
+            });
+            game_state.dead_enemy_effects_spawned++;
+            broadphase_swap_remove(game_state.broadphase, i);
+            e = enemies.back();
+            enemies.pop_back();
+        }
+
+        for (u32 i = 0; i < player_count; i++)
+        {
+            player_send_ball(game_state, game_player(game_state, i), i, inputs[i], audio_state, delta_seconds);
+        }
+        for (u32 i = 0; i < player_count; i++)
+        {
+            player_update_wind_ability(game_state, game_player(game_state, i), i, inputs[i], audio_state, delta_seconds);
+        }
+        game_update_camera(game_state, delta_seconds);
+
+        if (game_state.level_status == LevelStatus::InProgress && !game_state.chunks.asleep_win_walls
+            && !std::ranges::any_of(game_state.enemies, [] (EnemyState& e) { return e.contributes_to_win; }))
         {
             game_state.level_status = LevelStatus::Won;
             audio_play_sound(audio_state, AudioType::SFXLevelWon);
         } else if (game_state.level_status == LevelStatus::InProgress
             && !game_state.player.balls_available
+            && !(game_state.second_player && game_state.second_player->balls_available)
             && game_state.player_projectiles.empty()
             && game_state.dead_projectile_effects.empty())
         {
@@ -629,31 +881,237 @@ namespace woc
         }
     }
     
+    void game_add_second_player(GameState& game_state)
+    {
+        constexpr f32 PLAYER_START_SPACING = 150.f;
+        game_state.second_player = game_state.player;
+        game_state.player.pos_x -= PLAYER_START_SPACING;
+        game_state.second_player->pos_x += PLAYER_START_SPACING;
+    }
+
+    void camera_view_bounds(Camera& cam, f32 margin, Vector2& min, Vector2& max)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        // Level streaming wakes the chunks inside these, so they come from the sine table like the physics.
+        auto half_height = fixed_from_f32(cam.height * 0.5f) / fixed_from_f32(cam.zoom);
+        auto half_width = half_height * fixed_from_f32(cam.aspect);
+        auto angle = fixed_from_f32(cam.rot.val);
+        auto c = Fixed { std::abs(fixed_cos(angle).raw) };
+        auto s = Fixed { std::abs(fixed_sin(angle).raw) };
+        auto padding = fixed_from_f32(margin);
+        auto half_extents = FixedVector2 { c * half_width + s * half_height + padding, s * half_width + c * half_height + padding };
+        min = fixed_to_vector2(fixed_from_vector2(cam.pos) - half_extents);
+        max = fixed_to_vector2(fixed_from_vector2(cam.pos) + half_extents);
+#else
+        auto half_height = cam.height * 0.5f / cam.zoom;
+        auto half_width = half_height * cam.aspect;
+        auto c = std::abs(std::cos(cam.rot.val));
+        auto s = std::abs(std::sin(cam.rot.val));
+        auto half_extents = Vector2AddValue(Vector2 { c * half_width + s * half_height, s * half_width + c * half_height }, margin);
+        min = Vector2Subtract(cam.pos, half_extents);
+        max = Vector2Add(cam.pos, half_extents);
+#endif
+    }
+
+    bool physics_fits(Vector2 min, Vector2 max)
+    {
+#if WOC_FIXED_POINT_PHYSICS
+        return min.x >= -FIXED_POINT_MAX_COORDINATE && min.y >= -FIXED_POINT_MAX_COORDINATE
+            && max.x <= FIXED_POINT_MAX_COORDINATE && max.y <= FIXED_POINT_MAX_COORDINATE;
+#else
+        return true;
+#endif
+    }
+
+    bool game_can_pause(GameState& game_state)
+    {
+        // Nothing but moving walls moves on its own without a ball in flight, so skipping ticks can't change the outcome.
+        return game_state.level_status != LevelStatus::InProgress
+            || (game_state.player_projectiles.empty() && std::ranges::none_of(game_state.enemies, enemy_is_moving));
+    }
+    
+    woc_internal u64 game_hash_f32(u64 h, f32 value)
+    {
+        u32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return random_hash(h, bits);
+    }
+
+    woc_internal u64 game_hash_vector2(u64 h, Vector2 value)
+    {
+        return game_hash_f32(game_hash_f32(h, value.x), value.y);
+    }
+
+    woc_internal u64 game_hash_player(u64 h, PlayerState& player)
+    {
+        h = game_hash_f32(game_hash_f32(game_hash_f32(h, player.pos_x), player.vel), player.accel);
+        h = game_hash_f32(game_hash_f32(game_hash_f32(h, player.ball_velocity), player.ball_cd), player.gust_cd);
+        h = random_hash(random_hash(h, player.balls_available), player.wind_available);
+        if (auto& wind = player.active_wind_ability)
+        {
+            h = game_hash_f32(game_hash_f32(h, wind->timer), wind->angle.val);
+            h = game_hash_f32(game_hash_f32(h, wind->ball_current_velocity), wind->ball_target_velocity);
+        }
+        return h;
+    }
+
+    u64 game_hash(GameState& game_state)
+    {
+        u64 h = random_hash(game_state.current_level, static_cast<u64>(game_state.level_status));
+        h = game_hash_f32(h, game_state.time_scale);
+        // Only bigger worlds hash their bounds, so runs in the default one keep their hashes.
+        if (game_state.world_min.x != WORLD_MIN.x || game_state.world_min.y != WORLD_MIN.y || game_state.world_max.x != WORLD_MAX.x || game_state.world_max.y != WORLD_MAX.y)
+        {
+            h = game_hash_vector2(game_hash_vector2(h, game_state.world_min), game_state.world_max);
+        }
+        h = game_hash_player(h, game_state.player);
+        // Like the world bounds, only two player games hash what single player ones don't have.
+        if (game_state.second_player)
+        {
+            h = game_hash_player(random_hash(h, 2), *game_state.second_player);
+        }
+        for (auto& e : game_state.enemies)
+        {
+            h = random_hash(game_hash_vector2(h, e.pos), static_cast<u64>(e.health));
+            if (enemy_is_moving(e))
+            {
+                h = game_hash_f32(game_hash_f32(h, e.rot.val), e.motion.time);
+            }
+        }
+        for (auto& p : game_state.player_projectiles)
+        {
+            h = game_hash_f32(game_hash_vector2(game_hash_vector2(h, p.pos), p.dir), p.time_since_last_collision);
+            if (game_state.second_player)
+            {
+                h = random_hash(h, p.owner);
+            }
+        }
+        for (auto& p : game_state.dead_projectile_effects)
+        {
+            h = game_hash_f32(game_hash_vector2(h, p.pos), p.timer);
+        }
+        for (auto& e : game_state.dead_enemy_effects)
+        {
+            h = game_hash_f32(h, e.timer);
+        }
+        for (auto& gust : game_state.wind_gusts)
+        {
+            h = game_hash_f32(game_hash_vector2(h, gust.pos), gust.timer);
+        }
+        if (auto& chunks = game_state.chunks; chunks.stream)
+        {
+            h = random_hash(h, chunks.asleep_win_walls);
+            for (auto chunk : chunks.awake)
+            {
+                h = random_hash(h, chunk);
+            }
+            for (auto& e : chunks.asleep_walls)
+            {
+                h = random_hash(game_hash_vector2(random_hash(h, e.level_index), e.pos), static_cast<u64>(e.health));
+            }
+        }
+        return h;
+    }
+
     woc_internal Texture2D& texture_from_type(Renderer& r, TextureType t)
     {
         return r.loaded_textures.at(static_cast<size_t>(t));
     }
+
+    // Texture pixels live in video memory, sized here so they show up next to the heap.
+    woc_internal void renderer_account_textures(Renderer& renderer)
+    {
+        u64 bytes = memory_texture_bytes(renderer.world_target.texture);
+        for (auto& texture : renderer.loaded_textures)
+        {
+            bytes += memory_texture_bytes(texture);
+        }
+        memory_set_external(MemoryTag::Textures, bytes);
+    }
     
-    Renderer renderer_init()
+    void asset_preload_start(AssetPreload& preload)
+    {
+        constexpr u32 MAX_WORKERS = 4;
+        constexpr u32 IMAGE_COUNT = static_cast<u32>(TextureType::MAX);
+        constexpr u32 FILE_COUNT = IMAGE_COUNT + static_cast<u32>(AudioType::MAX_AUDIO_TYPE);
+        auto worker_count = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_WORKERS);
+        preload.images = {};
+        preload.waves = {};
+        preload.next_file.store(0, std::memory_order_relaxed);
+        preload.start = std::chrono::steady_clock::now();
+        preload.worker_seconds.assign(worker_count, 0.0);
+        preload.seconds = 0.0;
+        for (u32 worker = 0; worker < worker_count; worker++)
+        {
+            // Only the file loaders and decoders run here, they keep no state between calls.
+            preload.workers.emplace_back([&preload, worker]
+            {
+                for (auto file = preload.next_file.fetch_add(1); file < FILE_COUNT; file = preload.next_file.fetch_add(1))
+                {
+                    // Sounds first, the music alone takes longer to decode than all the images.
+                    if (file < static_cast<u32>(AudioType::MAX_AUDIO_TYPE))
+                    {
+                        auto previous_tag = memory_tag_push(MemoryTag::Audio);
+                        preload.waves.at(file) = LoadWave(AUDIO_PATHS.at(file));
+                        memory_tag_pop(previous_tag);
+                    } else {
+                        auto image = file - static_cast<u32>(AudioType::MAX_AUDIO_TYPE);
+                        auto previous_tag = memory_tag_push(MemoryTag::Textures);
+                        preload.images.at(image) = LoadImage(TEXTURE_PATHS.at(image));
+                        memory_tag_pop(previous_tag);
+                    }
+                }
+                preload.worker_seconds.at(worker) = std::chrono::duration<f64>(std::chrono::steady_clock::now() - preload.start).count();
+            });
+        }
+    }
+
+    void asset_preload_wait(AssetPreload& preload)
+    {
+        for (auto& worker : preload.workers)
+        {
+            worker.join();
+        }
+        if (!preload.workers.empty())
+        {
+            preload.seconds = *std::max_element(preload.worker_seconds.begin(), preload.worker_seconds.end());
+        }
+        preload.workers.clear();
+    }
+
+    Renderer renderer_init(AssetPreload& preload)
     {
         auto result = Renderer {
-            .loaded_textures{}
+            .loaded_textures{},
+            .world_target{},
+            .world_render_scale = MAX_RENDER_SCALE,
+            .dynamic_resolution = DynamicResolution {
+                .average_work_seconds = 0.f,
+                .settle_timer = 0.f,
+                .within_budget_timer = 0.f
+            },
+            .ui_text_size = 0,
+            .ui_layouts{},
+            .particles = particles_init(static_cast<u64>(std::chrono::steady_clock::now().time_since_epoch().count())),
+            .effects_game_id = 0,
+            .effects_projectiles_seen = 0,
+            .effects_enemies_seen = 0,
+            .frames_presented = 0,
+            .capture = nullptr,
+            .frame_limiter = nullptr
         };
 
-        texture_from_type(result, TextureType::KeyA) = LoadTexture("assets/textures/a_key.png");
-        texture_from_type(result, TextureType::KeyD) = LoadTexture("assets/textures/d_key.png");
-        texture_from_type(result, TextureType::KeyEsc) = LoadTexture("assets/textures/esc_key.png");
-        texture_from_type(result, TextureType::KeySpace) = LoadTexture("assets/textures/space_key.png");
-        texture_from_type(result, TextureType::KeyUp) = LoadTexture("assets/textures/up_key.png");
-        texture_from_type(result, TextureType::KeyDown) = LoadTexture("assets/textures/down_key.png");
-        texture_from_type(result, TextureType::KeyLeft) = LoadTexture("assets/textures/left_key.png");
-        texture_from_type(result, TextureType::KeyRight) = LoadTexture("assets/textures/right_key.png");
-        texture_from_type(result, TextureType::KeyR) = LoadTexture("assets/textures/r_key.png");
-        
-        texture_from_type(result, TextureType::IconBall) = LoadTexture("assets/textures/ball.png");
-        texture_from_type(result, TextureType::IconWind) = LoadTexture("assets/textures/wind.png");
+        asset_preload_wait(preload);
+        for (u32 i = 0; i < result.loaded_textures.size(); i++)
+        {
+            auto& image = preload.images.at(i);
+            result.loaded_textures.at(i) = LoadTextureFromImage(image);
+            UnloadImage(image);
+            image = Image{};
+        }
         
         GuiSetStyle(DEFAULT, TEXT_SIZE, 30);
+        renderer_account_textures(result);
 
         return result;
     }
@@ -664,6 +1122,252 @@ namespace woc
         {
             UnloadTexture(tex);
         }
+        if (renderer.world_target.id != 0)
+        {
+            UnloadRenderTexture(renderer.world_target);
+        }
+        memory_set_external(MemoryTag::Textures, 0);
+    }
+
+    woc_internal void ui_layout_push(UiLayout& layout, UiElementType type, u32 button, Rectangle bounds, i32 text_size, const char* text, i32 gui_state = STATE_NORMAL)
+    {
+        assert(layout.element_count < MAX_UI_ELEMENTS_PER_PAGE);
+        layout.elements.at(layout.element_count++) = UiElement {
+            .type = type,
+            .button = button,
+            .bounds = bounds,
+            .text_size = text_size,
+            .gui_state = gui_state,
+            .text = text,
+            .text_pos = Vector2Zero()
+        };
+    }
+
+    woc_internal void ui_layout_push_label(UiLayout& layout, Rectangle bounds, i32 text_size, const char* text, i32 gui_state = STATE_NORMAL)
+    {
+        ui_layout_push(layout, UiElementType::Label, 0, bounds, text_size, text, gui_state);
+    }
+
+    template <typename ButtonType>
+    woc_internal void ui_layout_push_control(UiLayout& layout, UiElementType type, ButtonType button, Rectangle bounds, i32 text_size, const char* text)
+    {
+        ui_layout_push(layout, type, static_cast<u32>(button), bounds, text_size, text);
+    }
+
+    woc_internal void ui_layout_build_main_menu(UiLayout& layout, Vector2 framebuffer_size)
+    {
+        // Everything sits one small button higher than centered so the editor button still fits at the bottom.
+        constexpr f32 STACK_RAISE = 60.f + BUTTON_SPACING;
+        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
+        title_rect.y -= title_rect.height + 40 + STACK_RAISE;
+        ui_layout_push_label(layout, title_rect, 125, "Winds of Change");
+        
+        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
+        auto secondary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 300.f, 60.f }, Vector2{0.5f, 0.0f});
+        primary_buttons_rect.y -= STACK_RAISE;
+        secondary_buttons_rect.y -= STACK_RAISE;
+        ui_layout_push_control(layout, UiElementType::Button, MainMenuButtonType::Continue, primary_buttons_rect, 65, "CONTINUE");
+        
+        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
+        secondary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, MainMenuButtonType::NewGame, primary_buttons_rect, 65, "NEW GAME");
+        
+        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
+        secondary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, MainMenuButtonType::Settings, secondary_buttons_rect, 40, "SETTINGS");
+        
+        secondary_buttons_rect.y += secondary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, MainMenuButtonType::Credits, secondary_buttons_rect, 40, "CREDITS");
+        
+        secondary_buttons_rect.y += secondary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, MainMenuButtonType::Editor, secondary_buttons_rect, 40, "EDITOR");
+        
+        secondary_buttons_rect.y += secondary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, MainMenuButtonType::Quit, secondary_buttons_rect, 40, "QUIT");
+    }
+
+    woc_internal void ui_layout_build_settings(UiLayout& layout, Vector2 framebuffer_size)
+    {
+        auto button_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.3f}, Vector2 { 300.f, 50.f }, Vector2{0.5f, 0.0f});
+        ui_layout_push(layout, UiElementType::Line, 0, button_rect, 40, "WINDOW");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Toggle, SettingsButtonType::Fullscreen, button_rect, 40, "FULLSCREEN");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+
+        ui_layout_push_control(layout, UiElementType::ComboBox, SettingsButtonType::Resolution, button_rect, 20, "1280x720;1600x900;1920x1080;2560x1440;3840x2160;CUSTOM");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+        
+        ui_layout_push(layout, UiElementType::Line, 0, button_rect, 40, "GRAPHICS");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Slider, SettingsButtonType::RenderScale, button_rect, 40, "SCALE:");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Toggle, SettingsButtonType::DynamicResolution, button_rect, 40, "DYNAMIC");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+        
+        ui_layout_push(layout, UiElementType::Line, 0, button_rect, 40, "AUDIO");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Slider, SettingsButtonType::Volume, button_rect, 40, "VOLUME:");
+        button_rect.y += button_rect.height + BUTTON_SPACING;
+
+        constexpr f32 SMALL_BUTTON_SIZE = 150.f;
+        button_rect.x += (button_rect.width - SMALL_BUTTON_SIZE) / 2.f;
+        button_rect.width = SMALL_BUTTON_SIZE;
+        ui_layout_push_control(layout, UiElementType::Button, SettingsButtonType::Back, button_rect, 20, "BACK");
+    }
+
+    woc_internal void ui_layout_build_credits(UiLayout& layout, Vector2 framebuffer_size)
+    {
+        auto label_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.16f}, Vector2 { framebuffer_size.x, 50.f }, Vector2{0.5f, 0.0f});
+        ui_layout_push_label(layout, label_rect, 40, "Developed by:");
+        label_rect.y += label_rect.height + BUTTON_SPACING;
+        label_rect.height = 100.f;
+        ui_layout_push_label(layout, label_rect, 80, "Oliver Jorgensen");
+        label_rect.y += label_rect.height + BUTTON_SPACING * 3;
+        label_rect.height = 50.f;
+        
+        ui_layout_push_label(layout, label_rect, 40, "Background Music:");
+        label_rect.y += label_rect.height + BUTTON_SPACING;
+        ui_layout_push_label(layout, label_rect, 40, "Cozy - Composed by One Man Symphony");
+        label_rect.y += label_rect.height + BUTTON_SPACING;
+        ui_layout_push_label(layout, label_rect, 40, "https://onemansymphony.bandcamp.com");
+        label_rect.y += label_rect.height + BUTTON_SPACING * 3;
+        
+        ui_layout_push_label(layout, label_rect, 40, "Sound Effects & Icons");
+        label_rect.y += label_rect.height + BUTTON_SPACING;
+        ui_layout_push_label(layout, label_rect, 40, "Created by Kenney");
+        label_rect.y += label_rect.height + BUTTON_SPACING;
+        ui_layout_push_label(layout, label_rect, 40, "https://kenney.nl");
+        label_rect.y += label_rect.height + BUTTON_SPACING * 3;
+        
+        auto button_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.75f}, Vector2 { 300.f, 50.f }, Vector2{0.5f, 0.0f});
+        button_rect.y = label_rect.y;
+        ui_layout_push_control(layout, UiElementType::Button, CreditsButtonType::Back, button_rect, 20, "BACK");
+    }
+
+    woc_internal void ui_layout_build_level_end(UiLayout& layout, Vector2 framebuffer_size, const char* title, i32 title_state, GameButtonType button, const char* button_text)
+    {
+        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
+        title_rect.y -= title_rect.height + 40;
+        ui_layout_push_label(layout, title_rect, 125, title, title_state);
+        
+        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
+        ui_layout_push_control(layout, UiElementType::Button, button, primary_buttons_rect, 65, button_text);
+    }
+
+    woc_internal void ui_layout_build_game_won(UiLayout& layout, Vector2 framebuffer_size)
+    {
+        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
+        title_rect.y -= title_rect.height + 2 * BUTTON_SPACING;
+        ui_layout_push_label(layout, title_rect, 125, "YOU WON!");
+        title_rect.y -= title_rect.height + 2 * BUTTON_SPACING;
+        ui_layout_push_label(layout, title_rect, 125, "CONGRATULATIONS!");
+        
+        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
+        ui_layout_push_control(layout, UiElementType::Button, GameButtonType::BackToMenu, primary_buttons_rect, 65, "TO MENU");
+        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, GameButtonType::Endless, primary_buttons_rect, 65, "ENDLESS");
+        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
+        ui_layout_push_control(layout, UiElementType::Button, GameButtonType::Credits, primary_buttons_rect, 65, "CREDITS");
+    }
+
+    woc_internal void ui_layout_build(UiLayout& layout, UiPage page, Vector2 framebuffer_size)
+    {
+        layout.valid = true;
+        layout.framebuffer_size = framebuffer_size;
+        layout.element_count = 0;
+        switch (page)
+        {
+            case UiPage::MainMenu:
+                ui_layout_build_main_menu(layout, framebuffer_size);
+                break;
+            case UiPage::Settings:
+                ui_layout_build_settings(layout, framebuffer_size);
+                break;
+            case UiPage::Credits:
+                ui_layout_build_credits(layout, framebuffer_size);
+                break;
+            case UiPage::LevelComplete:
+                ui_layout_build_level_end(layout, framebuffer_size, "LEVEL COMPLETE", STATE_NORMAL, GameButtonType::NextLevel, "NEXT LEVEL");
+                break;
+            case UiPage::LevelFail:
+                ui_layout_build_level_end(layout, framebuffer_size, "NOT QUITE...", STATE_FOCUSED, GameButtonType::TryAgain, "TRY AGAIN");
+                break;
+            case UiPage::GameWon:
+                ui_layout_build_game_won(layout, framebuffer_size);
+                break;
+            case UiPage::MAX:
+                assert(false);
+                break;
+        }
+
+        // Labels are drawn centered in their bounds like GuiLabel would, but measured only once here.
+        auto font = GuiGetFont();
+        auto spacing = static_cast<f32>(GuiGetStyle(DEFAULT, TEXT_SPACING));
+        for (u32 i = 0; i < layout.element_count; i++)
+        {
+            auto& element = layout.elements.at(i);
+            if (element.type != UiElementType::Label)
+            {
+                continue;
+            }
+            auto text_size = static_cast<f32>(element.text_size);
+            auto extent = MeasureTextEx(font, element.text, text_size, spacing);
+            element.text_pos = Vector2 {
+                element.bounds.x + (element.bounds.width - extent.x) * 0.5f,
+                element.bounds.y + (element.bounds.height - text_size) * 0.5f
+            };
+        }
+
+        std::stable_sort(layout.elements.begin(), layout.elements.begin() + layout.element_count, [] (const UiElement& a, const UiElement& b)
+        {
+            return a.text_size > b.text_size;
+        });
+    }
+
+    woc_internal UiLayout& renderer_ui_layout(Renderer& renderer, UiPage page, Vector2 framebuffer_size)
+    {
+        auto& layout = renderer.ui_layouts.at(static_cast<size_t>(page));
+        if (!layout.valid || !Vector2Equals(layout.framebuffer_size, framebuffer_size))
+        {
+            auto previous_tag = memory_tag_push(MemoryTag::UI);
+            ui_layout_build(layout, page, framebuffer_size);
+            memory_tag_pop(previous_tag);
+        }
+        return layout;
+    }
+
+    woc_internal void renderer_ui_set_text_size(Renderer& renderer, i32 text_size)
+    {
+        if (renderer.ui_text_size != text_size)
+        {
+            GuiSetStyle(DEFAULT, TEXT_SIZE, text_size);
+            renderer.ui_text_size = text_size;
+        }
+    }
+
+    // Draws labels and lines. Returns false for controls, which the page handles itself.
+    woc_internal bool renderer_ui_static_element(Renderer& renderer, UiElement& element)
+    {
+        renderer_ui_set_text_size(renderer, element.text_size);
+        switch (element.type)
+        {
+            case UiElementType::Label:
+            {
+                auto color = GetColor(static_cast<u32>(GuiGetStyle(LABEL, TEXT_COLOR_NORMAL + element.gui_state * 3)));
+                auto spacing = static_cast<f32>(GuiGetStyle(DEFAULT, TEXT_SPACING));
+                DrawTextEx(GuiGetFont(), element.text, element.text_pos, static_cast<f32>(element.text_size), spacing, color);
+                return true;
+            }
+            case UiElementType::Line:
+            {
+                GuiLine(element.bounds, element.text);
+                return true;
+            }
+            default:
+            {
+                return false;
+            }
+        }
     }
 
     woc_internal bool renderer_ui_button(
@@ -709,156 +1413,242 @@ namespace woc
     }
 
     void renderer_update_and_render_menu(Renderer& renderer, MenuState& menu_state, std::optional<GameState>& game_state, AudioState& audio_state, Vector2 framebuffer_size) {
-        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
-        title_rect.y -= title_rect.height + 40;
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 125);
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
-        GuiLabel(title_rect, "Winds of Change");
-        
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 65);
-        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
-        auto secondary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 300.f, 60.f }, Vector2{0.5f, 0.0f});
-        auto& continue_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(MainMenuButtonType::Continue));
-        if (!game_state)
+        auto& layout = renderer_ui_layout(renderer, UiPage::MainMenu, framebuffer_size);
+        for (u32 i = 0; i < layout.element_count; i++)
         {
-            GuiSetState(STATE_DISABLED);
-        }
-        if (renderer_ui_button(primary_buttons_rect, "CONTINUE", continue_hover, audio_state, continue_hover))
-        {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::Game);
+            auto& element = layout.elements.at(i);
+            if (renderer_ui_static_element(renderer, element))
+            {
+                continue;
+            }
+
+            auto& hover = menu_state.buttons_hover_state.at(element.button);
+            switch (static_cast<MainMenuButtonType>(element.button))
+            {
+                case MainMenuButtonType::Continue:
+                {
+                    if (!game_state)
+                    {
+                        GuiSetState(STATE_DISABLED);
+                    }
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::Game);
+                    }
+                    GuiSetState(STATE_NORMAL);
+                    break;
+                }
+                case MainMenuButtonType::NewGame:
+                {
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::Game);
+                        game_state = game_init(START_LEVEL);
+                    }
+                    break;
+                }
+                case MainMenuButtonType::Settings:
+                {
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::Settings);
+                    }
+                    break;
+                }
+                case MainMenuButtonType::Credits:
+                {
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::Credits);
+                    }
+                    break;
+                }
+                case MainMenuButtonType::Editor:
+                {
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::Editor);
+                    }
+                    break;
+                }
+                case MainMenuButtonType::Quit:
+                {
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::Quit);
+                    }
+                    break;
+                }
+            }
         }
+    }
+
+    void renderer_update_and_render_settings(Renderer& renderer, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size)
+    {
+        auto& layout = renderer_ui_layout(renderer, UiPage::Settings, framebuffer_size);
         GuiSetState(STATE_NORMAL);
-        
-        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
-        secondary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
-        
-        auto& new_game_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(MainMenuButtonType::NewGame));
-        if (renderer_ui_button(primary_buttons_rect, "NEW GAME", new_game_hover, audio_state, new_game_hover))
+        for (u32 i = 0; i < layout.element_count; i++)
         {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::Game);
-            game_state = game_init(START_LEVEL);
+            auto& element = layout.elements.at(i);
+            if (renderer_ui_static_element(renderer, element))
+            {
+                continue;
+            }
+
+            auto& hover = menu_state.buttons_hover_state.at(element.button);
+            switch (static_cast<SettingsButtonType>(element.button))
+            {
+                case SettingsButtonType::Fullscreen:
+                {
+                    renderer_ui_toggle_button(element.bounds, element.text, hover, audio_state, hover, menu_state.is_fullscreen);
+                    break;
+                }
+                case SettingsButtonType::Resolution:
+                {
+                    if (menu_state.is_fullscreen)
+                    {
+                        GuiSetState(STATE_DISABLED);
+                    }
+                    i32 current_res = static_cast<i32>(menu_state.resolution);
+                    GuiComboBox(element.bounds, element.text, &current_res);
+                    menu_state.resolution = static_cast<ResolutionPreset>(current_res);
+                    assert(menu_state.resolution < ResolutionPreset::MAX);
+                    GuiSetState(STATE_NORMAL);
+                    break;
+                }
+                case SettingsButtonType::Volume:
+                {
+                    GuiSlider(element.bounds, element.text, "", &menu_state.volume, 0.0f, 1.0f);
+                    break;
+                }
+                case SettingsButtonType::RenderScale:
+                {
+                    GuiSlider(element.bounds, element.text, "", &menu_state.render_scale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+                    break;
+                }
+                case SettingsButtonType::DynamicResolution:
+                {
+                    renderer_ui_toggle_button(element.bounds, element.text, hover, audio_state, hover, menu_state.dynamic_resolution);
+                    break;
+                }
+                case SettingsButtonType::Back:
+                {
+                    if (renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+                    {
+                        audio_play_sound(audio_state, AudioType::UIPageChange);
+                        menu_change_page(menu_state, MenuPageType::MainMenu);
+                    }
+                    break;
+                }
+            }
         }
-        
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 40);
-        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
-        secondary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
-        auto& settings_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(MainMenuButtonType::Settings));
-        if (renderer_ui_button(secondary_buttons_rect, "SETTINGS", settings_hover, audio_state, settings_hover))
+    }
+    
+    void renderer_update_and_render_credits(Renderer& renderer, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size)
+    {
+        auto& layout = renderer_ui_layout(renderer, UiPage::Credits, framebuffer_size);
+        for (u32 i = 0; i < layout.element_count; i++)
         {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::Settings);
-        }
-        
-        secondary_buttons_rect.y += secondary_buttons_rect.height + BUTTON_SPACING;
-        auto& credits_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(MainMenuButtonType::Credits));
+            auto& element = layout.elements.at(i);
+            if (renderer_ui_static_element(renderer, element))
+            {
+                continue;
+            }
 
-        if (renderer_ui_button(secondary_buttons_rect, "CREDITS", credits_hover, audio_state, credits_hover))
-        {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::Credits);
-        }
-        
-        secondary_buttons_rect.y += secondary_buttons_rect.height + BUTTON_SPACING;
-        auto& quit_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(MainMenuButtonType::Quit));
-        if (renderer_ui_button(secondary_buttons_rect, "QUIT", quit_hover, audio_state, quit_hover))
-        {
-            audio_play_sound_randomize_pitch(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::Quit);
+            auto& back_hover = menu_state.buttons_hover_state.at(element.button);
+            if (renderer_ui_button(element.bounds, element.text, back_hover, audio_state, back_hover))
+            {
+                audio_play_sound(audio_state, AudioType::UIPageChange);
+                menu_change_page(menu_state, MenuPageType::MainMenu);
+            }
         }
     }
 
-    void renderer_update_and_render_settings(Renderer& renderer, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size)
+    // Returns the size of the region the world gets drawn into.
+    woc_internal Vector2 renderer_begin_world_target(Renderer& renderer, Vector2 framebuffer_size)
     {
-        auto button_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.3f}, Vector2 { 300.f, 50.f }, Vector2{0.5f, 0.0f});
-        auto& back_hover = menu_state.buttons_hover_state.at((size_t)SettingsButtonType::Back);
-        GuiSetState(STATE_NORMAL);
-        
-        GuiLine(button_rect, "WINDOW");
-        button_rect.y += button_rect.height + BUTTON_SPACING;
-        if (renderer_ui_toggle_button(button_rect, "FULLSCREEN", back_hover, audio_state, back_hover, menu_state.is_fullscreen))
+        auto& target = renderer.world_target;
+        auto fb_width = std::max(1, static_cast<i32>(framebuffer_size.x));
+        auto fb_height = std::max(1, static_cast<i32>(framebuffer_size.y));
+        if (target.id == 0 || target.texture.width != fb_width || target.texture.height != fb_height)
         {
+            if (target.id != 0)
+            {
+                UnloadRenderTexture(target);
+            }
+            target = LoadRenderTexture(fb_width, fb_height);
+            SetTextureFilter(target.texture, TEXTURE_FILTER_BILINEAR);
+            renderer_account_textures(renderer);
         }
-        button_rect.y += button_rect.height + BUTTON_SPACING;
 
-        if (menu_state.is_fullscreen)
-        {
-            GuiSetState(STATE_DISABLED);
-        }
-        i32 current_res = static_cast<i32>(menu_state.resolution);
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 20);
-        button_rect.width /= static_cast<f32>(static_cast<u32>(ResolutionPreset::MAX));
-        constexpr auto RESOLUTION_TEXT = "1600x900;1920x1080";
-        GuiToggleGroup(button_rect, RESOLUTION_TEXT, &current_res);
-        menu_state.resolution = static_cast<ResolutionPreset>(current_res);
-        assert(menu_state.resolution < ResolutionPreset::MAX);
-        button_rect.y += button_rect.height + BUTTON_SPACING;
-        button_rect.width *= static_cast<f32>(static_cast<u32>(ResolutionPreset::MAX));
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 40);
-        GuiSetState(STATE_NORMAL);
+        auto scale = Clamp(renderer.world_render_scale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+        auto width = std::max(1, static_cast<i32>(static_cast<f32>(fb_width) * scale));
+        auto height = std::max(1, static_cast<i32>(static_cast<f32>(fb_height) * scale));
         
-        GuiLine(button_rect, "AUDIO");
-        button_rect.y += button_rect.height + BUTTON_SPACING;
-
-        GuiSlider(button_rect, "VOLUME:", "", &menu_state.volume, 0.0f, 1.0f);
-        button_rect.y += button_rect.height + BUTTON_SPACING;
-
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 20);
+        BeginTextureMode(target);
+        // BeginTextureMode sets up the whole texture. Narrow it to the scaled region.
+        rlViewport(0, 0, width, height);
+        rlMatrixMode(RL_PROJECTION);
+        rlLoadIdentity();
+        rlOrtho(0, width, height, 0, 0.0, 1.0);
+        rlMatrixMode(RL_MODELVIEW);
+        rlLoadIdentity();
+        ClearBackground(BACKGROUND_COLOR);
+        
+        return Vector2 { static_cast<f32>(width), static_cast<f32>(height) };
+    }
 
-        constexpr f32 SMALL_BUTTON_SIZE = 150.f;
-        button_rect.x += (button_rect.width - SMALL_BUTTON_SIZE) / 2.f;
-        button_rect.width = SMALL_BUTTON_SIZE;
-        if (renderer_ui_button(button_rect, "BACK", back_hover, audio_state, back_hover))
-        {
-            audio_play_sound(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::MainMenu);
-        }
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 40);
+    woc_internal void renderer_end_world_target(Renderer& renderer, Vector2 framebuffer_size, Vector2 target_size)
+    {
+        EndTextureMode();
+        // Render textures are stored bottom-up, so the negative height flips the region back upright.
+        auto source = Rectangle { 0.f, 0.f, target_size.x, -target_size.y };
+        auto dest = Rectangle { 0.f, 0.f, framebuffer_size.x, framebuffer_size.y };
+        DrawTexturePro(renderer.world_target.texture, source, dest, Vector2Zero(), 0.f, WHITE);
     }
-    
-    void renderer_update_and_render_credits(Renderer& renderer, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size)
+
+    void renderer_draw_enemy(EnemyState& e)
     {
-        auto label_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.16f}, Vector2 { framebuffer_size.x, 50.f }, Vector2{0.5f, 0.0f});
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 40);
-        GuiLabel(label_rect, "Developed by:");
-        label_rect.y += label_rect.height + BUTTON_SPACING;
-        label_rect.height = 100.f;
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 80);
-        GuiLabel(label_rect, "Oliver Jorgensen");
-        label_rect.y += label_rect.height + BUTTON_SPACING * 3;
-        label_rect.height = 50.f;
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 40);
-        
-        GuiLabel(label_rect, "Background Music:");
-        label_rect.y += label_rect.height + BUTTON_SPACING;
-        GuiLabel(label_rect, "Cozy - Composed by One Man Symphony");
-        label_rect.y += label_rect.height + BUTTON_SPACING;
-        GuiLabel(label_rect, "https://onemansymphony.bandcamp.com");
-        label_rect.y += label_rect.height + BUTTON_SPACING * 3;
-        
-        GuiLabel(label_rect, "Sound Effects & Icons");
-        label_rect.y += label_rect.height + BUTTON_SPACING;
-        GuiLabel(label_rect, "Created by Kenney");
-        label_rect.y += label_rect.height + BUTTON_SPACING;
-        GuiLabel(label_rect, "https://kenney.nl");
-        label_rect.y += label_rect.height + BUTTON_SPACING * 3;
-        
-        auto button_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.75f}, Vector2 { 300.f, 50.f }, Vector2{0.5f, 0.0f});
-        button_rect.y = label_rect.y;
+        auto half_size = Vector2Scale(e.size, 0.5f);
+        auto disp = Vector2 { -half_size.x, -half_size.y };
+        disp = Vector2Rotate(disp, e.rot.val);
+        auto e_rect = Rectangle {e.pos.x + disp.x, e.pos.y + disp.y, e.size.x, e.size.y };
         
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 20);
-        auto& back_hover = menu_state.buttons_hover_state.at((size_t)CreditsButtonType::Back);
-        if (renderer_ui_button(button_rect, "BACK", back_hover, audio_state, back_hover))
+        auto border_disp = Vector2Rotate({ 3.f, 3.f}, e.rot.val);
+        switch (e.type)
         {
-            audio_play_sound(audio_state, AudioType::UIPageChange);
-            menu_change_page(menu_state, MenuPageType::MainMenu);
+            case EnemyType::Indestructible: {
+                auto border_rect = e_rect;
+                border_rect.height += 6;
+                border_rect.width += 6;
+                border_rect.x -= border_disp.x;
+                border_rect.y -= border_disp.y;
+                DrawRectanglePro(border_rect, Vector2Zero(), e.rot.val * RAD2DEG, BLACK);
+                DrawRectanglePro(e_rect, Vector2Zero(), e.rot.val * RAD2DEG, INDESTRUCTIBLE_WALL_COLOR);
+                counters_add(Counter::DrawCalls, 2);
+                break;
+            }
+            case EnemyType::Normal: {
+                auto health_rect = e_rect;
+                for (auto i = 0; i < e.health; i++)
+                {
+                    health_rect.x -= border_disp.x;
+                    health_rect.y -= border_disp.y;
+                    health_rect.height += 6;
+                    health_rect.width += 6;
+                    DrawRectanglePro(health_rect, Vector2Zero(), e.rot.val * RAD2DEG, WHITE);
+                }
+                DrawRectanglePro(e_rect, Vector2Zero(), e.rot.val * RAD2DEG, WALL_COLOR);
+                counters_add(Counter::DrawCalls, static_cast<u64>(std::max(e.health, 0)) + 1);
+                break;
+            }
         }
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 40);
-        button_rect.y += button_rect.height + BUTTON_SPACING;
-
-        // Background music credits
     }
 
     void renderer_render_world(Renderer& renderer, GameState& game_state, Vector2 framebuffer_size)
@@ -866,85 +1656,117 @@ namespace woc
         auto& cam = game_state.cam;
         auto& player = game_state.player;
 
+        auto target_size = renderer_begin_world_target(renderer, framebuffer_size);
         BeginMode2D(Camera2D{
-            .offset = Vector2Scale(framebuffer_size, 0.5),
+            .offset = Vector2Scale(target_size, 0.5),
             .target = cam.pos,
             .rotation = cam.rot.val * RAD2DEG,
-            .zoom = (framebuffer_size.y / cam.height) * cam.zoom
+            .zoom = (target_size.y / cam.height) * cam.zoom
         });
 
-        auto player_half_size = Vector2Scale(player_size(), 0.5f);
-        auto player_rect = Rectangle { player.pos_x - player_half_size.x, PLAYER_WORLD_Y - player_half_size.y, PLAYER_DEFAULT_WIDTH, PLAYER_DEFAULT_HEIGHT };
-        DrawRectanglePro(player_rect, Vector2Zero(), 0.f, PLAYER_COLOR);
-        DrawRectangleLinesEx(player_rect, 1.0f, BLACK);
-        
-        for (auto& e : game_state.enemies)
+        // Everything below is culled against the view, so large worlds cost what's on screen. The margin covers
+        // what's drawn past an object's bounds, like a wall's health outlines.
+        constexpr f32 VIEW_MARGIN = 32.f;
+        // Culls against the camera's aspect even when the target is narrower, which only draws a little extra.
+        Vector2 view_min, view_max;
+        camera_view_bounds(cam, VIEW_MARGIN, view_min, view_max);
+
+        u64 draws = 0;
+        if (auto& field = game_state.wind_field; !field.x.empty())
         {
-            auto half_size = Vector2Scale(e.size, 0.5f);
-            auto disp = Vector2 { -half_size.x, -half_size.y };
-            disp = Vector2Rotate(disp, e.rot.val);
-            auto e_rect = Rectangle {e.pos.x + disp.x, e.pos.y + disp.y, e.size.x, e.size.y };
-            
-            auto border_disp = Vector2Rotate({ 3.f, 3.f}, e.rot.val);
-            switch (e.type)
+            constexpr f32 ARROW_SCALE = 20.f;
+            constexpr f32 MIN_ARROW_FORCE = 0.05f;
+            auto node_range = [cell = field.cell_size] (f32 min, f32 max, f32 origin, u32 count, u32& first, u32& last)
             {
-                case EnemyType::Indestructible: {
-                    auto border_rect = e_rect;
-                    border_rect.height += 6;
-                    border_rect.width += 6;
-                    border_rect.x -= border_disp.x;
-                    border_rect.y -= border_disp.y;
-                    DrawRectanglePro(border_rect, Vector2Zero(), e.rot.val * RAD2DEG, BLACK);
-                    DrawRectanglePro(e_rect, Vector2Zero(), e.rot.val * RAD2DEG, INDESTRUCTIBLE_WALL_COLOR);
-
-                    break;
-                }
-                case EnemyType::Normal: {
-                    auto health_rect = e_rect;
-                    for (auto i = 0; i < e.health; i++)
+                first = static_cast<u32>(std::clamp(std::floor((min - origin) / cell), 0.f, static_cast<f32>(count)));
+                last = static_cast<u32>(std::clamp(std::ceil((max - origin) / cell) + 1.f, 0.f, static_cast<f32>(count)));
+            };
+            u32 first_x, last_x, first_y, last_y;
+            node_range(view_min.x, view_max.x, field.origin.x, field.width, first_x, last_x);
+            node_range(view_min.y, view_max.y, field.origin.y, field.height, first_y, last_y);
+            for (u32 y = first_y; y < last_y; y++)
+            {
+                for (u32 x = first_x; x < last_x; x++)
+                {
+                    auto i = y * field.width + x;
+                    auto force = Vector2 { field.x.at(i), field.y.at(i) };
+                    if (Vector2LengthSqr(force) < MIN_ARROW_FORCE * MIN_ARROW_FORCE)
                     {
-                        health_rect.x -= border_disp.x;
-                        health_rect.y -= border_disp.y;
-                        health_rect.height += 6;
-                        health_rect.width += 6;
-                        DrawRectanglePro(health_rect, Vector2Zero(), e.rot.val * RAD2DEG, WHITE);
+                        continue;
                     }
-                    DrawRectanglePro(e_rect, Vector2Zero(), e.rot.val * RAD2DEG, WALL_COLOR);
-                    break;
+                    auto from = Vector2 { field.origin.x + static_cast<f32>(x) * field.cell_size, field.origin.y + static_cast<f32>(y) * field.cell_size };
+                    auto to = Vector2Add(from, Vector2Scale(force, ARROW_SCALE));
+                    DrawLineEx(from, to, 2.f, WIND_FIELD_COLOR);
+                    DrawCircleV(to, 3.f, WIND_FIELD_COLOR);
+                    draws += 2;
                 }
             }
         }
+
+        auto player_half_size = Vector2Scale(player_size(), 0.5f);
+        auto draw_player = [&] (PlayerState& player, Color color)
+        {
+            auto player_rect = Rectangle { player.pos_x - player_half_size.x, PLAYER_WORLD_Y - player_half_size.y, PLAYER_DEFAULT_WIDTH, PLAYER_DEFAULT_HEIGHT };
+            DrawRectanglePro(player_rect, Vector2Zero(), 0.f, color);
+            DrawRectangleLinesEx(player_rect, 1.0f, BLACK);
+            draws += 2;
+        };
+        draw_player(player, PLAYER_COLOR);
+        if (game_state.second_player)
+        {
+            draw_player(*game_state.second_player, SECOND_PLAYER_COLOR);
+        }
         
-        for (auto& e : game_state.dead_enemy_effects)
+        // A state nothing built the broadphase for yet has all its walls drawn.
+        auto& visible_walls = renderer.visible_walls;
+        if (game_state.broadphase.cells.size() == game_state.enemies.size())
+        {
+            broadphase_query_all(game_state.broadphase, view_min, view_max, visible_walls);
+        } else {
+            visible_walls.clear();
+            for (u32 i = 0; i < game_state.enemies.size(); i++)
+            {
+                visible_walls.emplace_back(i);
+            }
+        }
+        for (auto i : visible_walls)
         {
-            auto alpha = e.timer / ENEMY_DEAD_EFFECT_DURATION;
-            auto alpha_eased = ease_in_back(alpha);
-            auto size = Vector2Scale(e.size, alpha_eased);
-            auto half_size = Vector2Scale(size, 0.5f);
-            auto disp = Vector2 { -half_size.x, -half_size.y };
-            disp = Vector2Rotate(disp, e.rot.val);
-            auto e_rect = Rectangle {e.pos.x + disp.x, e.pos.y + disp.y, size.x, size.y };
-            DrawRectanglePro(e_rect, Vector2Zero(), e.rot.val * RAD2DEG, WHITE);
+            renderer_draw_enemy(game_state.enemies.at(i));
         }
+        counters_set(Counter::VisibleWalls, visible_walls.size());
         
         if (game_state.player.balls_available)
         {
             DrawCircleLinesV(Vector2Add(player_pos(player), Vector2 { 0.f, -BALL_DEFAULT_Y_OFFSET}), BALL_DEFAULT_RADIUS, BALL_COLOR);
+            draws++;
         }
-        
-        for (auto& projectile : game_state.player_projectiles)
+        if (game_state.second_player && game_state.second_player->balls_available)
         {
-            DrawCircleV(projectile.pos, BALL_DEFAULT_RADIUS, BALL_COLOR);
+            DrawCircleLinesV(Vector2Add(player_pos(*game_state.second_player), Vector2 { 0.f, -BALL_DEFAULT_Y_OFFSET}), BALL_DEFAULT_RADIUS, SECOND_BALL_COLOR);
+            draws++;
         }
-        for (auto& p : game_state.dead_projectile_effects)
+        
+        for (auto& projectile : game_state.player_projectiles)
         {
-            auto alpha = p.timer / PROJECTILE_DEAD_EFFECT_DURATION;
-            auto alpha_eased = ease_in_back(alpha);
-            auto size = BALL_DEFAULT_RADIUS * alpha_eased;
-            DrawCircleV(p.pos, size, WHITE);
+            if (CheckCollisionPointRec(projectile.pos, Rectangle { view_min.x, view_min.y, view_max.x - view_min.x, view_max.y - view_min.y }))
+            {
+                DrawCircleV(projectile.pos, BALL_DEFAULT_RADIUS, projectile.owner == 0 ? BALL_COLOR : SECOND_BALL_COLOR);
+                draws++;
+            }
         }
+        draws += particles_draw(renderer.particles, view_min, view_max);
+        counters_add(Counter::DrawCalls, draws);
 
         EndMode2D();
+        // Past the camera's aspect there can be walls that are asleep, so wider targets get bars at the sides.
+        auto shown_width = std::min(target_size.x, target_size.y * cam.aspect);
+        if (shown_width < target_size.x)
+        {
+            auto bar_width = (target_size.x - shown_width) * 0.5f;
+            DrawRectangleRec(Rectangle { 0.f, 0.f, bar_width, target_size.y }, BACKGROUND_COLOR);
+            DrawRectangleRec(Rectangle { target_size.x - bar_width, 0.f, bar_width, target_size.y }, BACKGROUND_COLOR);
+        }
+        renderer_end_world_target(renderer, framebuffer_size, target_size);
 
         auto balls_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2 { 1.0, 1.0f }, Vector2 { ICON_SIZE, ICON_SIZE }, Vector2 { 1.0, 1.0f });
         balls_rect.y -= ICON_SPACING / 2.f;
@@ -1014,18 +1836,20 @@ namespace woc
         overlay_color.a = static_cast<u8>(Lerp(225.f, 0.f, game_state.time_scale * game_state.time_scale));
         DrawRectangle(0, 0, fbx, fby, overlay_color);
         
-        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
-        title_rect.y -= title_rect.height + 40;
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 125);
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
-        GuiLabel(title_rect, "LEVEL COMPLETE");
-        
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 65);
-        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
-        auto& next_level_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(GameButtonType::NextLevel));
-        if (renderer_ui_button(primary_buttons_rect, "NEXT LEVEL", next_level_hover, audio_state, next_level_hover))
+        auto& layout = renderer_ui_layout(renderer, UiPage::LevelComplete, framebuffer_size);
+        for (u32 i = 0; i < layout.element_count; i++)
         {
-            game_state = game_init(game_state.current_level+1);
+            auto& element = layout.elements.at(i);
+            if (renderer_ui_static_element(renderer, element))
+            {
+                continue;
+            }
+
+            auto& next_level_hover = menu_state.buttons_hover_state.at(element.button);
+            if (renderer_ui_button(element.bounds, element.text, next_level_hover, audio_state, next_level_hover))
+            {
+                game_state = game_init(game_state.current_level+1);
+            }
         }
     }
     
@@ -1037,20 +1861,20 @@ namespace woc
         overlay_color.a = static_cast<u8>(Lerp(225.f, 0.f, game_state.time_scale * game_state.time_scale));
         DrawRectangle(0, 0, fbx, fby, overlay_color);
         
-        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
-        title_rect.y -= title_rect.height + 40;
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 125);
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
-        GuiSetState(STATE_FOCUSED);
-        GuiLabel(title_rect, "NOT QUITE...");
-        GuiSetState(STATE_NORMAL);
-        
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 65);
-        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
-        auto& try_again_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(GameButtonType::TryAgain));
-        if (renderer_ui_button(primary_buttons_rect, "TRY AGAIN", try_again_hover, audio_state, try_again_hover))
+        auto& layout = renderer_ui_layout(renderer, UiPage::LevelFail, framebuffer_size);
+        for (u32 i = 0; i < layout.element_count; i++)
         {
-            game_state = game_init(game_state.current_level);
+            auto& element = layout.elements.at(i);
+            if (renderer_ui_static_element(renderer, element))
+            {
+                continue;
+            }
+
+            auto& try_again_hover = menu_state.buttons_hover_state.at(element.button);
+            if (renderer_ui_button(element.bounds, element.text, try_again_hover, audio_state, try_again_hover))
+            {
+                game_state = game_init(game_state.current_level);
+            }
         }
     }
     
@@ -1062,34 +1886,110 @@ namespace woc
         overlay_color.a = static_cast<u8>(Lerp(225.f, 0.f, game_state->time_scale * game_state->time_scale));
         DrawRectangle(0, 0, fbx, fby, overlay_color);
         
-        auto title_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5}, Vector2 { framebuffer_size.x, 150.f }, Vector2{0.5f, 0.0f});
-        title_rect.y -= title_rect.height + 2 * BUTTON_SPACING;
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 125);
-        GuiSetStyle(LABEL, TEXT_ALIGNMENT, TEXT_ALIGN_CENTER);
-        GuiLabel(title_rect, "YOU WON!");
-        title_rect.y -= title_rect.height + 2 * BUTTON_SPACING;
-        GuiLabel(title_rect, "CONGRATULATIONS!");
-        
-        GuiSetStyle(DEFAULT, TEXT_SIZE, 65);
-        auto primary_buttons_rect = ui_rectangle_from_anchor(framebuffer_size, Vector2{0.5f, 0.5f}, Vector2 { 400.f, 100.f }, Vector2{0.5f, 0.0f});
-        auto& back_to_main_menu = menu_state.buttons_hover_state.at(static_cast<size_t>(GameButtonType::BackToMenu));
-        if (renderer_ui_button(primary_buttons_rect, "TO MENU", back_to_main_menu, audio_state, back_to_main_menu))
+        auto& layout = renderer_ui_layout(renderer, UiPage::GameWon, framebuffer_size);
+        for (u32 i = 0; i < layout.element_count; i++)
         {
-            menu_change_page(menu_state, MenuPageType::MainMenu);
-            game_state = std::nullopt;
+            auto& element = layout.elements.at(i);
+            if (renderer_ui_static_element(renderer, element))
+            {
+                continue;
+            }
+
+            auto& hover = menu_state.buttons_hover_state.at(element.button);
+            if (!renderer_ui_button(element.bounds, element.text, hover, audio_state, hover))
+            {
+                continue;
+            }
+            switch (static_cast<GameButtonType>(element.button))
+            {
+                case GameButtonType::BackToMenu:
+                {
+                    menu_change_page(menu_state, MenuPageType::MainMenu);
+                    game_state = std::nullopt;
+                    break;
+                }
+                case GameButtonType::Endless:
+                {
+                    game_state = game_init(ENDLESS_START_LEVEL);
+                    break;
+                }
+                case GameButtonType::Credits:
+                {
+                    menu_change_page(menu_state, MenuPageType::Credits);
+                    game_state = std::nullopt;
+                    break;
+                }
+                default:
+                {
+                    break;
+                }
+            }
         }
-        primary_buttons_rect.y += primary_buttons_rect.height + BUTTON_SPACING;
-        auto& credits_hover = menu_state.buttons_hover_state.at(static_cast<size_t>(GameButtonType::Credits));
-        if (renderer_ui_button(primary_buttons_rect, "CREDITS", credits_hover, audio_state, credits_hover))
+    }
+
+    void renderer_update_effects(Renderer& renderer, GameState& game_state, f32 frame_seconds)
+    {
+        constexpr f32 WALL_AREA_PER_SHARD = 120.f;
+        constexpr u32 WALL_DUST = 10;
+        constexpr u32 BALL_SPARKS = 24;
+        constexpr u32 BALL_DUST = 4;
+
+        auto& particles = renderer.particles;
+        if (renderer.effects_game_id != game_state.id)
+        {
+            particles_clear(particles);
+            renderer.effects_game_id = game_state.id;
+            renderer.effects_projectiles_seen = game_state.dead_projectile_effects_spawned;
+            renderer.effects_enemies_seen = game_state.dead_enemy_effects_spawned;
+        }
+        // A rewind takes the totals back, the deaths replayed after it are new again.
+        renderer.effects_projectiles_seen = std::min(renderer.effects_projectiles_seen, game_state.dead_projectile_effects_spawned);
+        renderer.effects_enemies_seen = std::min(renderer.effects_enemies_seen, game_state.dead_enemy_effects_spawned);
+
+        // Effects are appended as things die and expire oldest first, so the unseen ones are at the back.
+        auto& enemies = game_state.dead_enemy_effects;
+        auto new_enemies = std::min<size_t>(game_state.dead_enemy_effects_spawned - renderer.effects_enemies_seen, enemies.size());
+        for (auto i = enemies.size() - new_enemies; i < enemies.size(); i++)
         {
-            menu_change_page(menu_state, MenuPageType::Credits);
-            game_state = std::nullopt;
+            auto& e = enemies.at(i);
+            auto shards = static_cast<u32>(e.size.x * e.size.y / WALL_AREA_PER_SHARD);
+            particles_emit(particles, PARTICLE_SHARDS, e.pos, e.size, e.rot, Vector2Zero(), shards);
+            particles_emit(particles, PARTICLE_DUST, e.pos, e.size, e.rot, Vector2Zero(), WALL_DUST);
         }
+        auto& projectiles = game_state.dead_projectile_effects;
+        auto new_projectiles = std::min<size_t>(game_state.dead_projectile_effects_spawned - renderer.effects_projectiles_seen, projectiles.size());
+        for (auto i = projectiles.size() - new_projectiles; i < projectiles.size(); i++)
+        {
+            auto& p = projectiles.at(i);
+            auto ball_size = Vector2 { BALL_DEFAULT_RADIUS, BALL_DEFAULT_RADIUS };
+            particles_emit(particles, PARTICLE_SPARKS, p.pos, ball_size, Radian { 0.f }, p.dir, BALL_SPARKS);
+            particles_emit(particles, PARTICLE_DUST, p.pos, ball_size, Radian { 0.f }, Vector2Zero(), BALL_DUST);
+        }
+        renderer.effects_enemies_seen = game_state.dead_enemy_effects_spawned;
+        renderer.effects_projectiles_seen = game_state.dead_projectile_effects_spawned;
+
+        // Slows down with the rest of the game when a level ends.
+        particles_update(particles, frame_seconds * game_state.time_scale);
+        counters_set(Counter::Particles, particles.count);
     }
 
     void renderer_finalize_rendering(Renderer& renderer)
     {
+        if (renderer.capture)
+        {
+            capture_frame(*renderer.capture);
+        }
+        if (renderer.frame_limiter)
+        {
+            frame_limiter_wait(*renderer.frame_limiter);
+        }
         EndDrawing();
+        if (renderer.frame_limiter)
+        {
+            frame_limiter_presented(*renderer.frame_limiter);
+        }
+        renderer.frames_presented++;
+        counters_add(Counter::Frames, 1);
     }
 
     void renderer_prepare_rendering(Renderer& renderer)
@@ -1098,13 +1998,74 @@ namespace woc
         ClearBackground(BACKGROUND_COLOR);
     }
 
+    void renderer_update_render_scale(Renderer& renderer, MenuState& menu_state, f32 frame_seconds)
+    {
+        auto max_scale = Clamp(menu_state.render_scale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+        auto& dynamic = renderer.dynamic_resolution;
+        if (!menu_state.dynamic_resolution)
+        {
+            renderer.world_render_scale = max_scale;
+            dynamic.within_budget_timer = 0.f;
+            return;
+        }
+
+        // Page switches and window drags cause one-off long frames that say nothing about render cost.
+        constexpr f32 HITCH_SECONDS = 0.1f;
+        if (frame_seconds > HITCH_SECONDS)
+        {
+            return;
+        }
+
+        // The limiter measures work without its own wait or vsync's, against whatever rate it's presenting at.
+        // Without one the whole frame counts. Both thresholds sit below where adaptive mode drops to a slower
+        // rate, so resolution gives way first.
+        auto budget = DYNAMIC_RESOLUTION_BUDGET_SECONDS;
+        auto work_seconds = frame_seconds;
+        if (renderer.frame_limiter)
+        {
+            budget = static_cast<f32>(frame_limiter_interval(*renderer.frame_limiter));
+            work_seconds = static_cast<f32>(renderer.frame_limiter->work_seconds);
+        }
+        constexpr f32 AVERAGE_WEIGHT = 0.1f;
+        auto over_budget = budget * 0.9f;
+        auto within_budget = budget * 0.7f;
+        dynamic.average_work_seconds = Lerp(dynamic.average_work_seconds, work_seconds, AVERAGE_WEIGHT);
+        dynamic.settle_timer = std::max(0.f, dynamic.settle_timer - frame_seconds);
+        dynamic.within_budget_timer = dynamic.average_work_seconds <= within_budget ? dynamic.within_budget_timer + frame_seconds : 0.f;
+        if (dynamic.settle_timer > 0.f)
+        {
+            return;
+        }
+
+        // Work below budget doesn't say how much more resolution would fit, so scaling up is a probe: step up
+        // after a calm stretch and let the next over-budget average step it back down.
+        auto scale = renderer.world_render_scale;
+        if (dynamic.average_work_seconds > over_budget)
+        {
+            scale -= DYNAMIC_RESOLUTION_STEP;
+        } else if (dynamic.within_budget_timer > DYNAMIC_RESOLUTION_RAISE_SECONDS)
+        {
+            scale += DYNAMIC_RESOLUTION_STEP;
+            dynamic.within_budget_timer = 0.f;
+        }
+        scale = Clamp(scale, MIN_RENDER_SCALE, max_scale);
+        if (scale != renderer.world_render_scale)
+        {
+            renderer.world_render_scale = scale;
+            dynamic.settle_timer = DYNAMIC_RESOLUTION_SETTLE_SECONDS;
+        }
+    }
+
     MenuState menu_init(MenuPageType page, bool is_fullscreen, ResolutionPreset resolution)
     {
         auto result = MenuState {
             .current_page = page,
             .resolution = resolution,
+            .custom_resolution = Vector2 { 1600, 900 },
             .is_fullscreen = is_fullscreen,
             .volume = 1.0f,
+            .render_scale = MAX_RENDER_SCALE,
+            .dynamic_resolution = false,
             .buttons_hover_state = {}
         };
         return result;
@@ -1119,14 +2080,59 @@ namespace woc
         }
     }
 
-    Vector2 menu_resolution_to_size(ResolutionPreset resolution)
+    bool menu_page_is_static(MenuPageType page)
     {
-        switch (resolution)
+        return page == MenuPageType::MainMenu || page == MenuPageType::Settings || page == MenuPageType::Credits;
+    }
+
+    MenuIdleState menu_idle_init(MenuState& menu_state, f64 now_seconds)
+    {
+        auto result = MenuIdleState {
+            .last_activity_seconds = now_seconds,
+            .last_page = menu_state.current_page,
+            .last_resolution = menu_state.resolution,
+            .last_is_fullscreen = menu_state.is_fullscreen,
+            .last_volume = menu_state.volume,
+            .last_buttons_hover_state = menu_state.buttons_hover_state
+        };
+        return result;
+    }
+
+    bool menu_idle_update(MenuIdleState& idle_state, MenuState& menu_state, bool has_input_activity, f64 now_seconds)
+    {
+        bool menu_changed = idle_state.last_page != menu_state.current_page
+            || idle_state.last_resolution != menu_state.resolution
+            || idle_state.last_is_fullscreen != menu_state.is_fullscreen
+            || idle_state.last_volume != menu_state.volume
+            || idle_state.last_buttons_hover_state != menu_state.buttons_hover_state;
+        if (has_input_activity || menu_changed)
+        {
+            idle_state = menu_idle_init(menu_state, now_seconds);
+            return false;
+        }
+
+        return menu_page_is_static(menu_state.current_page)
+            && now_seconds - idle_state.last_activity_seconds > MENU_IDLE_GRACE_SECONDS;
+    }
+
+    Vector2 menu_resolution_to_size(MenuState& menu_state)
+    {
+        switch (menu_state.resolution)
         {
+        case ResolutionPreset::Resolution_1280x720:
+            return Vector2 { 1280, 720 };
         case ResolutionPreset::Resolution_1600x900:
             return Vector2 { 1600, 900 };
         case ResolutionPreset::Resolution_1920x1080:
             return Vector2 { 1920, 1080 };
+        case ResolutionPreset::Resolution_2560x1440:
+            return Vector2 { 2560, 1440 };
+        case ResolutionPreset::Resolution_3840x2160:
+            return Vector2 { 3840, 2160 };
+        case ResolutionPreset::Custom:
+            return menu_state.custom_resolution;
+        case ResolutionPreset::MAX:
+            break;
         }
 
         // Unhandled resolution preset
@@ -1138,10 +2144,20 @@ namespace woc
     {
         switch (resolution)
         {
+        case ResolutionPreset::Resolution_1280x720:
+            return "1280x720";
         case ResolutionPreset::Resolution_1600x900:
             return "1600x900";
         case ResolutionPreset::Resolution_1920x1080:
             return "1920x1080";
+        case ResolutionPreset::Resolution_2560x1440:
+            return "2560x1440";
+        case ResolutionPreset::Resolution_3840x2160:
+            return "3840x2160";
+        case ResolutionPreset::Custom:
+            return "CUSTOM";
+        case ResolutionPreset::MAX:
+            break;
         }
 
         // Unhandled resolution preset
@@ -1149,6 +2165,29 @@ namespace woc
         return "INVALID";
     }
 
+    const char* menu_page_title(MenuPageType page)
+    {
+        switch (page)
+        {
+        case MenuPageType::MainMenu:
+            return "main menu";
+        case MenuPageType::Game:
+            return "game";
+        case MenuPageType::Settings:
+            return "settings";
+        case MenuPageType::Quit:
+            return "quit";
+        case MenuPageType::Credits:
+            return "credits";
+        case MenuPageType::Editor:
+            return "editor";
+        }
+
+        // Unhandled page
+        assert(false);
+        return "INVALID";
+    }
+
     f32 ease_in_back(f32 alpha)
     {
         constexpr f32 c1 = 1.70158f;
@@ -1161,30 +2200,64 @@ namespace woc
         return alpha * alpha * alpha;
     }
 
-    AudioState audio_init()
+    u64 random_next(Random& random)
+    {
+        random.state += 0x9E3779B97F4A7C15ull;
+        u64 z = random.state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    f32 random_f32(Random& random, f32 min, f32 max)
+    {
+        auto unit = static_cast<f32>(random_next(random) >> 40) / static_cast<f32>(1ull << 24);
+        // Generated levels have to come out the same wherever the physics does.
+        return physics_mul_add(min, max - min, unit);
+    }
+
+    u32 random_u32(Random& random, u32 min, u32 max_inclusive)
+    {
+        assert(min <= max_inclusive);
+        auto range = static_cast<u64>(max_inclusive - min) + 1;
+        return min + static_cast<u32>(random_next(random) % range);
+    }
+
+    u64 random_hash(u64 a, u64 b)
+    {
+        auto random = Random { .state = a * 0xD1B54A32D192ED03ull ^ b };
+        return random_next(random);
+    }
+
+    AudioState audio_init(AssetPreload& preload)
     {
         InitAudioDevice();
 
+        auto previous_tag = memory_tag_push(MemoryTag::Audio);
         auto result = AudioState {
             .time_till_background_music = 0.f,
             .sounds{},
+            .defer_playback = false,
+            .deferred_sounds = {},
+            .sounds_played = 0
         };
-        result.sounds.at(static_cast<size_t>(AudioType::MusicBackground)) = LoadSound("assets/audio/cozy.ogg");
-        
-        result.sounds.at(static_cast<size_t>(AudioType::SFXIndestructibleImpact)) = LoadSound("assets/audio/impactTin_medium_004.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::SFXWallImpact)) = LoadSound("assets/audio/impactGlass_medium_004.ogg");
-        
-        result.sounds.at(static_cast<size_t>(AudioType::SFXSendBall)) = LoadSound("assets/audio/phaserUp3.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::SFXWind)) = LoadSound("assets/audio/phaseJump3.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::SFXBallDisappear)) = LoadSound("assets/audio/phaserDown3.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::SFXWallDisappear)) = LoadSound("assets/audio/pepSound5.ogg");
-        
-        result.sounds.at(static_cast<size_t>(AudioType::SFXLevelLost)) = LoadSound("assets/audio/error_003.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::SFXLevelWon)) = LoadSound("assets/audio/confirmation_003.ogg");
-        
-        result.sounds.at(static_cast<size_t>(AudioType::UIPageChange)) = LoadSound("assets/audio/card-slide-6.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::UIButtonHover)) = LoadSound("assets/audio/chips-handle-3.ogg");
-        result.sounds.at(static_cast<size_t>(AudioType::UIButtonClick)) = LoadSound("assets/audio/die-throw-1.ogg");
+        asset_preload_wait(preload);
+        for (u32 i = 0; i < result.sounds.size(); i++)
+        {
+            auto& wave = preload.waves.at(i);
+            result.sounds.at(i) = LoadSoundFromWave(wave);
+            UnloadWave(wave);
+            wave = Wave{};
+        }
+
+        // Decoded up front into raylib's buffers.
+        u64 sound_bytes = 0;
+        for (auto& sound : result.sounds)
+        {
+            sound_bytes += memory_sound_bytes(sound);
+        }
+        memory_set_external(MemoryTag::Audio, sound_bytes);
+        memory_tag_pop(previous_tag);
 
         return result;
     }
@@ -1195,20 +2268,33 @@ namespace woc
         {
             UnloadSound(sound);
         }
+        memory_set_external(MemoryTag::Audio, 0);
         CloseAudioDevice();
     }
 
     void audio_play_sound(AudioState& audio_state, AudioType sound_type)
     {
         assert(sound_type < AudioType::MAX_AUDIO_TYPE);
+        if (audio_state.defer_playback)
+        {
+            audio_state.deferred_sounds.emplace_back(DeferredSound { .type = sound_type, .randomize_pitch = false });
+            return;
+        }
         auto& sound = audio_state.sounds.at(static_cast<size_t>(sound_type));
         SetSoundPitch(sound, 1.0f);
         PlaySound(sound);
+        audio_state.sounds_played++;
+        counters_add(Counter::SoundsPlayed, 1);
     }
 
     void audio_play_sound_randomize_pitch(AudioState& audio_state, AudioType sound_type)
     {
         assert(sound_type < AudioType::MAX_AUDIO_TYPE);
+        if (audio_state.defer_playback)
+        {
+            audio_state.deferred_sounds.emplace_back(DeferredSound { .type = sound_type, .randomize_pitch = true });
+            return;
+        }
         i32 rand = GetRandomValue(0, 10000);
         f32 frand = static_cast<f32>(rand) / (10000.f * 0.5f) - 1.f;
         constexpr f32 PITCH_VARIATION = 0.10f;
@@ -1216,10 +2302,40 @@ namespace woc
         auto& sound = audio_state.sounds.at(static_cast<size_t>(sound_type));
         SetSoundPitch(sound, pitch);
         PlaySound(sound);
+        audio_state.sounds_played++;
+        counters_add(Counter::SoundsPlayed, 1);
     }
 
     void audio_set_volume(AudioState& audio_state, f32 volume)
     {
         SetMasterVolume(volume);
     }
+
+    void audio_play_deferred(AudioState& audio_state, std::vector<DeferredSound>& sounds)
+    {
+        for (auto& sound : sounds)
+        {
+            if (sound.randomize_pitch)
+            {
+                audio_play_sound_randomize_pitch(audio_state, sound.type);
+            } else
+            {
+                audio_play_sound(audio_state, sound.type);
+            }
+        }
+        sounds.clear();
+    }
+
+    void audio_update(AudioState& audio_state, f32 delta_seconds)
+    {
+        if (!IsSoundPlaying(audio_state.sounds.at(static_cast<size_t>(AudioType::MusicBackground))))
+        {
+            audio_state.time_till_background_music -= delta_seconds;
+            if (audio_state.time_till_background_music < 0.f)
+            {
+                audio_play_sound(audio_state, AudioType::MusicBackground);
+                audio_state.time_till_background_music = static_cast<f32>(GetRandomValue(10, 20));
+            }
+        }
+    }
 }
@@ -1,7 +1,33 @@
 ﻿#pragma once
 
+// 1 expects raylib to be built with RL_MALLOC, RL_CALLOC, RL_REALLOC and RL_FREE set to the woc_rl_* functions below,
+// and routes raygui through them too, so everything raylib allocates is charged to the caller's memory tag. Off,
+// raylib keeps its own heap and only the sizes of what it hands back are accounted, see memory.h.
+#ifndef WOC_RAYLIB_MEMORY_HOOKS
+#define WOC_RAYLIB_MEMORY_HOOKS 0
+#endif
+
+#if WOC_RAYLIB_MEMORY_HOOKS
+#include <cstddef>
+extern "C"
+{
+    void* woc_rl_malloc(size_t size);
+    void* woc_rl_calloc(size_t count, size_t size);
+    void* woc_rl_realloc(void* memory, size_t size);
+    void woc_rl_free(void* memory);
+}
+#define RL_MALLOC(sz) woc_rl_malloc(sz)
+#define RL_CALLOC(n, sz) woc_rl_calloc(n, sz)
+#define RL_REALLOC(ptr, sz) woc_rl_realloc(ptr, sz)
+#define RL_FREE(ptr) woc_rl_free(ptr)
+#define RAYGUI_MALLOC(sz) woc_rl_malloc(sz)
+#define RAYGUI_CALLOC(n, sz) woc_rl_calloc(n, sz)
+#define RAYGUI_FREE(ptr) woc_rl_free(ptr)
+#endif
+
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 #include "gui_styles/style_bluish.h"
@@ -14,9 +40,26 @@
 #include <array>
 #include <cassert>
 #include <variant>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <deque>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <span>
 
 #include "windsofchange.h"
 
+// 1 runs the math in game_update and its collision tests in Q16.16 fixed point (fixed.h), so ticks are bit-identical
+// across compilers, float settings and CPUs. Game state keeps its f32 fields either way.
+#ifndef WOC_FIXED_POINT_PHYSICS
+#define WOC_FIXED_POINT_PHYSICS 0
+#endif
+
 #define woc_internal static
 #define woc_global static
 #define woc_local static
@@ -35,10 +78,25 @@ namespace woc
     using f64 = double;
     
     constexpr f32 WIND_DURATION = 0.75f;
+    // A gust is a local patch of wind blown upwards from just above the paddle, costing one wind.
+    constexpr f32 GUST_DURATION = 1.5f;
+    constexpr f32 GUST_RADIUS = 200.f;
+    constexpr f32 GUST_FORCE = 2.5f;
+    constexpr f32 GUST_OFFSET_Y = 150.f;
+    constexpr f32 GUST_CD = 0.5f;
     constexpr u32 START_LEVEL = 0;
     constexpr u32 END_LEVEL = 7;
+    // Levels past END_LEVEL are generated from their number, see levelgen.h.
+    constexpr u32 ENDLESS_START_LEVEL = END_LEVEL + 1;
     constexpr Vector2 WORLD_MIN = Vector2{ -700, -500 };
     constexpr Vector2 WORLD_MAX = Vector2{ 700, 500 };
+    // Levels can make the world bigger than WORLD_MIN..WORLD_MAX, the camera then scrolls after the action.
+    // Follows at this rate per second. Games start with a CAMERA_ASPECT view, see Camera::aspect.
+    constexpr f32 CAMERA_FOLLOW_RATE = 4.f;
+    constexpr f32 CAMERA_ASPECT = 16.f / 9.f;
+    // Fixed point physics works in Q16.16, which holds +-32768. Collisions subtract positions from each other, so
+    // fixed point builds keep worlds and walls within half of that.
+    constexpr f32 FIXED_POINT_MAX_COORDINATE = 16384.f;
     constexpr f32 PLAYER_WORLD_Y = 400.f;
     constexpr i32 PLAYER_DEFAULT_WIDTH = 100;
     constexpr i32 PLAYER_DEFAULT_HEIGHT = 25;
@@ -47,6 +105,8 @@ namespace woc
     constexpr f32 BALL_DEFAULT_RADIUS = 10.f;
     constexpr f32 BALL_DEFAULT_Y_OFFSET = 25.f;
     constexpr f32 MIN_TIME_BETWEEN_COLLISIONS = 0.10f;
+    // While the window is hidden the game ticks at this interval instead of every frame.
+    constexpr f64 HIDDEN_GAME_TICK_SECONDS = 0.1;
     
     constexpr Vector2 WALL_SIZE_S = Vector2{ 100, 25 };
     constexpr Vector2 WALL_SIZE_DEFAULT = Vector2{ 200, 25 };
@@ -63,9 +123,12 @@ namespace woc
     constexpr Color BACKGROUND_COLOR = Color { 0xE3, 0xCB, 0xAF, 0xFF };
     constexpr Color BALL_COLOR = Color { 0x52, 0x82, 0x7D, 0xFF };
     constexpr Color PLAYER_COLOR = Color { 0x75, 0x9B, 0x97, 0xFF };
+    constexpr Color SECOND_PLAYER_COLOR = Color { 0xB5, 0x8B, 0x5A, 0xFF };
+    constexpr Color SECOND_BALL_COLOR = Color { 0x8E, 0x5F, 0x3A, 0xFF };
     constexpr Color INDESTRUCTIBLE_WALL_COLOR = Color { 0x9E, 0x76, 0x76, 0xFF };
     constexpr Color WALL_COLOR = Color { 0x4F, 0x4D, 0x70, 0xFF };
     constexpr Color WIND_COLOR = BALL_COLOR;
+    constexpr Color WIND_FIELD_COLOR = Color { 0x52, 0x82, 0x7D, 0x60 };
     
     struct Radian {
         f32 val;
@@ -76,6 +139,67 @@ namespace woc
 
     f32 ease_in_back(f32 alpha);
     f32 ease_in_cubic(f32 alpha);
+
+    // Small deterministic generator (splitmix64), for code that must not touch raylib's global GetRandomValue state.
+    struct Random
+    {
+        u64 state;
+    };
+    u64 random_next(Random& random);
+    f32 random_f32(Random& random, f32 min, f32 max);
+    u32 random_u32(Random& random, u32 min, u32 max_inclusive);
+    u64 random_hash(u64 a, u64 b);
+
+    // Who an allocation is charged to, see memory.h.
+    enum class MemoryTag : u8
+    {
+        Untagged,
+        Game,
+        Rewind,
+        Particles,
+        Levels,
+        Editor,
+        UI,
+        Audio,
+        Textures,
+        Fonts,
+        Capture,
+        Count
+    };
+    void* memory_alloc(size_t size, MemoryTag tag);
+    void memory_free(void* memory);
+
+    // Charges a container's storage to TAG whichever thread or tag scope happens to grow it.
+    template<typename T, MemoryTag TAG>
+    struct TaggedAllocator
+    {
+        using value_type = T;
+        template<typename U>
+        struct rebind
+        {
+            using other = TaggedAllocator<U, TAG>;
+        };
+
+        TaggedAllocator() = default;
+        template<typename U>
+        TaggedAllocator(const TaggedAllocator<U, TAG>&) {}
+
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(memory_alloc(count * sizeof(T), TAG));
+        }
+        void deallocate(T* memory, size_t count)
+        {
+            memory_free(memory);
+        }
+        template<typename U>
+        bool operator==(const TaggedAllocator<U, TAG>&) const
+        {
+            return true;
+        }
+    };
+    template<typename T, MemoryTag TAG>
+    using TaggedVector = std::vector<T, TaggedAllocator<T, TAG>>;
     
     enum class AudioType : u32
     {
@@ -95,22 +219,53 @@ namespace woc
         UIPageChange,
         MAX_AUDIO_TYPE
     };
+    constexpr std::array<const char*, static_cast<size_t>(AudioType::MAX_AUDIO_TYPE)> AUDIO_PATHS = {
+        "assets/audio/cozy.ogg",
+        "assets/audio/impactTin_medium_004.ogg",
+        "assets/audio/impactGlass_medium_004.ogg",
+        "assets/audio/phaserUp3.ogg",
+        "assets/audio/phaseJump3.ogg",
+        "assets/audio/phaserDown3.ogg",
+        "assets/audio/error_003.ogg",
+        "assets/audio/confirmation_003.ogg",
+        "assets/audio/pepSound5.ogg",
+        "assets/audio/chips-handle-3.ogg",
+        "assets/audio/die-throw-1.ogg",
+        "assets/audio/card-slide-6.ogg"
+    };
+    struct DeferredSound
+    {
+        AudioType type;
+        bool randomize_pitch;
+    };
     struct AudioState
     {
         f32 time_till_background_music;
         std::array<Sound, static_cast<size_t>(AudioType::MAX_AUDIO_TYPE)> sounds;
+        // Set on copies used off the main thread. Sounds are queued and played later by audio_play_deferred.
+        bool defer_playback;
+        std::vector<DeferredSound> deferred_sounds;
+        // Played for real, not deferred.
+        u64 sounds_played;
     };
-    AudioState audio_init();
+    struct AssetPreload;
+    // Waits for the preload's sounds, then hands them to the audio device.
+    AudioState audio_init(AssetPreload& preload);
     void audio_deinit(AudioState& audio_state);
     void audio_play_sound(AudioState& audio_state, AudioType sound_type);
     void audio_play_sound_randomize_pitch(AudioState& audio_state, AudioType sound_type);
     void audio_set_volume(AudioState& audio_state, f32 volume);
+    void audio_update(AudioState& audio_state, f32 delta_seconds);
+    void audio_play_deferred(AudioState& audio_state, std::vector<DeferredSound>& sounds);
     
     struct Camera {
         Vector2 pos;
         f32 height;
         Radian rot;
         f32 zoom;
+        // Width over height of the widest view shown. Streamed levels wake the chunks in it, so it's part of the
+        // game rather than the window, and the renderer puts bars beside anything wider.
+        f32 aspect;
     };
 
     struct WindAbility
@@ -130,6 +285,7 @@ namespace woc
         f32 ball_cd;
         u32 wind_available;
         std::optional<WindAbility> active_wind_ability;
+        f32 gust_cd;
     };
 
     enum class EnemyType
@@ -137,6 +293,28 @@ namespace woc
         Indestructible,
         Normal,
     };
+    enum class EnemyMotionType
+    {
+        None,
+        // Swings between origin - points[0] and origin + points[0] once per period.
+        Oscillate,
+        // Loops through origin + points[0..point_count), spending period / point_count on each leg.
+        Path,
+    };
+    constexpr u32 ENEMY_PATH_MAX_POINTS = 4;
+    // Walls with a motion are kinematic: game_update moves them and balls bouncing off pick up their velocity.
+    // spin turns the wall on top of either motion type, in radians per second.
+    struct EnemyMotion {
+        EnemyMotionType type;
+        Vector2 origin;
+        std::array<Vector2, ENEMY_PATH_MAX_POINTS> points;
+        u32 point_count;
+        f32 period;
+        f32 spin;
+        f32 time;
+        // Over the last tick, for bounces.
+        Vector2 vel;
+    };
     struct EnemyState {
         Vector2 pos;
         Vector2 size;
@@ -144,6 +322,9 @@ namespace woc
         Radian rot;
         EnemyType type;
         bool contributes_to_win;
+        EnemyMotion motion;
+        // Which wall of its level file this is, so a reloaded file can be matched up with the running game.
+        u32 level_index;
     };
     
     struct EnemyDeadEffect {
@@ -159,6 +340,7 @@ namespace woc
         i32 wind_dir_y;
         
         u32 send_ball;
+        u32 cast_gust;
         u32 new_game;
         u32 game_menu_swap;
         u32 restart_level;
@@ -169,6 +351,8 @@ namespace woc
         Vector2 pos;
         Vector2 dir;
         f32 time_since_last_collision;
+        // 0 for GameState::player, 1 for GameState::second_player. The owner's ball velocity and wind move it.
+        u32 owner;
     };
     struct ProjectileDeadEffect
     {
@@ -177,6 +361,83 @@ namespace woc
         f32 timer;
     };
 
+    // A level-defined rectangle of steady wind. force bends a ball's direction, in units per second.
+    struct WindZone
+    {
+        Vector2 pos;
+        Vector2 size;
+        Vector2 force;
+    };
+
+    struct WindGust
+    {
+        Vector2 pos;
+        Vector2 force;
+        f32 radius;
+        f32 timer;
+        f32 duration;
+    };
+
+    // Wind vectors on a grid of width by height nodes, cell_size apart from origin, covering the level's world,
+    // see windfield.h. base holds the level's zones and the live grid adds the active gusts on top. Both stay empty on levels
+    // without any wind, so copying a GameState stays cheap.
+    struct WindField
+    {
+        std::vector<f32> base_x;
+        std::vector<f32> base_y;
+        std::vector<f32> x;
+        std::vector<f32> y;
+        Vector2 origin;
+        f32 cell_size;
+        u32 width;
+        u32 height;
+        bool stamped;
+    };
+
+    // Inclusive range of broadphase cells a wall's bounds overlap.
+    struct BroadphaseCells
+    {
+        i16 min_x;
+        i16 min_y;
+        i16 max_x;
+        i16 max_y;
+    };
+    struct BroadphaseNode
+    {
+        u32 enemy;
+        u32 next;
+    };
+    // Wall indices bucketed into a coarse grid over the world, see broadphase.h. Each cell is a list threaded
+    // through one shared node pool, so moving a wall only touches the cells it left or entered and copying
+    // a GameState copies three flat vectors.
+    struct Broadphase
+    {
+        std::vector<u32> heads;
+        std::vector<BroadphaseNode> nodes;
+        std::vector<BroadphaseCells> cells;
+        u32 free_node;
+        // The grid covers the default world and every wall at build time, sized up for large levels.
+        Vector2 origin;
+        i32 width;
+        i32 height;
+    };
+
+    // Which chunks of a streamed level are simulated, see levelstream.h. Part of the game state so rewinding and
+    // copying keep it in step with the walls, the stream itself is shared and read-only to the game.
+    struct LevelStream;
+    struct LevelChunks
+    {
+        // Null for levels that aren't streamed.
+        std::shared_ptr<LevelStream> stream;
+        // Sorted chunk ids. Exactly their walls are in GameState::enemies.
+        std::vector<u32> awake;
+        // Walls of sleeping chunks that no longer match their chunk file, sorted by level_index. Broken ones are
+        // kept with no health.
+        std::vector<EnemyState> asleep_walls;
+        // Walls in sleeping chunks still standing between the player and a win.
+        u32 asleep_win_walls;
+    };
+
     enum class LevelStatus
     {
         InProgress,
@@ -185,19 +446,54 @@ namespace woc
     };
 
     struct GameState {
+        // Unique per game_init call, so code holding a copy can tell a restarted level from the one it has.
+        u64 id = 0;
         u32 current_level = 0; 
         f32 time_scale = 1.0f;
         LevelStatus level_status;
         PlayerState player;
+        // The other paddle of a two player game, see game_update_players.
+        std::optional<PlayerState> second_player;
         Camera cam;
+        // Where balls leave the world and the paddle stops, never smaller than WORLD_MIN..WORLD_MAX.
+        Vector2 world_min = WORLD_MIN;
+        Vector2 world_max = WORLD_MAX;
         std::vector<EnemyState> enemies;
         std::vector<Projectile> player_projectiles;
         
         std::vector<ProjectileDeadEffect> dead_projectile_effects;
         std::vector<EnemyDeadEffect> dead_enemy_effects;
+        // Running totals, so the renderer can tell which of the effects above it hasn't seen yet.
+        u32 dead_projectile_effects_spawned = 0;
+        u32 dead_enemy_effects_spawned = 0;
+
+        std::vector<WindZone> wind_zones;
+        std::vector<WindGust> wind_gusts;
+        WindField wind_field;
+        Broadphase broadphase;
+        LevelChunks chunks;
     };
     GameState game_init();
+    // A level with no walls or resources, for callers that lay out their own.
+    GameState game_init_empty(u32 level);
+    // Starts generating level in the background when game_init would generate it, see levelgen_prefetch.
+    void game_prefetch_level(u32 level);
     void game_update(GameState& game_state, InputState& input, AudioState& audio_state, f32 delta_seconds);
+    // One input per paddle, inputs[1] drives second_player. The paddles share the walls and the wind, each sends
+    // and steers its own balls, and the level is lost once neither has a ball left.
+    void game_update_players(GameState& game_state, std::span<InputState> inputs, AudioState& audio_state, f32 delta_seconds);
+    // Splits the paddles apart and gives the second one the same balls and wind as the first.
+    void game_add_second_player(GameState& game_state);
+    bool game_can_pause(GameState& game_state);
+    // Whether min..max is inside what this build's physics can represent, always true unless
+    // WOC_FIXED_POINT_PHYSICS is set. Level files and level tools refuse worlds that aren't.
+    bool physics_fits(Vector2 min, Vector2 max);
+    // World space bounds of everything the camera shows, grown by margin. Fixed point under WOC_FIXED_POINT_PHYSICS,
+    // since level streaming wakes chunks from them.
+    void camera_view_bounds(Camera& cam, f32 margin, Vector2& min, Vector2& max);
+    bool enemy_is_moving(EnemyState& enemy);
+    // Hashes the exact bits of everything game_update reads, for comparing runs across builds.
+    u64 game_hash(GameState& game_state);
 
     struct MenuState;
     
@@ -207,16 +503,25 @@ namespace woc
         Game,
         Settings,
         Quit,
-        Credits
+        Credits,
+        Editor
     };
     
     enum class ResolutionPreset
     {
+        Resolution_1280x720,
         Resolution_1600x900,
         Resolution_1920x1080,
+        Resolution_2560x1440,
+        Resolution_3840x2160,
+        // Whatever size the user dragged the window to, see MenuState::custom_resolution.
+        Custom,
         MAX
     };
     
+    constexpr f32 MIN_RENDER_SCALE = 0.25f;
+    constexpr f32 MAX_RENDER_SCALE = 1.0f;
+    
     constexpr u32 MAX_BUTTONS_PER_PAGE = 12;
     enum class MainMenuButtonType
     {
@@ -224,6 +529,7 @@ namespace woc
         Continue,
         Settings,
         Credits,
+        Editor,
         Quit
     };
     static_assert(static_cast<u32>(MainMenuButtonType::Quit) < MAX_BUTTONS_PER_PAGE);
@@ -233,8 +539,11 @@ namespace woc
         Resolution,
         Fullscreen,
         Back,
+        Volume,
+        RenderScale,
+        DynamicResolution,
     };
-    static_assert(static_cast<u32>(SettingsButtonType::Back) < MAX_BUTTONS_PER_PAGE);
+    static_assert(static_cast<u32>(SettingsButtonType::DynamicResolution) < MAX_BUTTONS_PER_PAGE);
     
     enum class CreditsButtonType
     {
@@ -249,21 +558,44 @@ namespace woc
         TryAgain,
         Menu,
         Credits,
+        Endless,
     };
-    static_assert(static_cast<u32>(GameButtonType::Menu) < MAX_BUTTONS_PER_PAGE);
+    static_assert(static_cast<u32>(GameButtonType::Endless) < MAX_BUTTONS_PER_PAGE);
     
     struct MenuState
     {
         MenuPageType current_page;
         ResolutionPreset resolution;
+        Vector2 custom_resolution;
         bool is_fullscreen;
         f32 volume;
+        // World pixels per framebuffer pixel. With dynamic resolution on this is the upper bound.
+        f32 render_scale;
+        bool dynamic_resolution;
         std::array<bool, MAX_BUTTONS_PER_PAGE> buttons_hover_state;
     };
     MenuState menu_init(MenuPageType page, bool is_fullscreen, ResolutionPreset resolution);
     void menu_change_page(MenuState& menu_state, MenuPageType page);
-    Vector2 menu_resolution_to_size(ResolutionPreset resolution);
+    bool menu_page_is_static(MenuPageType page);
+
+    // Keep drawing for a short while after the last change so raygui press/release states make it to screen.
+    constexpr f64 MENU_IDLE_GRACE_SECONDS = 0.5;
+    constexpr f64 MENU_IDLE_WAIT_SECONDS = 0.25;
+    struct MenuIdleState
+    {
+        f64 last_activity_seconds;
+        MenuPageType last_page;
+        ResolutionPreset last_resolution;
+        bool last_is_fullscreen;
+        f32 last_volume;
+        std::array<bool, MAX_BUTTONS_PER_PAGE> last_buttons_hover_state;
+    };
+    MenuIdleState menu_idle_init(MenuState& menu_state, f64 now_seconds);
+    // Returns true when the current page can skip drawing until the next input event.
+    bool menu_idle_update(MenuIdleState& idle_state, MenuState& menu_state, bool has_input_activity, f64 now_seconds);
+    Vector2 menu_resolution_to_size(MenuState& menu_state);
     const char* menu_resolution_title(ResolutionPreset resolution);
+    const char* menu_page_title(MenuPageType page);
 
     enum class TextureType
     {
@@ -280,16 +612,151 @@ namespace woc
         IconWind,
         MAX
     };
+    constexpr std::array<const char*, static_cast<size_t>(TextureType::MAX)> TEXTURE_PATHS = {
+        "assets/textures/a_key.png",
+        "assets/textures/d_key.png",
+        "assets/textures/esc_key.png",
+        "assets/textures/space_key.png",
+        "assets/textures/left_key.png",
+        "assets/textures/right_key.png",
+        "assets/textures/up_key.png",
+        "assets/textures/down_key.png",
+        "assets/textures/r_key.png",
+        "assets/textures/ball.png",
+        "assets/textures/wind.png"
+    };
+    enum class UiPage
+    {
+        MainMenu,
+        Settings,
+        Credits,
+        LevelComplete,
+        LevelFail,
+        GameWon,
+        MAX
+    };
+    
+    enum class UiElementType
+    {
+        Label,
+        Line,
+        Button,
+        Toggle,
+        ComboBox,
+        Slider,
+    };
+    // Labels and lines are drawn straight from the layout. Controls are handed back to the page by button id.
+    struct UiElement
+    {
+        UiElementType type;
+        u32 button;
+        Rectangle bounds;
+        i32 text_size;
+        i32 gui_state;
+        const char* text;
+        Vector2 text_pos;
+    };
+    
+    constexpr u32 MAX_UI_ELEMENTS_PER_PAGE = 16;
+    // Rectangles and measured text for one page, rebuilt only when the framebuffer size changes.
+    // Elements are sorted by text size so a page switches raygui's text size once per size, not per element.
+    struct UiLayout
+    {
+        bool valid;
+        Vector2 framebuffer_size;
+        u32 element_count;
+        std::array<UiElement, MAX_UI_ELEMENTS_PER_PAGE> elements;
+    };
+    
+    // Frames are budgeted against the frame limiter's interval, this is only for renderers without one.
+    constexpr f32 DYNAMIC_RESOLUTION_BUDGET_SECONDS = 1.f / 60.f;
+    constexpr f32 DYNAMIC_RESOLUTION_STEP = 0.05f;
+    constexpr f32 DYNAMIC_RESOLUTION_SETTLE_SECONDS = 0.25f;
+    // Frames have to sit within budget this long before the scale is probed upwards again.
+    constexpr f32 DYNAMIC_RESOLUTION_RAISE_SECONDS = 2.0f;
+    struct DynamicResolution
+    {
+        f32 average_work_seconds;
+        f32 settle_timer;
+        f32 within_budget_timer;
+    };
+    
+    // Fixed-capacity structure of arrays, see particles.h. Live particles are packed at the front.
+    struct ParticlePool
+    {
+        TaggedVector<f32, MemoryTag::Particles> pos_x;
+        TaggedVector<f32, MemoryTag::Particles> pos_y;
+        TaggedVector<f32, MemoryTag::Particles> vel_x;
+        TaggedVector<f32, MemoryTag::Particles> vel_y;
+        TaggedVector<f32, MemoryTag::Particles> angle;
+        TaggedVector<f32, MemoryTag::Particles> spin;
+        TaggedVector<f32, MemoryTag::Particles> life;
+        TaggedVector<f32, MemoryTag::Particles> inv_lifetime;
+        TaggedVector<f32, MemoryTag::Particles> size;
+        TaggedVector<f32, MemoryTag::Particles> stretch;
+        TaggedVector<f32, MemoryTag::Particles> drag;
+        TaggedVector<f32, MemoryTag::Particles> gravity;
+        TaggedVector<Color, MemoryTag::Particles> color;
+        u32 count;
+        Random random;
+    };
+    
+    // Image and sound files decoded on worker threads while the window and GL context come up. Only the upload
+    // needs the main thread, renderer_init and audio_init do that once the files they need are in.
+    struct AssetPreload
+    {
+        std::array<Image, static_cast<size_t>(TextureType::MAX)> images;
+        std::array<Wave, static_cast<size_t>(AudioType::MAX_AUDIO_TYPE)> waves;
+        std::atomic<u32> next_file;
+        std::vector<std::thread> workers;
+        std::chrono::steady_clock::time_point start;
+        // Per worker, when it ran out of files.
+        std::vector<f64> worker_seconds;
+        // From asset_preload_start until the last file was decoded.
+        f64 seconds;
+    };
+    // Starts decoding in place, so preload must stay put until asset_preload_wait.
+    void asset_preload_start(AssetPreload& preload);
+    void asset_preload_wait(AssetPreload& preload);
+
+    struct Capture;
+    struct FrameLimiter;
     struct Renderer {
         std::array<Texture2D, static_cast<size_t>(TextureType::MAX)> loaded_textures;
+        // Allocated at framebuffer size. Lower render scales draw into its bottom-left corner, so changing
+        // the scale never reallocates it.
+        RenderTexture2D world_target;
+        f32 world_render_scale;
+        DynamicResolution dynamic_resolution;
+        // 0 when unknown, e.g. after GuiSetFont resets it behind our back.
+        i32 ui_text_size;
+        std::array<UiLayout, static_cast<size_t>(UiPage::MAX)> ui_layouts;
+        ParticlePool particles;
+        // The game and its effect totals the particles were last emitted for.
+        u64 effects_game_id;
+        u32 effects_projectiles_seen;
+        u32 effects_enemies_seen;
+        u64 frames_presented;
+        // Set by main when frame capture is on, finalizing a frame hands it over before the swap.
+        Capture* capture;
+        // Set by main, holds each present back to its deadline.
+        FrameLimiter* frame_limiter;
+        // Walls inside the view this frame, reused so culling doesn't allocate.
+        std::vector<u32> visible_walls;
     };
-    Renderer renderer_init();
+    // Waits for the preload's images, then uploads them.
+    Renderer renderer_init(AssetPreload& preload);
     void renderer_deinit(Renderer& renderer);
     void renderer_finalize_rendering(Renderer& renderer);
     void renderer_prepare_rendering(Renderer& renderer);
+    void renderer_update_render_scale(Renderer& renderer, MenuState& menu_state, f32 frame_seconds);
+    // Emits particles for the snapshot's new deaths and moves the live ones along.
+    void renderer_update_effects(Renderer& renderer, GameState& game_state, f32 frame_seconds);
     void renderer_update_and_render_menu(Renderer& renderer, MenuState& menu_state, std::optional<GameState>& game_state, AudioState& audio_state, Vector2 framebuffer_size);
     void renderer_update_and_render_settings(Renderer& renderer, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size);
     void renderer_render_world(Renderer& renderer, GameState& game_state, AudioState& audio_state, Vector2 framebuffer_size);
+    // In world space, inside BeginMode2D.
+    void renderer_draw_enemy(EnemyState& enemy);
     void renderer_render_level_fail(Renderer& renderer, GameState& game_state, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size);
     void renderer_render_level_complete(Renderer& renderer, GameState& game_state, MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size);
     void renderer_render_game_won(Renderer& renderer, std::optional<GameState>& game_state,  MenuState& menu_state, AudioState& audio_state, Vector2 framebuffer_size);